@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -6,6 +7,11 @@
 #include "src/solver.h"
 #include "src/tests.h"
 #include "src/simu.h"
+#include "src/bench.h"
+#include "src/trace.h"
+#ifdef FEM2A_MPI
+#include <mpi.h>
+#endif
 
 /* Global variables */
 std::vector< std::string > arguments;
@@ -23,8 +29,62 @@ bool flag_is_used(
     return false;
 }
 
+/* To get the value following a flag, e.g. "--tol 1e-8" */
+std::string flag_value(
+    const std::string& flag,
+    const std::vector< std::string >& arguments )
+{
+    for( int i = 0; i + 1 < arguments.size(); ++i ) {
+        if( flag == arguments[i] ) {
+            return arguments[i + 1];
+        }
+    }
+    return "";
+}
+
 using namespace FEM2A;
 
+/* Builds the solver options from the command line arguments */
+SolverOptions parse_solver_options()
+{
+    SolverOptions options;
+    options.verbose = flag_is_used( "-v", arguments )
+        || flag_is_used( "--verbose", arguments );
+    options.symmetric = flag_is_used( "--symmetric", arguments );
+    options.multicolor = flag_is_used( "--multicolor", arguments );
+
+    std::string value = flag_value( "--solver", arguments );
+    if( !value.empty() && !solver_type_from_string( value, options.solver ) ) {
+        std::cout << "Unknown solver " << value << ", using default" << std::endl;
+    }
+    value = flag_value( "--precond", arguments );
+    if( !value.empty()
+        && !preconditioner_type_from_string( value, options.preconditioner ) ) {
+        std::cout << "Unknown preconditioner " << value << ", using none" << std::endl;
+    }
+    value = flag_value( "--tol", arguments );
+    if( !value.empty() ) options.threshold = std::atof( value.c_str() );
+    value = flag_value( "--max-iter", arguments );
+    if( !value.empty() ) options.max_iterations = std::atoi( value.c_str() );
+    value = flag_value( "--inner-tol", arguments );
+    if( !value.empty() ) options.inner_threshold = std::atof( value.c_str() );
+    value = flag_value( "--recycle-dim", arguments );
+    if( !value.empty() ) options.recycle_dim = std::atoi( value.c_str() );
+    value = flag_value( "--omega", arguments );
+    if( !value.empty() ) options.omega = std::atof( value.c_str() );
+    value = flag_value( "--mic-relaxation", arguments );
+    if( !value.empty() ) options.mic_relaxation = std::atof( value.c_str() );
+    value = flag_value( "--amg-strength", arguments );
+    if( !value.empty() ) options.amg_strength = std::atof( value.c_str() );
+    value = flag_value( "--amg-smoother", arguments );
+    if( !value.empty() ) options.amg_chebyshev = ( value != "jacobi" );
+    value = flag_value( "--amg-steps", arguments );
+    if( !value.empty() ) options.amg_smoothing_steps = std::atoi( value.c_str() );
+    value = flag_value( "--threads", arguments );
+    if( !value.empty() ) options.nb_threads = std::atoi( value.c_str() );
+    return options;
+}
+
 void run_tests()
 {
     const bool t_opennl = false;
@@ -35,6 +95,29 @@ void run_tests()
     const bool t_ShapeFunction = true;
     const bool t_Ke = true;
     const bool t_src_term = true;
+    const bool t_native_pcg = true;
+    const bool t_amg = true;
+    const bool t_gmg = true;
+    const bool t_cholesky = true;
+    const bool t_block_solve = true;
+    const bool t_warm_start = true;
+    const bool t_mixed_precision = true;
+    const bool t_recycling = true;
+    const bool t_schwarz = true;
+    const bool t_level_schedule = true;
+    const bool t_heat = true;
+    const bool t_affine = true;
+    const bool t_reduced = true;
+    const bool t_adaptive = true;
+    const bool t_p2 = true;
+    const bool t_geometry = true;
+    const bool t_postprocess = true;
+    const bool t_vtu = true;
+    const bool t_async_writer = true;
+    const bool t_snapshot = true;
+    const bool t_bench = true;
+    const bool t_kernels = true;
+    const bool t_trace = true;
 
     if( t_opennl ) test_opennl();
     if( t_lmesh ) Tests::test_load_mesh();
@@ -45,6 +128,78 @@ void run_tests()
     if( t_ShapeFunction ) Tests::test_ShapeFunc();
     if( t_Ke ) Tests::test_Ke();
     if( t_src_term ) Tests::test_src_term();
+    if( t_native_pcg ) Tests::test_native_pcg("data/geothermie_4.mesh");
+    if( t_amg ) Tests::test_amg("data/geothermie_4.mesh");
+    if( t_amg ) Tests::test_amg("data/geothermie_0_5.mesh");
+    if( t_gmg ) Tests::bench_gmg("data/square.mesh", 3);
+    if( t_cholesky ) Tests::test_cholesky("data/mug_0_2.mesh");
+    if( t_cholesky ) Tests::test_cholesky("data/geothermie_0_5.mesh");
+    if( t_block_solve ) Tests::test_block_solve("data/geothermie_0_5.mesh", 16);
+    if( t_warm_start ) Tests::test_warm_start("data/mug_1.mesh", "data/mug_0_2.mesh");
+    if( t_mixed_precision ) Tests::test_mixed_precision("data/geothermie_0_5.mesh");
+    if( t_recycling ) Tests::test_recycling("data/geothermie_0_5.mesh", 10);
+    if( t_schwarz ) Tests::test_schwarz("data/geothermie_0_5.mesh");
+    if( t_level_schedule ) Tests::test_level_schedule("data/geothermie_0_5.mesh");
+    if( t_heat ) Tests::test_heat_transient("data/square.mesh");
+    if( t_affine ) Tests::test_affine_stiffness("data/geothermie_0_5.mesh", 10);
+    if( t_reduced ) Tests::test_reduced_basis("data/geothermie_0_5.mesh");
+    if( t_adaptive ) Tests::test_adaptive_refinement("data/square.mesh", 0.05);
+    if( t_p2 ) Tests::test_p2_elements("data/square.mesh", 3);
+    if( t_geometry ) Tests::test_geometry_cache("data/geothermie_0_5.mesh");
+    if( t_postprocess ) Tests::test_postprocessing("data/geothermie_0_1.mesh");
+    if( t_vtu ) Tests::test_vtu_output("data/geothermie_0_1.mesh", 0);
+    if( t_async_writer ) Tests::test_async_writer("data/geothermie_0_5.mesh");
+    if( t_snapshot ) Tests::test_system_snapshot("data/geothermie_0_5.mesh");
+    if( t_bench ) Tests::test_bench("data/square.mesh");
+    if( t_kernels ) Tests::bench_kernels("data/geothermie_0_5.mesh", 9);
+    if( t_trace ) Tests::test_trace("data/geothermie_0_5.mesh");
+}
+
+#ifdef FEM2A_MPI
+void run_mpi()
+{
+    if( flag_is_used( "--mpi-test", arguments ) ) {
+        Tests::test_distributed_solve("data/geothermie_0_5.mesh");
+    }
+    if( flag_is_used( "--mpi-bench", arguments ) ) {
+        Tests::bench_weak_scaling("data/square.mesh", 4);
+    }
+}
+#endif
+
+/* Runs the benchmarks, returns the number of regressions */
+int run_bench()
+{
+    BenchOptions options;
+    options.solver = parse_solver_options();
+    options.solver.verbose = false;
+    std::string value = flag_value( "--bench-reps", arguments );
+    if( !value.empty() ) options.repetitions = std::atoi( value.c_str() );
+    value = flag_value( "--bench-warmup", arguments );
+    if( !value.empty() ) options.warmup = std::atoi( value.c_str() );
+    value = flag_value( "--bench-mesh", arguments );
+    if( !value.empty() ) options.meshes.push_back( value );
+    options.quiet = !flag_is_used( "-v", arguments );
+
+    std::vector< BenchResult > results;
+    run_benchmarks( options, results );
+    print_bench_results( results );
+
+    value = flag_value( "--bench-json", arguments );
+    const std::string json_filename = value.empty() ? "bench.json" : value;
+    if( save_bench_json( options, results, json_filename ) ) {
+        std::cout << "results written in " << json_filename << std::endl;
+    }
+
+    int nb_regressions = 0;
+    const std::string baseline_filename = flag_value( "--bench-baseline", arguments );
+    std::vector< BenchResult > baseline;
+    if( !baseline_filename.empty() && load_bench_json( baseline_filename, baseline ) ) {
+        value = flag_value( "--bench-tolerance", arguments );
+        const double tolerance = value.empty() ? 0.1 : std::atof( value.c_str() );
+        nb_regressions = compare_bench_results( results, baseline, tolerance );
+    }
+    return nb_regressions;
 }
 
 void run_simu()
@@ -52,18 +207,45 @@ void run_simu()
 
     const bool simu_pure_dirichlet = true;
     const bool simu_dirichlet_source_term = true;
+    const bool simu_heat_transient = flag_is_used( "--transient", arguments );
+    const bool simu_adaptive = flag_is_used( "--adaptive", arguments );
+    const bool simu_p2 = flag_is_used( "--p2", arguments );
+    const bool use_system_cache = flag_is_used( "--system-cache", arguments );
+    const bool export_system = flag_is_used( "--export-mtx", arguments );
 
     const bool verbose = flag_is_used( "-v", arguments )
         || flag_is_used( "--verbose", arguments );
+    const SolverOptions solver_options = parse_solver_options();
 
     if( simu_pure_dirichlet ) {
-        Simu::pure_dirichlet_pb("data/square.mesh", verbose);
+        Simu::pure_dirichlet_pb("data/square.mesh", verbose, solver_options);
     }
     if( simu_dirichlet_source_term ) {
-    	Simu::dirichlet_with_src_pb("data/square.mesh", verbose);
+    	Simu::dirichlet_with_src_pb("data/square.mesh", verbose, solver_options,
+    	    use_system_cache, export_system);
     }
     if( simu_dirichlet_source_term ) {
-    	Simu::dirichlet_with_src_pb("data/square_fine.mesh", verbose);
+    	Simu::dirichlet_with_src_pb("data/square_fine.mesh", verbose, solver_options,
+    	    use_system_cache, export_system);
+    }
+    if( simu_p2 ) {
+        Simu::dirichlet_with_src_p2_pb("data/square_fine.mesh", verbose, solver_options);
+    }
+    if( simu_heat_transient ) {
+        std::string value = flag_value( "--dt", arguments );
+        const double dt = value.empty() ? 0.5 : std::atof( value.c_str() );
+        value = flag_value( "--steps", arguments );
+        const int nb_steps = value.empty() ? 1000 : std::atoi( value.c_str() );
+        value = flag_value( "--snapshot-period", arguments );
+        const int snapshot_period = value.empty() ? 100 : std::atoi( value.c_str() );
+        const double theta = flag_is_used( "--crank-nicolson", arguments ) ? 0.5 : 1.;
+        Simu::heat_transient_pb("data/geothermie_0_5.mesh", verbose, solver_options,
+            dt, nb_steps, theta, snapshot_period);
+    }
+    if( simu_adaptive ) {
+        const std::string value = flag_value( "--adapt-tol", arguments );
+        const double tolerance = value.empty() ? 0.05 : std::atof( value.c_str() );
+        Simu::adaptive_pb("data/geothermie_4.mesh", verbose, solver_options, tolerance);
     }
 }
 
@@ -73,6 +255,9 @@ int main( int argc, const char * argv[] )
     for( int i = 1; i < argc; ++i ) {
         arguments.push_back( std::string(argv[i]) );
     }
+#ifdef FEM2A_MPI
+    MPI_Init( NULL, NULL );
+#endif
 
     /* Show usage if asked or no arguments */
     if( arguments.size() == 0 || flag_is_used("-h", arguments)
@@ -83,9 +268,61 @@ int main( int argc, const char * argv[] )
         std::cout << " -t, --run-tests:   run the tests" << std::endl;
         std::cout << " -s, --run-simu:    run the simulations" << std::endl;
         std::cout << " -v, --verbose:     print lots of details" << std::endl;
+        std::cout << " --bench:           time each phase of the problems on all the meshes of data/" << std::endl;
+        std::cout << " --trace [file]:    write a Chrome trace (fem2a_trace.json) and a summary at exit" << std::endl;
+        std::cout << "Solver options (with -s): " << std::endl;
+        std::cout << " --solver <name>:   default, cg, bicgstab, gmres, native-cg, cholesky, mixed-cg or recycling-cg" << std::endl;
+        std::cout << " --precond <name>:  none, jacobi, ssor, ic0, mic0 or amg" << std::endl;
+        std::cout << " --tol <value>:     relative residual threshold (1e-12)" << std::endl;
+        std::cout << " --max-iter <n>:    maximum number of iterations" << std::endl;
+        std::cout << " --inner-tol <value>: inner threshold of mixed-cg (1e-3)" << std::endl;
+        std::cout << " --recycle-dim <n>: deflation subspace size of recycling-cg (8)" << std::endl;
+        std::cout << " --omega <value>:   SSOR relaxation parameter (1.5)" << std::endl;
+        std::cout << " --mic-relaxation <value>: MIC(0) relaxation parameter (0.95)" << std::endl;
+        std::cout << " --amg-strength <value>: AMG strength of connection threshold (0.08)" << std::endl;
+        std::cout << " --amg-smoother <name>: AMG smoother, chebyshev or jacobi" << std::endl;
+        std::cout << " --amg-steps <n>:   AMG pre/post smoothing steps (2)" << std::endl;
+        std::cout << " --symmetric:       declare the system symmetric" << std::endl;
+        std::cout << " --multicolor:      multicolour ordering of ssor, ic0 and mic0" << std::endl;
+        std::cout << " --threads <n>:     number of OpenMP threads" << std::endl;
+        std::cout << " --p2:              also solve the source term problem with P2 elements" << std::endl;
+        std::cout << " --system-cache:    reuse the assembled source term systems (system_<hash>.snap)" << std::endl;
+        std::cout << " --export-mtx:      write K and F of the source term problem in Matrix Market format" << std::endl;
+        std::cout << "Transient heat simulation (with -s): " << std::endl;
+        std::cout << " --transient:       run it after the steady simulations" << std::endl;
+        std::cout << " --dt <value>:      time step (0.5)" << std::endl;
+        std::cout << " --steps <n>:       number of time steps (1000)" << std::endl;
+        std::cout << " --crank-nicolson:  Crank-Nicolson instead of backward Euler" << std::endl;
+        std::cout << " --snapshot-period <n>: steps between two snapshots, 0 for none (100)" << std::endl;
+        std::cout << "Adaptive refinement (with -s): " << std::endl;
+        std::cout << " --adaptive:        solve-estimate-mark-refine on geothermie_4" << std::endl;
+        std::cout << " --adapt-tol <value>: target relative error estimate (0.05)" << std::endl;
+        std::cout << "Benchmark options (with --bench, and the solver options): " << std::endl;
+        std::cout << " --bench-reps <n>:  timed repetitions (3)" << std::endl;
+        std::cout << " --bench-warmup <n>: untimed runs before them (1)" << std::endl;
+        std::cout << " --bench-mesh <file>: a single mesh instead of all of data/" << std::endl;
+        std::cout << " --bench-json <file>: results file (bench.json)" << std::endl;
+        std::cout << " --bench-baseline <file>: results of a previous run to compare with" << std::endl;
+        std::cout << " --bench-tolerance <value>: relative slowdown reported as a regression (0.1)" << std::endl;
+#ifdef FEM2A_MPI
+        std::cout << "MPI options (mpirun -np <n> ./fem2a_mpi ...): " << std::endl;
+        std::cout << " --mpi-test:        distributed solve compared with the sequential one" << std::endl;
+        std::cout << " --mpi-bench:       weak scaling on refined square meshes" << std::endl;
+        MPI_Finalize();
+#endif
         return 0;
     }
 
+    /* Trace the timed scopes if asked, written at exit (after the
+     * background writers are stopped) */
+    if( flag_is_used("--trace", arguments) ) {
+        std::string trace_filename = flag_value( "--trace", arguments );
+        if( trace_filename.empty() || trace_filename[0] == '-' ) {
+            trace_filename = "fem2a_trace.json";
+        }
+        trace_until_exit( trace_filename );
+    }
+
     /* Run the tests if asked */
     if( flag_is_used("-t", arguments)
         || flag_is_used("--run-tests", arguments) ) {
@@ -98,5 +335,15 @@ int main( int argc, const char * argv[] )
         run_simu();
     }
 
-    return 0;
+    /* Run the benchmarks if asked, a regression gives a non zero status */
+    int status = 0;
+    if( flag_is_used("--bench", arguments) ) {
+        status = run_bench() > 0 ? 1 : 0;
+    }
+
+#ifdef FEM2A_MPI
+    run_mpi();
+    MPI_Finalize();
+#endif
+    return status;
 }
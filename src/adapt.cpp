@@ -0,0 +1,181 @@
+#include "adapt.h"
+#include "fem.h"
+#include "postprocess.h"
+
+#include <assert.h>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+
+namespace FEM2A {
+
+    static SolverOptions adaptive_solver_options( const SolverOptions& options )
+    {
+        SolverOptions adaptive_options = options ;
+        if( adaptive_options.solver == SOLVER_DEFAULT ) {
+            adaptive_options.solver = SOLVER_CHOLESKY ;
+        }
+        return adaptive_options ;
+    }
+
+    double zz_error_estimate( const Mesh& mesh, const std::vector< double >& u,
+        std::vector< double >& eta, double* gradient_norm )
+    {
+        return zz_error_estimate( mesh, GeometryCache( mesh ), u, eta, gradient_norm ) ;
+    }
+
+    double zz_error_estimate( const Mesh& mesh, const GeometryCache& geometry,
+        const std::vector< double >& u, std::vector< double >& eta, double* gradient_norm )
+    {
+        const int nt = mesh.nb_triangles() ;
+        std::vector< vec2 > gradients, recovered ;
+        triangle_gradients( mesh, geometry, u, gradients ) ;
+        recover_nodal_gradients( mesh, geometry, gradients, recovered ) ;
+        std::vector< double > areas( nt ) ;
+        double norm = 0. ;
+        for( int t = 0; t < nt; ++t ) {
+            areas[t] = geometry.area( t ) ;
+            norm += areas[t] * dot( gradients[t], gradients[t] ) ;
+        }
+
+        /* with d_i = G(v_i) - grad u, the P1 mass matrix gives
+         * int_T |sum phi_i d_i|^2 = |T|/12 (sum |d_i|^2 + |sum d_i|^2) */
+        eta.resize( nt ) ;
+        double total = 0. ;
+        for( int t = 0; t < nt; ++t ) {
+            vec2 sum ;
+            sum.x = 0. ;
+            sum.y = 0. ;
+            double squares = 0. ;
+            for( int i = 0; i < 3; ++i ) {
+                const vec2& G = recovered[mesh.get_triangle_vertex_index( t, i )] ;
+                vec2 d ;
+                d.x = G.x - gradients[t].x ;
+                d.y = G.y - gradients[t].y ;
+                squares += dot( d, d ) ;
+                sum.x += d.x ;
+                sum.y += d.y ;
+            }
+            const double eta2 = areas[t] / 12. * ( squares + dot( sum, sum ) ) ;
+            eta[t] = std::sqrt( eta2 ) ;
+            total += eta2 ;
+        }
+        if( gradient_norm != NULL ) *gradient_norm = std::sqrt( norm ) ;
+        return std::sqrt( total ) ;
+    }
+
+    void mark_bulk( const std::vector< double >& eta, double fraction,
+        std::vector< bool >& marked )
+    {
+        const int nt = eta.size() ;
+        marked.assign( nt, false ) ;
+        std::vector< std::pair< double, int > > sorted( nt ) ;
+        double total = 0. ;
+        for( int t = 0; t < nt; ++t ) {
+            sorted[t] = std::make_pair( -eta[t] * eta[t], t ) ;
+            total += eta[t] * eta[t] ;
+        }
+        std::sort( sorted.begin(), sorted.end() ) ;
+        double sum = 0. ;
+        for( int k = 0; k < nt; ++k ) {
+            if( sum >= fraction * total && k > 0 ) break ;
+            marked[sorted[k].second] = true ;
+            sum -= sorted[k].first ;
+        }
+    }
+
+    /****************************************************************/
+    /* Implementation of adaptive_solve */
+    /****************************************************************/
+
+    AdaptiveOptions::AdaptiveOptions()
+        : tolerance( 0.05 ), bulk_fraction( 0.5 ), max_iterations( 20 ),
+        max_vertices( 200000 ), verbose( false )
+    {
+
+    }
+
+    AdaptiveReport::AdaptiveReport()
+        : converged( false ), elapsed_time( 0. )
+    {
+
+    }
+
+    void AdaptiveReport::print() const
+    {
+        std::cout << ( converged ? "converged" : "NOT converged" )
+            << " in " << nb_vertices.size() << " iterations" ;
+        if( !nb_vertices.empty() ) {
+            std::cout << ", " << nb_vertices.back() << " vertices, eta/||grad u|| = "
+                << estimate.back() ;
+        }
+        std::cout << ", time = " << elapsed_time << " s" << std::endl ;
+    }
+
+    bool adaptive_solve( Mesh& mesh,
+        double (*coefficient)(vertex),
+        double (*source)(vertex),
+        double (*dirichlet_fct)(vertex),
+        const std::vector< bool >& attribute_is_dirichlet,
+        const AdaptiveOptions& options,
+        std::vector< double >& u,
+        AdaptiveReport* report )
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        const SolverOptions solver_options = adaptive_solver_options( options.solver ) ;
+        AdaptiveReport local_report ;
+        mesh.label_longest_edges() ;
+        bool converged = false ;
+        for( int iteration = 0; iteration < options.max_iterations; ++iteration ) {
+            /* solve */
+            const int n = mesh.nb_vertices() ;
+            SparseMatrix K( n ) ;
+            std::vector< double > F ;
+            assemble_p1_poisson( mesh, coefficient, source, K, F ) ;
+            std::vector< double > values( n ) ;
+            for( int v = 0; v < n; ++v ) values[v] = dirichlet_fct( mesh.get_vertex( v ) ) ;
+            apply_dirichlet_boundary_conditions( mesh, attribute_is_dirichlet, values, K, F ) ;
+            u.assign( n, 0. ) ;
+            if( !solve( K, F, u, solver_options ) ) {
+                std::cout << "adaptive_solve: the linear solver failed" << std::endl ;
+                break ;
+            }
+
+            /* estimate */
+            std::vector< double > eta ;
+            double gradient_norm = 0. ;
+            const double estimate = zz_error_estimate( mesh, GeometryCache( mesh ), u, eta,
+                &gradient_norm ) ;
+            const double relative = gradient_norm > 0. ? estimate / gradient_norm : estimate ;
+            local_report.nb_vertices.push_back( n ) ;
+            local_report.estimate.push_back( relative ) ;
+            if( options.verbose ) {
+                std::cout << "adaptive iteration " << iteration << ": " << n << " vertices, "
+                    << mesh.nb_triangles() << " triangles, eta/||grad u|| = "
+                    << relative << std::endl ;
+            }
+            if( relative < options.tolerance ) {
+                converged = true ;
+                break ;
+            }
+            if( iteration + 1 == options.max_iterations ) break ;
+
+            /* mark and refine */
+            std::vector< bool > marked ;
+            mark_bulk( eta, options.bulk_fraction, marked ) ;
+            Mesh fine ;
+            std::vector< int > parents ;
+            mesh.refine_marked( marked, fine, parents ) ;
+            if( fine.nb_vertices() > options.max_vertices ) break ;
+            mesh = fine ;
+        }
+        local_report.converged = converged ;
+        local_report.elapsed_time = std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+        if( report != NULL ) *report = local_report ;
+        return converged ;
+    }
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "mesh.h"
+#include "solver.h"
+#include "geometry.h"
+
+#include <vector>
+
+namespace FEM2A {
+
+    /**
+     * \brief Zienkiewicz-Zhu error estimator of a P1 solution: the
+     *        gradient is recovered at the vertices by averaging the
+     *        constant gradients of the neighbouring triangles (weighted
+     *        by their area), and the error of each triangle is the
+     *        distance between the recovered (P1) and the computed (P0)
+     *        gradients:
+     *          eta_T^2 = int_T |G(u) - grad u|^2
+     *
+     * \param[in] mesh The mesh
+     * \param[in] u The value at each vertex
+     * \param[out] eta The indicator eta_T of each triangle
+     * \param[out] gradient_norm If not NULL, ||grad u||_L2
+     * \return the global estimate (sum eta_T^2)^1/2 of ||grad(u_exact - u)||_L2
+     */
+    double zz_error_estimate( const Mesh& mesh, const std::vector< double >& u,
+        std::vector< double >& eta, double* gradient_norm = NULL ) ;
+
+    /**
+     * \brief Same as above with the geometric factors of the mesh
+     *        already computed.
+     */
+    double zz_error_estimate( const Mesh& mesh, const GeometryCache& geometry,
+        const std::vector< double >& u, std::vector< double >& eta,
+        double* gradient_norm = NULL ) ;
+
+    /**
+     * \brief Bulk (Doerfler) marking: marks the triangles with the
+     *        largest indicators until sum_marked eta_T^2 reaches
+     *        fraction * sum eta_T^2.
+     */
+    void mark_bulk( const std::vector< double >& eta, double fraction,
+        std::vector< bool >& marked ) ;
+
+    /**
+     * \brief Parameters of adaptive_solve().
+     */
+    struct AdaptiveOptions {
+        AdaptiveOptions() ;
+
+        double tolerance ;      /* stop when eta/||grad u|| < tolerance */
+        double bulk_fraction ;  /* of mark_bulk(), 1 refines all the triangles */
+        int max_iterations ;    /* solve-estimate-mark-refine loops */
+        int max_vertices ;      /* stop before refining a larger mesh */
+        SolverOptions solver ;  /* SOLVER_DEFAULT selects SOLVER_CHOLESKY */
+        bool verbose ;
+    } ;
+
+    /**
+     * \brief Statistics of adaptive_solve(), one entry per iteration.
+     */
+    struct AdaptiveReport {
+        AdaptiveReport() ;
+
+        bool converged ;
+        std::vector< int > nb_vertices ;
+        std::vector< double > estimate ;    /* eta/||grad u|| */
+        double elapsed_time ;               /* in seconds */
+
+        void print() const ;
+    } ;
+
+    /**
+     * \brief Solves
+     *          -div(k grad u) = f,  u = g on the Dirichlet edges
+     *        with P1 elements by the loop solve - estimate (ZZ) - mark
+     *        (bulk) - refine (newest vertex bisection) until the relative
+     *        estimate is below the tolerance.
+     *
+     * \param[in,out] mesh The initial mesh, with the attributes of its
+     *                     edges set. It is replaced by the last refined
+     *                     mesh (its vertices are relabeled by
+     *                     label_longest_edges() first)
+     * \param[out] u The solution on the last mesh
+     * \param[out] report If not NULL, the statistics of the loop
+     * \return true if the tolerance is reached
+     */
+    bool adaptive_solve( Mesh& mesh,
+        double (*coefficient)(vertex),
+        double (*source)(vertex),
+        double (*dirichlet_fct)(vertex),
+        const std::vector< bool >& attribute_is_dirichlet,
+        const AdaptiveOptions& options,
+        std::vector< double >& u,
+        AdaptiveReport* report = NULL ) ;
+
+}
@@ -0,0 +1,162 @@
+#include "affine.h"
+#include "geometry.h"
+#include "fem.h"
+
+#include <assert.h>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+
+namespace FEM2A {
+
+    /**
+     * \return the position of the column j in the row i of A
+     */
+    static int find_entry( const CSRMatrix& A, int i, int j )
+    {
+        const std::vector< int >::const_iterator begin = A.col_.begin() + A.row_ptr_[i] ;
+        const std::vector< int >::const_iterator end = A.col_.begin() + A.row_ptr_[i + 1] ;
+        const std::vector< int >::const_iterator it = std::lower_bound( begin, end, j ) ;
+        assert( it != end && *it == j ) ;
+        return it - A.col_.begin() ;
+    }
+
+    /****************************************************************/
+    /* Implementation of AffineStiffness */
+    /****************************************************************/
+
+    AffineStiffness::AffineStiffness( const Mesh& mesh )
+        : setup_time_( 0. )
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        const int n = mesh.nb_vertices() ;
+
+        /* regions: the attributes having triangles */
+        std::vector< int > region_of_attribute( mesh.get_attr_max() + 1, -1 ) ;
+        for( int t = 0; t < mesh.nb_triangles(); ++t ) {
+            const int a = mesh.get_triangle_attribute( t ) ;
+            if( region_of_attribute[a] < 0 ) {
+                region_of_attribute[a] = 0 ;
+                regions_.push_back( a ) ;
+            }
+        }
+        std::sort( regions_.begin(), regions_.end() ) ;
+        for( int r = 0; r < regions_.size(); ++r ) {
+            region_of_attribute[regions_[r]] = r ;
+        }
+        const int nb_regions = regions_.size() ;
+
+        /* common pattern: the vertices of each triangle are coupled */
+        std::vector< std::vector< int > > rows( n ) ;
+        for( int t = 0; t < mesh.nb_triangles(); ++t ) {
+            for( int i = 0; i < 3; ++i ) {
+                for( int j = 0; j < 3; ++j ) {
+                    rows[mesh.get_triangle_vertex_index( t, i )].push_back(
+                        mesh.get_triangle_vertex_index( t, j ) ) ;
+                }
+            }
+        }
+        pattern_.row_ptr_.assign( n + 1, 0 ) ;
+        for( int i = 0; i < n; ++i ) {
+            std::sort( rows[i].begin(), rows[i].end() ) ;
+            rows[i].erase( std::unique( rows[i].begin(), rows[i].end() ), rows[i].end() ) ;
+            pattern_.col_.insert( pattern_.col_.end(), rows[i].begin(), rows[i].end() ) ;
+            pattern_.row_ptr_[i + 1] = pattern_.col_.size() ;
+            std::vector< int >().swap( rows[i] ) ;
+        }
+        pattern_.val_.assign( pattern_.col_.size(), 0. ) ;
+        pattern_.update_diagonal() ;
+
+        /* the element loop, once, with a unit coefficient (the P1
+         * stiffness is exact from the cached geometric factors) */
+        const int nnz = pattern_.nnz() ;
+        values_.assign( nnz * nb_regions, 0. ) ;
+        constant_.assign( nnz, 0. ) ;
+        const GeometryCache geometry( mesh ) ;
+        for( int t = 0; t < mesh.nb_triangles(); ++t ) {
+            const int r = region_of_attribute[mesh.get_triangle_attribute( t )] ;
+            double Ke[9] ;
+            geometry.p1_stiffness( t, 1., Ke ) ;
+            for( int i = 0; i < 3; ++i ) {
+                const int vi = mesh.get_triangle_vertex_index( t, i ) ;
+                for( int j = 0; j < 3; ++j ) {
+                    const int k = find_entry( pattern_, vi, mesh.get_triangle_vertex_index( t, j ) ) ;
+                    values_[k * nb_regions + r] += Ke[3 * i + j] ;
+                }
+            }
+        }
+        setup_time_ = std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+    }
+
+    void AffineStiffness::add_dirichlet_penalty( const Mesh& mesh,
+        const std::vector< bool >& attribute_is_dirichlet )
+    {
+        std::vector< int > vertices ;
+        dirichlet_vertices( mesh, attribute_is_dirichlet, vertices ) ;
+        for( int k = 0; k < vertices.size(); ++k ) {
+            constant_[pattern_.diag_[vertices[k]]] += dirichlet_penalty ;
+        }
+    }
+
+    void AffineStiffness::combine( const std::vector< double >& coefficients,
+        CSRMatrix& K ) const
+    {
+        const int nnz = pattern_.nnz() ;
+        /* the comparison costs less than the combination, it catches a K
+         * of the same size but of another pattern */
+        if( K.row_ptr_ != pattern_.row_ptr_ || K.col_ != pattern_.col_ ) {
+            K = pattern_ ;
+        }
+        const int nb_regions = regions_.size() ;
+        std::vector< double > k( nb_regions ) ;
+        for( int r = 0; r < nb_regions; ++r ) {
+            assert( regions_[r] < coefficients.size() ) ;
+            k[r] = coefficients[regions_[r]] ;
+        }
+        const double* values = values_.empty() ? NULL : &values_[0] ;
+        double* result = nnz > 0 ? &K.val_[0] : NULL ;
+#pragma omp parallel for schedule( static )
+        for( int p = 0; p < nnz; ++p ) {
+            double sum = constant_[p] ;
+            const double* v = values + p * nb_regions ;
+            for( int r = 0; r < nb_regions; ++r ) sum += k[r] * v[r] ;
+            result[p] = sum ;
+        }
+    }
+
+    int AffineStiffness::nb_regions() const
+    {
+        return regions_.size() ;
+    }
+
+    void AffineStiffness::term( int q, CSRMatrix& K_q ) const
+    {
+        assert( q >= 0 && q <= nb_regions() ) ;
+        K_q = pattern_ ;
+        const int nb_regions = regions_.size() ;
+        for( int p = 0; p < pattern_.nnz(); ++p ) {
+            K_q.val_[p] = q < nb_regions ? values_[p * nb_regions + q] : constant_[p] ;
+        }
+    }
+
+    int AffineStiffness::region_attribute( int r ) const
+    {
+        return regions_[r] ;
+    }
+
+    const CSRMatrix& AffineStiffness::pattern() const
+    {
+        return pattern_ ;
+    }
+
+    void AffineStiffness::print() const
+    {
+        std::cout << "Affine stiffness: " << pattern_.nb_rows() << " rows, "
+            << pattern_.nnz() << " non-zeros, " << nb_regions() << " regions (attributes" ;
+        for( int r = 0; r < nb_regions(); ++r ) std::cout << " " << regions_[r] ;
+        std::cout << "), assembled in " << setup_time_ << " s" << std::endl ;
+    }
+
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "mesh.h"
+#include "solver.h"
+
+#include <vector>
+
+namespace FEM2A {
+
+    /**
+     * \brief AffineStiffness is the affine decomposition of the stiffness
+     *        matrix in the piecewise constant conductivity:
+     *          K(k) = sum_a k_a K_a + P
+     *        where K_a is assembled with a unit coefficient on the
+     *        triangles of attribute a (a region, e.g. a rock layer) and
+     *        P is the constant Dirichlet penalty.
+     *
+     * The element loop runs once, in the constructor. All the K_a share
+     * the pattern of K, and their values are stored interleaved, so
+     * combine() builds K for a new set of conductivities in a single
+     * pass over the non-zeros, without any element computation.
+     */
+    class AffineStiffness {
+        public:
+            /**
+             * \brief Assembles the K_a with the P1 stiffness of GeometryCache.
+             */
+            AffineStiffness( const Mesh& mesh ) ;
+
+            /**
+             * \brief Adds to P the penalty of
+             *        apply_dirichlet_boundary_conditions() on the
+             *        vertices of the Dirichlet edges (the penalty terms
+             *        of F are left to the caller).
+             */
+            void add_dirichlet_penalty( const Mesh& mesh,
+                const std::vector< bool >& attribute_is_dirichlet ) ;
+
+            /**
+             * \brief Computes K = sum_a k_a K_a + P.
+             * \param[in] coefficients The conductivity of each triangle
+             *                         attribute (size get_attr_max() + 1)
+             * \param[in,out] K The result. Its pattern is only copied if
+             *                  K does not already have it, so a K
+             *                  reused over a sweep only gets new values
+             */
+            void combine( const std::vector< double >& coefficients, CSRMatrix& K ) const ;
+
+            /**
+             * \return the number of regions, i.e. the triangle attributes
+             *         with at least one triangle
+             */
+            int nb_regions() const ;
+
+            /**
+             * \brief Extracts one term of the decomposition.
+             * \param q a region, or nb_regions() for the penalty P
+             * \param[out] K_q the matrix of the term, on the common pattern
+             */
+            void term( int q, CSRMatrix& K_q ) const ;
+
+            /**
+             * \return the triangle attribute of region r
+             */
+            int region_attribute( int r ) const ;
+
+            /**
+             * \return the common pattern of the K_a, with zero values
+             */
+            const CSRMatrix& pattern() const ;
+
+            void print() const ;
+
+        private:
+            CSRMatrix pattern_ ;
+            std::vector< int > regions_ ;       /* attribute of each region */
+            /* values_[k * nb_regions() + r] is the non-zero k of K_r */
+            std::vector< double > values_ ;
+            std::vector< double > constant_ ;   /* values of P */
+            double setup_time_ ;
+    } ;
+
+}
@@ -0,0 +1,64 @@
+#include "allocations.h"
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+#ifdef FEM2A_COUNT_ALLOCATIONS
+static std::atomic< long > allocation_count( 0 ) ;
+
+void* operator new( std::size_t size )
+{
+    allocation_count.fetch_add( 1, std::memory_order_relaxed ) ;
+    void* p = malloc( size > 0 ? size : 1 ) ;
+    if( p == NULL ) throw std::bad_alloc() ;
+    return p ;
+}
+
+void* operator new[]( std::size_t size )
+{
+    return operator new( size ) ;
+}
+
+void operator delete( void* p ) noexcept
+{
+    free( p ) ;
+}
+
+void operator delete[]( void* p ) noexcept
+{
+    free( p ) ;
+}
+
+void operator delete( void* p, std::size_t ) noexcept
+{
+    free( p ) ;
+}
+
+void operator delete[]( void* p, std::size_t ) noexcept
+{
+    free( p ) ;
+}
+#endif
+
+namespace FEM2A {
+
+    bool allocations_counted()
+    {
+#ifdef FEM2A_COUNT_ALLOCATIONS
+        return true ;
+#else
+        return false ;
+#endif
+    }
+
+    long nb_allocations()
+    {
+#ifdef FEM2A_COUNT_ALLOCATIONS
+        return allocation_count.load() ;
+#else
+        return 0 ;
+#endif
+    }
+
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+namespace FEM2A {
+
+    /**
+     * \brief Counts the heap allocations (operator new and new[]) of the
+     *        program, for the microbenchmarks of the kernels. The global
+     *        operators are replaced only in a build made with
+     *        make COUNT_ALLOCATIONS=1 (FEM2A_COUNT_ALLOCATIONS), so the
+     *        other builds pay nothing per allocation.
+     */
+    bool allocations_counted() ;
+
+    /**
+     * \return the number of allocations since the start of the program,
+     *         0 if they are not counted
+     */
+    long nb_allocations() ;
+
+}
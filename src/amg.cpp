@@ -0,0 +1,356 @@
+#include "amg.h"
+#include "dense.h"
+
+#include <assert.h>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+namespace FEM2A {
+
+    /* Size under which a level is solved directly */
+    const int amg_coarsest_size = 100 ;
+    const int amg_max_levels = 20 ;
+
+    /**
+     * \return an estimate of the spectral radius of D^-1 A computed with
+     *         a few power iterations
+     */
+    static double estimate_spectral_radius(
+        const CSRMatrix& A, const std::vector< double >& inv_diag )
+    {
+        const int n = A.nb_rows() ;
+        std::vector< double > x( n ), y( n ) ;
+        for( int i = 0; i < n; ++i ) {
+            x[i] = 1. + ( i % 7 ) * 0.1 ;
+        }
+        double rho = 0. ;
+        for( int it = 0; it < 15; ++it ) {
+            const double norm = std::sqrt( dot( x, x ) ) ;
+            if( norm == 0. ) break ;
+            for( int i = 0; i < n; ++i ) x[i] /= norm ;
+            A.mult( x, y ) ;
+            for( int i = 0; i < n; ++i ) y[i] *= inv_diag[i] ;
+            rho = std::sqrt( dot( y, y ) ) ;
+            x.swap( y ) ;
+        }
+        return rho ;
+    }
+
+    /**
+     * \brief Groups the unknowns in aggregates of strongly connected
+     *        neighbours (standard three pass algorithm).
+     * \return the number of aggregates; aggregate[i] is -1 if i is not
+     *         aggregated
+     */
+    static int aggregate( const CSRMatrix& A, double strength,
+        std::vector< int >& aggregate )
+    {
+        const int n = A.nb_rows() ;
+
+        /* strength of connection graph, without the diagonal */
+        std::vector< int > S_ptr( n + 1, 0 ) ;
+        std::vector< int > S_col ;
+        for( int i = 0; i < n; ++i ) {
+            const double a_ii = std::fabs( A.val_[A.diag_[i]] ) ;
+            for( int k = A.row_ptr_[i]; k < A.row_ptr_[i + 1]; ++k ) {
+                const int j = A.col_[k] ;
+                if( j == i ) continue ;
+                const double a_jj = std::fabs( A.val_[A.diag_[j]] ) ;
+                if( std::fabs( A.val_[k] ) >= strength * std::sqrt( a_ii * a_jj ) ) {
+                    S_col.push_back( j ) ;
+                }
+            }
+            S_ptr[i + 1] = S_col.size() ;
+        }
+
+        aggregate.assign( n, -1 ) ;
+        int nb_aggregates = 0 ;
+
+        /* pass 1: whole neighbourhoods that are still free */
+        for( int i = 0; i < n; ++i ) {
+            if( aggregate[i] >= 0 || S_ptr[i] == S_ptr[i + 1] ) continue ;
+            bool free = true ;
+            for( int k = S_ptr[i]; k < S_ptr[i + 1] && free; ++k ) {
+                free = aggregate[S_col[k]] < 0 ;
+            }
+            if( !free ) continue ;
+            aggregate[i] = nb_aggregates ;
+            for( int k = S_ptr[i]; k < S_ptr[i + 1]; ++k ) {
+                aggregate[S_col[k]] = nb_aggregates ;
+            }
+            nb_aggregates++ ;
+        }
+
+        /* pass 2: join a neighbouring aggregate */
+        std::vector< int > pass1( aggregate ) ;
+        for( int i = 0; i < n; ++i ) {
+            if( aggregate[i] >= 0 ) continue ;
+            for( int k = S_ptr[i]; k < S_ptr[i + 1]; ++k ) {
+                if( pass1[S_col[k]] >= 0 ) {
+                    aggregate[i] = pass1[S_col[k]] ;
+                    break ;
+                }
+            }
+        }
+
+        /* pass 3: new aggregates with the remaining free neighbours */
+        for( int i = 0; i < n; ++i ) {
+            if( aggregate[i] >= 0 || S_ptr[i] == S_ptr[i + 1] ) continue ;
+            aggregate[i] = nb_aggregates ;
+            for( int k = S_ptr[i]; k < S_ptr[i + 1]; ++k ) {
+                if( aggregate[S_col[k]] < 0 ) {
+                    aggregate[S_col[k]] = nb_aggregates ;
+                }
+            }
+            nb_aggregates++ ;
+        }
+        return nb_aggregates ;
+    }
+
+    /****************************************************************/
+    /* Implementation of MultigridPreconditioner */
+    /****************************************************************/
+
+    MultigridPreconditioner::MultigridPreconditioner(
+        bool chebyshev, int smoothing_steps )
+        : name_( "multigrid" ), chebyshev_( chebyshev ),
+        smoothing_steps_( smoothing_steps )
+    {
+
+    }
+
+    void MultigridPreconditioner::add_level( const CSRMatrix& A )
+    {
+        levels_.push_back( Level() ) ;
+        Level& level = levels_.back() ;
+        level.A = A ;
+        const int n = A.nb_rows() ;
+        level.inv_diag.resize( n ) ;
+        for( int i = 0; i < n; ++i ) {
+            assert( A.diag_[i] >= 0 ) ;
+            level.inv_diag[i] = 1. / A.val_[A.diag_[i]] ;
+        }
+        level.rho = estimate_spectral_radius( A, level.inv_diag ) ;
+        level.b.resize( n ) ;
+        level.x.resize( n ) ;
+        level.r.resize( n ) ;
+        level.d.resize( n ) ;
+        level.q.resize( n ) ;
+    }
+
+    void MultigridPreconditioner::set_prolongation( int l, const CSRMatrix& P )
+    {
+        levels_[l].P = P ;
+        levels_[l].R = transpose( P ) ;
+    }
+
+    /****************************************************************/
+    /* Implementation of AMGPreconditioner */
+    /****************************************************************/
+
+    AMGPreconditioner::AMGPreconditioner( const CSRMatrix& A,
+        double strength, bool chebyshev, int smoothing_steps )
+        : MultigridPreconditioner( chebyshev, smoothing_steps )
+    {
+        name_ = "AMG" ;
+        add_level( A ) ;
+        while( true ) {
+            const int l = levels_.size() - 1 ;
+            const CSRMatrix& Af = levels_[l].A ;
+            const int n = Af.nb_rows() ;
+            if( n <= amg_coarsest_size || levels_.size() == amg_max_levels ) break ;
+
+            std::vector< int > agg ;
+            const int nc = aggregate( Af, strength, agg ) ;
+            if( nc == 0 || nc >= n ) break ;
+
+            /* tentative prolongation, normalized columns */
+            std::vector< int > agg_size( nc, 0 ) ;
+            for( int i = 0; i < n; ++i ) {
+                if( agg[i] >= 0 ) agg_size[agg[i]]++ ;
+            }
+            CSRMatrix P_tent ;
+            P_tent.row_ptr_.assign( n + 1, 0 ) ;
+            for( int i = 0; i < n; ++i ) {
+                if( agg[i] >= 0 ) {
+                    P_tent.col_.push_back( agg[i] ) ;
+                    P_tent.val_.push_back( 1. / std::sqrt( double( agg_size[agg[i]] ) ) ) ;
+                }
+                P_tent.row_ptr_[i + 1] = P_tent.col_.size() ;
+            }
+
+            /* smoothed prolongation P = (I - w D^-1 A) P_tent */
+            const double omega = 4. / ( 3. * levels_[l].rho ) ;
+            CSRMatrix S( Af ) ;
+            for( int i = 0; i < n; ++i ) {
+                for( int k = S.row_ptr_[i]; k < S.row_ptr_[i + 1]; ++k ) {
+                    S.val_[k] *= -omega * levels_[l].inv_diag[i] ;
+                }
+                S.val_[S.diag_[i]] += 1. ;
+            }
+            set_prolongation( l, multiply( S, P_tent, nc ) ) ;
+
+            const CSRMatrix Ac = multiply( levels_[l].R,
+                multiply( Af, levels_[l].P, nc ), nc ) ;
+            add_level( Ac ) ;
+        }
+
+        factorize_coarsest() ;
+    }
+
+    void MultigridPreconditioner::factorize_coarsest()
+    {
+        const CSRMatrix& A = levels_.back().A ;
+        const int n = A.nb_rows() ;
+        coarse_L_.assign( n * n, 0. ) ;
+        for( int i = 0; i < n; ++i ) {
+            for( int k = A.row_ptr_[i]; k < A.row_ptr_[i + 1]; ++k ) {
+                coarse_L_[n * i + A.col_[k]] = A.val_[k] ;
+            }
+        }
+        const bool positive_definite = dense_cholesky( coarse_L_, n ) ;
+        assert( positive_definite ) ;
+    }
+
+    void MultigridPreconditioner::solve_coarsest(
+        const std::vector< double >& b, std::vector< double >& x ) const
+    {
+        x = b ;
+        dense_cholesky_solve( coarse_L_, b.size(), x ) ;
+    }
+
+    void MultigridPreconditioner::smooth( const Level& level ) const
+    {
+        const int n = level.A.nb_rows() ;
+        std::vector< double >& x = level.x ;
+        std::vector< double >& r = level.r ;
+        std::vector< double >& d = level.d ;
+
+        /* r = D^-1 (b - Ax) */
+        level.A.mult( x, r ) ;
+        for( int i = 0; i < n; ++i ) {
+            r[i] = level.inv_diag[i] * ( level.b[i] - r[i] ) ;
+        }
+
+        if( !chebyshev_ ) {
+            const double omega = 4. / ( 3. * level.rho ) ;
+            for( int step = 0; step < smoothing_steps_; ++step ) {
+                if( step > 0 ) {
+                    level.A.mult( x, r ) ;
+                    for( int i = 0; i < n; ++i ) {
+                        r[i] = level.inv_diag[i] * ( level.b[i] - r[i] ) ;
+                    }
+                }
+                for( int i = 0; i < n; ++i ) {
+                    x[i] += omega * r[i] ;
+                }
+            }
+            return ;
+        }
+
+        /* Chebyshev polynomial of D^-1 A damping [0.3 rho, 1.1 rho] */
+        std::vector< double >& q = level.q ;
+        const double upper = 1.1 * level.rho ;
+        const double lower = 0.3 * level.rho ;
+        const double theta = 0.5 * ( upper + lower ) ;
+        const double delta = 0.5 * ( upper - lower ) ;
+        const double sigma = theta / delta ;
+        double rho_old = 1. / sigma ;
+        for( int i = 0; i < n; ++i ) {
+            d[i] = r[i] / theta ;
+        }
+        for( int step = 0; step < smoothing_steps_; ++step ) {
+            for( int i = 0; i < n; ++i ) {
+                x[i] += d[i] ;
+            }
+            if( step + 1 == smoothing_steps_ ) break ;
+            level.A.mult( d, q ) ;
+            const double rho_new = 1. / ( 2. * sigma - rho_old ) ;
+            for( int i = 0; i < n; ++i ) {
+                r[i] -= level.inv_diag[i] * q[i] ;
+                d[i] = rho_new * rho_old * d[i] + 2. * rho_new / delta * r[i] ;
+            }
+            rho_old = rho_new ;
+        }
+    }
+
+    void MultigridPreconditioner::cycle( int l ) const
+    {
+        const Level& level = levels_[l] ;
+        if( l + 1 == levels_.size() ) {
+            solve_coarsest( level.b, level.x ) ;
+            return ;
+        }
+
+        /* pre-smoothing from x = 0 */
+        std::fill( level.x.begin(), level.x.end(), 0. ) ;
+        smooth( level ) ;
+
+        /* coarse grid correction */
+        const Level& coarse = levels_[l + 1] ;
+        level.A.mult( level.x, level.r ) ;
+        for( int i = 0; i < level.r.size(); ++i ) {
+            level.r[i] = level.b[i] - level.r[i] ;
+        }
+        level.R.mult( level.r, coarse.b ) ;
+        cycle( l + 1 ) ;
+        level.P.mult( coarse.x, level.r ) ;
+        for( int i = 0; i < level.x.size(); ++i ) {
+            level.x[i] += level.r[i] ;
+        }
+
+        /* post-smoothing */
+        smooth( level ) ;
+    }
+
+    void MultigridPreconditioner::apply(
+        const std::vector< double >& r, std::vector< double >& z ) const
+    {
+        levels_[0].b = r ;
+        cycle( 0 ) ;
+        z = levels_[0].x ;
+    }
+
+    double MultigridPreconditioner::flops() const
+    {
+        double flops = 0. ;
+        for( int l = 0; l + 1 < levels_.size(); ++l ) {
+            const Level& level = levels_[l] ;
+            /* 2 smoothings (1 SpMV per step), residual, restriction,
+             * prolongation */
+            flops += 2. * ( 2. * level.A.nnz() * smoothing_steps_
+                + 6. * level.A.nb_rows() * smoothing_steps_ ) ;
+            flops += 2. * level.A.nnz() + 2. * level.P.nnz() + 2. * level.R.nnz() ;
+        }
+        const double nc = levels_.back().A.nb_rows() ;
+        return flops + 2. * nc * nc ;
+    }
+
+    int MultigridPreconditioner::nb_levels() const
+    {
+        return levels_.size() ;
+    }
+
+    double MultigridPreconditioner::operator_complexity() const
+    {
+        double nnz = 0. ;
+        for( int l = 0; l < levels_.size(); ++l ) {
+            nnz += levels_[l].A.nnz() ;
+        }
+        return nnz / levels_[0].A.nnz() ;
+    }
+
+    void MultigridPreconditioner::print() const
+    {
+        std::cout << name_ << " hierarchy with " << nb_levels() << " levels ("
+            << ( chebyshev_ ? "Chebyshev" : "Jacobi" ) << " smoother)"
+            << std::endl ;
+        for( int l = 0; l < levels_.size(); ++l ) {
+            std::cout << "  level " << l << " : " << levels_[l].A.nb_rows()
+                << " unknowns, " << levels_[l].A.nnz() << " non-zeros" << std::endl ;
+        }
+        std::cout << "  operator complexity " << operator_complexity() << std::endl ;
+    }
+
+}
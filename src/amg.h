@@ -0,0 +1,129 @@
+#pragma once
+
+#include "solver.h"
+
+#include <string>
+#include <vector>
+
+namespace FEM2A {
+
+    /**
+     * \brief MultigridPreconditioner holds a hierarchy of matrices
+     *        (level 0 is the finest) with the prolongations between
+     *        them. One application of the preconditioner is one
+     *        V-cycle, so it can be used inside the conjugate gradient.
+     *        The derived classes build the hierarchy.
+     *
+     * The smoother is damped Jacobi or a Chebyshev polynomial of
+     * D^-1 A; the same number of steps is done before and after the
+     * coarse grid correction so the V-cycle is symmetric. The coarsest
+     * level is solved with a dense Cholesky factorization.
+     */
+    class MultigridPreconditioner : public Preconditioner {
+        public:
+            /**
+             * \param chebyshev smoother: Chebyshev polynomial if true,
+             *                  damped Jacobi otherwise
+             * \param smoothing_steps number of pre and post smoothing
+             *                        steps (degree of the polynomial for
+             *                        Chebyshev)
+             */
+            MultigridPreconditioner( bool chebyshev, int smoothing_steps ) ;
+
+            void apply( const std::vector< double >& r,
+                std::vector< double >& z ) const ;
+            double flops() const ;
+
+            int nb_levels() const ;
+
+            /**
+             * \return the sum of the nnz of all levels divided by the
+             *         nnz of the fine matrix
+             */
+            double operator_complexity() const ;
+
+            /**
+             * \brief Prints the size of each level of the hierarchy.
+             */
+            void print() const ;
+
+        protected:
+            struct Level {
+                CSRMatrix A ;
+                CSRMatrix P ;       /* prolongation from the next level */
+                CSRMatrix R ;       /* restriction P^T */
+                std::vector< double > inv_diag ;
+                double rho ;        /* spectral radius of D^-1 A */
+                /* work vectors */
+                mutable std::vector< double > b ;
+                mutable std::vector< double > x ;
+                mutable std::vector< double > r ;
+                mutable std::vector< double > d ;
+                mutable std::vector< double > q ;
+            } ;
+
+            /**
+             * \brief Appends a coarser level with matrix A and computes
+             *        its smoother data.
+             */
+            void add_level( const CSRMatrix& A ) ;
+
+            /**
+             * \brief Sets the prolongation from level l+1 to level l.
+             */
+            void set_prolongation( int l, const CSRMatrix& P ) ;
+
+            /**
+             * \brief Factorizes the coarsest level, to be called once
+             *        all the levels are added.
+             */
+            void factorize_coarsest() ;
+
+            /**
+             * \brief One V-cycle from level l: levels_[l].x is set to
+             *        an approximation of A_l^-1 levels_[l].b
+             */
+            void cycle( int l ) const ;
+
+            std::vector< Level > levels_ ;
+            std::string name_ ;
+
+        private:
+            void smooth( const Level& level ) const ;
+            void solve_coarsest( const std::vector< double >& b,
+                std::vector< double >& x ) const ;
+
+            std::vector< double > coarse_L_ ;   /* dense Cholesky factor */
+            bool chebyshev_ ;
+            int smoothing_steps_ ;
+    } ;
+
+    /**
+     * \brief AMGPreconditioner is a smoothed aggregation algebraic
+     *        multigrid preconditioner built from the assembled matrix
+     *        only.
+     *
+     * The hierarchy is built as follows on each level:
+     *   - strength of connection: j is strongly connected to i if
+     *     |a_ij| >= strength * sqrt(|a_ii a_jj|),
+     *   - aggregation of the strongly connected neighbourhoods,
+     *   - tentative prolongation (constant on each aggregate) smoothed
+     *     by one damped Jacobi step: P = (I - w D^-1 A) P_tent,
+     *   - Galerkin coarse operator: A_c = P^T A P.
+     * Unknowns without strong connections (e.g. rows penalized by the
+     * Dirichlet conditions) are not aggregated and left to the smoother.
+     */
+    class AMGPreconditioner : public MultigridPreconditioner {
+        public:
+            /**
+             * \brief Builds the multigrid hierarchy.
+             * \param A a symmetric positive definite matrix
+             * \param strength threshold of the strength of connection
+             * \param chebyshev see MultigridPreconditioner
+             * \param smoothing_steps see MultigridPreconditioner
+             */
+            AMGPreconditioner( const CSRMatrix& A, double strength,
+                bool chebyshev, int smoothing_steps ) ;
+    } ;
+
+}
@@ -0,0 +1,377 @@
+#include "bench.h"
+#include "mesh.h"
+#include "fem.h"
+#include "simu.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+namespace FEM2A {
+
+    static const char* problem_names[2] = { "pure_dirichlet", "dirichlet_with_source_term" } ;
+
+    /* the results are saved there, then removed */
+    static const std::string bench_output = "bench_tmp" ;
+
+    static double seconds_since( std::chrono::steady_clock::time_point start )
+    {
+        return std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count() ;
+    }
+
+    static double median_of( std::vector< double > values )
+    {
+        std::sort( values.begin(), values.end() ) ;
+        const int n = values.size() ;
+        return n % 2 == 1 ? values[n / 2] : 0.5 * ( values[n / 2 - 1] + values[n / 2] ) ;
+    }
+
+    static const char* solver_name( SolverType solver )
+    {
+        switch( solver ) {
+            case SOLVER_CG: return "cg" ;
+            case SOLVER_BICGSTAB: return "bicgstab" ;
+            case SOLVER_GMRES: return "gmres" ;
+            case SOLVER_NATIVE_CG: return "native-cg" ;
+            case SOLVER_CHOLESKY: return "cholesky" ;
+            case SOLVER_MIXED_CG: return "mixed-cg" ;
+            case SOLVER_RECYCLING_CG: return "recycling-cg" ;
+            default: return "default" ;
+        }
+    }
+
+    static const char* preconditioner_name( PreconditionerType preconditioner )
+    {
+        switch( preconditioner ) {
+            case PRECOND_JACOBI: return "jacobi" ;
+            case PRECOND_SSOR: return "ssor" ;
+            case PRECOND_IC0: return "ic0" ;
+            case PRECOND_MIC0: return "mic0" ;
+            case PRECOND_AMG: return "amg" ;
+            default: return "none" ;
+        }
+    }
+
+    /* the peak of the resident memory is reset to the current one */
+    static void reset_peak_rss()
+    {
+        std::ofstream clear_refs( "/proc/self/clear_refs" ) ;
+        if( clear_refs ) clear_refs << "5" ;
+    }
+
+    static long peak_rss_kb()
+    {
+        std::ifstream status( "/proc/self/status" ) ;
+        std::string line ;
+        while( std::getline( status, line ) ) {
+            if( line.compare( 0, 6, "VmHWM:" ) == 0 ) return std::atol( line.c_str() + 6 ) ;
+        }
+        struct rusage usage ;
+        getrusage( RUSAGE_SELF, &usage ) ;
+        return usage.ru_maxrss ;
+    }
+
+    /**
+     * \brief One run of a problem of Simu, phase by phase, with the
+     *        steps of Simu::pure_dirichlet_pb() and
+     *        Simu::dirichlet_with_src_pb().
+     */
+    static void run_problem( const std::string& mesh_filename, bool with_source,
+        const SolverOptions& options, double times[BENCH_NB_PHASES], BenchResult& result )
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now() ;
+        Mesh mesh ;
+        mesh.load( mesh_filename ) ;
+        times[BENCH_LOAD] = seconds_since( start ) ;
+
+        start = std::chrono::steady_clock::now() ;
+        const int n = mesh.nb_vertices() ;
+        SparseMatrix K( n ) ;
+        std::vector< double > F( n, 0. ) ;
+        Simu::assemble_p1_system( mesh, with_source, K, F ) ;
+        times[BENCH_ASSEMBLY] = seconds_since( start ) ;
+
+        start = std::chrono::steady_clock::now() ;
+        std::vector< bool > attribute_is_dirichlet ;
+        std::vector< double > values ;
+        mesh.set_attribute( Simu::unit_fct, 1, true ) ;
+        Simu::p1_dirichlet_values( mesh, with_source, attribute_is_dirichlet, values ) ;
+        apply_dirichlet_boundary_conditions( mesh, attribute_is_dirichlet, values, K, F ) ;
+        times[BENCH_BOUNDARY] = seconds_since( start ) ;
+
+        start = std::chrono::steady_clock::now() ;
+        std::vector< double > u( n ) ;
+        SolveReport report ;
+        solve( K, F, u, options, &report ) ;
+        times[BENCH_SOLVE] = seconds_since( start ) ;
+
+        start = std::chrono::steady_clock::now() ;
+        mesh.save( bench_output + ".mesh" ) ;
+        save_solution( u, bench_output + ".bb" ) ;
+        times[BENCH_SAVE] = seconds_since( start ) ;
+
+        times[BENCH_TOTAL] = 0. ;
+        for( int p = 0; p < BENCH_TOTAL; ++p ) times[BENCH_TOTAL] += times[p] ;
+
+        result.nb_vertices = n ;
+        result.nnz = 0 ;
+        for( int i = 0; i < n; ++i ) result.nnz += K.get_cols_at_line( i ).size() ;
+        result.nb_iterations = report.nb_iterations ;
+        result.converged = report.converged ;
+    }
+
+    /****************************************************************/
+    /* Implementation of the benchmarks */
+    /****************************************************************/
+
+    const char* bench_phase_name( int phase )
+    {
+        static const char* names[BENCH_NB_PHASES] = {
+            "load", "assembly", "boundary", "solve", "save", "total"
+        } ;
+        assert( phase >= 0 && phase < BENCH_NB_PHASES ) ;
+        return names[phase] ;
+    }
+
+    BenchOptions::BenchOptions()
+        : repetitions( 3 ), warmup( 1 ), quiet( true )
+    {
+
+    }
+
+    BenchResult::BenchResult()
+        : nb_vertices( 0 ), nnz( 0 ), nb_iterations( 0 ), converged( false ), peak_rss_kb( 0 )
+    {
+        for( int p = 0; p < BENCH_NB_PHASES; ++p ) {
+            min[p] = 0. ;
+            median[p] = 0. ;
+        }
+    }
+
+    std::vector< std::string > list_meshes( const std::string& directory )
+    {
+        std::vector< std::pair< long, std::string > > files ;
+        DIR* dir = opendir( directory.c_str() ) ;
+        if( dir == NULL ) {
+            std::cout << "Unable to read the directory " << directory << std::endl ;
+            return std::vector< std::string >() ;
+        }
+        struct dirent* entry ;
+        while( ( entry = readdir( dir ) ) != NULL ) {
+            const std::string name = entry->d_name ;
+            if( name.size() < 5 || name.compare( name.size() - 5, 5, ".mesh" ) != 0 ) continue ;
+            const std::string path = directory + "/" + name ;
+            struct stat status ;
+            if( stat( path.c_str(), &status ) != 0 || !S_ISREG( status.st_mode ) ) continue ;
+            files.push_back( std::make_pair( long( status.st_size ), path ) ) ;
+        }
+        closedir( dir ) ;
+        std::sort( files.begin(), files.end() ) ;
+        std::vector< std::string > meshes( files.size() ) ;
+        for( int i = 0; i < files.size(); ++i ) meshes[i] = files[i].second ;
+        return meshes ;
+    }
+
+    void run_benchmarks( const BenchOptions& options, std::vector< BenchResult >& results )
+    {
+        assert( options.repetitions > 0 && options.warmup >= 0 ) ;
+        const std::vector< std::string > meshes = options.meshes.empty() ?
+            list_meshes( "data" ) : options.meshes ;
+        results.clear() ;
+        const bool verbose = fem_verbose() ;
+        set_fem_verbose( !options.quiet ) ;
+        for( int m = 0; m < meshes.size(); ++m ) {
+            for( int problem = 0; problem < 2; ++problem ) {
+                BenchResult result ;
+                result.problem = problem_names[problem] ;
+                result.mesh = meshes[m] ;
+                result.solver = solver_name( options.solver.solver ) ;
+                result.preconditioner = preconditioner_name( options.solver.preconditioner ) ;
+                reset_peak_rss() ;
+                double times[BENCH_NB_PHASES] ;
+                for( int r = 0; r < options.warmup; ++r ) {
+                    run_problem( meshes[m], problem == 1, options.solver, times, result ) ;
+                }
+                std::vector< std::vector< double > > measures( BENCH_NB_PHASES ) ;
+                for( int r = 0; r < options.repetitions; ++r ) {
+                    run_problem( meshes[m], problem == 1, options.solver, times, result ) ;
+                    for( int p = 0; p < BENCH_NB_PHASES; ++p ) measures[p].push_back( times[p] ) ;
+                }
+                result.peak_rss_kb = peak_rss_kb() ;
+
+                for( int p = 0; p < BENCH_NB_PHASES; ++p ) {
+                    result.min[p] = *std::min_element( measures[p].begin(), measures[p].end() ) ;
+                    result.median[p] = median_of( measures[p] ) ;
+                }
+                std::cout << "bench " << result.problem << " on " << result.mesh
+                    << " .. " << result.median[BENCH_TOTAL] << " s" << std::endl ;
+                results.push_back( result ) ;
+            }
+        }
+        set_fem_verbose( verbose ) ;
+        remove( ( bench_output + ".mesh" ).c_str() ) ;
+        remove( ( bench_output + ".bb" ).c_str() ) ;
+    }
+
+    void print_bench_results( const std::vector< BenchResult >& results )
+    {
+        std::cout << std::left << std::setw( 28 ) << "problem" << std::setw( 28 ) << "mesh"
+            << std::right << std::setw( 8 ) << "vertices" << std::setw( 9 ) << "nnz"
+            << std::setw( 6 ) << "iter" ;
+        for( int p = 0; p < BENCH_NB_PHASES; ++p ) std::cout << std::setw( 10 ) << bench_phase_name( p ) ;
+        std::cout << std::setw( 10 ) << "RSS (MB)" << std::endl ;
+        for( int i = 0; i < results.size(); ++i ) {
+            const BenchResult& result = results[i] ;
+            std::cout << std::left << std::setw( 28 ) << result.problem << std::setw( 28 ) << result.mesh
+                << std::right << std::setw( 8 ) << result.nb_vertices << std::setw( 9 ) << result.nnz
+                << std::setw( 6 ) << result.nb_iterations << std::fixed << std::setprecision( 4 ) ;
+            for( int p = 0; p < BENCH_NB_PHASES; ++p ) std::cout << std::setw( 10 ) << result.median[p] ;
+            std::cout << std::setprecision( 1 ) << std::setw( 10 ) << result.peak_rss_kb / 1024. ;
+            std::cout << std::defaultfloat << std::setprecision( 6 ) << std::endl ;
+        }
+    }
+
+    bool save_bench_json( const BenchOptions& options,
+        const std::vector< BenchResult >& results, const std::string& filename )
+    {
+        std::ofstream json( filename.c_str(), std::ios::out | std::ios::trunc ) ;
+        if( !json ) {
+            std::cout << "Unable to write " << filename << std::endl ;
+            return false ;
+        }
+        json << std::setprecision( 9 ) ;
+        json << "{\n"
+            << "  \"benchmark\": \"fem2a\",\n"
+            << "  \"repetitions\": " << options.repetitions << ",\n"
+            << "  \"warmup\": " << options.warmup << ",\n"
+            << "  \"solver\": \"" << solver_name( options.solver.solver ) << "\",\n"
+            << "  \"preconditioner\": \"" << preconditioner_name( options.solver.preconditioner ) << "\",\n"
+            << "  \"results\": [\n" ;
+        for( int i = 0; i < results.size(); ++i ) {
+            const BenchResult& result = results[i] ;
+            json << "    {\n"
+                << "      \"problem\": \"" << result.problem << "\",\n"
+                << "      \"mesh\": \"" << result.mesh << "\",\n"
+                << "      \"vertices\": " << result.nb_vertices << ",\n"
+                << "      \"nnz\": " << result.nnz << ",\n"
+                << "      \"iterations\": " << result.nb_iterations << ",\n"
+                << "      \"converged\": " << ( result.converged ? "true" : "false" ) << ",\n"
+                << "      \"peak_rss_kb\": " << result.peak_rss_kb << ",\n" ;
+            for( int p = 0; p < BENCH_NB_PHASES; ++p ) {
+                json << "      \"" << bench_phase_name( p ) << "\": { \"min\": " << result.min[p]
+                    << ", \"median\": " << result.median[p] << " }"
+                    << ( p + 1 < BENCH_NB_PHASES ? ",\n" : "\n" ) ;
+            }
+            json << "    }" << ( i + 1 < results.size() ? ",\n" : "\n" ) ;
+        }
+        json << "  ]\n}\n" ;
+        return !json.fail() ;
+    }
+
+    /* the text following "key": in [from, end), or an empty string */
+    static std::string json_value( const std::string& text, const std::string& key,
+        size_t from, size_t end )
+    {
+        const size_t position = text.find( "\"" + key + "\":", from ) ;
+        if( position == std::string::npos || position >= end ) return "" ;
+        size_t begin = position + key.size() + 3 ;
+        while( begin < end && text[begin] == ' ' ) ++begin ;
+        if( begin < end && text[begin] == '"' ) {
+            return text.substr( begin + 1, text.find( '"', begin + 1 ) - begin - 1 ) ;
+        }
+        return text.substr( begin, text.find_first_of( ",}\n", begin ) - begin ) ;
+    }
+
+    bool load_bench_json( const std::string& filename, std::vector< BenchResult >& results )
+    {
+        std::ifstream json( filename.c_str() ) ;
+        if( !json ) {
+            std::cout << "Unable to read " << filename << std::endl ;
+            return false ;
+        }
+        std::ostringstream content ;
+        content << json.rdbuf() ;
+        const std::string text = content.str() ;
+        results.clear() ;
+        size_t from = text.find( "\"problem\":" ) ;
+        /* the options precede the results */
+        const size_t options_end = from == std::string::npos ? text.size() : from ;
+        const std::string solver = json_value( text, "solver", 0, options_end ) ;
+        const std::string preconditioner = json_value( text, "preconditioner", 0, options_end ) ;
+        while( from != std::string::npos ) {
+            const size_t next = text.find( "\"problem\":", from + 1 ) ;
+            const size_t end = next == std::string::npos ? text.size() : next ;
+            BenchResult result ;
+            result.problem = json_value( text, "problem", from, end ) ;
+            result.mesh = json_value( text, "mesh", from, end ) ;
+            result.solver = solver ;
+            result.preconditioner = preconditioner ;
+            result.nb_vertices = std::atoi( json_value( text, "vertices", from, end ).c_str() ) ;
+            result.nnz = std::atoi( json_value( text, "nnz", from, end ).c_str() ) ;
+            result.nb_iterations = std::atoi( json_value( text, "iterations", from, end ).c_str() ) ;
+            result.converged = json_value( text, "converged", from, end ) == "true" ;
+            result.peak_rss_kb = std::atol( json_value( text, "peak_rss_kb", from, end ).c_str() ) ;
+            for( int p = 0; p < BENCH_NB_PHASES; ++p ) {
+                const size_t phase = text.find( "\"" + std::string( bench_phase_name( p ) ) + "\":", from ) ;
+                if( phase == std::string::npos || phase >= end ) continue ;
+                result.min[p] = std::atof( json_value( text, "min", phase, end ).c_str() ) ;
+                result.median[p] = std::atof( json_value( text, "median", phase, end ).c_str() ) ;
+            }
+            results.push_back( result ) ;
+            from = next ;
+        }
+        return !results.empty() ;
+    }
+
+    int compare_bench_results( const std::vector< BenchResult >& results,
+        const std::vector< BenchResult >& baseline, double tolerance )
+    {
+        int nb_regressions = 0 ;
+        std::cout << "comparison with the baseline (current / baseline median times):" << std::endl ;
+        for( int i = 0; i < results.size(); ++i ) {
+            const BenchResult& result = results[i] ;
+            const BenchResult* reference = NULL ;
+            for( int j = 0; j < baseline.size(); ++j ) {
+                if( baseline[j].problem == result.problem && baseline[j].mesh == result.mesh ) {
+                    reference = &baseline[j] ;
+                }
+            }
+            if( reference == NULL ) continue ;
+            std::cout << "  " << result.problem << " on " << result.mesh << ":" ;
+            if( reference->solver != result.solver || reference->preconditioner != result.preconditioner ) {
+                std::cout << " not compared, the baseline used " << reference->solver << " ("
+                    << reference->preconditioner << "), not " << result.solver << " ("
+                    << result.preconditioner << ")" << std::endl ;
+                continue ;
+            }
+            for( int p = 0; p < BENCH_NB_PHASES; ++p ) {
+                const double ratio = reference->median[p] > 0. ?
+                    result.median[p] / reference->median[p] : 1. ;
+                const bool regression = ratio > 1. + tolerance
+                    && result.median[p] - reference->median[p] > 1e-3 ;
+                std::cout << " " << bench_phase_name( p ) << " x" << std::setprecision( 3 )
+                    << ratio << ( regression ? " (REGRESSION)" : "" ) ;
+                if( regression ) ++nb_regressions ;
+            }
+            if( result.nb_iterations != reference->nb_iterations ) {
+                std::cout << " | iterations " << reference->nb_iterations << " -> "
+                    << result.nb_iterations ;
+            }
+            std::cout << std::setprecision( 6 ) << std::endl ;
+        }
+        std::cout << nb_regressions << " regression(s) above " << 100. * tolerance << " %" << std::endl ;
+        return nb_regressions ;
+    }
+
+}
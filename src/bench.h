@@ -0,0 +1,107 @@
+#pragma once
+
+#include "solver.h"
+
+#include <vector>
+#include <string>
+
+namespace FEM2A {
+
+    /**
+     * \brief The phases timed by run_benchmarks(), in the order of a
+     *        simulation.
+     */
+    enum BenchPhase {
+        BENCH_LOAD, BENCH_ASSEMBLY, BENCH_BOUNDARY, BENCH_SOLVE, BENCH_SAVE,
+        BENCH_TOTAL, BENCH_NB_PHASES
+    } ;
+
+    /**
+     * \return "load", "assembly", "boundary", "solve", "save" or "total"
+     */
+    const char* bench_phase_name( int phase ) ;
+
+    /**
+     * \brief Parameters of run_benchmarks().
+     */
+    struct BenchOptions {
+        BenchOptions() ;
+
+        std::vector< std::string > meshes ; /* empty: all the .mesh files of data/ */
+        int repetitions ;       /* timed runs of each problem on each mesh */
+        int warmup ;            /* untimed runs before them */
+        SolverOptions solver ;
+        bool quiet ;            /* no per-call messages of fem.cpp during
+                                   the runs, see set_fem_verbose() */
+    } ;
+
+    /**
+     * \brief The measures of one problem on one mesh.
+     */
+    struct BenchResult {
+        BenchResult() ;
+
+        std::string problem ;
+        std::string mesh ;
+        std::string solver ;    /* "cg", "native-cg", ... see save_bench_json() */
+        std::string preconditioner ;
+        int nb_vertices ;
+        int nnz ;               /* of the assembled matrix */
+        int nb_iterations ;     /* of the last solve */
+        bool converged ;
+        long peak_rss_kb ;      /* peak resident memory during the runs */
+        double min[BENCH_NB_PHASES] ;       /* in seconds, over the repetitions */
+        double median[BENCH_NB_PHASES] ;
+    } ;
+
+    /**
+     * \return the .mesh files of a directory, from the smallest file
+     *         to the largest one
+     */
+    std::vector< std::string > list_meshes( const std::string& directory ) ;
+
+    /**
+     * \brief Runs the standard problems of Simu (pure Dirichlet, and
+     *        Dirichlet with a source term) on each mesh and times
+     *        separately the loading of the mesh, the assembly, the
+     *        boundary conditions, the solve and the save of the results
+     *        (Medit files, in a temporary file removed at the end).
+     *
+     * The peak resident memory is reset before each problem when the
+     * system allows it (/proc/self/clear_refs), else it is the peak of
+     * the process so far.
+     */
+    void run_benchmarks( const BenchOptions& options, std::vector< BenchResult >& results ) ;
+
+    /**
+     * \brief Prints a table of the median times.
+     */
+    void print_bench_results( const std::vector< BenchResult >& results ) ;
+
+    /**
+     * \brief Writes the results as JSON: the options, then one object
+     *        per problem and mesh with its sizes and, for each phase,
+     *        { "min": .., "median": .. } in seconds.
+     */
+    bool save_bench_json( const BenchOptions& options,
+        const std::vector< BenchResult >& results, const std::string& filename ) ;
+
+    /**
+     * \brief Reads the results written by save_bench_json() (it is not a
+     *        general JSON parser).
+     */
+    bool load_bench_json( const std::string& filename, std::vector< BenchResult >& results ) ;
+
+    /**
+     * \brief Compares the median times with a baseline, for the problems
+     *        and the meshes present in both, and prints the ratios. A
+     *        phase is a regression if it is slower by more than
+     *        tolerance (relative) and by more than 1 ms. The results of
+     *        another solver or preconditioner are not compared (only
+     *        reported).
+     * \return the number of regressions
+     */
+    int compare_bench_results( const std::vector< BenchResult >& results,
+        const std::vector< BenchResult >& baseline, double tolerance ) ;
+
+}
@@ -0,0 +1,544 @@
+#include "cholesky.h"
+
+#include <assert.h>
+#include <iostream>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+namespace FEM2A {
+
+    /* Subgraphs smaller than this are not dissected further */
+    const int nd_leaf_size = 32 ;
+
+    /**
+     * \brief Breadth first search from root restricted to the nodes v
+     *        such that tag[v] == t.
+     * \return the visited nodes in order; level[v] is their distance to root
+     */
+    static void bfs( int root, int t,
+        const std::vector< int >& adj_ptr, const std::vector< int >& adj,
+        const std::vector< int >& tag, std::vector< int >& level,
+        std::vector< int >& visited )
+    {
+        visited.clear() ;
+        visited.push_back( root ) ;
+        level[root] = 0 ;
+        for( int head = 0; head < visited.size(); ++head ) {
+            const int v = visited[head] ;
+            for( int k = adj_ptr[v]; k < adj_ptr[v + 1]; ++k ) {
+                const int w = adj[k] ;
+                if( tag[w] == t && level[w] < 0 ) {
+                    level[w] = level[v] + 1 ;
+                    visited.push_back( w ) ;
+                }
+            }
+        }
+    }
+
+    /**
+     * \brief Nested dissection of the subgraph made of nodes: the middle
+     *        level of a breadth first search from a pseudo-peripheral
+     *        node separates the subgraph in two parts, which are ordered
+     *        recursively before the separator.
+     */
+    static void dissect( const std::vector< int >& nodes,
+        const std::vector< int >& adj_ptr, const std::vector< int >& adj,
+        std::vector< int >& tag, int& next_tag, std::vector< int >& level,
+        std::vector< int >& order )
+    {
+        if( nodes.size() <= nd_leaf_size ) {
+            order.insert( order.end(), nodes.begin(), nodes.end() ) ;
+            return ;
+        }
+        const int t = next_tag++ ;
+        for( int i = 0; i < nodes.size(); ++i ) {
+            tag[nodes[i]] = t ;
+            level[nodes[i]] = -1 ;
+        }
+
+        std::vector< int > visited ;
+        bfs( nodes[0], t, adj_ptr, adj, tag, level, visited ) ;
+        if( visited.size() < nodes.size() ) {
+            /* disconnected: order the component of nodes[0] and the rest */
+            std::vector< int > rest ;
+            for( int i = 0; i < nodes.size(); ++i ) {
+                if( level[nodes[i]] < 0 ) rest.push_back( nodes[i] ) ;
+            }
+            dissect( visited, adj_ptr, adj, tag, next_tag, level, order ) ;
+            dissect( rest, adj_ptr, adj, tag, next_tag, level, order ) ;
+            return ;
+        }
+
+        /* pseudo-peripheral node: restart from the farthest node while
+         * the depth increases */
+        int depth = level[visited.back()] ;
+        for( int sweep = 0; sweep < 4; ++sweep ) {
+            const int root = visited.back() ;
+            for( int i = 0; i < nodes.size(); ++i ) level[nodes[i]] = -1 ;
+            bfs( root, t, adj_ptr, adj, tag, level, visited ) ;
+            const int new_depth = level[visited.back()] ;
+            if( new_depth <= depth ) break ;
+            depth = new_depth ;
+        }
+        depth = level[visited.back()] ;
+        if( depth < 2 ) {
+            order.insert( order.end(), nodes.begin(), nodes.end() ) ;
+            return ;
+        }
+
+        /* separator: the level containing the median node */
+        int middle = level[visited[visited.size() / 2]] ;
+        middle = std::max( 1, std::min( depth - 1, middle ) ) ;
+        std::vector< int > part_a, part_b, separator ;
+        for( int i = 0; i < nodes.size(); ++i ) {
+            const int v = nodes[i] ;
+            if( level[v] < middle ) {
+                part_a.push_back( v ) ;
+            } else if( level[v] > middle ) {
+                part_b.push_back( v ) ;
+            } else {
+                bool touches_b = false ;
+                for( int k = adj_ptr[v]; k < adj_ptr[v + 1] && !touches_b; ++k ) {
+                    touches_b = tag[adj[k]] == t && level[adj[k]] == middle + 1 ;
+                }
+                if( touches_b ) separator.push_back( v ) ; else part_a.push_back( v ) ;
+            }
+        }
+        dissect( part_a, adj_ptr, adj, tag, next_tag, level, order ) ;
+        dissect( part_b, adj_ptr, adj, tag, next_tag, level, order ) ;
+        order.insert( order.end(), separator.begin(), separator.end() ) ;
+    }
+
+    /**
+     * \brief Builds the lower adjacency (k < i) of the matrix graph in the
+     *        numbering given by iperm.
+     */
+    static void lower_graph( const CSRMatrix& A, const std::vector< int >& iperm,
+        std::vector< int >& ptr, std::vector< int >& adj )
+    {
+        const int n = A.nb_rows() ;
+        ptr.assign( n + 1, 0 ) ;
+        for( int r = 0; r < n; ++r ) {
+            for( int k = A.row_ptr_[r]; k < A.row_ptr_[r + 1]; ++k ) {
+                const int i = iperm[r] ;
+                const int j = iperm[A.col_[k]] ;
+                if( j < i ) ptr[i + 1]++ ;
+            }
+        }
+        for( int i = 0; i < n; ++i ) ptr[i + 1] += ptr[i] ;
+        adj.resize( ptr[n] ) ;
+        std::vector< int > next( ptr.begin(), ptr.end() - 1 ) ;
+        for( int r = 0; r < n; ++r ) {
+            for( int k = A.row_ptr_[r]; k < A.row_ptr_[r + 1]; ++k ) {
+                const int i = iperm[r] ;
+                const int j = iperm[A.col_[k]] ;
+                if( j < i ) adj[next[i]++] = j ;
+            }
+        }
+    }
+
+    /**
+     * \brief Elimination tree (Liu's algorithm with path compression).
+     */
+    static void elimination_tree( const std::vector< int >& ptr,
+        const std::vector< int >& adj, std::vector< int >& parent )
+    {
+        const int n = ptr.size() - 1 ;
+        parent.assign( n, -1 ) ;
+        std::vector< int > ancestor( n, -1 ) ;
+        for( int i = 0; i < n; ++i ) {
+            for( int k = ptr[i]; k < ptr[i + 1]; ++k ) {
+                int r = adj[k] ;
+                while( ancestor[r] != -1 && ancestor[r] != i ) {
+                    const int next = ancestor[r] ;
+                    ancestor[r] = i ;
+                    r = next ;
+                }
+                if( ancestor[r] == -1 ) {
+                    ancestor[r] = i ;
+                    parent[r] = i ;
+                }
+            }
+        }
+    }
+
+    /****************************************************************/
+    /* Implementation of SparseCholesky */
+    /****************************************************************/
+
+    SparseCholesky::SparseCholesky( Ordering ordering )
+        : ordering_( ordering ), nnz_lower_A_( 0 ),
+        analyze_time_( 0. ), factor_time_( 0. )
+    {
+
+    }
+
+    void SparseCholesky::analyze( const CSRMatrix& A )
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        const int n = A.nb_rows() ;
+        pattern_row_ptr_ = A.row_ptr_ ;
+        pattern_col_ = A.col_ ;
+
+        /* symmetric graph of A without the diagonal */
+        std::vector< int > identity( n ) ;
+        for( int i = 0; i < n; ++i ) identity[i] = i ;
+        std::vector< int > lower_ptr, lower_adj ;
+        lower_graph( A, identity, lower_ptr, lower_adj ) ;
+        nnz_lower_A_ = lower_adj.size() + n ;
+
+        /* fill-reducing ordering */
+        perm_ = identity ;
+        if( ordering_ == ORDERING_NESTED_DISSECTION ) {
+            std::vector< int > adj_ptr( n + 1, 0 ) ;
+            for( int i = 0; i < n; ++i ) {
+                for( int k = lower_ptr[i]; k < lower_ptr[i + 1]; ++k ) {
+                    adj_ptr[i + 1]++ ;
+                    adj_ptr[lower_adj[k] + 1]++ ;
+                }
+            }
+            for( int i = 0; i < n; ++i ) adj_ptr[i + 1] += adj_ptr[i] ;
+            std::vector< int > adj( adj_ptr[n] ) ;
+            std::vector< int > next( adj_ptr.begin(), adj_ptr.end() - 1 ) ;
+            for( int i = 0; i < n; ++i ) {
+                for( int k = lower_ptr[i]; k < lower_ptr[i + 1]; ++k ) {
+                    adj[next[i]++] = lower_adj[k] ;
+                    adj[next[lower_adj[k]]++] = i ;
+                }
+            }
+            std::vector< int > tag( n, -1 ), level( n, -1 ) ;
+            int next_tag = 0 ;
+            perm_.clear() ;
+            dissect( identity, adj_ptr, adj, tag, next_tag, level, perm_ ) ;
+        }
+        iperm_.resize( n ) ;
+        for( int i = 0; i < n; ++i ) iperm_[perm_[i]] = i ;
+
+        /* elimination tree, then postorder it so that the supernodes are
+         * made of consecutive columns */
+        std::vector< int > parent ;
+        lower_graph( A, iperm_, lower_ptr, lower_adj ) ;
+        elimination_tree( lower_ptr, lower_adj, parent ) ;
+        {
+            std::vector< int > first_child( n, -1 ), next_sibling( n, -1 ) ;
+            for( int j = n - 1; j >= 0; --j ) {
+                if( parent[j] >= 0 ) {
+                    next_sibling[j] = first_child[parent[j]] ;
+                    first_child[parent[j]] = j ;
+                }
+            }
+            std::vector< int > post, stack ;
+            post.reserve( n ) ;
+            for( int root = 0; root < n; ++root ) {
+                if( parent[root] >= 0 ) continue ;
+                stack.push_back( root ) ;
+                while( !stack.empty() ) {
+                    const int j = stack.back() ;
+                    if( first_child[j] >= 0 ) {
+                        /* visit the children first */
+                        const int c = first_child[j] ;
+                        first_child[j] = next_sibling[c] ;
+                        stack.push_back( c ) ;
+                    } else {
+                        stack.pop_back() ;
+                        post.push_back( j ) ;
+                    }
+                }
+            }
+            std::vector< int > new_perm( n ) ;
+            for( int k = 0; k < n; ++k ) new_perm[k] = perm_[post[k]] ;
+            perm_.swap( new_perm ) ;
+            for( int i = 0; i < n; ++i ) iperm_[perm_[i]] = i ;
+        }
+        lower_graph( A, iperm_, lower_ptr, lower_adj ) ;
+        elimination_tree( lower_ptr, lower_adj, parent ) ;
+
+        /* structure of the columns of L (without the diagonal), from the
+         * row subtrees of the elimination tree */
+        std::vector< int > col_ptr( n + 1, 0 ) ;
+        std::vector< int > mark( n, -1 ) ;
+        for( int pass = 0; pass < 2; ++pass ) {
+            std::vector< int > next( col_ptr.begin(), col_ptr.end() - 1 ) ;
+            std::vector< int > col_rows( pass == 0 ? 0 : col_ptr[n] ) ;
+            mark.assign( n, -1 ) ;
+            for( int i = 0; i < n; ++i ) {
+                mark[i] = i ;
+                for( int k = lower_ptr[i]; k < lower_ptr[i + 1]; ++k ) {
+                    for( int j = lower_adj[k]; mark[j] != i; j = parent[j] ) {
+                        mark[j] = i ;
+                        if( pass == 0 ) col_ptr[j + 1]++ ;
+                        else col_rows[next[j]++] = i ;
+                    }
+                }
+            }
+            if( pass == 0 ) {
+                for( int j = 0; j < n; ++j ) col_ptr[j + 1] += col_ptr[j] ;
+                continue ;
+            }
+
+            /* fundamental supernodes */
+            std::vector< int > nb_children( n, 0 ) ;
+            for( int j = 0; j < n; ++j ) {
+                if( parent[j] >= 0 ) nb_children[parent[j]]++ ;
+            }
+            super_first_.clear() ;
+            super_of_col_.resize( n ) ;
+            for( int j = 0; j < n; ++j ) {
+                const bool merge = j > 0 && parent[j - 1] == j
+                    && nb_children[j] == 1
+                    && col_ptr[j] - col_ptr[j - 1] == col_ptr[j + 1] - col_ptr[j] + 1 ;
+                if( !merge ) super_first_.push_back( j ) ;
+                super_of_col_[j] = super_first_.size() - 1 ;
+            }
+            super_first_.push_back( n ) ;
+
+            /* rows of each panel: its own columns, then the structure of
+             * its last column */
+            const int nb_super = super_first_.size() - 1 ;
+            super_rows_ptr_.assign( nb_super + 1, 0 ) ;
+            panel_ptr_.assign( nb_super + 1, 0 ) ;
+            super_rows_.clear() ;
+            for( int s = 0; s < nb_super; ++s ) {
+                const int first = super_first_[s] ;
+                const int last = super_first_[s + 1] - 1 ;
+                for( int j = first; j <= last; ++j ) super_rows_.push_back( j ) ;
+                super_rows_.insert( super_rows_.end(),
+                    col_rows.begin() + col_ptr[last], col_rows.begin() + col_ptr[last + 1] ) ;
+                super_rows_ptr_[s + 1] = super_rows_.size() ;
+                const long height = super_rows_ptr_[s + 1] - super_rows_ptr_[s] ;
+                panel_ptr_[s + 1] = panel_ptr_[s] + height * ( last - first + 1 ) ;
+            }
+        }
+
+        analyze_time_ = std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+    }
+
+    bool SparseCholesky::factor( const CSRMatrix& A )
+    {
+        if( A.row_ptr_ != pattern_row_ptr_ || A.col_ != pattern_col_ ) {
+            analyze( A ) ;
+        }
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        const int n = A.nb_rows() ;
+        const int nb_super = nb_supernodes() ;
+        values_.assign( panel_ptr_[nb_super], 0. ) ;
+        D_.assign( n, 0. ) ;
+        std::vector< int > pos( n, -1 ) ;
+
+        /* scatter the lower part of PAP^T in the panels */
+        std::vector< int > col_ptr( n + 1, 0 ) ;
+        for( int r = 0; r < n; ++r ) {
+            for( int k = A.row_ptr_[r]; k < A.row_ptr_[r + 1]; ++k ) {
+                if( iperm_[A.col_[k]] <= iperm_[r] ) col_ptr[iperm_[A.col_[k]] + 1]++ ;
+            }
+        }
+        for( int j = 0; j < n; ++j ) col_ptr[j + 1] += col_ptr[j] ;
+        std::vector< int > entry_row( col_ptr[n] ) ;
+        std::vector< double > entry_val( col_ptr[n] ) ;
+        {
+            std::vector< int > next( col_ptr.begin(), col_ptr.end() - 1 ) ;
+            for( int r = 0; r < n; ++r ) {
+                for( int k = A.row_ptr_[r]; k < A.row_ptr_[r + 1]; ++k ) {
+                    const int j = iperm_[A.col_[k]] ;
+                    if( j <= iperm_[r] ) {
+                        entry_row[next[j]] = iperm_[r] ;
+                        entry_val[next[j]++] = A.val_[k] ;
+                    }
+                }
+            }
+        }
+        for( int s = 0; s < nb_super; ++s ) {
+            const int* rows = &super_rows_[super_rows_ptr_[s]] ;
+            const int height = super_rows_ptr_[s + 1] - super_rows_ptr_[s] ;
+            for( int a = 0; a < height; ++a ) pos[rows[a]] = a ;
+            double* panel = &values_[panel_ptr_[s]] ;
+            for( int j = super_first_[s]; j < super_first_[s + 1]; ++j ) {
+                double* column = panel + ( j - super_first_[s] ) * height ;
+                for( int k = col_ptr[j]; k < col_ptr[j + 1]; ++k ) {
+                    column[pos[entry_row[k]]] += entry_val[k] ;
+                }
+            }
+            for( int a = 0; a < height; ++a ) pos[rows[a]] = -1 ;
+        }
+
+        /* right-looking supernodal factorization */
+        for( int s = 0; s < nb_super; ++s ) {
+            const int first = super_first_[s] ;
+            const int width = super_first_[s + 1] - first ;
+            const int* rows = &super_rows_[super_rows_ptr_[s]] ;
+            const int height = super_rows_ptr_[s + 1] - super_rows_ptr_[s] ;
+            double* L = &values_[panel_ptr_[s]] ;
+
+            /* dense L D L^T of the panel */
+            for( int j = 0; j < width; ++j ) {
+                double* Lj = L + j * height ;
+                for( int k = 0; k < j; ++k ) {
+                    const double* Lk = L + k * height ;
+                    const double coef = Lk[j] * D_[first + k] ;
+                    for( int i = j; i < height; ++i ) {
+                        Lj[i] -= Lk[i] * coef ;
+                    }
+                }
+                const double d = Lj[j] ;
+                if( !( d > 0. ) ) {
+                    std::cout << "SparseCholesky: non positive pivot at column "
+                        << first + j << std::endl ;
+                    return false ;
+                }
+                D_[first + j] = d ;
+                Lj[j] = 1. ;
+                for( int i = j + 1; i < height; ++i ) {
+                    Lj[i] /= d ;
+                }
+            }
+
+            /* update of the supernodes of the rows below the panel */
+            int target = -1 ;
+            for( int b = width; b < height; ++b ) {
+                const int c = rows[b] ;
+                if( super_of_col_[c] != target ) {
+                    if( target >= 0 ) {
+                        for( int a = super_rows_ptr_[target]; a < super_rows_ptr_[target + 1]; ++a ) {
+                            pos[super_rows_[a]] = -1 ;
+                        }
+                    }
+                    target = super_of_col_[c] ;
+                    for( int a = super_rows_ptr_[target]; a < super_rows_ptr_[target + 1]; ++a ) {
+                        pos[super_rows_[a]] = a - super_rows_ptr_[target] ;
+                    }
+                }
+                const int target_height = super_rows_ptr_[target + 1] - super_rows_ptr_[target] ;
+                double* column = &values_[panel_ptr_[target]]
+                    + long( c - super_first_[target] ) * target_height ;
+                for( int k = 0; k < width; ++k ) {
+                    const double* Lk = L + k * height ;
+                    const double coef = Lk[b] * D_[first + k] ;
+                    if( coef == 0. ) continue ;
+                    for( int a = b; a < height; ++a ) {
+                        column[pos[rows[a]]] -= Lk[a] * coef ;
+                    }
+                }
+            }
+            if( target >= 0 ) {
+                for( int a = super_rows_ptr_[target]; a < super_rows_ptr_[target + 1]; ++a ) {
+                    pos[super_rows_[a]] = -1 ;
+                }
+            }
+        }
+
+        factor_time_ = std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+        return true ;
+    }
+
+    void SparseCholesky::solve( const std::vector< double >& b,
+        std::vector< double >& x ) const
+    {
+        const int n = nb_rows() ;
+        const int nb_super = nb_supernodes() ;
+        std::vector< double >& y = work_ ;
+        y.resize( n ) ;
+        for( int i = 0; i < n; ++i ) y[i] = b[perm_[i]] ;
+
+        /* L y = b */
+        for( int s = 0; s < nb_super; ++s ) {
+            const int first = super_first_[s] ;
+            const int width = super_first_[s + 1] - first ;
+            const int* rows = &super_rows_[super_rows_ptr_[s]] ;
+            const int height = super_rows_ptr_[s + 1] - super_rows_ptr_[s] ;
+            const double* L = &values_[panel_ptr_[s]] ;
+            for( int j = 0; j < width; ++j ) {
+                const double yj = y[first + j] ;
+                const double* Lj = L + j * height ;
+                for( int i = j + 1; i < height; ++i ) {
+                    y[rows[i]] -= Lj[i] * yj ;
+                }
+            }
+        }
+        /* D y = y */
+        for( int i = 0; i < n; ++i ) y[i] /= D_[i] ;
+        /* L^T y = y */
+        for( int s = nb_super - 1; s >= 0; --s ) {
+            const int first = super_first_[s] ;
+            const int width = super_first_[s + 1] - first ;
+            const int* rows = &super_rows_[super_rows_ptr_[s]] ;
+            const int height = super_rows_ptr_[s + 1] - super_rows_ptr_[s] ;
+            const double* L = &values_[panel_ptr_[s]] ;
+            for( int j = width - 1; j >= 0; --j ) {
+                const double* Lj = L + j * height ;
+                double sum = y[first + j] ;
+                for( int i = j + 1; i < height; ++i ) {
+                    sum -= Lj[i] * y[rows[i]] ;
+                }
+                y[first + j] = sum ;
+            }
+        }
+
+        x.resize( n ) ;
+        for( int i = 0; i < n; ++i ) x[perm_[i]] = y[i] ;
+    }
+
+    void SparseCholesky::apply( const std::vector< double >& r,
+        std::vector< double >& z ) const
+    {
+        solve( r, z ) ;
+    }
+
+    double SparseCholesky::flops() const
+    {
+        return 4. * nnz_L() ;
+    }
+
+    int SparseCholesky::nb_rows() const
+    {
+        return perm_.size() ;
+    }
+
+    int SparseCholesky::nb_supernodes() const
+    {
+        return super_first_.empty() ? 0 : super_first_.size() - 1 ;
+    }
+
+    long SparseCholesky::nnz_L() const
+    {
+        /* the panels store the strict upper part of their diagonal block */
+        long nnz = 0 ;
+        for( int s = 0; s < nb_supernodes(); ++s ) {
+            const long width = super_first_[s + 1] - super_first_[s] ;
+            const long height = super_rows_ptr_[s + 1] - super_rows_ptr_[s] ;
+            nnz += width * height - width * ( width - 1 ) / 2 ;
+        }
+        return nnz ;
+    }
+
+    double SparseCholesky::fill() const
+    {
+        return nnz_lower_A_ > 0 ? double( nnz_L() ) / nnz_lower_A_ : 0. ;
+    }
+
+    double SparseCholesky::analyze_time() const
+    {
+        return analyze_time_ ;
+    }
+
+    double SparseCholesky::factor_time() const
+    {
+        return factor_time_ ;
+    }
+
+    void SparseCholesky::print() const
+    {
+        std::cout << "sparse Cholesky ("
+            << ( ordering_ == ORDERING_NESTED_DISSECTION ? "nested dissection" : "natural" )
+            << " ordering) : " << nb_rows() << " unknowns, "
+            << nb_supernodes() << " supernodes, nnz(L) = " << nnz_L()
+            << ", fill = " << fill()
+            << ", analyze " << analyze_time_ << " s, factor " << factor_time_ << " s"
+            << std::endl ;
+    }
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "solver.h"
+
+#include <vector>
+
+namespace FEM2A {
+
+    /**
+     * \brief SparseCholesky computes the sparse L D L^T factorization of
+     *        a symmetric positive definite matrix, so that one
+     *        factorization serves all the subsequent right hand sides.
+     *
+     * The work is split in three phases:
+     *   - analyze(): fill-reducing ordering (nested dissection of the
+     *     matrix graph), elimination tree, structure of L and supernodes
+     *     (groups of consecutive columns of L with the same structure).
+     *     It only depends on the sparsity pattern and is cached: it is
+     *     skipped by factor() if the pattern did not change.
+     *   - factor(): supernodal numeric factorization, each supernode is
+     *     stored as a dense panel.
+     *   - solve(): forward and backward substitutions.
+     */
+    class SparseCholesky : public Preconditioner {
+        public:
+            enum Ordering { ORDERING_NATURAL, ORDERING_NESTED_DISSECTION } ;
+
+            SparseCholesky( Ordering ordering = ORDERING_NESTED_DISSECTION ) ;
+
+            /**
+             * \brief Symbolic analysis of the pattern of A (only the lower
+             *        triangular part is used).
+             */
+            void analyze( const CSRMatrix& A ) ;
+
+            /**
+             * \brief Numeric factorization. Calls analyze() first if the
+             *        pattern of A differs from the analyzed one.
+             * \return false if a non positive pivot is met (A is not SPD)
+             */
+            bool factor( const CSRMatrix& A ) ;
+
+            /**
+             * \brief Solves Ax = b with the last factorization.
+             */
+            void solve( const std::vector< double >& b, std::vector< double >& x ) const ;
+
+            /* As a Preconditioner, applies A^-1 exactly */
+            void apply( const std::vector< double >& r,
+                std::vector< double >& z ) const ;
+            double flops() const ;
+
+            int nb_rows() const ;
+            int nb_supernodes() const ;
+
+            /**
+             * \return the number of non-zeros of L (with the diagonal)
+             */
+            long nnz_L() const ;
+
+            /**
+             * \return nnz_L() divided by the number of non-zeros in the
+             *         lower triangular part of A
+             */
+            double fill() const ;
+
+            double analyze_time() const ;   /* in seconds */
+            double factor_time() const ;    /* in seconds */
+
+            void print() const ;
+
+        private:
+            Ordering ordering_ ;
+
+            /* pattern of the analyzed matrix */
+            std::vector< int > pattern_row_ptr_ ;
+            std::vector< int > pattern_col_ ;
+            long nnz_lower_A_ ;
+
+            /* symbolic data */
+            std::vector< int > perm_ ;      /* new index -> old index */
+            std::vector< int > iperm_ ;     /* old index -> new index */
+            std::vector< int > super_first_ ;   /* first column of each supernode, + n */
+            std::vector< int > super_of_col_ ;
+            std::vector< int > super_rows_ptr_ ;
+            std::vector< int > super_rows_ ;    /* row indices of each panel */
+            std::vector< long > panel_ptr_ ;    /* offset of each panel in values_ */
+
+            /* numeric data */
+            std::vector< double > values_ ;     /* column major panels of L */
+            std::vector< double > D_ ;
+
+            mutable std::vector< double > work_ ;
+
+            double analyze_time_ ;
+            double factor_time_ ;
+    } ;
+
+}
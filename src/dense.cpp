@@ -0,0 +1,82 @@
+#include "dense.h"
+
+#include <cmath>
+
+namespace FEM2A {
+
+    bool dense_cholesky( std::vector< double >& E, int k )
+    {
+        for( int j = 0; j < k; ++j ) {
+            double d = E[j * k + j] ;
+            for( int l = 0; l < j; ++l ) d -= E[j * k + l] * E[j * k + l] ;
+            if( !( d > 0. ) ) return false ;
+            E[j * k + j] = std::sqrt( d ) ;
+            for( int i = j + 1; i < k; ++i ) {
+                double s = E[i * k + j] ;
+                for( int l = 0; l < j; ++l ) s -= E[i * k + l] * E[j * k + l] ;
+                E[i * k + j] = s / E[j * k + j] ;
+            }
+        }
+        return true ;
+    }
+
+    void dense_cholesky_solve( const std::vector< double >& L, int k,
+        std::vector< double >& y )
+    {
+        for( int i = 0; i < k; ++i ) {
+            for( int l = 0; l < i; ++l ) y[i] -= L[i * k + l] * y[l] ;
+            y[i] /= L[i * k + i] ;
+        }
+        for( int i = k - 1; i >= 0; --i ) {
+            for( int l = i + 1; l < k; ++l ) y[i] -= L[l * k + i] * y[l] ;
+            y[i] /= L[i * k + i] ;
+        }
+    }
+
+    void dense_symmetric_eigen( std::vector< double >& G, int m,
+        std::vector< double >& V )
+    {
+        V.assign( m * m, 0. ) ;
+        for( int i = 0; i < m; ++i ) V[i * m + i] = 1. ;
+        for( int sweep = 0; sweep < 100; ++sweep ) {
+            double off = 0., total = 0. ;
+            for( int i = 0; i < m; ++i ) {
+                for( int j = 0; j < m; ++j ) {
+                    total += G[i * m + j] * G[i * m + j] ;
+                    if( i != j ) off += G[i * m + j] * G[i * m + j] ;
+                }
+            }
+            if( off <= 1e-24 * total ) break ;
+            for( int p = 0; p < m; ++p ) {
+                for( int q = p + 1; q < m; ++q ) {
+                    const double g_pq = G[p * m + q] ;
+                    if( g_pq == 0. ) continue ;
+                    const double theta = ( G[q * m + q] - G[p * m + p] ) / ( 2. * g_pq ) ;
+                    const double t = ( theta >= 0. ? 1. : -1. )
+                        / ( std::fabs( theta ) + std::sqrt( theta * theta + 1. ) ) ;
+                    const double c = 1. / std::sqrt( t * t + 1. ) ;
+                    const double s = t * c ;
+                    for( int k = 0; k < m; ++k ) {
+                        const double g_kp = G[k * m + p] ;
+                        const double g_kq = G[k * m + q] ;
+                        G[k * m + p] = c * g_kp - s * g_kq ;
+                        G[k * m + q] = s * g_kp + c * g_kq ;
+                    }
+                    for( int k = 0; k < m; ++k ) {
+                        const double g_pk = G[p * m + k] ;
+                        const double g_qk = G[q * m + k] ;
+                        G[p * m + k] = c * g_pk - s * g_qk ;
+                        G[q * m + k] = s * g_pk + c * g_qk ;
+                    }
+                    for( int k = 0; k < m; ++k ) {
+                        const double v_kp = V[k * m + p] ;
+                        const double v_kq = V[k * m + q] ;
+                        V[k * m + p] = c * v_kp - s * v_kq ;
+                        V[k * m + q] = s * v_kp + c * v_kq ;
+                    }
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+namespace FEM2A {
+
+    /*
+     * Small dense symmetric matrices (coarse levels, projected systems),
+     * stored row by row in a std::vector of size k * k.
+     */
+
+    /**
+     * \brief In place Cholesky factorization E = L L^T of a dense
+     *        symmetric k x k matrix. Only the lower part of E is read and
+     *        it receives L, the upper part is left unchanged.
+     * \return false if E is not positive definite
+     */
+    bool dense_cholesky( std::vector< double >& E, int k ) ;
+
+    /**
+     * \brief Solves L L^T y = y in place with the factor of
+     *        dense_cholesky().
+     */
+    void dense_cholesky_solve( const std::vector< double >& L, int k,
+        std::vector< double >& y ) ;
+
+    /**
+     * \brief Eigenvalues and eigenvectors of a dense symmetric m x m
+     *        matrix with the cyclic Jacobi method. G is overwritten, its
+     *        diagonal holds the eigenvalues; the column j of V is the
+     *        eigenvector of G[j][j].
+     */
+    void dense_symmetric_eigen( std::vector< double >& G, int m,
+        std::vector< double >& V ) ;
+
+}
@@ -0,0 +1,500 @@
+#include "distributed.h"
+#include "fem.h"
+
+#include <assert.h>
+#include <iostream>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <utility>
+
+namespace FEM2A {
+
+    /**
+     * \brief Contribution of a rank to a row owned by another rank. col is
+     *        the global index of the column, or COL_RHS for a term of F,
+     *        or COL_DIRICHLET if the vertex is on a Dirichlet edge.
+     */
+    struct RowEntry {
+        int row ;
+        int col ;
+        int col_owner ;
+        double value ;
+    } ;
+
+    static const int COL_RHS = -1 ;
+    static const int COL_DIRICHLET = -2 ;
+
+    static bool entry_less( const RowEntry& a, const RowEntry& b )
+    {
+        return a.row < b.row || ( a.row == b.row && a.col < b.col ) ;
+    }
+
+    /**
+     * \return the value associated to key in a sorted vector of pairs
+     */
+    static int lookup( const std::vector< std::pair< int, int > >& sorted, int key )
+    {
+        std::vector< std::pair< int, int > >::const_iterator it = std::lower_bound(
+            sorted.begin(), sorted.end(), std::make_pair( key, -1 ) ) ;
+        assert( it != sorted.end() && it->first == key ) ;
+        return it->second ;
+    }
+
+    /**
+     * \brief Exchanges variable size blocks of T between all the ranks:
+     *        send[send_ptr[q] .. send_ptr[q + 1]) goes to rank q.
+     */
+    template< class T >
+    static void all_to_all( MPI_Comm comm, const std::vector< T >& send,
+        const std::vector< int >& send_ptr, std::vector< T >& recv,
+        std::vector< int >& recv_ptr )
+    {
+        const int nb_ranks = send_ptr.size() - 1 ;
+        std::vector< int > send_counts( nb_ranks ), recv_counts( nb_ranks ) ;
+        for( int q = 0; q < nb_ranks; ++q ) {
+            send_counts[q] = ( send_ptr[q + 1] - send_ptr[q] ) * sizeof( T ) ;
+        }
+        MPI_Alltoall( &send_counts[0], 1, MPI_INT, &recv_counts[0], 1, MPI_INT, comm ) ;
+        std::vector< int > send_displs( nb_ranks ), recv_displs( nb_ranks ) ;
+        recv_ptr.assign( nb_ranks + 1, 0 ) ;
+        for( int q = 0; q < nb_ranks; ++q ) {
+            send_displs[q] = send_ptr[q] * sizeof( T ) ;
+            recv_displs[q] = recv_ptr[q] * sizeof( T ) ;
+            recv_ptr[q + 1] = recv_ptr[q] + recv_counts[q] / sizeof( T ) ;
+        }
+        recv.resize( recv_ptr[nb_ranks] ) ;
+        MPI_Alltoallv( send.empty() ? NULL : (void*)&send[0], &send_counts[0],
+            &send_displs[0], MPI_BYTE, recv.empty() ? NULL : (void*)&recv[0],
+            &recv_counts[0], &recv_displs[0], MPI_BYTE, comm ) ;
+    }
+
+    /****************************************************************/
+    /* Implementation of DistributedSystem */
+    /****************************************************************/
+
+    DistributedSystem::DistributedSystem( MPI_Comm comm )
+        : comm_( comm ), nb_global_( 0 ), nb_ghosts_( 0 ), halo_time_( 0. )
+    {
+        MPI_Comm_rank( comm_, &rank_ ) ;
+        MPI_Comm_size( comm_, &nb_ranks_ ) ;
+    }
+
+    void DistributedSystem::distribute( const Mesh& mesh )
+    {
+        std::vector< int > ints, ids ;
+        std::vector< double > reals ;
+        if( rank_ == 0 ) {
+            nb_global_ = mesh.nb_vertices() ;
+            std::vector< int > part_of_triangle ;
+            mesh.partition( nb_ranks_, part_of_triangle ) ;
+            std::vector< std::vector< int > > triangles( nb_ranks_ ) ;
+            std::vector< int > owner( mesh.nb_vertices(), nb_ranks_ ) ;
+            for( int t = 0; t < mesh.nb_triangles(); ++t ) {
+                const int p = part_of_triangle[t] ;
+                triangles[p].push_back( t ) ;
+                for( int k = 0; k < 3; ++k ) {
+                    const int v = mesh.get_triangle_vertex_index( t, k ) ;
+                    owner[v] = std::min( owner[v], p ) ;
+                }
+            }
+            /* the last part is sent first, rank 0 keeps the first one */
+            for( int p = nb_ranks_ - 1; p >= 0; --p ) {
+                Mesh part ;
+                std::vector< int > vertex_map ;
+                mesh.extract( triangles[p], part, vertex_map ) ;
+                part.pack( ints, reals ) ;
+                /* global index and owner of each vertex of the part */
+                ids.resize( 2 * vertex_map.size() ) ;
+                for( int v = 0; v < vertex_map.size(); ++v ) {
+                    ids[2 * v] = vertex_map[v] ;
+                    ids[2 * v + 1] = owner[vertex_map[v]] ;
+                }
+                if( p > 0 ) {
+                    int sizes[3] = { int( ints.size() ), int( reals.size() ), int( ids.size() ) } ;
+                    MPI_Send( sizes, 3, MPI_INT, p, 0, comm_ ) ;
+                    MPI_Send( &ints[0], sizes[0], MPI_INT, p, 1, comm_ ) ;
+                    MPI_Send( reals.empty() ? NULL : &reals[0], sizes[1], MPI_DOUBLE, p, 2, comm_ ) ;
+                    MPI_Send( ids.empty() ? NULL : &ids[0], sizes[2], MPI_INT, p, 3, comm_ ) ;
+                }
+            }
+        } else {
+            int sizes[3] ;
+            MPI_Recv( sizes, 3, MPI_INT, 0, 0, comm_, MPI_STATUS_IGNORE ) ;
+            ints.resize( sizes[0] ) ;
+            reals.resize( sizes[1] ) ;
+            ids.resize( sizes[2] ) ;
+            MPI_Recv( &ints[0], sizes[0], MPI_INT, 0, 1, comm_, MPI_STATUS_IGNORE ) ;
+            MPI_Recv( reals.empty() ? NULL : &reals[0], sizes[1], MPI_DOUBLE, 0, 2,
+                comm_, MPI_STATUS_IGNORE ) ;
+            MPI_Recv( ids.empty() ? NULL : &ids[0], sizes[2], MPI_INT, 0, 3,
+                comm_, MPI_STATUS_IGNORE ) ;
+        }
+        MPI_Bcast( &nb_global_, 1, MPI_INT, 0, comm_ ) ;
+
+        local_mesh_.unpack( ints, reals ) ;
+        const int n_local = local_mesh_.nb_vertices() ;
+        global_vertex_.resize( n_local ) ;
+        owner_.resize( n_local ) ;
+        owned_vertex_.clear() ;
+        for( int v = 0; v < n_local; ++v ) {
+            global_vertex_[v] = ids[2 * v] ;
+            owner_[v] = ids[2 * v + 1] ;
+            if( owner_[v] == rank_ ) owned_vertex_.push_back( v ) ;
+        }
+    }
+
+    void DistributedSystem::assemble(
+        double (*coefficient)(vertex),
+        double (*source)(vertex),
+        double (*dirichlet_fct)(vertex),
+        const std::vector< bool >& attribute_is_dirichlet )
+    {
+        /* local assembly on the triangles of this rank */
+        const int n_local = local_mesh_.nb_vertices() ;
+        SparseMatrix K_local( n_local ) ;
+        std::vector< double > F_local ;
+        assemble_p1_poisson( local_mesh_, coefficient, source, K_local, F_local ) ;
+        std::vector< bool > is_dirichlet( n_local, false ) ;
+        for( int e = 0; e < local_mesh_.nb_edges(); ++e ) {
+            if( attribute_is_dirichlet[local_mesh_.get_edge_attribute( e )] ) {
+                is_dirichlet[local_mesh_.get_edge_vertex_index( e, 0 )] = true ;
+                is_dirichlet[local_mesh_.get_edge_vertex_index( e, 1 )] = true ;
+            }
+        }
+
+        /* every row goes to the owner of its vertex (itself included) */
+        std::vector< int > send_ptr( nb_ranks_ + 1, 0 ) ;
+        for( int v = 0; v < n_local; ++v ) {
+            send_ptr[owner_[v] + 1] += K_local.get_cols_at_line( v ).size() + 2 ;
+        }
+        for( int q = 0; q < nb_ranks_; ++q ) send_ptr[q + 1] += send_ptr[q] ;
+        std::vector< RowEntry > send( send_ptr[nb_ranks_] ) ;
+        std::vector< int > fill( send_ptr.begin(), send_ptr.end() - 1 ) ;
+        for( int v = 0; v < n_local; ++v ) {
+            const std::vector< int >& J = K_local.get_cols_at_line( v ) ;
+            const std::vector< double >& V = K_local.get_vals_at_line( v ) ;
+            int& pos = fill[owner_[v]] ;
+            for( int k = 0; k < J.size(); ++k ) {
+                const RowEntry entry = { global_vertex_[v], global_vertex_[J[k]], owner_[J[k]], V[k] } ;
+                send[pos++] = entry ;
+            }
+            const RowEntry rhs = { global_vertex_[v], COL_RHS, -1, F_local[v] } ;
+            send[pos++] = rhs ;
+            const RowEntry flag = { global_vertex_[v], COL_DIRICHLET, -1,
+                is_dirichlet[v] ? 1. : 0. } ;
+            send[pos++] = flag ;
+        }
+        std::vector< RowEntry > received ;
+        std::vector< int > recv_ptr ;
+        all_to_all( comm_, send, send_ptr, received, recv_ptr ) ;
+        send.clear() ;
+
+        /* owned rows, sorted by global index */
+        const int n = owned_vertex_.size() ;
+        std::vector< std::pair< int, int > > row_of_global( n ) ;
+        for( int r = 0; r < n; ++r ) {
+            row_of_global[r] = std::make_pair( global_vertex_[owned_vertex_[r]], r ) ;
+        }
+        std::sort( row_of_global.begin(), row_of_global.end() ) ;
+
+        /* ghosts: the columns owned by other ranks, grouped by owner */
+        std::vector< std::pair< int, int > > ghosts ;    /* (owner, global) */
+        for( int k = 0; k < received.size(); ++k ) {
+            const RowEntry& entry = received[k] ;
+            if( entry.col >= 0 && entry.col_owner != rank_ ) {
+                ghosts.push_back( std::make_pair( entry.col_owner, entry.col ) ) ;
+            }
+        }
+        std::sort( ghosts.begin(), ghosts.end() ) ;
+        ghosts.erase( std::unique( ghosts.begin(), ghosts.end() ), ghosts.end() ) ;
+        nb_ghosts_ = ghosts.size() ;
+        std::vector< std::pair< int, int > > ghost_of_global( nb_ghosts_ ) ;
+        for( int g = 0; g < nb_ghosts_; ++g ) {
+            ghost_of_global[g] = std::make_pair( ghosts[g].second, g ) ;
+        }
+        std::sort( ghost_of_global.begin(), ghost_of_global.end() ) ;
+
+        /* sum of the contributions, row by row */
+        std::sort( received.begin(), received.end(), entry_less ) ;
+        std::vector< std::vector< std::pair< int, double > > > rows( n ) ;
+        std::vector< bool > row_is_dirichlet( n, false ) ;
+        F_.assign( n, 0. ) ;
+        for( int k = 0; k < received.size(); ++k ) {
+            const RowEntry& entry = received[k] ;
+            const int r = lookup( row_of_global, entry.row ) ;
+            if( entry.col == COL_RHS ) {
+                F_[r] += entry.value ;
+            } else if( entry.col == COL_DIRICHLET ) {
+                if( entry.value > 0. ) row_is_dirichlet[r] = true ;
+            } else {
+                const int c = entry.col_owner == rank_ ? lookup( row_of_global, entry.col )
+                    : n + lookup( ghost_of_global, entry.col ) ;
+                if( !rows[r].empty() && rows[r].back().first == c ) {
+                    rows[r].back().second += entry.value ;
+                } else {
+                    rows[r].push_back( std::make_pair( c, entry.value ) ) ;
+                }
+            }
+        }
+        received.clear() ;
+
+        /* CSR matrix, with the penalty on the Dirichlet rows */
+        A_ = CSRMatrix() ;
+        A_.row_ptr_.assign( n + 1, 0 ) ;
+        interior_rows_.clear() ;
+        interface_rows_.clear() ;
+        for( int r = 0; r < n; ++r ) {
+            std::vector< std::pair< int, double > >& row = rows[r] ;
+            std::sort( row.begin(), row.end() ) ;
+            bool has_ghost = false ;
+            for( int k = 0; k < row.size(); ++k ) {
+                A_.col_.push_back( row[k].first ) ;
+                A_.val_.push_back( row[k].second ) ;
+                if( row[k].first >= n ) has_ghost = true ;
+            }
+            A_.row_ptr_[r + 1] = A_.col_.size() ;
+            ( has_ghost ? interface_rows_ : interior_rows_ ).push_back( r ) ;
+            std::vector< std::pair< int, double > >().swap( row ) ;
+        }
+        A_.update_diagonal() ;
+        for( int r = 0; r < n; ++r ) {
+            if( !row_is_dirichlet[r] ) continue ;
+            assert( A_.diag_[r] >= 0 ) ;
+            A_.val_[A_.diag_[r]] += dirichlet_penalty ;
+            F_[r] += dirichlet_penalty
+                * dirichlet_fct( local_mesh_.get_vertex( owned_vertex_[r] ) ) ;
+        }
+
+        /* halo plan: ask each owner for its ghosts */
+        recv_ptr_.assign( nb_ranks_ + 1, 0 ) ;
+        std::vector< int > requested( nb_ghosts_ ) ;
+        for( int g = 0; g < nb_ghosts_; ++g ) {
+            recv_ptr_[ghosts[g].first + 1]++ ;
+            requested[g] = ghosts[g].second ;
+        }
+        for( int q = 0; q < nb_ranks_; ++q ) recv_ptr_[q + 1] += recv_ptr_[q] ;
+        std::vector< int > asked ;
+        all_to_all( comm_, requested, recv_ptr_, asked, send_ptr_ ) ;
+        send_rows_.resize( asked.size() ) ;
+        for( int k = 0; k < asked.size(); ++k ) {
+            send_rows_[k] = lookup( row_of_global, asked[k] ) ;
+        }
+        x_ext_.resize( n + nb_ghosts_ ) ;
+        send_buffer_.resize( send_rows_.size() ) ;
+        halo_time_ = 0. ;
+    }
+
+    void DistributedSystem::mult( const std::vector< double >& x, std::vector< double >& y ) const
+    {
+        const int n = nb_owned() ;
+        y.resize( n ) ;
+        std::copy( x.begin(), x.begin() + n, x_ext_.begin() ) ;
+
+        /* start the halo exchange */
+        requests_.clear() ;
+        for( int q = 0; q < nb_ranks_; ++q ) {
+            const int count = recv_ptr_[q + 1] - recv_ptr_[q] ;
+            if( count == 0 ) continue ;
+            requests_.push_back( MPI_Request() ) ;
+            MPI_Irecv( &x_ext_[n + recv_ptr_[q]], count, MPI_DOUBLE, q, 4, comm_,
+                &requests_.back() ) ;
+        }
+        for( int q = 0; q < nb_ranks_; ++q ) {
+            const int count = send_ptr_[q + 1] - send_ptr_[q] ;
+            if( count == 0 ) continue ;
+            for( int k = send_ptr_[q]; k < send_ptr_[q + 1]; ++k ) {
+                send_buffer_[k] = x[send_rows_[k]] ;
+            }
+            requests_.push_back( MPI_Request() ) ;
+            MPI_Isend( &send_buffer_[send_ptr_[q]], count, MPI_DOUBLE, q, 4, comm_,
+                &requests_.back() ) ;
+        }
+
+        /* rows without ghost column while the messages travel */
+        for( int k = 0; k < interior_rows_.size(); ++k ) {
+            const int i = interior_rows_[k] ;
+            double sum = 0. ;
+            for( int l = A_.row_ptr_[i]; l < A_.row_ptr_[i + 1]; ++l ) {
+                sum += A_.val_[l] * x_ext_[A_.col_[l]] ;
+            }
+            y[i] = sum ;
+        }
+
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        if( !requests_.empty() ) {
+            MPI_Waitall( requests_.size(), &requests_[0], MPI_STATUSES_IGNORE ) ;
+        }
+        halo_time_ += std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+
+        for( int k = 0; k < interface_rows_.size(); ++k ) {
+            const int i = interface_rows_[k] ;
+            double sum = 0. ;
+            for( int l = A_.row_ptr_[i]; l < A_.row_ptr_[i + 1]; ++l ) {
+                sum += A_.val_[l] * x_ext_[A_.col_[l]] ;
+            }
+            y[i] = sum ;
+        }
+    }
+
+    double DistributedSystem::dot( const std::vector< double >& a,
+        const std::vector< double >& b ) const
+    {
+        double local = 0. ;
+        for( int i = 0; i < nb_owned(); ++i ) local += a[i] * b[i] ;
+        double global = 0. ;
+        MPI_Allreduce( &local, &global, 1, MPI_DOUBLE, MPI_SUM, comm_ ) ;
+        return global ;
+    }
+
+    bool DistributedSystem::solve( std::vector< double >& x, const SolverOptions& options,
+        SolveReport* report ) const
+    {
+        MPI_Barrier( comm_ ) ;
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        const int n = nb_owned() ;
+        std::vector< double > inv_diag( n ) ;
+        for( int i = 0; i < n; ++i ) inv_diag[i] = 1. / A_.val_[A_.diag_[i]] ;
+
+        x.assign( n, 0. ) ;
+        std::vector< double > r( F_ ) ;
+        std::vector< double > z( n ), p( n ), Ap( n ) ;
+        std::vector< double > history ;
+        for( int i = 0; i < n; ++i ) p[i] = z[i] = inv_diag[i] * r[i] ;
+
+        /* ||F||^2 and r.z in one reduction */
+        double local[2] = { 0., 0. }, global[2] ;
+        for( int i = 0; i < n; ++i ) {
+            local[0] += r[i] * r[i] ;
+            local[1] += r[i] * z[i] ;
+        }
+        MPI_Allreduce( local, global, 2, MPI_DOUBLE, MPI_SUM, comm_ ) ;
+        const double b_norm = std::sqrt( global[0] ) ;
+        double rz = global[1] ;
+        double error = b_norm > 0. ? 1. : 0. ;
+        history.push_back( error ) ;
+
+        int it = 0 ;
+        while( error > options.threshold && it < options.max_iterations ) {
+            mult( p, Ap ) ;
+            const double alpha = rz / dot( p, Ap ) ;
+            local[0] = local[1] = 0. ;
+            for( int i = 0; i < n; ++i ) {
+                x[i] += alpha * p[i] ;
+                r[i] -= alpha * Ap[i] ;
+                z[i] = inv_diag[i] * r[i] ;
+                local[0] += r[i] * r[i] ;
+                local[1] += r[i] * z[i] ;
+            }
+            MPI_Allreduce( local, global, 2, MPI_DOUBLE, MPI_SUM, comm_ ) ;
+            ++it ;
+            error = std::sqrt( global[0] ) / b_norm ;
+            history.push_back( error ) ;
+            if( options.verbose && rank_ == 0 && it % 100 == 0 ) {
+                std::cout << "  iter " << it << " ||r||/||b|| = " << error << std::endl ;
+            }
+            const double beta = global[1] / rz ;
+            rz = global[1] ;
+            for( int i = 0; i < n; ++i ) p[i] = z[i] + beta * p[i] ;
+        }
+
+        const double elapsed = std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+        const bool converged = error <= options.threshold ;
+        if( report != NULL ) {
+            double flops = ( 2. * A_.nnz() + 13. * n ) * it ;
+            double total_flops = 0. ;
+            MPI_Allreduce( &flops, &total_flops, 1, MPI_DOUBLE, MPI_SUM, comm_ ) ;
+            report->converged = converged ;
+            report->nb_iterations = it ;
+            report->error = error ;
+            report->elapsed_time = elapsed ;
+            report->gflops = elapsed > 0. ? total_flops / ( elapsed * 1e9 ) : 0. ;
+            report->residual_history.swap( history ) ;
+        }
+        return converged ;
+    }
+
+    void DistributedSystem::gather( const std::vector< double >& x,
+        std::vector< double >& global_x ) const
+    {
+        const int n = nb_owned() ;
+        std::vector< int > ids( n ) ;
+        for( int r = 0; r < n; ++r ) ids[r] = global_vertex_[owned_vertex_[r]] ;
+        std::vector< int > counts( nb_ranks_ ), displs( nb_ranks_, 0 ) ;
+        MPI_Gather( const_cast< int* >( &n ), 1, MPI_INT, &counts[0], 1, MPI_INT, 0, comm_ ) ;
+        for( int q = 1; q < nb_ranks_; ++q ) displs[q] = displs[q - 1] + counts[q - 1] ;
+        std::vector< int > all_ids( rank_ == 0 ? nb_global_ : 0 ) ;
+        std::vector< double > all_x( rank_ == 0 ? nb_global_ : 0 ) ;
+        MPI_Gatherv( ids.empty() ? NULL : &ids[0], n, MPI_INT,
+            all_ids.empty() ? NULL : &all_ids[0], &counts[0], &displs[0], MPI_INT, 0, comm_ ) ;
+        MPI_Gatherv( x.empty() ? NULL : const_cast< double* >( &x[0] ), n, MPI_DOUBLE,
+            all_x.empty() ? NULL : &all_x[0], &counts[0], &displs[0], MPI_DOUBLE, 0, comm_ ) ;
+        global_x.clear() ;
+        if( rank_ != 0 ) return ;
+        global_x.assign( nb_global_, 0. ) ;
+        for( int k = 0; k < nb_global_; ++k ) global_x[all_ids[k]] = all_x[k] ;
+    }
+
+    int DistributedSystem::rank() const
+    {
+        return rank_ ;
+    }
+
+    int DistributedSystem::nb_ranks() const
+    {
+        return nb_ranks_ ;
+    }
+
+    int DistributedSystem::nb_owned() const
+    {
+        return owned_vertex_.size() ;
+    }
+
+    int DistributedSystem::nb_ghosts() const
+    {
+        return nb_ghosts_ ;
+    }
+
+    int DistributedSystem::nb_global() const
+    {
+        return nb_global_ ;
+    }
+
+    const Mesh& DistributedSystem::local_mesh() const
+    {
+        return local_mesh_ ;
+    }
+
+    const std::vector< double >& DistributedSystem::rhs() const
+    {
+        return F_ ;
+    }
+
+    double DistributedSystem::halo_time() const
+    {
+        return halo_time_ ;
+    }
+
+    void DistributedSystem::print() const
+    {
+        int neighbors = 0 ;
+        for( int q = 0; q < nb_ranks_; ++q ) {
+            if( recv_ptr_[q + 1] > recv_ptr_[q] ) ++neighbors ;
+        }
+        int local[3] = { nb_owned(), nb_ghosts(), neighbors } ;
+        int min_values[3], max_values[3] ;
+        MPI_Reduce( local, min_values, 3, MPI_INT, MPI_MIN, 0, comm_ ) ;
+        MPI_Reduce( local, max_values, 3, MPI_INT, MPI_MAX, 0, comm_ ) ;
+        if( rank_ != 0 ) return ;
+        std::cout << "Distributed system: " << nb_global_ << " unknowns on "
+            << nb_ranks_ << " ranks, " << min_values[0] << " to " << max_values[0]
+            << " owned, " << min_values[1] << " to " << max_values[1]
+            << " ghosts, " << min_values[2] << " to " << max_values[2]
+            << " neighbours per rank" << std::endl ;
+    }
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "mesh.h"
+#include "solver.h"
+
+#include <mpi.h>
+#include <vector>
+
+namespace FEM2A {
+
+    /**
+     * \brief DistributedSystem assembles and solves a Poisson problem with
+     *        the mesh, the matrix and the vectors distributed over the
+     *        processes (ranks) of an MPI communicator, so that no process
+     *        holds more than its part once the mesh is distributed.
+     *
+     * The triangles are partitioned with Mesh::partition(); each vertex is
+     * owned by the smallest rank having one of its triangles, the other
+     * ranks having it see it as a ghost. Each rank assembles its triangles
+     * with the element routines of fem.h, sends the rows of the vertices
+     * it does not own to their owners (ghost vertex exchange) and keeps
+     * the complete rows of its owned vertices. The columns of these rows
+     * are numbered with the owned rows first, then the ghosts grouped by
+     * owner, so the halo exchange of the matrix product receives each
+     * neighbour's values in one contiguous block.
+     *
+     * Only compiled in the MPI build (make mpi, FEM2A_MPI defined).
+     */
+    class DistributedSystem {
+        public:
+            DistributedSystem( MPI_Comm comm ) ;
+
+            /**
+             * \brief Partitions the mesh of rank 0 in one part per rank and
+             *        sends each rank its part. Collective.
+             * \param mesh The global mesh on rank 0, with its attributes
+             *             set (ignored on the other ranks)
+             */
+            void distribute( const Mesh& mesh ) ;
+
+            /**
+             * \brief Assembles the owned rows of K and F. The Dirichlet
+             *        penalty of apply_dirichlet_boundary_conditions() is
+             *        applied by the owner of each Dirichlet vertex.
+             *        Collective.
+             */
+            void assemble(
+                double (*coefficient)(vertex),
+                double (*source)(vertex),
+                double (*dirichlet_fct)(vertex),
+                const std::vector< bool >& attribute_is_dirichlet ) ;
+
+            /**
+             * \brief Computes y = Kx on the owned rows. The ghost values of
+             *        x are exchanged with the neighbours while the rows
+             *        without ghost column are computed. Collective.
+             * \param x The owned values
+             */
+            void mult( const std::vector< double >& x, std::vector< double >& y ) const ;
+
+            /**
+             * \brief Solves Kx = F with a Jacobi preconditioned CG. The
+             *        two scalar products of each iteration are reduced
+             *        together. Collective.
+             * \param[out] x The owned values of the solution
+             * \param[in] options threshold, max_iterations and verbose are used
+             * \param[out] report if not NULL, filled with the statistics
+             * \return true if the solver has converged
+             */
+            bool solve( std::vector< double >& x, const SolverOptions& options,
+                SolveReport* report = NULL ) const ;
+
+            /**
+             * \brief Gathers a distributed vector on rank 0, numbered as the
+             *        vertices of the global mesh. Collective.
+             */
+            void gather( const std::vector< double >& x, std::vector< double >& global_x ) const ;
+
+            int rank() const ;
+            int nb_ranks() const ;
+            int nb_owned() const ;
+            int nb_ghosts() const ;
+            int nb_global() const ;
+            const Mesh& local_mesh() const ;
+            const std::vector< double >& rhs() const ;
+
+            /**
+             * \return the time spent waiting for the halo exchanges of
+             *         mult() since the last assemble(), in seconds
+             */
+            double halo_time() const ;
+
+            /**
+             * \brief Prints the balance of the partition on rank 0. Collective.
+             */
+            void print() const ;
+
+        private:
+            /* scalar product of two distributed vectors */
+            double dot( const std::vector< double >& a, const std::vector< double >& b ) const ;
+
+            MPI_Comm comm_ ;
+            int rank_ ;
+            int nb_ranks_ ;
+            int nb_global_ ;
+
+            Mesh local_mesh_ ;
+            std::vector< int > global_vertex_ ;     /* global index of each local vertex */
+            std::vector< int > owner_ ;             /* rank owning each local vertex */
+            std::vector< int > owned_vertex_ ;      /* local vertex of each owned row */
+
+            CSRMatrix A_ ;
+            std::vector< double > F_ ;
+            std::vector< int > interior_rows_ ;     /* rows without ghost column */
+            std::vector< int > interface_rows_ ;
+            int nb_ghosts_ ;
+
+            /* halo exchange: the rows sent to rank q are
+             * send_rows_[send_ptr_[q] .. send_ptr_[q + 1]), the ghosts
+             * received from q are recv_ptr_[q] .. recv_ptr_[q + 1] */
+            std::vector< int > send_ptr_ ;
+            std::vector< int > send_rows_ ;
+            std::vector< int > recv_ptr_ ;
+            mutable std::vector< double > x_ext_ ;  /* owned values, then the ghosts */
+            mutable std::vector< double > send_buffer_ ;
+            mutable std::vector< MPI_Request > requests_ ;
+            mutable double halo_time_ ;
+    } ;
+
+}
@@ -1,5 +1,6 @@
 #include "fem.h"
 #include "mesh.h"
+#include "trace.h"
 
 #include <iomanip>
 #include <iostream>
@@ -7,9 +8,23 @@
 #include <limits>
 #include <stdlib.h>
 #include <assert.h>
+#include <map>
 
 namespace FEM2A {
 
+    /* the per-call messages, see set_fem_verbose() */
+    static bool verbose_calls = true ;
+
+    void set_fem_verbose( bool verbose )
+    {
+        verbose_calls = verbose ;
+    }
+
+    bool fem_verbose()
+    {
+        return verbose_calls ;
+    }
+
     void print( const std::vector<double>& x )
     {
         for ( int i = 0; i < x.size(); ++i ) {
@@ -132,8 +147,8 @@ namespace FEM2A {
     ElementMapping::ElementMapping( const Mesh& M, bool border, int i )
         : border_( border ) //constructeur d'ElementMapping
     {
-    	if (border) std::cout << "(border)"; // s'il y a border alors segment
-    	std::cout << '\n';
+    	if (verbose_calls && border) std::cout << "(border)"; // s'il y a border alors segment
+    	if( verbose_calls ) std::cout << '\n';
     	
     	if (border) { // cas d'un segment donc max que deux vertices = deux points
     		for (int v_local_index = 0; v_local_index < 2; v_local_index++) { //on note v le vertex local index
@@ -149,25 +164,25 @@ namespace FEM2A {
 
     vertex ElementMapping::transform( vertex x_r ) const
     {
-        std::cout << "[ElementMapping] transform reference to world space " << '\n';
+        if( verbose_calls ) std::cout << "[ElementMapping] transform reference to world space " << '\n';
         
         vertex r ; // dans le réel
         if (border_) { //cas segment
         	r.x = (1 - x_r.x) * vertices_[0].x + x_r.x * vertices_[1].x;
         	r.y = (1 - x_r.x) * vertices_[0].y + x_r.x * vertices_[1].y;
-        	std::cout << "Coordonnées du vertice du segment dans le réel " << r.x << " " << r.y << '\n';
+        	if( verbose_calls ) std::cout << "Coordonnées du vertice du segment dans le réel " << r.x << " " << r.y << '\n';
         }
         else { //cas triangle
         	r.x = (1 - x_r.x - x_r.y)* vertices_[0].x + x_r.x * vertices_[1].x + x_r.y * vertices_[2].x;
         	r.y = (1 - x_r.x - x_r.y)* vertices_[0].y + x_r.x * vertices_[1].y + x_r.y * vertices_[2].y;
-        	std::cout << "Coordonnées du vertice du triangle dans le réel " << r.x << " " << r.y << '\n';
+        	if( verbose_calls ) std::cout << "Coordonnées du vertice du triangle dans le réel " << r.x << " " << r.y << '\n';
         }
         return r ;
     }
 
     DenseMatrix ElementMapping::jacobian_matrix( vertex x_r ) const
     {
-        std::cout << "[ElementMapping] compute jacobian matrix " << '\n';
+        if( verbose_calls ) std::cout << "[ElementMapping] compute jacobian matrix " << '\n';
  
         DenseMatrix J ;
         if (border_) {
@@ -187,19 +202,19 @@ namespace FEM2A {
 
     double ElementMapping::jacobian( vertex x_r ) const
     {
-        std::cout << "[ElementMapping] compute jacobian determinant " << '\n';
+        if( verbose_calls ) std::cout << "[ElementMapping] compute jacobian determinant " << '\n';
  
         DenseMatrix J = jacobian_matrix(x_r);
         if (border_) {
         	DenseMatrix T = J.transpose();
-        	float produit = J.get(0,0)*T.get(0,0) + J.get(1,0)*T.get(0,1);
-        	float det = sqrt(produit);
-        	std::cout << "Le determinant est : " << det << '\n';
+        	double produit = J.get(0,0)*T.get(0,0) + J.get(1,0)*T.get(0,1);
+        	double det = sqrt(produit);
+        	if( verbose_calls ) std::cout << "Le determinant est : " << det << '\n';
         	return det;
         }
         else {
-        	float det = J.det_2x2();
-        	std::cout << "Le determinant est : " << det << '\n';
+        	double det = J.det_2x2();
+        	if( verbose_calls ) std::cout << "Le determinant est : " << det << '\n';
         	return det;
         }
     }
@@ -210,18 +225,22 @@ namespace FEM2A {
     ShapeFunctions::ShapeFunctions( int dim, int order )
         : dim_( dim ), order_( order )
     {
-        std::cout << "[ShapeFunctions] constructor in dimension " << dim << '\n';
+        if( verbose_calls ) std::cout << "[ShapeFunctions] constructor in dimension " << dim << '\n';
         if (dim_ != 1 && dim != 2) {
         	std::cout << "Attention, vous avez entré une mauvaise dimension" << '\n';
         }
-        if (order_ != 1) {
-        	std::cout << "Attention, vous avez entré un ordre supérieur à 1" << '\n';
+        if (order_ != 1 && order_ != 2) {
+        	std::cout << "Attention, vous avez entré un ordre supérieur à 2" << '\n';
         }
     }
 
     int ShapeFunctions::nb_functions() const
     {
-        std::cout << "[ShapeFunctions] number of functions" << '\n';
+        if( verbose_calls ) std::cout << "[ShapeFunctions] number of functions" << '\n';
+        if (order_ == 2) {
+        	// fonctions des sommets puis des milieux des arêtes
+        	return dim_ == 1 ? 3 : 6;
+        }
         if (dim_ == 1) {
         	return 1;
 	}
@@ -232,7 +251,24 @@ namespace FEM2A {
 
     double ShapeFunctions::evaluate( int i, vertex x_r ) const
     {
-        std::cout << "[ShapeFunctions] evaluate shape function " << i << '\n';
+        if( verbose_calls ) std::cout << "[ShapeFunctions] evaluate shape function " << i << '\n';
+        if (order_ == 2) {
+        	// 3 fonctions sur un segment, 6 sur un triangle
+        	assert(i >= 0 && i < (dim_ == 1 ? 3 : 6));
+        	if (dim_ == 1) {
+        		const double x = x_r.x;
+        		switch(i) {
+        			case 0 : return (1 - x) * (1 - 2 * x);
+        			case 1 : return x * (2 * x - 1);
+        			case 2 : return 4 * x * (1 - x);
+        		}
+        		return 0.;
+        	}
+        	// coordonnées barycentriques, le milieu 3 + k est celui de l'arête (k, k+1)
+        	const double l[3] = { 1 - x_r.x - x_r.y, x_r.x, x_r.y };
+        	if (i < 3) return l[i] * (2 * l[i] - 1);
+        	return 4 * l[i - 3] * l[(i - 2) % 3];
+        }
         if (dim_ ==1) {
         	switch(i) {
         		case 0 :
@@ -257,9 +293,34 @@ namespace FEM2A {
 
     vec2 ShapeFunctions::evaluate_grad( int i, vertex x_r ) const
     {
-        std::cout << "[ShapeFunctions] evaluate gradient shape function " << i << '\n';
+        if( verbose_calls ) std::cout << "[ShapeFunctions] evaluate gradient shape function " << i << '\n';
         vec2 g ;
         
+        if (order_ == 2) {
+        	if (dim_ == 1) {
+        		const double x = x_r.x;
+        		switch(i) {
+        			case 0 : g.x = 4 * x - 3 ; break;
+        			case 1 : g.x = 4 * x - 1 ; break;
+        			case 2 : g.x = 4 - 8 * x ; break;
+        		}
+        		g.y = 0 ;
+        		return g ;
+        	}
+        	const double l[3] = { 1 - x_r.x - x_r.y, x_r.x, x_r.y };
+        	const vec2 grad_l[3] = { { -1, -1 }, { 1, 0 }, { 0, 1 } };
+        	if (i < 3) {
+        		g.x = (4 * l[i] - 1) * grad_l[i].x ;
+        		g.y = (4 * l[i] - 1) * grad_l[i].y ;
+        	}
+        	else {
+        		const int a = i - 3;
+        		const int b = (i - 2) % 3;
+        		g.x = 4 * (l[a] * grad_l[b].x + l[b] * grad_l[a].x) ;
+        		g.y = 4 * (l[a] * grad_l[b].y + l[b] * grad_l[a].y) ;
+        	}
+        	return g ;
+        }
         if (dim_==1) {
         	switch(i) {
         		case 0 :
@@ -281,6 +342,84 @@ namespace FEM2A {
         return g ;
     }
 
+    /****************************************************************/
+    /* Implementation of DofNumbering */
+    /****************************************************************/
+    DofNumbering::DofNumbering( const Mesh& M, int order )
+        : order_( order ), nb_triangle_dofs_( order == 2 ? 6 : 3 ),
+        nb_edge_dofs_( order == 2 ? 3 : 2 )
+    {
+        assert( order == 1 || order == 2 ) ;
+        positions_.resize( M.nb_vertices() ) ;
+        for( int v = 0; v < M.nb_vertices(); ++v ) positions_[v] = M.get_vertex( v ) ;
+        triangle_dofs_.resize( nb_triangle_dofs_ * M.nb_triangles() ) ;
+        edge_dofs_.resize( nb_edge_dofs_ * M.nb_edges() ) ;
+
+        /* middle of each edge, indexed by its sorted end points, numbered
+         * in the order of the loop of refine_uniformly() */
+        std::map< std::pair< int, int >, int > middles ;
+        for( int t = 0; t < M.nb_triangles(); ++t ) {
+            for( int k = 0; k < 3; ++k ) {
+                const int a = M.get_triangle_vertex_index( t, k ) ;
+                triangle_dofs_[nb_triangle_dofs_ * t + k] = a ;
+                if( order_ == 1 ) continue ;
+                const int b = M.get_triangle_vertex_index( t, ( k + 1 ) % 3 ) ;
+                const std::pair< int, int > key( std::min( a, b ), std::max( a, b ) ) ;
+                std::map< std::pair< int, int >, int >::const_iterator it = middles.find( key ) ;
+                int m ;
+                if( it != middles.end() ) {
+                    m = it->second ;
+                } else {
+                    m = positions_.size() ;
+                    middles[key] = m ;
+                    vertex middle ;
+                    middle.x = 0.5 * ( positions_[a].x + positions_[b].x ) ;
+                    middle.y = 0.5 * ( positions_[a].y + positions_[b].y ) ;
+                    positions_.push_back( middle ) ;
+                }
+                triangle_dofs_[nb_triangle_dofs_ * t + 3 + k] = m ;
+            }
+        }
+        for( int e = 0; e < M.nb_edges(); ++e ) {
+            const int a = M.get_edge_vertex_index( e, 0 ) ;
+            const int b = M.get_edge_vertex_index( e, 1 ) ;
+            edge_dofs_[nb_edge_dofs_ * e] = a ;
+            edge_dofs_[nb_edge_dofs_ * e + 1] = b ;
+            if( order_ == 1 ) continue ;
+            std::map< std::pair< int, int >, int >::const_iterator it
+                = middles.find( std::make_pair( std::min( a, b ), std::max( a, b ) ) ) ;
+            assert( it != middles.end() ) ;
+            edge_dofs_[nb_edge_dofs_ * e + 2] = it->second ;
+        }
+    }
+
+    int DofNumbering::order() const
+    {
+        return order_ ;
+    }
+
+    int DofNumbering::nb_dofs() const
+    {
+        return positions_.size() ;
+    }
+
+    int DofNumbering::get_triangle_dof_index( int t, int local_index ) const
+    {
+        assert( local_index < nb_triangle_dofs_ ) ;
+        return triangle_dofs_[nb_triangle_dofs_ * t + local_index] ;
+    }
+
+    int DofNumbering::get_edge_dof_index( int e, int local_index ) const
+    {
+        assert( local_index < nb_edge_dofs_ ) ;
+        return edge_dofs_[nb_edge_dofs_ * e + local_index] ;
+    }
+
+    vertex DofNumbering::get_dof_position( int d ) const
+    {
+        return positions_[d] ;
+    }
+
     /****************************************************************/
     /* Implementation of Finite Element functions */
     /****************************************************************/
@@ -292,7 +431,7 @@ namespace FEM2A {
         double (*coefficient)(vertex),
         DenseMatrix& Ke )
     {
-        std::cout << "compute elementary matrix" << '\n';
+        if( verbose_calls ) std::cout << "compute elementary matrix" << '\n';
         // taille Ke est le nbre de points d'interpolation
         Ke.set_size(reference_functions.nb_functions(), reference_functions.nb_functions());
         for (int i=0; i < reference_functions.nb_functions(); ++i) {
@@ -311,13 +450,73 @@ namespace FEM2A {
         }
     }
 
+    void assemble_elementary_matrices(
+        const ElementMapping& elt_mapping,
+        const ShapeFunctions& reference_functions,
+        const Quadrature& quadrature,
+        double (*coefficient)(vertex),
+        DenseMatrix& Ke,
+        DenseMatrix& Me )
+    {
+        if( verbose_calls ) std::cout << "compute elementary matrices (stiffness and mass)" << '\n';
+        const int nb_functions = reference_functions.nb_functions();
+        Ke.set_size(nb_functions, nb_functions);
+        Me.set_size(nb_functions, nb_functions);
+        for (int i = 0; i < nb_functions; ++i) {
+        	for (int j = 0; j < nb_functions; ++j) {
+        		Ke.set(i, j, 0.);
+        		Me.set(i, j, 0.);
+        	}
+        }
+        // la jacobienne n'est calculée qu'une fois par point de Gauss
+        for (int k = 0; k < quadrature.nb_points(); ++k) {
+        	vertex ptg_q = quadrature.point(k);
+        	DenseMatrix inv_J = elt_mapping.jacobian_matrix(ptg_q).invert_2x2().transpose();
+        	const double w_det = quadrature.weight(k) * elt_mapping.jacobian(ptg_q);
+        	const double k_q = coefficient(elt_mapping.transform(ptg_q));
+        	for (int i = 0; i < nb_functions; ++i) {
+        		vec2 grad_i = inv_J.mult_2x2_2(reference_functions.evaluate_grad(i, ptg_q));
+        		const double phi_i = reference_functions.evaluate(i, ptg_q);
+        		for (int j = 0; j < nb_functions; ++j) {
+        			vec2 grad_j = inv_J.mult_2x2_2(reference_functions.evaluate_grad(j, ptg_q));
+        			Ke.add(i, j, w_det * k_q * dot(grad_i, grad_j));
+        			Me.add(i, j, w_det * phi_i * reference_functions.evaluate(j, ptg_q));
+        		}
+        	}
+        }
+    }
+
+    void assemble_p1_poisson(
+        const Mesh& M,
+        double (*coefficient)(vertex),
+        double (*source)(vertex),
+        SparseMatrix& K,
+        std::vector< double >& F )
+    {
+        F.assign(M.nb_vertices(), 0.);
+        ShapeFunctions shape_f_triangle(2, 1);
+        Quadrature quad = Quadrature::get_quadrature(2);
+        for (int triangle = 0; triangle < M.nb_triangles(); ++triangle) {
+        	ElementMapping mapping(M, false, triangle);
+        	DenseMatrix Ke;
+        	assemble_elementary_matrix(mapping, shape_f_triangle, quad, coefficient, Ke);
+        	local_to_global_matrix(M, triangle, Ke, K);
+        	if ( source != NULL ) {
+        		std::vector< double > Fe(shape_f_triangle.nb_functions(), 0.);
+        		assemble_elementary_vector(mapping, shape_f_triangle, quad, source, Fe);
+        		local_to_global_vector(M, false, triangle, Fe, F);
+        	}
+        }
+    }
+
     void local_to_global_matrix(
         const Mesh& M,
         int t,
         const DenseMatrix& Ke,
         SparseMatrix& K )
     {
-        std::cout << "Ke -> K" << '\n';
+        ScopedTimer timer( "scatter" ) ;
+        if( verbose_calls ) std::cout << "Ke -> K" << '\n';
         // taille de K est le nbre de points d'interpolation globale, ie nbre de points du maillage
         for (int ligne = 0; ligne < Ke.height(); ++ligne){
         	// parcours de la matrice Ke sur ses lignes et colonnes et récupération des indices
@@ -329,6 +528,21 @@ namespace FEM2A {
         }
     }
     
+    void local_to_global_matrix(
+        const DofNumbering& dofs,
+        int t,
+        const DenseMatrix& Ke,
+        SparseMatrix& K )
+    {
+        ScopedTimer timer( "scatter" ) ;
+        for (int ligne = 0; ligne < Ke.height(); ++ligne) {
+        	int i = dofs.get_triangle_dof_index(t, ligne);
+        	for (int colonne = 0; colonne < Ke.width(); ++colonne) {
+        		K.add(i, dofs.get_triangle_dof_index(t, colonne), Ke.get(ligne, colonne));
+        	}
+        }
+    }
+
     void assemble_elementary_vector(
         const ElementMapping& elt_mapping,
         const ShapeFunctions& reference_functions,
@@ -336,13 +550,13 @@ namespace FEM2A {
         double (*source)(vertex),
         std::vector< double >& Fe )
     {
-        std::cout << "compute elementary vector (source term)" << '\n';
+        if( verbose_calls ) std::cout << "compute elementary vector (source term)" << '\n';
         for (int i = 0; i < reference_functions.nb_functions(); ++i) {
         	for (int k = 0; k < quadrature.nb_points(); ++k) {
         		const vertex ptg_q = quadrature.point(k);
         		//On redimensionne Fe et on la rempli avec 0 au début puis avec les valeurs de la boucle
         		Fe[i] += quadrature.weight(k) * source(elt_mapping.transform(ptg_q)) * reference_functions.evaluate(i, ptg_q) * elt_mapping.jacobian(ptg_q);
-        		std::cout << "Calcul de la somme" << '\n';
+        		if( verbose_calls ) std::cout << "Calcul de la somme" << '\n';
         	}
         }
     }
@@ -355,7 +569,7 @@ namespace FEM2A {
         double (*neumann)(vertex),
         std::vector< double >& Fe )
     {
-        std::cout << "compute elementary vector (neumann condition)" << '\n';
+        if( verbose_calls ) std::cout << "compute elementary vector (neumann condition)" << '\n';
         // TODO
     }
 
@@ -366,7 +580,8 @@ namespace FEM2A {
         std::vector< double >& Fe,
         std::vector< double >& F )
     {
-        std::cout << "Fe -> F" << '\n';
+        ScopedTimer timer( "scatter" ) ;
+        if( verbose_calls ) std::cout << "Fe -> F" << '\n';
         
         // condition d'un segment
         if (border) {
@@ -384,6 +599,39 @@ namespace FEM2A {
         }
     }
     
+    void local_to_global_vector(
+        const DofNumbering& dofs,
+        bool border,
+        int i,
+        std::vector< double >& Fe,
+        std::vector< double >& F )
+    {
+        ScopedTimer timer( "scatter" ) ;
+        for (int ligne = 0; ligne < Fe.size(); ++ligne) {
+        	const int d = border ? dofs.get_edge_dof_index(i, ligne)
+        		: dofs.get_triangle_dof_index(i, ligne);
+        	F[d] += Fe[ligne];
+        }
+    }
+
+    void dirichlet_vertices(
+        const Mesh& M,
+        const std::vector< bool >& attribute_is_dirichlet,
+        std::vector< int >& vertices )
+    {
+        vertices.clear();
+        std::vector< bool > processed(M.nb_vertices(), false);
+        for (int edge = 0; edge < M.nb_edges(); ++edge) {
+        	if ( !attribute_is_dirichlet[M.get_edge_attribute(edge)] ) continue;
+        	for (int n = 0; n < 2; ++n) {
+        		const int v = M.get_edge_vertex_index(edge, n);
+        		if ( processed[v] ) continue;
+        		processed[v] = true;
+        		vertices.push_back(v);
+        	}
+        }
+    }
+
     void apply_dirichlet_boundary_conditions(
         const Mesh& M,
         const std::vector< bool >& attribute_is_dirichlet, /* size: nb of attributes */
@@ -391,25 +639,38 @@ namespace FEM2A {
         SparseMatrix& K,
         std::vector< double >& F )
     {
-        std::cout << "apply dirichlet boundary conditions" << '\n';
-        std::vector<bool> processed_vertices(values.size(), false);
-        double penalty_coefficient = 10000.;
-        
-       // parcours de chaque segment
+        ScopedTimer timer( "boundary conditions" ) ;
+        if( verbose_calls ) std::cout << "apply dirichlet boundary conditions" << '\n';
+        // sommets des segments de Dirichlet, chacun traité une seule fois
+        std::vector< int > vertices;
+        dirichlet_vertices(M, attribute_is_dirichlet, vertices);
+        for (int k = 0; k < vertices.size(); ++k) {
+        	const int vertex_index = vertices[k];
+        	K.add(vertex_index, vertex_index, dirichlet_penalty);
+        	F[vertex_index] += dirichlet_penalty * values[vertex_index];
+        }
+    }
+
+    void apply_dirichlet_boundary_conditions(
+        const Mesh& M,
+        const DofNumbering& dofs,
+        const std::vector< bool >& attribute_is_dirichlet,
+        const std::vector< double >& values,
+        SparseMatrix& K,
+        std::vector< double >& F )
+    {
+        ScopedTimer timer( "boundary conditions" ) ;
+        std::vector<bool> processed_dofs(values.size(), false);
+        const int nb_edge_dofs = dofs.order() == 2 ? 3 : 2;
         for (int edge = 0; edge < M.nb_edges(); ++edge) {
-        	int edge_attribute = M.get_edge_attribute(edge);
-        	if ( attribute_is_dirichlet[edge_attribute] ) {
-        		// parcours de chaque noued de chaque segment
-        		for (int n = 0; n < 2; ++n){
-      				// application de la condition de Dirichlet
-        			int vertex_index = M.get_edge_vertex_index(edge,n);
-        			// condition de vérification qu'un noeud est traité qu'une seule fois
-        			if ( !processed_vertices[vertex_index] ) {
-        				processed_vertices[vertex_index] = true;
-        				K.add(vertex_index, vertex_index, penalty_coefficient);
-        				F[vertex_index] += penalty_coefficient * values[vertex_index];
-        			}
-        		}
+        	if ( !attribute_is_dirichlet[M.get_edge_attribute(edge)] ) continue;
+        	// les deux sommets, et le milieu en P2
+        	for (int n = 0; n < nb_edge_dofs; ++n) {
+        		const int d = dofs.get_edge_dof_index(edge, n);
+        		if ( processed_dofs[d] ) continue;
+        		processed_dofs[d] = true;
+        		K.add(d, d, dirichlet_penalty);
+        		F[d] += dirichlet_penalty * values[d];
         	}
         }
     }
@@ -424,7 +685,7 @@ namespace FEM2A {
             std::vector<double>& solution,
             int verbose )
     {
-        std::cout << "solve poisson problem" << '\n';
+        if( verbose_calls ) std::cout << "solve poisson problem" << '\n';
         // TODO
     }
 
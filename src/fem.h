@@ -10,6 +10,14 @@
 
 namespace FEM2A {
 
+    /**
+     * \brief Turns on (the default) or off the messages printed at each
+     *        call by the functions below ("Ke -> K", "[ElementMapping]
+     *        ...", ...). The warnings are always printed.
+     */
+    void set_fem_verbose( bool verbose ) ;
+    bool fem_verbose() ;
+
     /**
      * \brief Structure used to store a quadrature, which is a set of
      *        weights and points.
@@ -100,7 +108,12 @@ namespace FEM2A {
      * \brief ShapeFunctions is a class that defines the interpolation
      *        functions on the reference triangle (if dim == 2) or on
      *        the reference segment (if dim == 1).
-     *        Only defined for order 1 -> The functions are linear.
+     *        Order 1: the functions are linear (one per vertex).
+     *        Order 2: the functions are quadratic, the vertex functions
+     *        come first, then the functions of the middles of the edges
+     *        (3 + k is the middle of the edge (k, k+1) of the triangle,
+     *        2 the middle of the segment). Use a quadrature of order 4
+     *        with them.
      *        Reference elements:
      *          segment: [0,1]
      *          triangle: (0,0) (1,0) (0,1)
@@ -110,13 +123,14 @@ namespace FEM2A {
             /**
              * \brief Constructor of the ShapeFunctions
              * \param dim 1 for reference segment, 2 for reference triangle
-             * \param order Should be 1 (linear functions only)
+             * \param order 1 (linear functions) or 2 (quadratic functions)
              */
             ShapeFunctions( int dim, int order );
 
             /**
              * \brief Number of shape functions
-             * \return 2 if segment, 3 if triangle
+             * \return 2 if segment, 3 if triangle (order 1),
+             *         3 if segment, 6 if triangle (order 2)
              */
             int nb_functions() const ;
 
@@ -143,6 +157,57 @@ namespace FEM2A {
             int order_ ;
     } ;
 
+    /**
+     * \brief DofNumbering numbers the degrees of freedom of the P1 or P2
+     *        Lagrange elements of a mesh. The DOFs of the vertices keep
+     *        their index, the P2 DOFs of the middles of the edges come
+     *        after them, in the order refine_uniformly() creates its
+     *        middle points: a P2 field is then the P1 field of the
+     *        uniformly refined mesh with the same values (used to save
+     *        it for Medit).
+     */
+    class DofNumbering {
+        public:
+            /**
+             * \param M The mesh
+             * \param order 1 or 2
+             */
+            DofNumbering( const Mesh& M, int order ) ;
+
+            int order() const ;
+            int nb_dofs() const ;
+
+            /**
+             * \param t The index of the triangle
+             * \param local_index The index of the shape function of
+             *                    the triangle (< 3 or 6)
+             * \return the index of the DOF
+             */
+            int get_triangle_dof_index( int t, int local_index ) const ;
+
+            /**
+             * \param e The index of the edge
+             * \param local_index The index of the shape function of
+             *                    the segment (< 2 or 3)
+             * \return the index of the DOF
+             */
+            int get_edge_dof_index( int e, int local_index ) const ;
+
+            /**
+             * \return the position of the DOF d (a vertex or the middle
+             *         of an edge)
+             */
+            vertex get_dof_position( int d ) const ;
+
+        private:
+            int order_ ;
+            int nb_triangle_dofs_ ;
+            int nb_edge_dofs_ ;
+            std::vector< int > triangle_dofs_ ;
+            std::vector< int > edge_dofs_ ;
+            std::vector< vertex > positions_ ;
+    } ;
+
     /****************************/
     /* Finite Element functions */
     /****************************/
@@ -166,6 +231,51 @@ namespace FEM2A {
         double (*coefficient)(vertex),
         DenseMatrix& Ke ) ;
 
+    /**
+     * \brief Computes the elementary stiffness matrix Ke and the
+     *        elementary mass matrix Me (Me_ij = integral of phi_i phi_j)
+     *        of a triangle in the same loop on the quadrature points,
+     *        for the transient problems.
+     *
+     * \param[in] elt_mapping The mapping of the considered triangle
+     * \param[in] reference_functions The shape functions on the
+                                      reference triangle
+     * \param[in] quadrature The quadrature on the reference triangle,
+     *                       of order 2 at least for Me to be exact
+     * \param[in] coefficient The function associated to the diffusion
+     *                        coefficient k(x,y)
+     * \param[out] Ke The stiffness matrix
+     * \param[out] Me The mass matrix
+     */
+    void assemble_elementary_matrices(
+        const ElementMapping& elt_mapping,
+        const ShapeFunctions& reference_functions,
+        const Quadrature& quadrature,
+        double (*coefficient)(vertex),
+        DenseMatrix& Ke,
+        DenseMatrix& Me ) ;
+
+    /**
+     * \brief Assembles the global stiffness matrix K and right-hand side
+     *        F of the Poisson problem -div(k grad u) = f with P1
+     *        elements (the element loop of the problems, the multigrid
+     *        levels, the adaptive loop...). The Dirichlet conditions
+     *        are left to apply_dirichlet_boundary_conditions().
+     *
+     * \param[in] M The mesh
+     * \param[in] coefficient The diffusion coefficient k(x,y)
+     * \param[in] source The source term f(x,y), NULL for f = 0
+     * \param[in,out] K The global matrix (of size M.nb_vertices()),
+     *                  the element contributions are added to it
+     * \param[out] F The global right-hand side
+     */
+    void assemble_p1_poisson(
+        const Mesh& M,
+        double (*coefficient)(vertex),
+        double (*source)(vertex),
+        SparseMatrix& K,
+        std::vector< double >& F ) ;
+
     /**
      * \brief  Adds the contribution Ke of triangle t to
      *         the global matrix K.
@@ -181,6 +291,16 @@ namespace FEM2A {
         const DenseMatrix& Ke,
         SparseMatrix& K ) ;
 
+    /**
+     * \brief  Adds the contribution Ke of triangle t to the global
+     *         matrix K, the rows and columns being the DOFs of t.
+     */
+    void local_to_global_matrix(
+        const DofNumbering& dofs,
+        int t,
+        const DenseMatrix& Ke,
+        SparseMatrix& K ) ;
+
     /**
      * \brief Computes the elementary vector Fe associated to a
      *        triangle defined by its ElementMapping due to the
@@ -239,6 +359,34 @@ namespace FEM2A {
         std::vector< double >& Fe,
         std::vector< double >& F ) ;
 
+    /**
+     * \brief  Adds the contribution Fe of element i (triangle or edge)
+     *         to the global vector F, the rows being the DOFs of i.
+     */
+    void local_to_global_vector(
+        const DofNumbering& dofs,
+        bool border,
+        int i,
+        std::vector< double >& Fe,
+        std::vector< double >& F ) ;
+
+    /**
+     * \brief  Coefficient of the penalty method: a Dirichlet row i gets
+     *         K(i,i) += dirichlet_penalty and
+     *         F(i) += dirichlet_penalty * value(i).
+     */
+    const double dirichlet_penalty = 10000. ;
+
+    /**
+     * \brief  Lists the vertices of the edges whose attribute i is such
+     *         that attribute_is_dirichlet[i] = true, each one once, in
+     *         the order of the edges.
+     */
+    void dirichlet_vertices(
+        const Mesh& M,
+        const std::vector< bool >& attribute_is_dirichlet,
+        std::vector< int >& vertices ) ;
+
     /**
      * \brief  Modifies the linear system with the penalty method to
      *         apply Dirichlet boundary conditions.
@@ -258,6 +406,21 @@ namespace FEM2A {
         SparseMatrix& K,
         std::vector< double >& F ) ;
 
+    /**
+     * \brief  Same as above on all the DOFs of the Dirichlet edges
+     *         (their middle with P2 elements).
+     *
+     * \param[in] values The values imposed at the DOFs; size must be
+     *                   dofs.nb_dofs()
+     */
+    void apply_dirichlet_boundary_conditions(
+        const Mesh& M,
+        const DofNumbering& dofs,
+        const std::vector< bool >& attribute_is_dirichlet,
+        const std::vector< double >& values,
+        SparseMatrix& K,
+        std::vector< double >& F ) ;
+
     /**
      * \brief Genereal function to solve a Poisson problem with the
      *        finite element method
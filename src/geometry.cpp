@@ -0,0 +1,137 @@
+#include "geometry.h"
+
+#include <assert.h>
+#include <cmath>
+
+namespace FEM2A {
+
+    /* gradients of the P1 shape functions on the reference triangle */
+    static const double reference_grad_x[3] = { -1., 1., 0. } ;
+    static const double reference_grad_y[3] = { -1., 0., 1. } ;
+
+    /****************************************************************/
+    /* Implementation of GeometryCache */
+    /****************************************************************/
+
+    GeometryCache::GeometryCache()
+    {
+
+    }
+
+    GeometryCache::GeometryCache( const Mesh& mesh )
+    {
+        compute( mesh ) ;
+    }
+
+    void GeometryCache::compute( const Mesh& mesh )
+    {
+        const int nt = mesh.nb_triangles() ;
+        det_.resize( nt ) ;
+        inv_jt_xx_.resize( nt ) ;
+        inv_jt_xy_.resize( nt ) ;
+        inv_jt_yx_.resize( nt ) ;
+        inv_jt_yy_.resize( nt ) ;
+        centroid_x_.resize( nt ) ;
+        centroid_y_.resize( nt ) ;
+        if( nt == 0 ) return ;
+
+        /* gather the vertices (the edge vectors go in the J^-T arrays
+         * and the first vertex in the centroid ones), then compute the
+         * factors with a loop on contiguous arrays only */
+        double* jxx = &inv_jt_xx_[0] ;
+        double* jxy = &inv_jt_xy_[0] ;
+        double* jyx = &inv_jt_yx_[0] ;
+        double* jyy = &inv_jt_yy_[0] ;
+        double* cx = &centroid_x_[0] ;
+        double* cy = &centroid_y_[0] ;
+        double* det = &det_[0] ;
+#pragma omp parallel for schedule( static )
+        for( int t = 0; t < nt; ++t ) {
+            const vertex p0 = mesh.get_triangle_vertex( t, 0 ) ;
+            const vertex p1 = mesh.get_triangle_vertex( t, 1 ) ;
+            const vertex p2 = mesh.get_triangle_vertex( t, 2 ) ;
+            jxx[t] = p1.x - p0.x ;
+            jxy[t] = p2.x - p0.x ;
+            jyx[t] = p1.y - p0.y ;
+            jyy[t] = p2.y - p0.y ;
+            cx[t] = p0.x + p1.x + p2.x ;
+            cy[t] = p0.y + p1.y + p2.y ;
+        }
+#pragma omp parallel for simd schedule( static )
+        for( int t = 0; t < nt; ++t ) {
+            const double a = jxx[t] ;   /* J = [a b; c d] */
+            const double b = jxy[t] ;
+            const double c = jyx[t] ;
+            const double d = jyy[t] ;
+            const double det_t = a * d - b * c ;
+            const double inv_det = 1. / det_t ;
+            det[t] = det_t ;
+            jxx[t] = d * inv_det ;      /* J^-T = [d -c; -b a] / det */
+            jxy[t] = -c * inv_det ;
+            jyx[t] = -b * inv_det ;
+            jyy[t] = a * inv_det ;
+            cx[t] *= 1. / 3. ;
+            cy[t] *= 1. / 3. ;
+        }
+    }
+
+    int GeometryCache::nb_triangles() const
+    {
+        return det_.size() ;
+    }
+
+    double GeometryCache::area( int t ) const
+    {
+        return 0.5 * std::fabs( det_[t] ) ;
+    }
+
+    vec2 GeometryCache::map_gradient( int t, vec2 g_r ) const
+    {
+        vec2 g ;
+        g.x = inv_jt_xx_[t] * g_r.x + inv_jt_xy_[t] * g_r.y ;
+        g.y = inv_jt_yx_[t] * g_r.x + inv_jt_yy_[t] * g_r.y ;
+        return g ;
+    }
+
+    vec2 GeometryCache::p1_gradient( int t, double u0, double u1, double u2 ) const
+    {
+        vec2 g_r ;
+        g_r.x = u1 - u0 ;
+        g_r.y = u2 - u0 ;
+        return map_gradient( t, g_r ) ;
+    }
+
+    void GeometryCache::p1_stiffness( int t, double k, double Ke[9] ) const
+    {
+        double gx[3], gy[3] ;
+        for( int i = 0; i < 3; ++i ) {
+            gx[i] = inv_jt_xx_[t] * reference_grad_x[i] + inv_jt_xy_[t] * reference_grad_y[i] ;
+            gy[i] = inv_jt_yx_[t] * reference_grad_x[i] + inv_jt_yy_[t] * reference_grad_y[i] ;
+        }
+        const double factor = k * area( t ) ;
+        for( int i = 0; i < 3; ++i ) {
+            for( int j = 0; j < 3; ++j ) {
+                Ke[3 * i + j] = factor * ( gx[i] * gx[j] + gy[i] * gy[j] ) ;
+            }
+        }
+    }
+
+    void GeometryCache::p1_mass( int t, double Me[9] ) const
+    {
+        const double factor = area( t ) / 12. ;
+        for( int i = 0; i < 3; ++i ) {
+            for( int j = 0; j < 3; ++j ) {
+                Me[3 * i + j] = ( i == j ? 2. : 1. ) * factor ;
+            }
+        }
+    }
+
+    void GeometryCache::p1_load( int t, double f, double Fe[3] ) const
+    {
+        const double value = f * area( t ) / 3. ;
+        Fe[0] = value ;
+        Fe[1] = value ;
+        Fe[2] = value ;
+    }
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <vector>
+
+namespace FEM2A {
+
+    /**
+     * \brief GeometryCache stores the geometric factors of the affine
+     *        mapping of every triangle of a mesh, computed once:
+     *          det_[t]         det J
+     *          inv_jt_xx_[t].. the entries of J^-T (row by row)
+     *          centroid_x_[t], centroid_y_[t]
+     *        where J = [x1 - x0, x2 - x0; y1 - y0, y2 - y0] is the
+     *        jacobian of ElementMapping. The arrays are stored by field
+     *        (structure of arrays), so the kernels looping on the
+     *        triangles read contiguous memory and can be vectorized.
+     *
+     * With P1 elements the gradients are constant on each triangle, so
+     * the stiffness and the mass matrices and the gradients of a field
+     * need no quadrature: the kernels below are exact, the coefficients
+     * and the sources being constant on the triangle (e.g. per region).
+     */
+    struct GeometryCache {
+
+        /* Methods */
+        GeometryCache() ;
+        explicit GeometryCache( const Mesh& mesh ) ;
+
+        /**
+         * \brief Computes the factors of all the triangles of the mesh,
+         *        in a parallel pass.
+         */
+        void compute( const Mesh& mesh ) ;
+
+        int nb_triangles() const ;
+
+        /**
+         * \return the area |det J| / 2 of the triangle t
+         */
+        double area( int t ) const ;
+
+        /**
+         * \return the gradient J^-T g_r of a function whose gradient
+         *         on the reference triangle is g_r
+         */
+        vec2 map_gradient( int t, vec2 g_r ) const ;
+
+        /**
+         * \return the (constant) gradient of the P1 field with the
+         *         values u0, u1, u2 at the vertices of the triangle t
+         */
+        vec2 p1_gradient( int t, double u0, double u1, double u2 ) const ;
+
+        /**
+         * \brief Ke[3 i + j] = k int_T grad phi_i . grad phi_j
+         */
+        void p1_stiffness( int t, double k, double Ke[9] ) const ;
+
+        /**
+         * \brief Me[3 i + j] = int_T phi_i phi_j
+         */
+        void p1_mass( int t, double Me[9] ) const ;
+
+        /**
+         * \brief Fe[i] = f int_T phi_i
+         */
+        void p1_load( int t, double f, double Fe[3] ) const ;
+
+        /* Data */
+        std::vector< double > det_ ;
+        std::vector< double > inv_jt_xx_ ;
+        std::vector< double > inv_jt_xy_ ;
+        std::vector< double > inv_jt_yx_ ;
+        std::vector< double > inv_jt_yy_ ;
+        std::vector< double > centroid_x_ ;
+        std::vector< double > centroid_y_ ;
+    } ;
+
+}
@@ -0,0 +1,189 @@
+#include "gmg.h"
+
+#include <assert.h>
+#include <iostream>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+namespace FEM2A {
+
+    /**
+     * \brief Assembles K and F of the Poisson problem on a mesh, then
+     *        applies the Dirichlet conditions.
+     */
+    static void assemble_level(
+        const Mesh& M,
+        double (*coefficient)(vertex),
+        double (*source)(vertex),
+        double (*dirichlet_fct)(vertex),
+        const std::vector< bool >& attribute_is_dirichlet,
+        SparseMatrix& K,
+        std::vector< double >& F )
+    {
+        assemble_p1_poisson( M, coefficient, source, K, F ) ;
+        std::vector< double > values( M.nb_vertices() ) ;
+        for( int v = 0; v < M.nb_vertices(); ++v ) {
+            values[v] = dirichlet_fct( M.get_vertex( v ) ) ;
+        }
+        apply_dirichlet_boundary_conditions( M, attribute_is_dirichlet, values, K, F ) ;
+    }
+
+    /**
+     * \return the P1 interpolation from a mesh to its uniform refinement,
+     *         given the parents of each fine vertex
+     */
+    static CSRMatrix interpolation( const std::vector< int >& parents )
+    {
+        const int n = parents.size() / 2 ;
+        CSRMatrix P ;
+        P.row_ptr_.assign( n + 1, 0 ) ;
+        for( int v = 0; v < n; ++v ) {
+            const int a = std::min( parents[2 * v], parents[2 * v + 1] ) ;
+            const int b = std::max( parents[2 * v], parents[2 * v + 1] ) ;
+            if( a == b ) {
+                P.col_.push_back( a ) ;
+                P.val_.push_back( 1. ) ;
+            } else {
+                P.col_.push_back( a ) ;
+                P.val_.push_back( 0.5 ) ;
+                P.col_.push_back( b ) ;
+                P.val_.push_back( 0.5 ) ;
+            }
+            P.row_ptr_[v + 1] = P.col_.size() ;
+        }
+        P.update_diagonal() ;
+        return P ;
+    }
+
+    /****************************************************************/
+    /* Implementation of GeometricMultigrid */
+    /****************************************************************/
+
+    GeometricMultigrid::GeometricMultigrid(
+        const Mesh& coarse_mesh,
+        int nb_refinements,
+        double (*coefficient)(vertex),
+        double (*source)(vertex),
+        double (*dirichlet_fct)(vertex),
+        const std::vector< bool >& attribute_is_dirichlet,
+        bool chebyshev,
+        int smoothing_steps )
+        : MultigridPreconditioner( chebyshev, smoothing_steps )
+    {
+        name_ = "GMG" ;
+
+        /* meshes from the coarsest to the finest */
+        std::vector< Mesh > meshes( nb_refinements + 1 ) ;
+        std::vector< std::vector< int > > parents( nb_refinements ) ;
+        meshes[0] = coarse_mesh ;
+        for( int r = 0; r < nb_refinements; ++r ) {
+            meshes[r].refine_uniformly( meshes[r + 1], parents[r] ) ;
+        }
+
+        /* levels from the finest to the coarsest */
+        meshes_.assign( meshes.rbegin(), meshes.rend() ) ;
+        rhs_.resize( meshes_.size() ) ;
+        for( int l = 0; l < meshes_.size(); ++l ) {
+            SparseMatrix K( meshes_[l].nb_vertices() ) ;
+            assemble_level( meshes_[l], coefficient, source, dirichlet_fct,
+                attribute_is_dirichlet, K, rhs_[l] ) ;
+            add_level( CSRMatrix( K ) ) ;
+            if( l > 0 ) {
+                set_prolongation( l - 1, interpolation( parents[nb_refinements - l] ) ) ;
+            }
+        }
+        factorize_coarsest() ;
+    }
+
+    const Mesh& GeometricMultigrid::mesh( int l ) const
+    {
+        return meshes_[l] ;
+    }
+
+    const CSRMatrix& GeometricMultigrid::matrix( int l ) const
+    {
+        return levels_[l].A ;
+    }
+
+    const std::vector< double >& GeometricMultigrid::rhs( int l ) const
+    {
+        return rhs_[l] ;
+    }
+
+    void GeometricMultigrid::full_multigrid( std::vector< double >& x, int nb_cycles ) const
+    {
+        const int coarsest = levels_.size() - 1 ;
+        levels_[coarsest].b = rhs_[coarsest] ;
+        cycle( coarsest ) ;
+        x = levels_[coarsest].x ;
+
+        std::vector< double > x_fine ;
+        for( int l = coarsest - 1; l >= 0; --l ) {
+            const Level& level = levels_[l] ;
+            level.P.mult( x, x_fine ) ;
+            for( int c = 0; c < nb_cycles; ++c ) {
+                level.A.mult( x_fine, level.b ) ;
+                for( int i = 0; i < x_fine.size(); ++i ) {
+                    level.b[i] = rhs_[l][i] - level.b[i] ;
+                }
+                cycle( l ) ;
+                for( int i = 0; i < x_fine.size(); ++i ) {
+                    x_fine[i] += level.x[i] ;
+                }
+            }
+            x.swap( x_fine ) ;
+        }
+    }
+
+    bool GeometricMultigrid::solve( std::vector< double >& x,
+        const SolverOptions& options, SolveReport* report, bool use_fmg ) const
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        const std::vector< double >& F = rhs_[0] ;
+        const int n = F.size() ;
+        if( use_fmg ) {
+            full_multigrid( x, 1 ) ;
+        } else {
+            x.assign( n, 0. ) ;
+        }
+
+        const Level& fine = levels_[0] ;
+        const double F_norm = std::sqrt( dot( F, F ) ) ;
+        std::vector< double > history ;
+        double error = 0. ;
+        int it = 0 ;
+        while( true ) {
+            fine.A.mult( x, fine.b ) ;
+            for( int i = 0; i < n; ++i ) {
+                fine.b[i] = F[i] - fine.b[i] ;
+            }
+            error = F_norm > 0. ? std::sqrt( dot( fine.b, fine.b ) ) / F_norm : 0. ;
+            history.push_back( error ) ;
+            if( options.verbose ) {
+                std::cout << "  V-cycle " << it << " ||F-Kx||/||F|| = " << error << std::endl ;
+            }
+            if( error <= options.threshold || it >= options.max_iterations ) break ;
+            cycle( 0 ) ;
+            for( int i = 0; i < n; ++i ) {
+                x[i] += fine.x[i] ;
+            }
+            ++it ;
+        }
+
+        const double elapsed = std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+        const bool converged = error <= options.threshold ;
+        if( report != NULL ) {
+            report->converged = converged ;
+            report->nb_iterations = it ;
+            report->error = error ;
+            report->elapsed_time = elapsed ;
+            report->gflops = elapsed > 0. ? flops() * it / ( elapsed * 1e9 ) : 0. ;
+            report->residual_history.swap( history ) ;
+        }
+        return converged ;
+    }
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "mesh.h"
+#include "fem.h"
+#include "amg.h"
+
+#include <vector>
+
+namespace FEM2A {
+
+    /**
+     * \brief GeometricMultigrid solves a Poisson problem on a hierarchy
+     *        of nested meshes obtained by uniform refinement of a coarse
+     *        mesh. K and F are assembled on each level with the element
+     *        routines of fem.h, and the P1 interpolation from a mesh to
+     *        its refinement is used as prolongation (its transpose as
+     *        restriction).
+     *
+     * It can be used as a preconditioner (one V-cycle, see
+     * MultigridPreconditioner), as a stand-alone V-cycle iteration, or
+     * with full multigrid (FMG) which reaches the discretization accuracy
+     * with a few V-cycles per level, in O(N) work.
+     */
+    class GeometricMultigrid : public MultigridPreconditioner {
+        public:
+            /**
+             * \brief Refines the coarse mesh and assembles each level.
+             *
+             * \param coarse_mesh The coarsest mesh, with its attributes set
+             * \param nb_refinements Number of uniform refinements
+             * \param coefficient The diffusion coefficient k(x,y)
+             * \param source The source term f(x,y)
+             * \param dirichlet_fct The value imposed on the Dirichlet edges
+             * \param attribute_is_dirichlet See apply_dirichlet_boundary_conditions()
+             * \param chebyshev see MultigridPreconditioner
+             * \param smoothing_steps see MultigridPreconditioner
+             */
+            GeometricMultigrid(
+                const Mesh& coarse_mesh,
+                int nb_refinements,
+                double (*coefficient)(vertex),
+                double (*source)(vertex),
+                double (*dirichlet_fct)(vertex),
+                const std::vector< bool >& attribute_is_dirichlet,
+                bool chebyshev,
+                int smoothing_steps ) ;
+
+            /**
+             * \param l Level index, 0 is the finest
+             */
+            const Mesh& mesh( int l ) const ;
+            const CSRMatrix& matrix( int l ) const ;
+            const std::vector< double >& rhs( int l ) const ;
+
+            /**
+             * \brief Full multigrid: solves the coarsest problem, then on
+             *        each finer level interpolates the solution and
+             *        improves it with nb_cycles V-cycles.
+             * \param[out] x The solution on the finest mesh
+             * \param[in] nb_cycles Number of V-cycles per level
+             */
+            void full_multigrid( std::vector< double >& x, int nb_cycles ) const ;
+
+            /**
+             * \brief Solves the finest problem with V-cycles until
+             *        ||F - Kx||/||F|| <= options.threshold.
+             * \param[out] x The solution on the finest mesh
+             * \param[in] options threshold, max_iterations and verbose are used
+             * \param[out] report if not NULL, filled with the statistics
+             * \param[in] use_fmg Start from the full multigrid solution
+             *                    (one V-cycle per level) instead of zero
+             * \return true if the iteration has converged
+             */
+            bool solve( std::vector< double >& x, const SolverOptions& options,
+                SolveReport* report, bool use_fmg = true ) const ;
+
+        private:
+            std::vector< Mesh > meshes_ ;
+            std::vector< std::vector< double > > rhs_ ;
+    } ;
+
+}
@@ -0,0 +1,212 @@
+#include "heat.h"
+
+#include <assert.h>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cmath>
+#include <chrono>
+
+namespace FEM2A {
+
+    /**
+     * \return options, with SOLVER_CHOLESKY instead of SOLVER_DEFAULT
+     */
+    static SolverOptions heat_solver_options( const SolverOptions& options )
+    {
+        SolverOptions heat_options = options ;
+        if( heat_options.solver == SOLVER_DEFAULT ) {
+            heat_options.solver = SOLVER_CHOLESKY ;
+        }
+        heat_options.verbose = false ;
+        return heat_options ;
+    }
+
+    /****************************************************************/
+    /* Implementation of HeatSolver */
+    /****************************************************************/
+
+    HeatSolver::HeatSolver( const Mesh& mesh,
+        double (*conductivity)(vertex),
+        double (*source)(vertex),
+        double (*dirichlet_fct)(vertex),
+        const std::vector< bool >& attribute_is_dirichlet,
+        double dt, double theta,
+        const SolverOptions& options )
+        : mesh_( mesh ), dt_( dt ), theta_( theta ), time_( 0. ), nb_steps_( 0 ),
+        A_( mesh.nb_vertices() ), session_( heat_solver_options( options ) ),
+        snapshots_( 1, 1 ),
+        setup_time_( 0. ), step_time_( 0. ), nb_iterations_( 0 )
+    {
+        assert( dt > 0. && theta >= 0. && theta <= 1. ) ;
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        const int n = mesh.nb_vertices() ;
+
+        /* K, M and F in a single loop on the triangles */
+        SparseMatrix K( n ), M( n ) ;
+        std::vector< double > F( n, 0. ) ;
+        ShapeFunctions shape_f_triangle( 2, 1 ) ;
+        Quadrature quad = Quadrature::get_quadrature( 2 ) ;
+        for( int t = 0; t < mesh.nb_triangles(); ++t ) {
+            ElementMapping mapping( mesh, false, t ) ;
+            DenseMatrix Ke, Me ;
+            assemble_elementary_matrices( mapping, shape_f_triangle, quad,
+                conductivity, Ke, Me ) ;
+            local_to_global_matrix( mesh, t, Ke, K ) ;
+            local_to_global_matrix( mesh, t, Me, M ) ;
+            std::vector< double > Fe( shape_f_triangle.nb_functions(), 0. ) ;
+            assemble_elementary_vector( mapping, shape_f_triangle, quad, source, Fe ) ;
+            local_to_global_vector( mesh, false, t, Fe, F ) ;
+        }
+
+        /* A = M + theta dt K and R = M - (1 - theta) dt K, on the same pattern */
+        const CSRMatrix K_csr( K ), M_csr( M ) ;
+        assert( K_csr.col_ == M_csr.col_ ) ;
+        R_ = M_csr ;
+        for( int k = 0; k < R_.nnz(); ++k ) {
+            R_.val_[k] -= ( 1. - theta ) * dt * K_csr.val_[k] ;
+        }
+        for( int i = 0; i < n; ++i ) {
+            for( int k = M_csr.row_ptr_[i]; k < M_csr.row_ptr_[i + 1]; ++k ) {
+                A_.add( i, M_csr.col_[k], M_csr.val_[k] + theta * dt * K_csr.val_[k] ) ;
+            }
+        }
+
+        /* Dirichlet penalty, as apply_dirichlet_boundary_conditions() but
+         * scaled by dt */
+        dirichlet_vertices( mesh, attribute_is_dirichlet, dirichlet_vertices_ ) ;
+        dirichlet_values_.resize( dirichlet_vertices_.size() ) ;
+        for( int d = 0; d < dirichlet_vertices_.size(); ++d ) {
+            dirichlet_values_[d] = dirichlet_fct( mesh.get_vertex( dirichlet_vertices_[d] ) ) ;
+        }
+        constant_rhs_.resize( n ) ;
+        for( int i = 0; i < n; ++i ) constant_rhs_[i] = dt * F[i] ;
+        for( int d = 0; d < dirichlet_vertices_.size(); ++d ) {
+            const int v = dirichlet_vertices_[d] ;
+            A_.add( v, v, dt * dirichlet_penalty ) ;
+            constant_rhs_[v] += dt * dirichlet_penalty * dirichlet_values_[d] ;
+        }
+
+        /* factorization (or preconditioner) computed once for all the steps */
+        if( !session_.set_matrix( A_ ) ) {
+            std::cout << "HeatSolver: the setup of the linear solver failed" << std::endl ;
+        }
+        u_.assign( n, 0. ) ;
+        setup_time_ = std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+    }
+
+    HeatSolver::~HeatSolver()
+    {
+        flush() ;
+    }
+
+    void HeatSolver::set_initial_condition( double (*initial_fct)(vertex) )
+    {
+        for( int v = 0; v < u_.size(); ++v ) {
+            u_[v] = initial_fct( mesh_.get_vertex( v ) ) ;
+        }
+        for( int d = 0; d < dirichlet_vertices_.size(); ++d ) {
+            u_[dirichlet_vertices_[d]] = dirichlet_values_[d] ;
+        }
+        time_ = 0. ;
+        nb_steps_ = 0 ;
+        nb_iterations_ = 0 ;
+        step_time_ = 0. ;
+    }
+
+    bool HeatSolver::step()
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        /* rhs = R u_n + dt F (+ penalty), then A u_n+1 = rhs */
+        R_.mult( u_, rhs_ ) ;
+        for( int i = 0; i < rhs_.size(); ++i ) rhs_[i] += constant_rhs_[i] ;
+        SolveReport report ;
+        const bool ok = session_.solve( rhs_, u_, true, &report ) ;
+        nb_iterations_ += report.nb_iterations ;
+        time_ += dt_ ;
+        ++nb_steps_ ;
+        step_time_ += std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+        return ok ;
+    }
+
+    bool HeatSolver::run( int nb_steps, int snapshot_period,
+        const std::string& snapshot_prefix )
+    {
+        if( snapshot_period > 0 ) {
+            snapshots_.save_mesh( Mesh( mesh_ ), snapshot_prefix + ".mesh" ) ;
+        }
+        bool ok = true ;
+        for( int s = 0; s < nb_steps; ++s ) {
+            if( snapshot_period > 0 && nb_steps_ % snapshot_period == 0 ) {
+                std::ostringstream filename ;
+                filename << snapshot_prefix << "_" << std::setw( 5 )
+                    << std::setfill( '0' ) << nb_steps_ << ".bb" ;
+                save_snapshot( filename.str() ) ;
+            }
+            ok = step() && ok ;
+        }
+        return ok ;
+    }
+
+    void HeatSolver::save_snapshot( const std::string& filename )
+    {
+        snapshots_.save_solution( std::vector< double >( u_ ), filename ) ;
+    }
+
+    void HeatSolver::flush()
+    {
+        snapshots_.flush() ;
+    }
+
+    const std::vector< double >& HeatSolver::solution() const
+    {
+        return u_ ;
+    }
+
+    double HeatSolver::time() const
+    {
+        return time_ ;
+    }
+
+    int HeatSolver::nb_steps() const
+    {
+        return nb_steps_ ;
+    }
+
+    int HeatSolver::nb_vertices() const
+    {
+        return u_.size() ;
+    }
+
+    double HeatSolver::setup_time() const
+    {
+        return setup_time_ ;
+    }
+
+    double HeatSolver::step_time() const
+    {
+        return step_time_ ;
+    }
+
+    int HeatSolver::nb_iterations() const
+    {
+        return nb_iterations_ ;
+    }
+
+    void HeatSolver::print() const
+    {
+        std::cout << "Heat solver: " << nb_vertices() << " unknowns, dt = " << dt_
+            << ", theta = " << theta_ << " | setup " << setup_time_ << " s | "
+            << nb_steps_ << " steps in " << step_time_ << " s ("
+            << ( nb_steps_ > 0 ? step_time_ / nb_steps_ : 0. ) << " s/step" ;
+        if( nb_iterations_ > 0 ) {
+            std::cout << ", " << double( nb_iterations_ ) / nb_steps_ << " it/step" ;
+        }
+        std::cout << ")" << std::endl ;
+    }
+
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "mesh.h"
+#include "fem.h"
+#include "solver.h"
+#include "writer.h"
+
+#include <vector>
+#include <string>
+
+namespace FEM2A {
+
+    /**
+     * \brief HeatSolver integrates the heat equation
+     *          du/dt - div(k grad u) = f,  u = g on the Dirichlet edges
+     *        with P1 elements and the theta scheme
+     *          (M + theta dt K) u_n+1 = (M - (1 - theta) dt K) u_n + dt F
+     *        (theta = 1: backward Euler, theta = 1/2: Crank-Nicolson).
+     *
+     * K and the mass matrix M are assembled in the same element loop
+     * (assemble_elementary_matrices()). The system matrix is built and
+     * set up once in a SolverSession: with the default solver, it is
+     * factorized by SparseCholesky, and each step only costs a product
+     * by M - (1 - theta) dt K and two triangular solves. The native
+     * solvers keep their preconditioner and start from the previous
+     * step. The OpenNL solvers rebuild their context at each step.
+     *
+     * The Dirichlet conditions use the penalty of
+     * apply_dirichlet_boundary_conditions() multiplied by dt, so the
+     * steady state is the solution of the steady penalized problem.
+     *
+     * The snapshots are written by an AsyncWriter thread while the next
+     * steps are computed. At most one snapshot waits in its queue: the
+     * next one blocks until it is being written.
+     */
+    class HeatSolver {
+        public:
+            /**
+             * \param mesh The mesh, with the attributes of its edges set
+             * \param conductivity The diffusion coefficient k(x,y)
+             * \param source The source term f(x,y)
+             * \param dirichlet_fct The value g(x,y) on the Dirichlet edges
+             * \param attribute_is_dirichlet The Dirichlet edge attributes
+             * \param dt The time step
+             * \param theta 1 for backward Euler, 0.5 for Crank-Nicolson
+             * \param options The linear solver, SOLVER_DEFAULT selects
+             *                SOLVER_CHOLESKY
+             */
+            HeatSolver( const Mesh& mesh,
+                double (*conductivity)(vertex),
+                double (*source)(vertex),
+                double (*dirichlet_fct)(vertex),
+                const std::vector< bool >& attribute_is_dirichlet,
+                double dt, double theta,
+                const SolverOptions& options = SolverOptions() ) ;
+
+            /**
+             * \brief Waits for the pending snapshot.
+             */
+            ~HeatSolver() ;
+
+            /**
+             * \brief Sets u_0 (the Dirichlet values are imposed) and the
+             *        time to 0.
+             */
+            void set_initial_condition( double (*initial_fct)(vertex) ) ;
+
+            /**
+             * \brief Computes u_n+1 from u_n.
+             * \return false if the linear solver failed
+             */
+            bool step() ;
+
+            /**
+             * \brief Runs nb_steps steps and writes a snapshot every
+             *        snapshot_period steps (none if 0), in
+             *        <snapshot_prefix>_<step>.bb, after writing the mesh
+             *        in <snapshot_prefix>.mesh.
+             * \return false if a linear solve failed
+             */
+            bool run( int nb_steps, int snapshot_period = 0,
+                const std::string& snapshot_prefix = "heat" ) ;
+
+            /**
+             * \brief Writes (a copy of) the current solution in the
+             *        background.
+             */
+            void save_snapshot( const std::string& filename ) ;
+
+            /**
+             * \brief Waits until the pending snapshot is written.
+             */
+            void flush() ;
+
+            const std::vector< double >& solution() const ;
+            double time() const ;
+            int nb_steps() const ;
+            int nb_vertices() const ;
+
+            /**
+             * \return the time spent in the assembly and in the setup of
+             *         the linear solver (factorization), in seconds
+             */
+            double setup_time() const ;
+
+            /**
+             * \return the time spent in step(), in seconds
+             */
+            double step_time() const ;
+
+            /**
+             * \return the number of iterations of the linear solver since
+             *         the initial condition (0 with SOLVER_CHOLESKY)
+             */
+            int nb_iterations() const ;
+
+            void print() const ;
+
+        private:
+            /* not copyable */
+            HeatSolver( const HeatSolver& ) ;
+            HeatSolver& operator=( const HeatSolver& ) ;
+
+            const Mesh& mesh_ ;
+            double dt_ ;
+            double theta_ ;
+            double time_ ;
+            int nb_steps_ ;
+
+            SparseMatrix A_ ;           /* M + theta dt K + dt penalty */
+            CSRMatrix R_ ;              /* M - (1 - theta) dt K */
+            std::vector< double > constant_rhs_ ;   /* dt F + dt penalty g */
+            std::vector< int > dirichlet_vertices_ ;
+            std::vector< double > dirichlet_values_ ;
+            SolverSession session_ ;
+
+            std::vector< double > u_ ;
+            std::vector< double > rhs_ ;
+            AsyncWriter snapshots_ ;
+
+            double setup_time_ ;
+            double step_time_ ;
+            int nb_iterations_ ;
+    } ;
+
+}
@@ -1,7 +1,12 @@
 #include "mesh.h"
+#include "trace.h"
 #include <cassert>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 
 namespace FEM2A {
 
@@ -103,6 +108,238 @@ namespace FEM2A {
         return attr_max_;
     }
 
+    void Mesh::refine_uniformly( Mesh& fine, std::vector< int >& parents ) const
+    {
+        const int nv = nb_vertices();
+        fine.vertices_ = vertices_;
+        fine.vertex_attributes_ = vertex_attributes_;
+        fine.bdr_attr_max_ = bdr_attr_max_;
+        fine.attr_max_ = attr_max_;
+        parents.resize( 2 * nv );
+        for( int v = 0; v < nv; v++ ) {
+            parents[2 * v] = v;
+            parents[2 * v + 1] = v;
+        }
+
+        /* middle vertex of each edge, indexed by its sorted end points */
+        std::map< std::pair< int, int >, int > middles;
+        std::map< std::pair< int, int >, int > border_attributes;
+        for( int e = 0; e < nb_edges(); e++ ) {
+            int v0 = edges_[2 * e];
+            int v1 = edges_[2 * e + 1];
+            border_attributes[std::make_pair( std::min( v0, v1 ), std::max( v0, v1 ) )]
+                = edge_attributes_[e];
+        }
+
+        std::vector< int > m( 3 );
+        fine.triangles_.clear();
+        fine.triangle_attributes_.clear();
+        fine.triangles_.reserve( 4 * triangles_.size() );
+        fine.triangle_attributes_.reserve( 4 * nb_triangles() );
+        for( int t = 0; t < nb_triangles(); t++ ) {
+            const int* v = &triangles_[3 * t];
+            for( int k = 0; k < 3; k++ ) {
+                int a = v[k];
+                int b = v[( k + 1 ) % 3];
+                std::pair< int, int > key( std::min( a, b ), std::max( a, b ) );
+                std::map< std::pair< int, int >, int >::iterator it = middles.find( key );
+                if( it != middles.end() ) {
+                    m[k] = it->second;
+                    continue;
+                }
+                m[k] = fine.vertices_.size();
+                middles[key] = m[k];
+                vertex middle;
+                middle.x = 0.5 * ( vertices_[a].x + vertices_[b].x );
+                middle.y = 0.5 * ( vertices_[a].y + vertices_[b].y );
+                fine.vertices_.push_back( middle );
+                std::map< std::pair< int, int >, int >::const_iterator border
+                    = border_attributes.find( key );
+                int attribute = 0;
+                if( border != border_attributes.end() ) {
+                    attribute = border->second;
+                } else if( vertex_attributes_[a] == vertex_attributes_[b] ) {
+                    attribute = vertex_attributes_[a];
+                }
+                fine.vertex_attributes_.push_back( attribute );
+                parents.push_back( a );
+                parents.push_back( b );
+            }
+            /* m[k] is the middle of the edge (v[k], v[k+1]) */
+            const int children[12] = {
+                v[0], m[0], m[2],
+                m[0], v[1], m[1],
+                m[2], m[1], v[2],
+                m[0], m[1], m[2]
+            };
+            for( int c = 0; c < 12; c++ ) {
+                fine.triangles_.push_back( children[c] );
+            }
+            for( int c = 0; c < 4; c++ ) {
+                fine.triangle_attributes_.push_back( triangle_attributes_[t] );
+            }
+        }
+
+        fine.edges_.clear();
+        fine.edge_attributes_.clear();
+        for( int e = 0; e < nb_edges(); e++ ) {
+            int v0 = edges_[2 * e];
+            int v1 = edges_[2 * e + 1];
+            std::map< std::pair< int, int >, int >::const_iterator it
+                = middles.find( std::make_pair( std::min( v0, v1 ), std::max( v0, v1 ) ) );
+            assert( it != middles.end() );
+            fine.edges_.push_back( v0 );
+            fine.edges_.push_back( it->second );
+            fine.edges_.push_back( it->second );
+            fine.edges_.push_back( v1 );
+            fine.edge_attributes_.push_back( edge_attributes_[e] );
+            fine.edge_attributes_.push_back( edge_attributes_[e] );
+        }
+    }
+
+    void Mesh::label_longest_edges()
+    {
+        for( int t = 0; t < nb_triangles(); t++ ) {
+            int* v = &triangles_[3 * t];
+            /* the edge k is opposite to the vertex k */
+            int longest = 0;
+            double max_length = -1.;
+            for( int k = 0; k < 3; k++ ) {
+                const vertex& a = vertices_[v[( k + 1 ) % 3]];
+                const vertex& b = vertices_[v[( k + 2 ) % 3]];
+                const double length = ( a.x - b.x ) * ( a.x - b.x ) + ( a.y - b.y ) * ( a.y - b.y );
+                if( length > max_length ) {
+                    max_length = length;
+                    longest = k;
+                }
+            }
+            std::rotate( v, v + longest, v + 3 );
+        }
+    }
+
+    static std::pair< int, int > edge_key( int a, int b )
+    {
+        return std::make_pair( std::min( a, b ), std::max( a, b ) );
+    }
+
+    /* bisects (v0, v1, v2), v0 being its newest vertex, then its children,
+     * as long as their refinement edge has a middle point */
+    static void bisect( int v0, int v1, int v2,
+        const std::map< std::pair< int, int >, int >& middles,
+        std::vector< int >& triangles )
+    {
+        std::map< std::pair< int, int >, int >::const_iterator it
+            = middles.find( edge_key( v1, v2 ) );
+        if( it == middles.end() ) {
+            triangles.push_back( v0 );
+            triangles.push_back( v1 );
+            triangles.push_back( v2 );
+            return;
+        }
+        const int m = it->second;
+        bisect( m, v0, v1, middles, triangles );
+        bisect( m, v2, v0, middles, triangles );
+    }
+
+    void Mesh::refine_marked( const std::vector< bool >& marked, Mesh& fine,
+        std::vector< int >& parents ) const
+    {
+        assert( marked.size() == nb_triangles() );
+        /* edges to bisect: all the edges of the marked triangles */
+        std::map< std::pair< int, int >, int > middles;
+        for( int t = 0; t < nb_triangles(); t++ ) {
+            if( !marked[t] ) continue;
+            const int* v = &triangles_[3 * t];
+            for( int k = 0; k < 3; k++ ) {
+                middles[edge_key( v[k], v[( k + 1 ) % 3] )] = -1;
+            }
+        }
+        /* closure: a triangle with a bisected edge bisects its refinement
+         * edge, so that its children reach the other one */
+        bool changed = true;
+        while( changed ) {
+            changed = false;
+            for( int t = 0; t < nb_triangles(); t++ ) {
+                const int* v = &triangles_[3 * t];
+                const std::pair< int, int > refinement_edge = edge_key( v[1], v[2] );
+                if( middles.find( refinement_edge ) != middles.end() ) continue;
+                if( middles.find( edge_key( v[0], v[1] ) ) != middles.end()
+                    || middles.find( edge_key( v[2], v[0] ) ) != middles.end() ) {
+                    middles[refinement_edge] = -1;
+                    changed = true;
+                }
+            }
+        }
+
+        fine.vertices_ = vertices_;
+        fine.vertex_attributes_ = vertex_attributes_;
+        fine.bdr_attr_max_ = bdr_attr_max_;
+        fine.attr_max_ = attr_max_;
+        const int nv = nb_vertices();
+        parents.resize( 2 * nv );
+        for( int v = 0; v < nv; v++ ) {
+            parents[2 * v] = v;
+            parents[2 * v + 1] = v;
+        }
+        std::map< std::pair< int, int >, int > border_attributes;
+        for( int e = 0; e < nb_edges(); e++ ) {
+            border_attributes[edge_key( edges_[2 * e], edges_[2 * e + 1] )] = edge_attributes_[e];
+        }
+        for( std::map< std::pair< int, int >, int >::iterator it = middles.begin();
+            it != middles.end(); ++it ) {
+            const int a = it->first.first;
+            const int b = it->first.second;
+            it->second = fine.vertices_.size();
+            vertex middle;
+            middle.x = 0.5 * ( vertices_[a].x + vertices_[b].x );
+            middle.y = 0.5 * ( vertices_[a].y + vertices_[b].y );
+            fine.vertices_.push_back( middle );
+            std::map< std::pair< int, int >, int >::const_iterator border
+                = border_attributes.find( it->first );
+            int attribute = 0;
+            if( border != border_attributes.end() ) {
+                attribute = border->second;
+            } else if( vertex_attributes_[a] == vertex_attributes_[b] ) {
+                attribute = vertex_attributes_[a];
+            }
+            fine.vertex_attributes_.push_back( attribute );
+            parents.push_back( a );
+            parents.push_back( b );
+        }
+
+        fine.triangles_.clear();
+        fine.triangle_attributes_.clear();
+        for( int t = 0; t < nb_triangles(); t++ ) {
+            const int* v = &triangles_[3 * t];
+            const int first = fine.triangles_.size() / 3;
+            bisect( v[0], v[1], v[2], middles, fine.triangles_ );
+            for( int c = first; c < fine.triangles_.size() / 3; c++ ) {
+                fine.triangle_attributes_.push_back( triangle_attributes_[t] );
+            }
+        }
+
+        fine.edges_.clear();
+        fine.edge_attributes_.clear();
+        for( int e = 0; e < nb_edges(); e++ ) {
+            int v0 = edges_[2 * e];
+            int v1 = edges_[2 * e + 1];
+            std::map< std::pair< int, int >, int >::const_iterator it
+                = middles.find( edge_key( v0, v1 ) );
+            if( it == middles.end() ) {
+                fine.edges_.push_back( v0 );
+                fine.edges_.push_back( v1 );
+                fine.edge_attributes_.push_back( edge_attributes_[e] );
+                continue;
+            }
+            fine.edges_.push_back( v0 );
+            fine.edges_.push_back( it->second );
+            fine.edges_.push_back( it->second );
+            fine.edges_.push_back( v1 );
+            fine.edge_attributes_.push_back( edge_attributes_[e] );
+            fine.edge_attributes_.push_back( edge_attributes_[e] );
+        }
+    }
+
     enum input_flag {
         HEADER, DIMENSION, VERTICES, TRIANGLES, EDGES, NO_FLAG
     };
@@ -122,8 +359,256 @@ namespace FEM2A {
         }
     }
 
+    void Mesh::interpolate( const std::vector< double >& values, const Mesh& target,
+        std::vector< double >& target_values ) const
+    {
+        assert( values.size() == nb_vertices() ) ;
+        target_values.assign( target.nb_vertices(), 0. ) ;
+        if( nb_triangles() == 0 ) return ;
+
+        /* regular grid of buckets holding the triangles overlapping them */
+        double x_min = vertices_[0].x, x_max = x_min ;
+        double y_min = vertices_[0].y, y_max = y_min ;
+        for( int v = 1; v < nb_vertices(); ++v ) {
+            x_min = std::min( x_min, vertices_[v].x ) ;
+            x_max = std::max( x_max, vertices_[v].x ) ;
+            y_min = std::min( y_min, vertices_[v].y ) ;
+            y_max = std::max( y_max, vertices_[v].y ) ;
+        }
+        const int res = std::max( 1, int( std::sqrt( double( nb_triangles() ) ) ) ) ;
+        const double cell_x = ( x_max - x_min ) / res + 1e-300 ;
+        const double cell_y = ( y_max - y_min ) / res + 1e-300 ;
+        std::vector< std::vector< int > > buckets( res * res ) ;
+        for( int t = 0; t < nb_triangles(); ++t ) {
+            double tx_min = x_max, tx_max = x_min, ty_min = y_max, ty_max = y_min ;
+            for( int k = 0; k < 3; ++k ) {
+                const vertex& p = vertices_[triangles_[3 * t + k]] ;
+                tx_min = std::min( tx_min, p.x ) ;
+                tx_max = std::max( tx_max, p.x ) ;
+                ty_min = std::min( ty_min, p.y ) ;
+                ty_max = std::max( ty_max, p.y ) ;
+            }
+            const int i0 = std::min( res - 1, int( ( tx_min - x_min ) / cell_x ) ) ;
+            const int i1 = std::min( res - 1, int( ( tx_max - x_min ) / cell_x ) ) ;
+            const int j0 = std::min( res - 1, int( ( ty_min - y_min ) / cell_y ) ) ;
+            const int j1 = std::min( res - 1, int( ( ty_max - y_min ) / cell_y ) ) ;
+            for( int j = j0; j <= j1; ++j ) {
+                for( int i = i0; i <= i1; ++i ) {
+                    buckets[j * res + i].push_back( t ) ;
+                }
+            }
+        }
+
+        for( int v = 0; v < target.nb_vertices(); ++v ) {
+            const vertex p = target.get_vertex( v ) ;
+            const int ci = std::max( 0, std::min( res - 1, int( ( p.x - x_min ) / cell_x ) ) ) ;
+            const int cj = std::max( 0, std::min( res - 1, int( ( p.y - y_min ) / cell_y ) ) ) ;
+
+            /* the triangle whose smallest barycentric coordinate of p is
+             * the largest: it contains p if this coordinate is >= 0 */
+            int best = -1 ;
+            double best_lambda[3] = { 0., 0., 0. } ;
+            double best_min = -1e300 ;
+            int first_ring = -1 ;
+            for( int ring = 0; ring < res; ++ring ) {
+                for( int j = cj - ring; j <= cj + ring; ++j ) {
+                    for( int i = ci - ring; i <= ci + ring; ++i ) {
+                        if( i < 0 || j < 0 || i >= res || j >= res ) continue ;
+                        if( std::max( std::abs( i - ci ), std::abs( j - cj ) ) != ring ) continue ;
+                        const std::vector< int >& bucket = buckets[j * res + i] ;
+                        for( int k = 0; k < bucket.size(); ++k ) {
+                            const int t = bucket[k] ;
+                            const vertex& a = vertices_[triangles_[3 * t]] ;
+                            const vertex& b = vertices_[triangles_[3 * t + 1]] ;
+                            const vertex& c = vertices_[triangles_[3 * t + 2]] ;
+                            const double det = ( b.x - a.x ) * ( c.y - a.y )
+                                - ( c.x - a.x ) * ( b.y - a.y ) ;
+                            const double l1 = ( ( p.x - a.x ) * ( c.y - a.y )
+                                - ( c.x - a.x ) * ( p.y - a.y ) ) / det ;
+                            const double l2 = ( ( b.x - a.x ) * ( p.y - a.y )
+                                - ( p.x - a.x ) * ( b.y - a.y ) ) / det ;
+                            const double l0 = 1. - l1 - l2 ;
+                            const double l_min = std::min( l0, std::min( l1, l2 ) ) ;
+                            if( l_min > best_min ) {
+                                best = t ;
+                                best_min = l_min ;
+                                best_lambda[0] = l0 ;
+                                best_lambda[1] = l1 ;
+                                best_lambda[2] = l2 ;
+                            }
+                        }
+                    }
+                }
+                if( best >= 0 && first_ring < 0 ) first_ring = ring ;
+                if( best_min >= -1e-12 || ( first_ring >= 0 && ring > first_ring ) ) break ;
+            }
+
+            /* outside of the mesh: clamped barycentric coordinates */
+            double sum = 0. ;
+            for( int k = 0; k < 3; ++k ) {
+                best_lambda[k] = std::max( 0., best_lambda[k] ) ;
+                sum += best_lambda[k] ;
+            }
+            for( int k = 0; k < 3; ++k ) {
+                target_values[v] += best_lambda[k] / sum * values[triangles_[3 * best + k]] ;
+            }
+        }
+    }
+
+    /**
+     * \brief Recursive inertial bisection of the points [begin, end) of
+     *        order, numbered from first_part.
+     */
+    static void inertial_bisection( const std::vector< vertex >& centroids,
+        std::vector< int >& order, int begin, int end, int nb_parts, int first_part,
+        std::vector< int >& part_of_triangle )
+    {
+        if( nb_parts <= 1 || end - begin <= 1 ) {
+            for( int k = begin; k < end; ++k ) part_of_triangle[order[k]] = first_part ;
+            return ;
+        }
+        /* principal axis of the 2x2 inertia matrix of the centroids */
+        double cx = 0., cy = 0. ;
+        for( int k = begin; k < end; ++k ) {
+            cx += centroids[order[k]].x ;
+            cy += centroids[order[k]].y ;
+        }
+        cx /= ( end - begin ) ;
+        cy /= ( end - begin ) ;
+        double sxx = 0., sxy = 0., syy = 0. ;
+        for( int k = begin; k < end; ++k ) {
+            const double dx = centroids[order[k]].x - cx ;
+            const double dy = centroids[order[k]].y - cy ;
+            sxx += dx * dx ;
+            sxy += dx * dy ;
+            syy += dy * dy ;
+        }
+        const double angle = 0.5 * std::atan2( 2. * sxy, sxx - syy ) ;
+        const double ax = std::cos( angle ) ;
+        const double ay = std::sin( angle ) ;
+
+        /* split at the projection giving sizes proportional to the parts */
+        const int left_parts = nb_parts / 2 ;
+        const int middle = begin + int( ( long( end - begin ) * left_parts ) / nb_parts ) ;
+        struct AxisLess {
+            const std::vector< vertex >& c ;
+            double ax, ay ;
+            bool operator()( int a, int b ) const {
+                return c[a].x * ax + c[a].y * ay < c[b].x * ax + c[b].y * ay ;
+            }
+        } less = { centroids, ax, ay } ;
+        std::nth_element( order.begin() + begin, order.begin() + middle,
+            order.begin() + end, less ) ;
+        inertial_bisection( centroids, order, begin, middle, left_parts, first_part,
+            part_of_triangle ) ;
+        inertial_bisection( centroids, order, middle, end, nb_parts - left_parts,
+            first_part + left_parts, part_of_triangle ) ;
+    }
+
+    void Mesh::partition( int nb_parts, std::vector< int >& part_of_triangle ) const
+    {
+        assert( nb_parts >= 1 ) ;
+        std::vector< vertex > centroids( nb_triangles() ) ;
+        std::vector< int > order( nb_triangles() ) ;
+        for( int t = 0; t < nb_triangles(); ++t ) {
+            vertex c = { 0., 0. } ;
+            for( int k = 0; k < 3; ++k ) {
+                c.x += vertices_[triangles_[3 * t + k]].x / 3. ;
+                c.y += vertices_[triangles_[3 * t + k]].y / 3. ;
+            }
+            centroids[t] = c ;
+            order[t] = t ;
+        }
+        part_of_triangle.assign( nb_triangles(), 0 ) ;
+        inertial_bisection( centroids, order, 0, nb_triangles(), nb_parts, 0,
+            part_of_triangle ) ;
+    }
+
+    void Mesh::extract( const std::vector< int >& triangles, Mesh& part,
+        std::vector< int >& vertex_map ) const
+    {
+        std::vector< int > local_index( nb_vertices(), -1 ) ;
+        vertex_map.clear() ;
+        part.vertices_.clear() ;
+        part.vertex_attributes_.clear() ;
+        part.triangles_.resize( 3 * triangles.size() ) ;
+        part.triangle_attributes_.resize( triangles.size() ) ;
+        for( int k = 0; k < triangles.size(); ++k ) {
+            const int t = triangles[k] ;
+            for( int l = 0; l < 3; ++l ) {
+                const int v = triangles_[3 * t + l] ;
+                if( local_index[v] < 0 ) {
+                    local_index[v] = vertex_map.size() ;
+                    vertex_map.push_back( v ) ;
+                    part.vertices_.push_back( vertices_[v] ) ;
+                    part.vertex_attributes_.push_back( vertex_attributes_[v] ) ;
+                }
+                part.triangles_[3 * k + l] = local_index[v] ;
+            }
+            part.triangle_attributes_[k] = triangle_attributes_[t] ;
+        }
+        part.edges_.clear() ;
+        part.edge_attributes_.clear() ;
+        for( int e = 0; e < nb_edges(); ++e ) {
+            const int a = local_index[edges_[2 * e]] ;
+            const int b = local_index[edges_[2 * e + 1]] ;
+            if( a >= 0 && b >= 0 ) {
+                part.edges_.push_back( a ) ;
+                part.edges_.push_back( b ) ;
+                part.edge_attributes_.push_back( edge_attributes_[e] ) ;
+            }
+        }
+        part.bdr_attr_max_ = bdr_attr_max_ ;
+        part.attr_max_ = attr_max_ ;
+    }
+
+    void Mesh::pack( std::vector< int >& ints, std::vector< double >& reals ) const
+    {
+        ints.clear() ;
+        ints.push_back( nb_vertices() ) ;
+        ints.push_back( nb_edges() ) ;
+        ints.push_back( nb_triangles() ) ;
+        ints.push_back( bdr_attr_max_ ) ;
+        ints.push_back( attr_max_ ) ;
+        ints.insert( ints.end(), vertex_attributes_.begin(), vertex_attributes_.end() ) ;
+        ints.insert( ints.end(), edges_.begin(), edges_.end() ) ;
+        ints.insert( ints.end(), edge_attributes_.begin(), edge_attributes_.end() ) ;
+        ints.insert( ints.end(), triangles_.begin(), triangles_.end() ) ;
+        ints.insert( ints.end(), triangle_attributes_.begin(), triangle_attributes_.end() ) ;
+        reals.resize( 2 * nb_vertices() ) ;
+        for( int v = 0; v < nb_vertices(); ++v ) {
+            reals[2 * v] = vertices_[v].x ;
+            reals[2 * v + 1] = vertices_[v].y ;
+        }
+    }
+
+    void Mesh::unpack( const std::vector< int >& ints, const std::vector< double >& reals )
+    {
+        const int nv = ints[0] ;
+        const int ne = ints[1] ;
+        const int nt = ints[2] ;
+        bdr_attr_max_ = ints[3] ;
+        attr_max_ = ints[4] ;
+        std::vector< int >::const_iterator it = ints.begin() + 5 ;
+        vertex_attributes_.assign( it, it + nv ) ;
+        it += nv ;
+        edges_.assign( it, it + 2 * ne ) ;
+        it += 2 * ne ;
+        edge_attributes_.assign( it, it + ne ) ;
+        it += ne ;
+        triangles_.assign( it, it + 3 * nt ) ;
+        it += 3 * nt ;
+        triangle_attributes_.assign( it, it + nt ) ;
+        vertices_.resize( nv ) ;
+        for( int v = 0; v < nv; ++v ) {
+            vertices_[v].x = reals[2 * v] ;
+            vertices_[v].y = reals[2 * v + 1] ;
+        }
+    }
+
     bool Mesh::load( const std::string& file_name )
     {
+        ScopedTimer timer( "mesh load" ) ;
         std::string line;
         std::ifstream ifs( file_name.c_str(), std::ifstream::in );
         if( ifs.is_open() ) {
@@ -210,6 +695,7 @@ namespace FEM2A {
 
     bool Mesh::save( const std::string& file_name ) const
     {
+        ScopedTimer timer( "mesh save" ) ;
         std::ofstream ofs( file_name.c_str() );
 
         ofs << "MeshVersionFormatted 2" << std::endl;
@@ -246,6 +732,7 @@ namespace FEM2A {
 
     void save_solution( const std::vector< double >& x, const std::string& filename )
     {
+        ScopedTimer timer( "solution save" ) ;
         std::ofstream medit_bb( filename.c_str(), std::ios::out | std::ios::trunc );
 
         medit_bb << " 2 1 " << x.size() << " 2" << std::endl;
@@ -46,6 +46,93 @@ namespace FEM2A {
              */
             void set_attribute( double (*region)(vertex), int attribute_index, bool border ) ;
 
+            /**
+             * \brief  Splits each triangle in 4 and each edge in 2 at the middle
+             *         of their edges. Attributes are inherited from the parent
+             *         elements. The vertices keep their index in the fine mesh,
+             *         the middle points are appended after them.
+             *
+             * \param[out] fine The refined mesh
+             * \param[out] parents For each vertex v of the fine mesh, the two vertices
+             *                     of this mesh whose middle is v (parents[2*v] and
+             *                     parents[2*v+1] are both v for the old vertices)
+             */
+            void refine_uniformly( Mesh& fine, std::vector< int >& parents ) const ;
+
+            /**
+             * \brief  Rotates the vertices of each triangle (keeping its
+             *         orientation) so that its longest edge is opposite to
+             *         its local vertex 0. Gives the initial labeling of
+             *         refine_marked().
+             */
+            void label_longest_edges() ;
+
+            /**
+             * \brief  Conforming local refinement by newest vertex bisection.
+             *         The refinement edge of a triangle is the edge opposite
+             *         to its local vertex 0, its newest vertex: bisecting it
+             *         gives two children whose vertex 0 is the middle point.
+             *         The three edges of the marked triangles are bisected
+             *         (each one is split in 4), then, until the mesh is
+             *         conforming, the refinement edge of every triangle
+             *         having a bisected edge. Attributes are inherited as in
+             *         refine_uniformly(), a split edge gives two edges with
+             *         its attribute.
+             *
+             * \param[in] marked The triangles to refine
+             * \param[out] fine The refined mesh
+             * \param[out] parents As in refine_uniformly()
+             */
+            void refine_marked( const std::vector< bool >& marked, Mesh& fine,
+                std::vector< int >& parents ) const ;
+
+            /**
+             * \brief  Interpolates a P1 field of this mesh at the vertices of
+             *         another mesh covering the same domain (e.g. a coarse
+             *         solution used as initial guess on a fine mesh). The
+             *         vertices outside this mesh (curved boundaries) are
+             *         extrapolated from the nearest triangle with clamped
+             *         barycentric coordinates.
+             *
+             * \param[in] values The value at each vertex of this mesh
+             * \param[in] target The mesh where the field is interpolated
+             * \param[out] target_values The value at each vertex of target
+             */
+            void interpolate( const std::vector< double >& values, const Mesh& target,
+                std::vector< double >& target_values ) const ;
+
+            /**
+             * \brief  Partitions the triangles in nb_parts subdomains of
+             *         (almost) the same size by recursive inertial
+             *         bisection: each set of triangles is split by the
+             *         line orthogonal to the principal axis of inertia of
+             *         its centroids, at the position giving the wanted
+             *         sizes (nb_parts needs not be a power of two).
+             *
+             * \param[in] nb_parts The number of subdomains
+             * \param[out] part_of_triangle The subdomain of each triangle
+             */
+            void partition( int nb_parts, std::vector< int >& part_of_triangle ) const ;
+
+            /**
+             * \brief  Builds the mesh made of some triangles of this mesh,
+             *         with the edges whose two vertices are in it.
+             *
+             * \param[in] triangles The indices of the triangles to keep
+             * \param[out] part The extracted mesh
+             * \param[out] vertex_map The index in this mesh of each vertex
+             *                        of part
+             */
+            void extract( const std::vector< int >& triangles, Mesh& part,
+                std::vector< int >& vertex_map ) const ;
+
+            /**
+             * \brief  Serializes the mesh in two arrays (e.g. to send it to
+             *         another process), unpack() rebuilds it.
+             */
+            void pack( std::vector< int >& ints, std::vector< double >& reals ) const ;
+            void unpack( const std::vector< int >& ints, const std::vector< double >& reals ) ;
+
             bool load( const std::string& file_name ) ;
             bool save( const std::string& file_name ) const ;
 
@@ -0,0 +1,167 @@
+#include "postprocess.h"
+#include "trace.h"
+
+#include <assert.h>
+#include <iostream>
+#include <fstream>
+#include <cmath>
+
+namespace FEM2A {
+
+    /**
+     * \brief Builds the triangles around each vertex: those of v are
+     *        triangles[first[v]] .. triangles[first[v + 1] - 1].
+     */
+    static void vertex_triangles( const Mesh& mesh, std::vector< int >& first,
+        std::vector< int >& triangles )
+    {
+        const int nv = mesh.nb_vertices() ;
+        first.assign( nv + 1, 0 ) ;
+        for( int t = 0; t < mesh.nb_triangles(); ++t ) {
+            for( int i = 0; i < 3; ++i ) ++first[mesh.get_triangle_vertex_index( t, i ) + 1] ;
+        }
+        for( int v = 0; v < nv; ++v ) first[v + 1] += first[v] ;
+        triangles.resize( first[nv] ) ;
+        std::vector< int > next( first.begin(), first.end() - 1 ) ;
+        for( int t = 0; t < mesh.nb_triangles(); ++t ) {
+            for( int i = 0; i < 3; ++i ) {
+                triangles[next[mesh.get_triangle_vertex_index( t, i )]++] = t ;
+            }
+        }
+    }
+
+    void triangle_gradients( const Mesh& mesh, const GeometryCache& geometry,
+        const std::vector< double >& u, std::vector< vec2 >& gradients )
+    {
+        const int nt = mesh.nb_triangles() ;
+        assert( geometry.nb_triangles() == nt ) ;
+        gradients.resize( nt ) ;
+#pragma omp parallel for schedule( static )
+        for( int t = 0; t < nt; ++t ) {
+            gradients[t] = geometry.p1_gradient( t,
+                u[mesh.get_triangle_vertex_index( t, 0 )],
+                u[mesh.get_triangle_vertex_index( t, 1 )],
+                u[mesh.get_triangle_vertex_index( t, 2 )] ) ;
+        }
+    }
+
+    void recover_nodal_gradients( const Mesh& mesh, const GeometryCache& geometry,
+        const std::vector< vec2 >& gradients, std::vector< vec2 >& nodal_gradients )
+    {
+        std::vector< int > first, triangles ;
+        vertex_triangles( mesh, first, triangles ) ;
+        const int nv = mesh.nb_vertices() ;
+        nodal_gradients.resize( nv ) ;
+#pragma omp parallel for schedule( static )
+        for( int v = 0; v < nv; ++v ) {
+            double gx = 0., gy = 0., weight = 0. ;
+            for( int k = first[v]; k < first[v + 1]; ++k ) {
+                const int t = triangles[k] ;
+                const double area = geometry.area( t ) ;
+                gx += area * gradients[t].x ;
+                gy += area * gradients[t].y ;
+                weight += area ;
+            }
+            nodal_gradients[v].x = weight > 0. ? gx / weight : 0. ;
+            nodal_gradients[v].y = weight > 0. ? gy / weight : 0. ;
+        }
+    }
+
+    void boundary_fluxes( const Mesh& mesh, const GeometryCache& geometry,
+        const std::vector< vec2 >& gradients, double (*conductivity)(vertex),
+        std::vector< double >& fluxes )
+    {
+        std::vector< int > first, triangles ;
+        vertex_triangles( mesh, first, triangles ) ;
+        const int ne = mesh.nb_edges() ;
+        std::vector< double > edge_flux( ne, 0. ) ;
+#pragma omp parallel for schedule( static )
+        for( int e = 0; e < ne; ++e ) {
+            const int a = mesh.get_edge_vertex_index( e, 0 ) ;
+            const int b = mesh.get_edge_vertex_index( e, 1 ) ;
+            /* the triangles of the edge: those of a containing b */
+            for( int k = first[a]; k < first[a + 1]; ++k ) {
+                const int t = triangles[k] ;
+                int nb_found = 0, opposite = -1 ;
+                for( int i = 0; i < 3; ++i ) {
+                    const int v = mesh.get_triangle_vertex_index( t, i ) ;
+                    if( v == a || v == b ) ++nb_found ;
+                    else opposite = v ;
+                }
+                if( nb_found != 2 ) continue ;
+                /* normal of length |e|, away from the opposite vertex */
+                const vertex pa = mesh.get_vertex( a ) ;
+                const vertex pb = mesh.get_vertex( b ) ;
+                const vertex pc = mesh.get_vertex( opposite ) ;
+                vec2 n ;
+                n.x = pb.y - pa.y ;
+                n.y = pa.x - pb.x ;
+                if( n.x * ( pc.x - pa.x ) + n.y * ( pc.y - pa.y ) > 0. ) {
+                    n.x = -n.x ;
+                    n.y = -n.y ;
+                }
+                vertex centroid ;
+                centroid.x = geometry.centroid_x_[t] ;
+                centroid.y = geometry.centroid_y_[t] ;
+                edge_flux[e] -= conductivity( centroid )
+                    * ( gradients[t].x * n.x + gradients[t].y * n.y ) ;
+            }
+        }
+        fluxes.assign( mesh.get_bdr_attr_max() + 1, 0. ) ;
+        for( int e = 0; e < ne; ++e ) {
+            const int attribute = mesh.get_edge_attribute( e ) ;
+            if( attribute >= fluxes.size() ) fluxes.resize( attribute + 1, 0. ) ;
+            fluxes[attribute] += edge_flux[e] ;
+        }
+    }
+
+    bool save_vector_field( const std::vector< vec2 >& values, bool at_vertices,
+        const std::string& filename )
+    {
+        std::ofstream medit_bb( filename.c_str(), std::ios::out | std::ios::trunc ) ;
+        if( !medit_bb ) {
+            std::cout << "Unable to write " << filename << std::endl ;
+            return false ;
+        }
+        /* dimension, components, number of values, 1 per element or 2 per vertex */
+        medit_bb << " 2 2 " << values.size() << " " << ( at_vertices ? 2 : 1 ) << std::endl ;
+        for( int i = 0; i < values.size(); ++i ) {
+            medit_bb << values[i].x << " " << values[i].y << std::endl ;
+        }
+        return true ;
+    }
+
+    bool save_postprocessing( const Mesh& mesh, const std::vector< double >& u,
+        double (*conductivity)(vertex), const std::string& name,
+        std::vector< double >* fluxes )
+    {
+        ScopedTimer timer( "post-processing" ) ;
+        const GeometryCache geometry( mesh ) ;
+        std::vector< vec2 > gradients, nodal_gradients ;
+        triangle_gradients( mesh, geometry, u, gradients ) ;
+        recover_nodal_gradients( mesh, geometry, gradients, nodal_gradients ) ;
+        std::vector< double > attribute_fluxes ;
+        boundary_fluxes( mesh, geometry, gradients, conductivity, attribute_fluxes ) ;
+
+        std::vector< double > lengths( attribute_fluxes.size(), 0. ) ;
+        for( int e = 0; e < mesh.nb_edges(); ++e ) {
+            const vertex a = mesh.get_edge_vertex( e, 0 ) ;
+            const vertex b = mesh.get_edge_vertex( e, 1 ) ;
+            lengths[mesh.get_edge_attribute( e )] += std::sqrt(
+                ( b.x - a.x ) * ( b.x - a.x ) + ( b.y - a.y ) * ( b.y - a.y ) ) ;
+        }
+        std::ofstream flux_file( ( name + "_flux.txt" ).c_str(), std::ios::out | std::ios::trunc ) ;
+        if( !flux_file ) {
+            std::cout << "Unable to write " << name << "_flux.txt" << std::endl ;
+            return false ;
+        }
+        flux_file << "# attribute flux length" << std::endl ;
+        for( int a = 0; a < attribute_fluxes.size(); ++a ) {
+            if( lengths[a] == 0. ) continue ;
+            flux_file << a << " " << attribute_fluxes[a] << " " << lengths[a] << std::endl ;
+        }
+        if( fluxes != NULL ) fluxes->swap( attribute_fluxes ) ;
+        return save_vector_field( nodal_gradients, true, name + "_gradient.bb" ) ;
+    }
+
+}
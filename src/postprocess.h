@@ -0,0 +1,72 @@
+#pragma once
+
+#include "mesh.h"
+#include "geometry.h"
+
+#include <vector>
+#include <string>
+
+namespace FEM2A {
+
+    /**
+     * \brief Computes the gradient of a P1 field on each triangle (it is
+     *        constant), in parallel.
+     *
+     * \param[in] u The value at each vertex
+     * \param[out] gradients The gradient on each triangle
+     */
+    void triangle_gradients( const Mesh& mesh, const GeometryCache& geometry,
+        const std::vector< double >& u, std::vector< vec2 >& gradients ) ;
+
+    /**
+     * \brief Recovers a continuous gradient at the vertices: the average
+     *        of the gradients of the triangles around each vertex,
+     *        weighted by their area (the recovery used by
+     *        zz_error_estimate()).
+     *        The vertices are processed in parallel through the list of
+     *        their triangles, without concurrent writes.
+     */
+    void recover_nodal_gradients( const Mesh& mesh, const GeometryCache& geometry,
+        const std::vector< vec2 >& gradients, std::vector< vec2 >& nodal_gradients ) ;
+
+    /**
+     * \brief Integrates the normal heat flux -k grad u . n over the edges
+     *        of each attribute, n being the unit normal pointing out of
+     *        the triangles containing the edge and k being evaluated at
+     *        their centroid. On the border, it is the flux leaving the
+     *        domain; on an inner edge (e.g. a Dirichlet line), the sum of
+     *        the fluxes leaving its two triangles, i.e. the heat it
+     *        absorbs.
+     *
+     * \param[in] gradients The gradient on each triangle
+     * \param[in] conductivity The diffusion coefficient k(x,y)
+     * \param[out] fluxes The flux through the edges of attribute a, for
+     *                    a = 0 .. get_bdr_attr_max()
+     */
+    void boundary_fluxes( const Mesh& mesh, const GeometryCache& geometry,
+        const std::vector< vec2 >& gradients, double (*conductivity)(vertex),
+        std::vector< double >& fluxes ) ;
+
+    /**
+     * \brief Saves a vector field for Medit: one value per vertex if
+     *        at_vertices is true, else one per triangle.
+     */
+    bool save_vector_field( const std::vector< vec2 >& values, bool at_vertices,
+        const std::string& filename ) ;
+
+    /**
+     * \brief Computes the fluxes and the gradients of a P1 solution and
+     *        writes them next to its .bb file:
+     *          <name>_gradient.bb   the recovered gradient at the vertices
+     *          <name>_flux.txt      "attribute flux length" per line
+     *
+     * \param[in] u The solution
+     * \param[in] conductivity The diffusion coefficient k(x,y)
+     * \param[in] name The name of the solution files, without extension
+     * \param[out] fluxes If not NULL, the flux of each edge attribute
+     */
+    bool save_postprocessing( const Mesh& mesh, const std::vector< double >& u,
+        double (*conductivity)(vertex), const std::string& name,
+        std::vector< double >* fluxes = NULL ) ;
+
+}
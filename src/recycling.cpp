@@ -0,0 +1,287 @@
+#include "recycling.h"
+#include "dense.h"
+
+#include <assert.h>
+#include <iostream>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+namespace FEM2A {
+
+    /****************************************************************/
+    /* Implementation of RecyclingCG */
+    /****************************************************************/
+
+    RecyclingCG::RecyclingCG( int nb_vectors )
+        : max_vectors_( std::max( 0, nb_vectors ) ), k_( 0 )
+    {
+
+    }
+
+    int RecyclingCG::nb_vectors() const
+    {
+        return k_ ;
+    }
+
+    void RecyclingCG::clear()
+    {
+        k_ = 0 ;
+        W_.clear() ;
+    }
+
+    bool RecyclingCG::solve( const CSRMatrix& A, const std::vector< double >& b,
+        std::vector< double >& x, const Preconditioner* P,
+        const SolverOptions& options, SolveReport* report )
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        const int n = A.nb_rows() ;
+        assert( b.size() == n ) ;
+        if( W_.size() != n * k_ ) clear() ;
+
+        /* deflation subspace for the current matrix: E = W^T A W */
+        int k = k_ ;
+        std::vector< double > AW ;
+        std::vector< double > E( k * k, 0. ) ;
+        if( k > 0 ) {
+            A.mult_block( W_, AW, k ) ;
+            for( int i = 0; i < n; ++i ) {
+                const double* w = &W_[i * k] ;
+                const double* aw = &AW[i * k] ;
+                for( int a = 0; a < k; ++a ) {
+                    for( int c = 0; c < k; ++c ) E[a * k + c] += w[a] * aw[c] ;
+                }
+            }
+            for( int a = 0; a < k; ++a ) {
+                for( int c = 0; c < a; ++c ) {
+                    E[a * k + c] = E[c * k + a] = 0.5 * ( E[a * k + c] + E[c * k + a] ) ;
+                }
+            }
+            if( !dense_cholesky( E, k ) ) {
+                clear() ;
+                AW.clear() ;
+                k = 0 ;
+            }
+        }
+        std::vector< double > mu( k ) ;
+
+        std::vector< double > r( b ) ;
+        std::vector< double > z( n ) ;
+        std::vector< double > p( n, 0. ) ;
+        std::vector< double > Ap( n ) ;
+        std::vector< double > history ;
+        /* if b = 0, the solution is 0 whatever the initial guess */
+        const double b_norm = std::sqrt( dot( b, b ) ) ;
+        if( options.use_initial_guess && x.size() == n && b_norm > 0. ) {
+            A.mult( x, Ap ) ;
+            for( int i = 0; i < n; ++i ) r[i] -= Ap[i] ;
+        } else {
+            x.assign( n, 0. ) ;
+        }
+
+        /* Galerkin projection of the solution on W: W^T r = 0 */
+        if( k > 0 ) {
+            mu.assign( k, 0. ) ;
+            for( int i = 0; i < n; ++i ) {
+                for( int j = 0; j < k; ++j ) mu[j] += W_[i * k + j] * r[i] ;
+            }
+            dense_cholesky_solve( E, k, mu ) ;
+            for( int i = 0; i < n; ++i ) {
+                for( int j = 0; j < k; ++j ) {
+                    x[i] += W_[i * k + j] * mu[j] ;
+                    r[i] -= AW[i * k + j] * mu[j] ;
+                }
+            }
+        }
+        double error = b_norm > 0. ? std::sqrt( dot( r, r ) ) / b_norm : 0. ;
+        history.push_back( error ) ;
+
+        /* the first search directions are kept to update the subspace */
+        const int nb_harvested = 2 * max_vectors_ ;
+        std::vector< std::vector< double > > D, AD ;
+
+        if( P != NULL ) P->apply( r, z ) ; else z = r ;
+        double rz = dot( r, z ) ;
+        double beta = 0. ;
+        int it = 0 ;
+        while( error > options.threshold && it < options.max_iterations ) {
+            /* p = z + beta p - W E^-1 (AW)^T z, A-orthogonal to W */
+            if( k > 0 ) {
+                mu.assign( k, 0. ) ;
+                for( int i = 0; i < n; ++i ) {
+                    const double* aw = &AW[i * k] ;
+                    for( int j = 0; j < k; ++j ) mu[j] += aw[j] * z[i] ;
+                }
+                dense_cholesky_solve( E, k, mu ) ;
+                for( int i = 0; i < n; ++i ) {
+                    const double* w = &W_[i * k] ;
+                    double sum = z[i] + beta * p[i] ;
+                    for( int j = 0; j < k; ++j ) sum -= w[j] * mu[j] ;
+                    p[i] = sum ;
+                }
+            } else {
+                for( int i = 0; i < n; ++i ) p[i] = z[i] + beta * p[i] ;
+            }
+
+            A.mult( p, Ap ) ;
+            if( D.size() < nb_harvested ) {
+                D.push_back( p ) ;
+                AD.push_back( Ap ) ;
+            }
+            const double alpha = rz / dot( p, Ap ) ;
+            for( int i = 0; i < n; ++i ) {
+                x[i] += alpha * p[i] ;
+                r[i] -= alpha * Ap[i] ;
+            }
+            ++it ;
+            error = std::sqrt( dot( r, r ) ) / b_norm ;
+            history.push_back( error ) ;
+            if( options.verbose && it % 100 == 0 ) {
+                std::cout << "  iter " << it << " ||r||/||b|| = " << error << std::endl ;
+            }
+            if( error <= options.threshold ) break ;
+
+            if( P != NULL ) P->apply( r, z ) ; else z = r ;
+            const double rz_new = dot( r, z ) ;
+            beta = rz_new / rz ;
+            rz = rz_new ;
+        }
+
+        if( max_vectors_ > 0 ) update_subspace( AW, D, AD, P ) ;
+
+        const double elapsed = std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+        const bool converged = error <= options.threshold ;
+        if( options.verbose ) {
+            std::cout << "in recycling CG : ||Ax-b||/||b|| = " << error
+                << ", deflation subspace of dimension " << k << std::endl ;
+        }
+        if( report != NULL ) {
+            const double flops_per_iteration = 2. * A.nnz() + 12. * n + 4. * k * n
+                + ( P != NULL ? P->flops() : 0. ) ;
+            report->converged = converged ;
+            report->nb_iterations = it ;
+            report->error = error ;
+            report->elapsed_time = elapsed ;
+            report->gflops = elapsed > 0. ?
+                flops_per_iteration * it / ( elapsed * 1e9 ) : 0. ;
+            report->residual_history.swap( history ) ;
+        }
+        return converged ;
+    }
+
+    void RecyclingCG::update_subspace( const std::vector< double >& AW,
+        const std::vector< std::vector< double > >& D,
+        const std::vector< std::vector< double > >& AD, const Preconditioner* P )
+    {
+        const int k = k_ ;
+        const int m = k + D.size() ;
+        if( m == 0 ) return ;
+        const int n = k > 0 ? W_.size() / k : D[0].size() ;
+
+        /* Phi = [W, D] and A Phi, M^-1 A Phi, stored row by row */
+        std::vector< double > Phi( n * m ), APhi( n * m ), MAPhi( n * m ) ;
+        std::vector< double > v( n ), Mv( n ) ;
+        for( int j = 0; j < m; ++j ) {
+            for( int i = 0; i < n; ++i ) {
+                Phi[i * m + j] = j < k ? W_[i * k + j] : D[j - k][i] ;
+                v[i] = j < k ? AW[i * k + j] : AD[j - k][i] ;
+                APhi[i * m + j] = v[i] ;
+            }
+            if( P != NULL ) P->apply( v, Mv ) ; else Mv = v ;
+            for( int i = 0; i < n; ++i ) MAPhi[i * m + j] = Mv[i] ;
+        }
+
+        /* G = Phi^T A Phi and H = (A Phi)^T M^-1 (A Phi), in one pass */
+        std::vector< double > G( m * m, 0. ), H( m * m, 0. ) ;
+        for( int i = 0; i < n; ++i ) {
+            const double* phi = &Phi[i * m] ;
+            const double* aphi = &APhi[i * m] ;
+            const double* maphi = &MAPhi[i * m] ;
+            for( int a = 0; a < m; ++a ) {
+                for( int c = 0; c < m; ++c ) {
+                    G[a * m + c] += phi[a] * aphi[c] ;
+                    H[a * m + c] += aphi[a] * maphi[c] ;
+                }
+            }
+        }
+        for( int a = 0; a < m; ++a ) {
+            for( int c = 0; c < a; ++c ) {
+                G[a * m + c] = G[c * m + a] = 0.5 * ( G[a * m + c] + G[c * m + a] ) ;
+                H[a * m + c] = H[c * m + a] = 0.5 * ( H[a * m + c] + H[c * m + a] ) ;
+            }
+        }
+
+        /* coefficients C of a G-orthonormal basis of span(Phi), so that
+         * Phi C is A-orthonormal; the dependent vectors are dropped */
+        std::vector< std::vector< double > > C ;
+        for( int c = 0; c < m; ++c ) {
+            if( !( G[c * m + c] > 0. ) ) continue ;
+            std::vector< double > y( m, 0. ), Gy( m ) ;
+            y[c] = 1. ;
+            /* Gram-Schmidt done twice for the orthogonality */
+            for( int pass = 0; pass < 2; ++pass ) {
+                for( int q = 0; q < C.size(); ++q ) {
+                    double coef = 0. ;
+                    for( int a = 0; a < m; ++a ) {
+                        for( int e = 0; e < m; ++e ) coef += C[q][a] * G[a * m + e] * y[e] ;
+                    }
+                    for( int a = 0; a < m; ++a ) y[a] -= coef * C[q][a] ;
+                }
+            }
+            double yGy = 0. ;
+            for( int a = 0; a < m; ++a ) {
+                for( int e = 0; e < m; ++e ) yGy += y[a] * G[a * m + e] * y[e] ;
+            }
+            if( !( yGy > 1e-12 * G[c * m + c] ) ) continue ;
+            for( int a = 0; a < m; ++a ) y[a] /= std::sqrt( yGy ) ;
+            C.push_back( y ) ;
+        }
+
+        /* Rayleigh-Ritz for M^-1 A in the A scalar product: the Ritz
+         * pairs are the eigenpairs of C^T H C; the smallest ones slow
+         * down PCG */
+        const int nb_basis = C.size() ;
+        std::vector< double > HC( m * nb_basis, 0. ) ;
+        for( int a = 0; a < m; ++a ) {
+            for( int q = 0; q < nb_basis; ++q ) {
+                for( int e = 0; e < m; ++e ) HC[a * nb_basis + q] += H[a * m + e] * C[q][e] ;
+            }
+        }
+        std::vector< double > R( nb_basis * nb_basis, 0. ), V ;
+        for( int q = 0; q < nb_basis; ++q ) {
+            for( int l = 0; l < nb_basis; ++l ) {
+                for( int a = 0; a < m; ++a ) R[q * nb_basis + l] += C[q][a] * HC[a * nb_basis + l] ;
+            }
+        }
+        dense_symmetric_eigen( R, nb_basis, V ) ;
+        std::vector< std::pair< double, int > > ritz( nb_basis ) ;
+        for( int j = 0; j < nb_basis; ++j ) {
+            ritz[j] = std::make_pair( R[j * nb_basis + j], j ) ;
+        }
+        std::sort( ritz.begin(), ritz.end() ) ;
+
+        /* W = Phi Y with Y = C V for the kept Ritz vectors */
+        const int new_k = std::min( max_vectors_, nb_basis ) ;
+        std::vector< double > Y( m * new_k, 0. ) ;
+        for( int l = 0; l < new_k; ++l ) {
+            const int j = ritz[l].second ;
+            for( int q = 0; q < nb_basis; ++q ) {
+                for( int a = 0; a < m; ++a ) {
+                    Y[a * new_k + l] += C[q][a] * V[q * nb_basis + j] ;
+                }
+            }
+        }
+        W_.assign( n * new_k, 0. ) ;
+        for( int i = 0; i < n; ++i ) {
+            const double* phi = &Phi[i * m] ;
+            double* w = &W_[i * new_k] ;
+            for( int a = 0; a < m; ++a ) {
+                for( int l = 0; l < new_k; ++l ) w[l] += phi[a] * Y[a * new_k + l] ;
+            }
+        }
+        k_ = new_k ;
+    }
+
+}
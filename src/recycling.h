@@ -0,0 +1,82 @@
+#pragma once
+
+#include "solver.h"
+
+#include <vector>
+
+namespace FEM2A {
+
+    /**
+     * \brief RecyclingCG is a deflated preconditioned conjugate gradient
+     *        for sequences of systems whose matrices change slightly
+     *        (e.g. a parametric study on the diffusion coefficients).
+     *
+     * Each solve keeps some search directions; at the end of the solve,
+     * the Rayleigh-Ritz procedure on the span of these directions and of
+     * the current subspace W gives approximate eigenvectors of the
+     * smallest eigenvalues of the preconditioned matrix M^-1 A, which become the new W. The next solves
+     * start from the Galerkin projection of the solution on W and keep
+     * the search directions A-orthogonal to W, so these eigenvalues no
+     * longer slow down the convergence (deflated CG, Saad et al. 2000).
+     * The subspace improves along the sequence, like the recycled space
+     * of GCRO-DR but with the short recurrences of CG.
+     */
+    class RecyclingCG {
+        public:
+            /**
+             * \param nb_vectors dimension of the deflation subspace
+             */
+            RecyclingCG( int nb_vectors ) ;
+
+            /**
+             * \brief Solves Ax=b with deflation by the current subspace,
+             *        then updates the subspace.
+             *
+             * \param[in] A a symmetric positive definite matrix
+             * \param[in] b the right hand side vector
+             * \param[in,out] x the solution (initial guess on input if
+             *                  options.use_initial_guess is set)
+             * \param[in] P the preconditioner, or NULL
+             * \param[in] options threshold, max_iterations,
+             *                    use_initial_guess and verbose are used
+             * \param[out] report if not NULL, filled with the statistics
+             *
+             * \return true if the solver has converged.
+             */
+            bool solve( const CSRMatrix& A, const std::vector< double >& b,
+                std::vector< double >& x, const Preconditioner* P,
+                const SolverOptions& options, SolveReport* report = NULL ) ;
+
+            /**
+             * \return the current dimension of the deflation subspace
+             */
+            int nb_vectors() const ;
+
+            /**
+             * \brief Forgets the deflation subspace.
+             */
+            void clear() ;
+
+        private:
+            /**
+             * \brief Rayleigh-Ritz on span(W, D): keeps the Ritz vectors
+             *        of the smallest Ritz values of the preconditioned
+             *        matrix as the new W.
+             * \param AW A W, stored like W_
+             * \param D the search directions kept during the solve
+             * \param AD A D
+             */
+            void update_subspace( const std::vector< double >& AW,
+                const std::vector< std::vector< double > >& D,
+                const std::vector< std::vector< double > >& AD,
+                const Preconditioner* P ) ;
+
+            int max_vectors_ ;
+            int k_ ;    /* current dimension of the subspace */
+            /* basis of the subspace, stored row by row like the blocks of
+             * CSRMatrix::mult_block(): W_[i * k_ + j] is the row i of the
+             * vector j, so the projections are done in one pass */
+            std::vector< double > W_ ;
+    } ;
+
+}
@@ -0,0 +1,353 @@
+#include "reduced.h"
+#include "geometry.h"
+#include "dense.h"
+
+#include <assert.h>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+
+namespace FEM2A {
+
+    static double dot_product( const std::vector< double >& x, const std::vector< double >& y )
+    {
+        double sum = 0. ;
+        for( int i = 0; i < x.size(); ++i ) sum += x[i] * y[i] ;
+        return sum ;
+    }
+
+    /****************************************************************/
+    /* Implementation of ReducedBasis */
+    /****************************************************************/
+
+    ReducedBasis::ReducedBasis( const Mesh& mesh,
+        const std::vector< bool >& attribute_is_dirichlet )
+        : mesh_( mesh ), affine_( mesh ), ok_( true ), offline_time_( 0. )
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        const int n = mesh.nb_vertices() ;
+        affine_.add_dirichlet_penalty( mesh, attribute_is_dirichlet ) ;
+        const int nb_regions = affine_.nb_regions() ;
+        A_.resize( nb_regions + 1 ) ;
+        for( int q = 0; q <= nb_regions; ++q ) affine_.term( q, A_[q] ) ;
+
+        /* unit source of each region */
+        std::vector< int > region_of_attribute( mesh.get_attr_max() + 1, -1 ) ;
+        for( int r = 0; r < nb_regions; ++r ) {
+            region_of_attribute[affine_.region_attribute( r )] = r ;
+        }
+        F_.assign( nb_regions, std::vector< double >( n, 0. ) ) ;
+        const GeometryCache geometry( mesh ) ;
+        for( int t = 0; t < mesh.nb_triangles(); ++t ) {
+            double Fe[3] ;
+            geometry.p1_load( t, 1., Fe ) ;
+            std::vector< double >& F = F_[region_of_attribute[mesh.get_triangle_attribute( t )]] ;
+            for( int i = 0; i < 3; ++i ) F[mesh.get_triangle_vertex_index( t, i )] += Fe[i] ;
+        }
+
+        /* energy product of the reference parameter k = 1 */
+        affine_.combine( std::vector< double >( mesh.get_attr_max() + 1, 1. ), X_ ) ;
+        if( !X_factor_.factor( X_ ) ) {
+            std::cout << "Failure: the energy matrix is not positive definite" << std::endl ;
+            ok_ = false ;
+        }
+
+        /* Riesz representers of the sources */
+        riesz_F_.resize( nb_regions ) ;
+        gram_FF_.assign( nb_regions * nb_regions, 0. ) ;
+        for( int b = 0; b < nb_regions && ok_; ++b ) {
+            X_factor_.solve( F_[b], riesz_F_[b] ) ;
+            for( int b2 = 0; b2 <= b; ++b2 ) {
+                gram_FF_[b * nb_regions + b2] = gram_FF_[b2 * nb_regions + b]
+                    = dot_product( riesz_F_[b], F_[b2] ) ;
+            }
+        }
+        F_N_.assign( nb_regions, std::vector< double >() ) ;
+        A_N_.assign( nb_regions + 1, std::vector< double >() ) ;
+        offline_time_ += std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+    }
+
+    void ReducedBasis::theta( const ReducedParameter& mu, std::vector< double >& theta_a,
+        std::vector< double >& theta_f ) const
+    {
+        const int nb_regions = affine_.nb_regions() ;
+        theta_a.resize( nb_regions + 1 ) ;
+        theta_f.resize( nb_regions ) ;
+        for( int r = 0; r < nb_regions; ++r ) {
+            theta_a[r] = mu.conductivity[affine_.region_attribute( r )] ;
+            theta_f[r] = mu.source[affine_.region_attribute( r )] ;
+        }
+        theta_a[nb_regions] = 1. ;
+    }
+
+    bool ReducedBasis::truth_solve( const ReducedParameter& mu, std::vector< double >& u )
+    {
+        std::vector< double > theta_a, theta_f ;
+        theta( mu, theta_a, theta_f ) ;
+        affine_.combine( mu.conductivity, truth_matrix_ ) ;
+        std::vector< double > F( nb_vertices(), 0. ) ;
+        for( int b = 0; b < F_.size(); ++b ) {
+            for( int i = 0; i < F.size(); ++i ) F[i] += theta_f[b] * F_[b][i] ;
+        }
+        /* the symbolic analysis is kept, all the parameters share the pattern */
+        if( !truth_factor_.factor( truth_matrix_ ) ) {
+            std::cout << "Failure: the truth matrix is not positive definite" << std::endl ;
+            return false ;
+        }
+        truth_factor_.solve( F, u ) ;
+        return true ;
+    }
+
+    bool ReducedBasis::add_basis_vector( const std::vector< double >& u )
+    {
+        const int N_old = V_.size() ;
+        const int Q = A_.size() ;
+        const int Qf = F_.size() ;
+
+        /* Gram-Schmidt in the X product, twice for stability */
+        std::vector< double > v( u ), Xv ;
+        X_.mult( v, Xv ) ;
+        const double u_norm = std::sqrt( dot_product( v, Xv ) ) ;
+        for( int pass = 0; pass < 2; ++pass ) {
+            for( int j = 0; j < N_old; ++j ) {
+                const double alpha = dot_product( V_[j], Xv ) ;
+                for( int i = 0; i < v.size(); ++i ) v[i] -= alpha * V_[j][i] ;
+            }
+            X_.mult( v, Xv ) ;
+        }
+        const double v_norm = std::sqrt( dot_product( v, Xv ) ) ;
+        if( !( v_norm > 1e-10 * u_norm ) ) return false ;
+        for( int i = 0; i < v.size(); ++i ) v[i] /= v_norm ;
+        V_.push_back( v ) ;
+        const int N = N_old + 1 ;
+
+        /* projections: new row and column of each A_N^q, new entry of F_N^b */
+        std::vector< std::vector< double > > Av( Q ) ;
+        for( int q = 0; q < Q; ++q ) {
+            A_[q].mult( v, Av[q] ) ;
+            std::vector< double > projected( N * N, 0. ) ;
+            for( int i = 0; i < N_old; ++i ) {
+                for( int j = 0; j < N_old; ++j ) {
+                    projected[i * N + j] = A_N_[q][i * N_old + j] ;
+                }
+            }
+            for( int i = 0; i < N; ++i ) {
+                projected[i * N + N_old] = projected[N_old * N + i] = dot_product( V_[i], Av[q] ) ;
+            }
+            A_N_[q].swap( projected ) ;
+        }
+        for( int b = 0; b < Qf; ++b ) {
+            F_N_[b].push_back( dot_product( v, F_[b] ) ) ;
+        }
+
+        /* Riesz representers X^-1 A_q v and their Gram matrices: with
+         * w_m = X^-1 a_m, (w_m, w_m')_X = w_m^T a_m' */
+        const int M_old = N_old * Q ;
+        const int M = N * Q ;
+        for( int q = 0; q < Q; ++q ) {
+            riesz_A_.push_back( std::vector< double >() ) ;
+            X_factor_.solve( Av[q], riesz_A_.back() ) ;
+        }
+        std::vector< double > gram( M * M, 0. ) ;
+        for( int i = 0; i < M_old; ++i ) {
+            for( int j = 0; j < M_old; ++j ) gram[i * M + j] = gram_AA_[i * M_old + j] ;
+        }
+        for( int i = 0; i < M; ++i ) {
+            for( int q = 0; q < Q; ++q ) {
+                const int j = M_old + q ;
+                if( i > j ) continue ;
+                gram[i * M + j] = gram[j * M + i] = dot_product( riesz_A_[i], Av[q] ) ;
+            }
+        }
+        gram_AA_.swap( gram ) ;
+        for( int q = 0; q < Q; ++q ) {
+            for( int b = 0; b < Qf; ++b ) {
+                gram_AF_.push_back( dot_product( riesz_F_[b], Av[q] ) ) ;
+            }
+        }
+        return true ;
+    }
+
+    int ReducedBasis::build_greedy( const std::vector< ReducedParameter >& training,
+        double tolerance, int max_size )
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        if( !ok_ ) return -1 ;
+        std::vector< double > u, c ;
+        int selected = 0 ;
+        bool ok = true ;
+        while( size() < max_size && !training.empty() ) {
+            if( size() > 0 ) {
+                /* parameter with the largest relative error estimate */
+                double max_estimate = 0. ;
+                for( int p = 0; p < training.size(); ++p ) {
+                    double estimate = 0. ;
+                    solve( training[p], c, &estimate ) ;
+                    const double c_norm = std::sqrt( dot_product( c, c ) ) ;
+                    estimate = c_norm > 0. ? estimate / c_norm : estimate ;
+                    if( estimate > max_estimate ) {
+                        max_estimate = estimate ;
+                        selected = p ;
+                    }
+                }
+                if( max_estimate < tolerance ) break ;
+            }
+            ok = truth_solve( training[selected], u ) ;
+            if( !ok || !add_basis_vector( u ) ) break ;
+        }
+        offline_time_ += std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+        return ok ? size() : -1 ;
+    }
+
+    int ReducedBasis::build_pod( const std::vector< ReducedParameter >& training,
+        double tolerance, int max_size )
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        if( !ok_ ) return -1 ;
+        const int m = training.size() ;
+        std::vector< std::vector< double > > snapshots( m ), X_snapshots( m ) ;
+        for( int p = 0; p < m; ++p ) {
+            if( !truth_solve( training[p], snapshots[p] ) ) return -1 ;
+            X_.mult( snapshots[p], X_snapshots[p] ) ;
+        }
+        /* correlation matrix of the snapshots in the X product */
+        std::vector< double > C( m * m ), Y ;
+        for( int i = 0; i < m; ++i ) {
+            for( int j = 0; j <= i; ++j ) {
+                C[i * m + j] = C[j * m + i] = dot_product( snapshots[i], X_snapshots[j] ) ;
+            }
+        }
+        dense_symmetric_eigen( C, m, Y ) ;
+        std::vector< std::pair< double, int > > modes( m ) ;
+        double total = 0. ;
+        for( int i = 0; i < m; ++i ) {
+            modes[i] = std::make_pair( -C[i * m + i], i ) ;
+            total += std::max( C[i * m + i], 0. ) ;
+        }
+        std::sort( modes.begin(), modes.end() ) ;
+
+        /* the modes V y / sqrt(lambda), until the discarded energy is small */
+        double discarded = total ;
+        std::vector< double > v( nb_vertices() ) ;
+        for( int k = 0; k < m && size() < max_size; ++k ) {
+            if( discarded <= tolerance * tolerance * total ) break ;
+            const double lambda = -modes[k].first ;
+            if( !( lambda > 0. ) ) break ;
+            const int mode = modes[k].second ;
+            std::fill( v.begin(), v.end(), 0. ) ;
+            for( int p = 0; p < m; ++p ) {
+                const double y = Y[p * m + mode] / std::sqrt( lambda ) ;
+                for( int i = 0; i < v.size(); ++i ) v[i] += y * snapshots[p][i] ;
+            }
+            if( !add_basis_vector( v ) ) break ;
+            discarded -= lambda ;
+        }
+        offline_time_ += std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+        return size() ;
+    }
+
+    bool ReducedBasis::solve( const ReducedParameter& mu, std::vector< double >& c,
+        double* error_estimate ) const
+    {
+        const int N = size() ;
+        const int Q = A_.size() ;
+        const int Qf = F_.size() ;
+        std::vector< double > theta_a, theta_f ;
+        theta( mu, theta_a, theta_f ) ;
+
+        std::vector< double > A_N( N * N, 0. ) ;
+        for( int q = 0; q < Q; ++q ) {
+            for( int k = 0; k < N * N; ++k ) A_N[k] += theta_a[q] * A_N_[q][k] ;
+        }
+        c.assign( N, 0. ) ;
+        for( int b = 0; b < Qf; ++b ) {
+            for( int i = 0; i < N; ++i ) c[i] += theta_f[b] * F_N_[b][i] ;
+        }
+        const bool ok = dense_cholesky( A_N, N ) ;
+        if( ok ) dense_cholesky_solve( A_N, N, c ) ;
+
+        if( error_estimate != NULL ) {
+            /* ||r||_X'^2 = f^T FF f - 2 y^T AF f + y^T AA y, y_jQ+q = theta_q c_j */
+            const int M = N * Q ;
+            std::vector< double > y( M ) ;
+            for( int j = 0; j < N; ++j ) {
+                for( int q = 0; q < Q; ++q ) y[j * Q + q] = theta_a[q] * c[j] ;
+            }
+            double source_norm = 0. ;
+            for( int b = 0; b < Qf; ++b ) {
+                for( int b2 = 0; b2 < Qf; ++b2 ) {
+                    source_norm += theta_f[b] * theta_f[b2] * gram_FF_[b * Qf + b2] ;
+                }
+            }
+            double residual = source_norm ;
+            for( int i = 0; i < M; ++i ) {
+                double AF_f = 0. ;
+                for( int b = 0; b < Qf; ++b ) AF_f += gram_AF_[i * Qf + b] * theta_f[b] ;
+                double AA_y = 0. ;
+                for( int j = 0; j < M; ++j ) AA_y += gram_AA_[i * M + j] * y[j] ;
+                residual += y[i] * ( AA_y - 2. * AF_f ) ;
+            }
+            /* the expansion cancels down to the rounding errors of its
+             * terms: below that level the residual is not resolved, so
+             * the estimate is floored rather than underestimated */
+            const double rounding = 1e-12 * source_norm ;
+            /* min-theta lower bound of the coercivity constant */
+            double alpha = 1. ;
+            for( int q = 0; q < Q; ++q ) alpha = std::min( alpha, theta_a[q] ) ;
+            *error_estimate = std::sqrt( std::max( residual, rounding ) ) / alpha ;
+        }
+        return ok ;
+    }
+
+    void ReducedBasis::reconstruct( const std::vector< double >& c,
+        std::vector< double >& u ) const
+    {
+        assert( c.size() == size() ) ;
+        u.assign( nb_vertices(), 0. ) ;
+        for( int j = 0; j < size(); ++j ) {
+            for( int i = 0; i < u.size(); ++i ) u[i] += c[j] * V_[j][i] ;
+        }
+    }
+
+    double ReducedBasis::energy_norm( const std::vector< double >& x ) const
+    {
+        std::vector< double > Xx ;
+        X_.mult( x, Xx ) ;
+        return std::sqrt( dot_product( x, Xx ) ) ;
+    }
+
+    bool ReducedBasis::ok() const
+    {
+        return ok_ ;
+    }
+
+    int ReducedBasis::size() const
+    {
+        return V_.size() ;
+    }
+
+    int ReducedBasis::nb_vertices() const
+    {
+        return mesh_.nb_vertices() ;
+    }
+
+    double ReducedBasis::offline_time() const
+    {
+        return offline_time_ ;
+    }
+
+    void ReducedBasis::print() const
+    {
+        std::cout << "Reduced basis: " << size() << " vectors for " << nb_vertices()
+            << " unknowns, " << A_.size() << " operator terms, " << F_.size()
+            << " source terms, offline " << offline_time_ << " s" << std::endl ;
+    }
+
+}
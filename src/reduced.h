@@ -0,0 +1,154 @@
+#pragma once
+
+#include "mesh.h"
+#include "solver.h"
+#include "cholesky.h"
+#include "affine.h"
+
+#include <vector>
+
+namespace FEM2A {
+
+    /**
+     * \brief Parameters of the geothermie problem: a conductivity and a
+     *        volumic source per triangle attribute (region).
+     */
+    struct ReducedParameter {
+        std::vector< double > conductivity ;   /* size get_attr_max() + 1 */
+        std::vector< double > source ;         /* size get_attr_max() + 1 */
+    } ;
+
+    /**
+     * \brief ReducedBasis is an offline/online reduced basis solver of
+     *          -div(k grad u) = f,  u = 0 on the Dirichlet edges
+     *        with k and f constant in each region.
+     *
+     * Offline, the full ("truth") problems are assembled without element
+     * loop from an AffineStiffness and the unit source of each region,
+     * and solved with SparseCholesky (the symbolic analysis is shared by
+     * all the parameters). The basis V is built from their solutions
+     * either by a greedy selection driven by the error estimator, or by
+     * a POD of a set of snapshots. It is orthonormal for the energy
+     * product of the reference parameter, X = K(k = 1) + P.
+     *
+     * The operators are projected term by term, A_N^q = V^T A_q V and
+     * F_N^b = V^T F_b, so online the reduced system
+     *   (sum_q k_q A_N^q) c = sum_b f_b F_N^b
+     * only costs O(Q N^2 + N^3) operations, independent of the mesh.
+     *
+     * The error estimate is ||r||_X' / alpha_LB with the residual dual
+     * norm computed online from the Gram matrices of the Riesz
+     * representers X^-1 F_b and X^-1 A_q v_j (precomputed offline), and
+     * alpha_LB = min(1, min_q k_q) the min-theta lower bound of the
+     * coercivity constant: it bounds the energy norm ||u - V c||_X.
+     * The online expansion of ||r||^2 cancels, so the estimate cannot go
+     * below about 1e-6 ||f||_X' / alpha_LB (rounding floor).
+     */
+    class ReducedBasis {
+        public:
+            /**
+             * \param mesh The mesh, with the attributes of its edges set
+             * \param attribute_is_dirichlet The Dirichlet edge attributes
+             */
+            ReducedBasis( const Mesh& mesh, const std::vector< bool >& attribute_is_dirichlet ) ;
+
+            /**
+             * \return false if the energy matrix of the reference
+             *         parameter (k = 1) is not positive definite: the
+             *         basis cannot be built
+             */
+            bool ok() const ;
+
+            /**
+             * \brief Solves the full problem.
+             * \return false if the matrix is not positive definite
+             */
+            bool truth_solve( const ReducedParameter& mu, std::vector< double >& u ) ;
+
+            /**
+             * \brief Greedy selection: adds the truth solution of the
+             *        training parameter with the largest relative error
+             *        estimate until it is below tolerance.
+             * \return the size of the basis, -1 if !ok() or a truth
+             *         solve failed (the basis is then incomplete)
+             */
+            int build_greedy( const std::vector< ReducedParameter >& training,
+                double tolerance, int max_size ) ;
+
+            /**
+             * \brief Proper orthogonal decomposition of the truth solutions
+             *        of the training parameters (method of snapshots): keeps
+             *        the modes until the relative X-norm of the discarded
+             *        part of the snapshots is below tolerance.
+             * \return the size of the basis, -1 if !ok() or a truth
+             *         solve failed
+             */
+            int build_pod( const std::vector< ReducedParameter >& training,
+                double tolerance, int max_size ) ;
+
+            /**
+             * \brief Online solve.
+             * \param[out] c The coefficients of the solution in the basis
+             * \param[out] error_estimate If not NULL, the bound of
+             *                            ||u - V c||_X
+             * \return false if the reduced system is singular
+             */
+            bool solve( const ReducedParameter& mu, std::vector< double >& c,
+                double* error_estimate = NULL ) const ;
+
+            /**
+             * \brief Computes u = V c.
+             */
+            void reconstruct( const std::vector< double >& c, std::vector< double >& u ) const ;
+
+            /**
+             * \return ||x||_X, the energy norm of the reference parameter
+             */
+            double energy_norm( const std::vector< double >& x ) const ;
+
+            int size() const ;
+            int nb_vertices() const ;
+
+            /**
+             * \return the time spent in the offline stage (truth solves,
+             *         compression, projections), in seconds
+             */
+            double offline_time() const ;
+
+            void print() const ;
+
+        private:
+            /* X-orthonormalizes u against the basis, then adds it and
+             * its projections; returns false if u is in the span */
+            bool add_basis_vector( const std::vector< double >& u ) ;
+
+            /* coefficients of the terms: k_q, with 1 for the penalty */
+            void theta( const ReducedParameter& mu, std::vector< double >& theta_a,
+                std::vector< double >& theta_f ) const ;
+
+            const Mesh& mesh_ ;
+            AffineStiffness affine_ ;
+            std::vector< CSRMatrix > A_ ;          /* terms, last: penalty */
+            std::vector< std::vector< double > > F_ ;  /* unit source of each region */
+            CSRMatrix X_ ;
+            SparseCholesky X_factor_ ;
+            bool ok_ ;                  /* X_ is factorized */
+            SparseCholesky truth_factor_ ;
+            CSRMatrix truth_matrix_ ;
+
+            std::vector< std::vector< double > > V_ ;  /* the basis */
+            /* A_N^q (N x N each, row by row) and F_N^b */
+            std::vector< std::vector< double > > A_N_ ;
+            std::vector< std::vector< double > > F_N_ ;
+
+            /* Riesz representers X^-1 F_b and X^-1 A_q v_j (index j Q + q) */
+            std::vector< std::vector< double > > riesz_F_ ;
+            std::vector< std::vector< double > > riesz_A_ ;
+            std::vector< double > gram_FF_ ;    /* Qf x Qf */
+            std::vector< double > gram_AF_ ;    /* (Q N) x Qf, row by row */
+            std::vector< double > gram_AA_ ;    /* (Q N) x (Q N) */
+
+            double offline_time_ ;
+    } ;
+
+}
@@ -0,0 +1,287 @@
+#include "schwarz.h"
+#include "fem.h"
+#include "dense.h"
+
+#include <assert.h>
+#include <iostream>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace FEM2A {
+
+    /****************************************************************/
+    /* Implementation of SchwarzPreconditioner */
+    /****************************************************************/
+
+    SchwarzPreconditioner::SchwarzPreconditioner( const Mesh& mesh, const CSRMatrix& A,
+        const std::vector< bool >& attribute_is_dirichlet,
+        int nb_subdomains, int overlap, bool coarse_correction )
+        : A_( A ), coarse_correction_( coarse_correction ), ok_( true ), flops_( 0. ),
+        setup_time_( 0. )
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        const int n = A.nb_rows() ;
+        assert( n == mesh.nb_vertices() ) ;
+        const int nb_parts = std::max( 1, std::min( nb_subdomains, mesh.nb_triangles() ) ) ;
+
+        /* non overlapping partition of the triangles, each vertex is
+         * owned by the subdomain of its first triangle */
+        std::vector< int > part_of_triangle ;
+        mesh.partition( nb_parts, part_of_triangle ) ;
+        owner_.assign( n, -1 ) ;
+        dofs_.assign( nb_parts, std::vector< int >() ) ;
+        std::vector< int > mark( n, -1 ) ;
+        for( int t = 0; t < mesh.nb_triangles(); ++t ) {
+            const int p = part_of_triangle[t] ;
+            for( int k = 0; k < 3; ++k ) {
+                const int v = mesh.get_triangle_vertex_index( t, k ) ;
+                if( owner_[v] < 0 ) owner_[v] = p ;
+            }
+        }
+        /* the vertices in no triangle go to the first subdomain */
+        for( int i = 0; i < n; ++i ) {
+            if( owner_[i] < 0 ) {
+                owner_[i] = 0 ;
+                mark[i] = 0 ;
+                dofs_[0].push_back( i ) ;
+            }
+        }
+
+        /* subdomains: vertices of the triangles, then overlap layers of
+         * neighbours in the graph of A */
+        std::vector< std::vector< int > > triangles_of_part( nb_parts ) ;
+        for( int t = 0; t < mesh.nb_triangles(); ++t ) {
+            triangles_of_part[part_of_triangle[t]].push_back( t ) ;
+        }
+        for( int p = 0; p < nb_parts; ++p ) {
+            std::vector< int >& dofs = dofs_[p] ;
+            for( int k = 0; k < triangles_of_part[p].size(); ++k ) {
+                for( int l = 0; l < 3; ++l ) {
+                    const int v = mesh.get_triangle_vertex_index( triangles_of_part[p][k], l ) ;
+                    if( mark[v] != p ) {
+                        mark[v] = p ;
+                        dofs.push_back( v ) ;
+                    }
+                }
+            }
+            int layer_begin = 0 ;
+            for( int layer = 0; layer < overlap; ++layer ) {
+                const int layer_end = dofs.size() ;
+                for( int d = layer_begin; d < layer_end; ++d ) {
+                    const int i = dofs[d] ;
+                    for( int k = A.row_ptr_[i]; k < A.row_ptr_[i + 1]; ++k ) {
+                        const int j = A.col_[k] ;
+                        if( mark[j] != p ) {
+                            mark[j] = p ;
+                            dofs.push_back( j ) ;
+                        }
+                    }
+                }
+                layer_begin = layer_end ;
+            }
+            std::sort( dofs.begin(), dofs.end() ) ;
+        }
+
+        /* copies of each row in the subdomains */
+        copies_ptr_.assign( n + 1, 0 ) ;
+        for( int p = 0; p < nb_parts; ++p ) {
+            for( int d = 0; d < dofs_[p].size(); ++d ) copies_ptr_[dofs_[p][d] + 1]++ ;
+        }
+        for( int i = 0; i < n; ++i ) copies_ptr_[i + 1] += copies_ptr_[i] ;
+        copies_.resize( 2 * copies_ptr_[n] ) ;
+        std::vector< int > fill( copies_ptr_.begin(), copies_ptr_.end() - 1 ) ;
+        for( int p = 0; p < nb_parts; ++p ) {
+            for( int d = 0; d < dofs_[p].size(); ++d ) {
+                const int c = fill[dofs_[p][d]]++ ;
+                copies_[2 * c] = p ;
+                copies_[2 * c + 1] = d ;
+            }
+        }
+
+        /* local matrices A_p = R_p A R_p^T, factorized concurrently */
+        local_.assign( nb_parts, SparseCholesky() ) ;
+        local_r_.assign( nb_parts, std::vector< double >() ) ;
+        local_z_.assign( nb_parts, std::vector< double >() ) ;
+        bool ok = true ;
+        #pragma omp parallel for schedule(dynamic) reduction(&&:ok)
+        for( int p = 0; p < nb_parts; ++p ) {
+            const std::vector< int >& dofs = dofs_[p] ;
+            CSRMatrix Ap ;
+            Ap.row_ptr_.assign( 1, 0 ) ;
+            for( int d = 0; d < dofs.size(); ++d ) {
+                const int i = dofs[d] ;
+                for( int k = A.row_ptr_[i]; k < A.row_ptr_[i + 1]; ++k ) {
+                    /* the columns are sorted, as dofs */
+                    std::vector< int >::const_iterator it =
+                        std::lower_bound( dofs.begin(), dofs.end(), A.col_[k] ) ;
+                    if( it != dofs.end() && *it == A.col_[k] ) {
+                        Ap.col_.push_back( it - dofs.begin() ) ;
+                        Ap.val_.push_back( A.val_[k] ) ;
+                    }
+                }
+                Ap.row_ptr_.push_back( Ap.col_.size() ) ;
+            }
+            Ap.update_diagonal() ;
+            ok = local_[p].factor( Ap ) && ok ;
+            local_r_[p].resize( dofs.size() ) ;
+            local_z_[p].resize( dofs.size() ) ;
+        }
+        if( !ok ) {
+            std::cout << "Failure: a local matrix is not positive definite" << std::endl ;
+            ok_ = false ;
+        }
+
+        for( int p = 0; p < nb_parts; ++p ) {
+            flops_ += local_[p].flops() + 2. * dofs_[p].size() ;
+        }
+        if( coarse_correction_ ) {
+            /* the Dirichlet rows are left out of the coarse space */
+            std::vector< int > vertices ;
+            dirichlet_vertices( mesh, attribute_is_dirichlet, vertices ) ;
+            fixed_.assign( n, false ) ;
+            for( int k = 0; k < vertices.size(); ++k ) fixed_[vertices[k]] = true ;
+            if( !factor_coarse( A ) ) {
+                std::cout << "Failure: the coarse matrix is not positive definite" << std::endl ;
+                ok_ = false ;
+            }
+            flops_ += 4. * nb_parts * nb_parts + 4. * A.nnz() + 10. * n ;
+        }
+        setup_time_ = std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+    }
+
+    bool SchwarzPreconditioner::factor_coarse( const CSRMatrix& A )
+    {
+        /* A_0 = Z^T A Z, where column p of Z is 1 on the free rows owned
+         * by p */
+        const int m = nb_subdomains() ;
+        const int n = A.nb_rows() ;
+        coarse_L_.assign( m * m, 0. ) ;
+        for( int i = 0; i < n; ++i ) {
+            if( fixed_[i] ) continue ;
+            for( int k = A.row_ptr_[i]; k < A.row_ptr_[i + 1]; ++k ) {
+                if( fixed_[A.col_[k]] ) continue ;
+                coarse_L_[m * owner_[i] + owner_[A.col_[k]]] += A.val_[k] ;
+            }
+        }
+        /* a subdomain without free row has an empty coarse vector */
+        for( int j = 0; j < m; ++j ) {
+            if( coarse_L_[m * j + j] == 0. ) coarse_L_[m * j + j] = 1. ;
+        }
+        coarse_r_.resize( m ) ;
+        y_.resize( n ) ;
+        t_.resize( n ) ;
+        w_.resize( n ) ;
+        return dense_cholesky( coarse_L_, m ) ;
+    }
+
+    void SchwarzPreconditioner::coarse_correction( const std::vector< double >& r,
+        std::vector< double >& y ) const
+    {
+        const int n = r.size() ;
+        const int m = nb_subdomains() ;
+        std::vector< double >& c = coarse_r_ ;
+        c.assign( m, 0. ) ;
+        for( int i = 0; i < n; ++i ) {
+            if( !fixed_[i] ) c[owner_[i]] += r[i] ;
+        }
+        dense_cholesky_solve( coarse_L_, m, c ) ;
+        for( int i = 0; i < n; ++i ) {
+            y[i] = fixed_[i] ? 0. : c[owner_[i]] ;
+        }
+    }
+
+    void SchwarzPreconditioner::apply( const std::vector< double >& r,
+        std::vector< double >& z ) const
+    {
+        const int n = r.size() ;
+        if( !ok_ ) {
+            z = r ;
+            return ;
+        }
+        z.resize( n ) ;
+        if( !coarse_correction_ ) {
+            local_solves( r, z ) ;
+            return ;
+        }
+        /* balancing: y = Q r, w = M_1 (r - A y), z = y + w - Q A w */
+        coarse_correction( r, y_ ) ;
+        A_.mult( y_, t_ ) ;
+        for( int i = 0; i < n; ++i ) t_[i] = r[i] - t_[i] ;
+        local_solves( t_, w_ ) ;
+        A_.mult( w_, t_ ) ;
+        coarse_correction( t_, z ) ;
+        for( int i = 0; i < n; ++i ) z[i] = y_[i] + w_[i] - z[i] ;
+    }
+
+    void SchwarzPreconditioner::local_solves( const std::vector< double >& r,
+        std::vector< double >& z ) const
+    {
+        const int n = r.size() ;
+        const int nb_parts = nb_subdomains() ;
+        z.resize( n ) ;
+
+        /* independent local solves */
+        #pragma omp parallel for schedule(dynamic)
+        for( int p = 0; p < nb_parts; ++p ) {
+            const std::vector< int >& dofs = dofs_[p] ;
+            std::vector< double >& local_r = local_r_[p] ;
+            for( int d = 0; d < dofs.size(); ++d ) local_r[d] = r[dofs[d]] ;
+            local_[p].solve( local_r, local_z_[p] ) ;
+        }
+
+        /* sum of the extended local solutions, row by row */
+        #pragma omp parallel for
+        for( int i = 0; i < n; ++i ) {
+            double sum = 0. ;
+            for( int c = copies_ptr_[i]; c < copies_ptr_[i + 1]; ++c ) {
+                sum += local_z_[copies_[2 * c]][copies_[2 * c + 1]] ;
+            }
+            z[i] = sum ;
+        }
+    }
+
+    bool SchwarzPreconditioner::ok() const
+    {
+        return ok_ ;
+    }
+
+    double SchwarzPreconditioner::flops() const
+    {
+        return flops_ ;
+    }
+
+    int SchwarzPreconditioner::nb_subdomains() const
+    {
+        return dofs_.size() ;
+    }
+
+    double SchwarzPreconditioner::setup_time() const
+    {
+        return setup_time_ ;
+    }
+
+    void SchwarzPreconditioner::print() const
+    {
+        int min_size = dofs_.empty() ? 0 : dofs_[0].size() ;
+        int max_size = min_size ;
+        long total = 0 ;
+        for( int p = 0; p < nb_subdomains(); ++p ) {
+            min_size = std::min( min_size, int( dofs_[p].size() ) ) ;
+            max_size = std::max( max_size, int( dofs_[p].size() ) ) ;
+            total += dofs_[p].size() ;
+        }
+        std::cout << "Schwarz preconditioner: " << nb_subdomains() << " subdomains of "
+            << min_size << " to " << max_size << " unknowns, "
+            << double( total ) / owner_.size() << " copies per unknown, "
+            << ( coarse_correction_ ? "with" : "without" ) << " coarse correction, setup "
+            << setup_time_ << " s" << std::endl ;
+    }
+
+}
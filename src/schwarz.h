@@ -0,0 +1,107 @@
+#pragma once
+
+#include "mesh.h"
+#include "solver.h"
+#include "cholesky.h"
+
+#include <vector>
+
+namespace FEM2A {
+
+    /**
+     * \brief SchwarzPreconditioner is an overlapping additive Schwarz
+     *        preconditioner M_1 = sum_p R_p^T A_p^-1 R_p, where R_p
+     *        restricts to the unknowns of the subdomain p and
+     *        A_p = R_p A R_p^T is factorized with SparseCholesky, with an
+     *        optional coarse correction.
+     *
+     * The triangles are partitioned with Mesh::partition(), then each
+     * subdomain is extended by overlap layers of neighbours in the graph
+     * of A. The local factorizations and the local solves are independent
+     * and run concurrently on the OpenMP threads.
+     *
+     * The coarse space Z has one vector per subdomain, constant on the
+     * vertices owned by the subdomain (Nicolaides) and zero on the
+     * Dirichlet rows. With Q = Z A_0^-1 Z^T and A_0 = Z^T A Z, it is
+     * combined in the balancing form
+     *   M^-1 = Q + (I - Q A) M_1 (I - A Q)
+     * which costs two more products by A per application but keeps the
+     * number of iterations almost constant when the number of subdomains
+     * grows (the additive form Q + M_1 barely improves M_1). M is
+     * symmetric positive definite and can be used with pcg_solve().
+     */
+    class SchwarzPreconditioner : public Preconditioner {
+        public:
+            /**
+             * \param mesh The mesh on which A is assembled, one unknown
+             *             per vertex
+             * \param A The matrix, kept by reference
+             * \param attribute_is_dirichlet The Dirichlet edge
+             *        attributes of the mesh (the rows fixed by the
+             *        penalty, left out of the coarse space)
+             * \param nb_subdomains The number of subdomains, typically a
+             *                      multiple of the number of threads
+             * \param overlap The number of layers of vertices added around
+             *                each subdomain
+             * \param coarse_correction Add the coarse space correction
+             */
+            SchwarzPreconditioner( const Mesh& mesh, const CSRMatrix& A,
+                const std::vector< bool >& attribute_is_dirichlet,
+                int nb_subdomains, int overlap = 1, bool coarse_correction = true ) ;
+
+            /**
+             * \return false if a local matrix or the coarse matrix could
+             *         not be factorized (not positive definite): apply()
+             *         is then the identity, and the caller should use
+             *         another preconditioner
+             */
+            bool ok() const ;
+
+            void apply( const std::vector< double >& r,
+                std::vector< double >& z ) const ;
+            double flops() const ;
+
+            int nb_subdomains() const ;
+
+            /**
+             * \return the time spent in the constructor (partitioning and
+             *         factorizations) in seconds
+             */
+            double setup_time() const ;
+
+            void print() const ;
+
+        private:
+            /* false if Z^T A Z is not positive definite */
+            bool factor_coarse( const CSRMatrix& A ) ;
+            /* y = Q r = Z A_0^-1 Z^T r */
+            void coarse_correction( const std::vector< double >& r,
+                std::vector< double >& y ) const ;
+            /* z = M_1 r = sum_p R_p^T A_p^-1 R_p r */
+            void local_solves( const std::vector< double >& r,
+                std::vector< double >& z ) const ;
+
+            const CSRMatrix& A_ ;
+
+            std::vector< std::vector< int > > dofs_ ;   /* unknowns of each subdomain */
+            std::vector< SparseCholesky > local_ ;
+            /* for each row, the (subdomain, local index) pairs containing
+             * it, so the local solutions are summed without conflicts */
+            std::vector< int > copies_ptr_ ;
+            std::vector< int > copies_ ;
+
+            bool coarse_correction_ ;
+            std::vector< int > owner_ ;         /* subdomain owning each row */
+            std::vector< bool > fixed_ ;        /* Dirichlet rows, not in Z */
+            std::vector< double > coarse_L_ ;   /* dense Cholesky factor of Z^T A Z */
+
+            bool ok_ ;
+            double flops_ ;
+            double setup_time_ ;
+
+            /* work vectors */
+            mutable std::vector< std::vector< double > > local_r_, local_z_ ;
+            mutable std::vector< double > coarse_r_, y_, t_, w_ ;
+    } ;
+
+}
@@ -2,9 +2,17 @@
 
 #include "mesh.h"
 #include "fem.h"
+#include "heat.h"
+#include "adapt.h"
+#include "postprocess.h"
+#include "vtu.h"
+#include "writer.h"
+#include "snapshot.h"
+#include "trace.h"
 #include <math.h>
 #include <cmath>
 #include <iostream>
+#include <utility>
 
 namespace FEM2A {
     namespace Simu {
@@ -13,26 +21,53 @@ namespace FEM2A {
         //  Useful functions
         //#################################
 
-        double unit_fct( vertex v )
+        inline double unit_fct( vertex v )
         {
             return 1.;
         }
 
-        double zero_fct( vertex v )
+        inline double zero_fct( vertex v )
         {
             return 0.;
         }
 
-        double xy_fct( vertex v )
+        inline double xy_fct( vertex v )
         {
             return v.x + v.y;
         }
 
+        //#################################
+        //  Étapes des problèmes P1 (aussi chronométrées par bench.cpp)
+        //#################################
+
+        // assemblage de K (k = 1) et, avec le terme source f = 1, de F
+        inline void assemble_p1_system( const Mesh& mesh, bool with_source,
+                SparseMatrix& K, std::vector< double >& F )
+        {
+            ScopedTimer timer("element loop");
+            // parcours des triangles consituant le maillage, k = 1
+            assemble_p1_poisson(mesh, unit_fct, with_source ? unit_fct : NULL, K, F);
+        }
+
+        // condition de Dirichlet sur le bord (attribut 1, voir
+        // Mesh::set_attribute) : u = x + y sans terme source, u = 0 avec
+        inline void p1_dirichlet_values( const Mesh& mesh, bool with_source,
+                std::vector< bool >& attribut_dirichlet, std::vector< double >& values )
+        {
+            attribut_dirichlet.assign(2, false);
+            attribut_dirichlet[1] = true;
+            values.resize(mesh.nb_vertices());
+            for (int i = 0; i < mesh.nb_vertices(); ++i) {
+            	values[i] = with_source ? zero_fct(mesh.get_vertex(i)) : xy_fct(mesh.get_vertex(i));
+            }
+        }
+
         //#################################
         //  Simulations
         //#################################
 
-        void pure_dirichlet_pb( const std::string& mesh_filename, bool verbose )
+        inline void pure_dirichlet_pb( const std::string& mesh_filename, bool verbose,
+                const SolverOptions& solver_options = SolverOptions() )
         {
             std::cout << "Solving a pure Dirichlet problem" << std::endl;
             Mesh mesh;
@@ -40,80 +75,175 @@ namespace FEM2A {
             SparseMatrix K(mesh.nb_vertices());
             std::vector< double > F(mesh.nb_vertices(), 0.);
             
-            // parcours des triangles consituant le maillage
-            for ( int triangle = 0; triangle < mesh.nb_triangles(); ++triangle) {
-            	ElementMapping mapping(mesh, false, triangle);
-            	ShapeFunctions shape_f_triangle(2,1);
-            	Quadrature quad = Quadrature::get_quadrature(2);
-            	DenseMatrix Ke;
-            	// on utilise unit_fct pour le calcul de Ke car k = 1
-            	assemble_elementary_matrix(mapping, shape_f_triangle, quad, unit_fct, Ke);
-            	local_to_global_matrix(mesh, triangle, Ke, K);
-            }
+            assemble_p1_system(mesh, false, K, F);
             
             // condition de Dirichlet
-            std::vector< double > values(mesh.nb_vertices());
-            std::vector< bool > attribut_dirichlet(2, false);
-            attribut_dirichlet[1] = true;
+            std::vector< double > values;
+            std::vector< bool > attribut_dirichlet;
             mesh.set_attribute(unit_fct, 1, true);
-            
-            for (int i = 0; i < mesh.nb_vertices(); ++i) {
-            	values[i] = xy_fct(mesh.get_vertex(i));
-            }
+            p1_dirichlet_values(mesh, false, attribut_dirichlet, values);
             apply_dirichlet_boundary_conditions(mesh, attribut_dirichlet,values, K, F);
             
             // résolution du système linéaire
             std::vector< double > u(mesh.nb_vertices());
-            solve(K, F, u);
+            SolveReport report;
+            solve(K, F, u, solver_options, &report);
+            report.print();
             
-            // sauvergarde
+            // sauvergarde en tâche de fond, le maillage et la solution sont transférés
             std::string export_name ="pure_dirichlet";
-            mesh.save(export_name+".mesh"); /* sauvergarde du maillage */
-            save_solution(u, export_name+".bb"); /* sauvergarde de la solution du pb */
+            output_writer().save_mesh(std::move(mesh), export_name+".mesh"); /* sauvergarde du maillage */
+            output_writer().save_solution(std::move(u), export_name+".bb"); /* sauvergarde de la solution du pb */
         }
 	
-	void dirichlet_with_src_pb(const std::string& mesh_filename, bool verbose)
+	inline void dirichlet_with_src_pb(const std::string& mesh_filename, bool verbose,
+                const SolverOptions& solver_options = SolverOptions(),
+                bool use_system_cache = false, bool export_system = false)
 	{
             std::cout << "Solving a Dirichlet problem with a source term" << std::endl;
             Mesh mesh;
             mesh.load(mesh_filename);
+            mesh.set_attribute(unit_fct, 1, true);
             SparseMatrix K(mesh.nb_vertices());
             std::vector< double > F(mesh.nb_vertices(), 0.);
             
-            // parcours des triangles consituant le maillage
-            for ( int triangle = 0; triangle < mesh.nb_triangles(); ++triangle) {
-            	ElementMapping mapping(mesh, false, triangle);
-            	ShapeFunctions shape_f_triangle(2,1);
-            	Quadrature quad = Quadrature::get_quadrature(2);
-            	// on utilise unit_fct pour le calcul de Ke car k = 1
-            	DenseMatrix Ke;
-            	assemble_elementary_matrix(mapping, shape_f_triangle, quad, unit_fct, Ke);
-            	local_to_global_matrix(mesh, triangle, Ke, K);
-            	std::vector< double > Fe(shape_f_triangle.nb_functions(), 0.);
-            	assemble_elementary_vector(mapping, shape_f_triangle, quad, unit_fct, Fe);
-            	local_to_global_vector(mesh, false, triangle, Fe, F);
+            // système déjà assemblé pour ce maillage et ce problème ?
+            const unsigned long long key = snapshot_key(mesh_filename,
+                "dirichlet_with_source_term P1 k=1 f=1 g=0 penalty="
+                + std::to_string(dirichlet_penalty));
+            const std::string snapshot = snapshot_filename(key);
+            AssembledSystem system;
+            if( use_system_cache && system.load(snapshot, key) ) {
+            	std::cout << "assembled system loaded from " << snapshot << std::endl;
+            	system.to_sparse_matrix(K);
+            	F = system.F_;
+            } else {
+            	assemble_p1_system(mesh, true, K, F);
+            	// Condition de Dirichlet
+            	std::vector< double > values;
+            	std::vector< bool > attribut_dirichlet;
+            	p1_dirichlet_values(mesh, true, attribut_dirichlet, values);
+            	
+            	apply_dirichlet_boundary_conditions(mesh, attribut_dirichlet, values, K, F);
+            	if( use_system_cache || export_system ) {
+            		system = AssembledSystem(K, F);
+            		system.set_boundary(mesh, attribut_dirichlet, values);
+            	}
+            	if( use_system_cache ) system.save(snapshot, key);
             }
-            // Condition de Dirichlet
-            std::vector< double > values(mesh.nb_vertices());
-            std::vector< bool > attribut_dirichlet(2, false);
-            attribut_dirichlet[1] = true;
-            mesh.set_attribute(unit_fct, 1, true);
-            
-            for (int i = 0; i < mesh.nb_vertices(); ++i) {
-            	values[i] = zero_fct(mesh.get_vertex(i));
-            }
-            
-            apply_dirichlet_boundary_conditions(mesh, attribut_dirichlet, values, K, F);
+            // K et F au format Matrix Market
+            if( export_system ) system.export_matrix_market("dirichlet_with_source_term");
             
             // solve du système linéaire
             std::vector< double > u(mesh.nb_vertices());
-            solve(K, F, u);
+            SolveReport report;
+            solve(K, F, u, solver_options, &report);
+            report.print();
             
-            // sauvegarde
+            // sauvegarde en tâche de fond : maillage, solution, gradient et flux, .vtu
             std::string export_name = "dirichlet_with_source_term";
-            mesh.save(export_name+".mesh"); /* sauvergarde du maillage */
-            save_solution(u, export_name+".bb"); /* sauvergarde de la solution du pb */
+            output_writer().save_results(std::move(mesh), std::move(u), unit_fct, export_name);
 	}
+
+        inline void dirichlet_with_src_p2_pb( const std::string& mesh_filename, bool verbose,
+                const SolverOptions& solver_options = SolverOptions() )
+        {
+            std::cout << "Solving a Dirichlet problem with a source term (P2 elements)" << std::endl;
+            Mesh mesh;
+            mesh.load(mesh_filename);
+            mesh.set_attribute(unit_fct, 1, true);
+            // sommets puis milieux des arêtes
+            DofNumbering dofs(mesh, 2);
+            SparseMatrix K(dofs.nb_dofs());
+            std::vector< double > F(dofs.nb_dofs(), 0.);
+            ShapeFunctions shape_f_triangle(2,2);
+            Quadrature quad = Quadrature::get_quadrature(4);
+            {
+            	ScopedTimer timer("element loop");
+            	for ( int triangle = 0; triangle < mesh.nb_triangles(); ++triangle) {
+            		ElementMapping mapping(mesh, false, triangle);
+            		DenseMatrix Ke;
+            		assemble_elementary_matrix(mapping, shape_f_triangle, quad, unit_fct, Ke);
+            		local_to_global_matrix(dofs, triangle, Ke, K);
+            		std::vector< double > Fe(shape_f_triangle.nb_functions(), 0.);
+            		assemble_elementary_vector(mapping, shape_f_triangle, quad, unit_fct, Fe);
+            		local_to_global_vector(dofs, false, triangle, Fe, F);
+            	}
+            }
+            // Condition de Dirichlet
+            std::vector< double > values(dofs.nb_dofs());
+            std::vector< bool > attribut_dirichlet(2, false);
+            attribut_dirichlet[1] = true;
+            for (int d = 0; d < dofs.nb_dofs(); ++d) {
+            	values[d] = zero_fct(dofs.get_dof_position(d));
+            }
+            apply_dirichlet_boundary_conditions(mesh, dofs, attribut_dirichlet, values, K, F);
+
+            std::vector< double > u(dofs.nb_dofs());
+            SolveReport report;
+            solve(K, F, u, solver_options, &report);
+            report.print();
+
+            // sauvegarde : les DOFs P2 sont les sommets du maillage raffiné
+            Mesh sub_mesh;
+            std::vector< int > parents;
+            mesh.refine_uniformly(sub_mesh, parents);
+            std::string export_name = "dirichlet_with_source_term_p2";
+            sub_mesh.save(export_name+".mesh");
+            save_solution(u, export_name+".bb");
+        }
+
+        inline void heat_transient_pb( const std::string& mesh_filename, bool verbose,
+                const SolverOptions& solver_options, double dt, int nb_steps,
+                double theta, int snapshot_period )
+        {
+            std::cout << "Solving a transient heat problem with a source term" << std::endl;
+            Mesh mesh;
+            mesh.load(mesh_filename);
+            // condition de Dirichlet u = 0 sur le bord, u = 0 à t = 0
+            std::vector< bool > attribut_dirichlet(2, false);
+            attribut_dirichlet[1] = true;
+            mesh.set_attribute(unit_fct, 1, true);
+
+            // matrices assemblées et factorisées une seule fois
+            HeatSolver heat(mesh, unit_fct, unit_fct, zero_fct, attribut_dirichlet,
+                dt, theta, solver_options);
+            heat.set_initial_condition(zero_fct);
+
+            // pas de temps, les instantanés sont écrits en tâche de fond
+            std::string export_name = "heat_transient";
+            heat.run(nb_steps, snapshot_period, export_name);
+            heat.save_snapshot(export_name + ".bb"); /* solution finale */
+            heat.flush();
+            heat.print();
+        }
+
+        inline void adaptive_pb( const std::string& mesh_filename, bool verbose,
+                const SolverOptions& solver_options, double tolerance )
+        {
+            std::cout << "Solving a Dirichlet problem with a source term on an adapted mesh" << std::endl;
+            Mesh mesh;
+            mesh.load(mesh_filename);
+            std::vector< bool > attribut_dirichlet(2, false);
+            attribut_dirichlet[1] = true;
+            mesh.set_attribute(unit_fct, 1, true);
+
+            // boucle solve - estimate - mark - refine
+            AdaptiveOptions options;
+            options.tolerance = tolerance;
+            options.solver = solver_options;
+            options.verbose = true;
+            std::vector< double > u;
+            AdaptiveReport report;
+            adaptive_solve(mesh, unit_fct, unit_fct, zero_fct, attribut_dirichlet,
+                options, u, &report);
+            report.print();
+
+            // sauvegarde
+            std::string export_name = "adaptive";
+            mesh.save(export_name+".mesh");
+            save_solution(u, export_name+".bb");
+        }
     }
 
 }
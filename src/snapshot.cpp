@@ -0,0 +1,249 @@
+#include "snapshot.h"
+#include "fem.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace FEM2A {
+
+    static const char snapshot_magic[8] = { 'F', 'E', 'M', '2', 'A', 'S', 'Y', 'S' } ;
+    static const uint32_t snapshot_version = 1 ;
+
+    /* the 64 bytes at the beginning of a snapshot */
+    struct SnapshotHeader {
+        char magic[8] ;
+        uint32_t version ;
+        uint32_t nb_attributes ;
+        uint64_t key ;
+        uint64_t nb_rows ;
+        uint64_t nnz ;
+        uint64_t nb_dirichlet ;
+        uint64_t reserved[2] ;
+    } ;
+
+    static void fnv1a( const char* data, size_t size, uint64_t& hash )
+    {
+        for( size_t i = 0; i < size; ++i ) {
+            hash ^= static_cast< unsigned char >( data[i] ) ;
+            hash *= 1099511628211ULL ;
+        }
+    }
+
+    unsigned long long snapshot_key( const std::string& mesh_filename,
+        const std::string& problem )
+    {
+        uint64_t hash = 14695981039346656037ULL ;
+        std::ifstream mesh_file( mesh_filename.c_str(), std::ios::in | std::ios::binary ) ;
+        if( !mesh_file ) {
+            std::cout << "snapshot_key: unable to read " << mesh_filename << std::endl ;
+        }
+        std::vector< char > buffer( 1 << 16 ) ;
+        while( mesh_file ) {
+            mesh_file.read( &buffer[0], buffer.size() ) ;
+            fnv1a( &buffer[0], mesh_file.gcount(), hash ) ;
+        }
+        /* a separator, so that the file and the problem cannot be shifted */
+        const char separator = 0 ;
+        fnv1a( &separator, 1, hash ) ;
+        fnv1a( problem.c_str(), problem.size(), hash ) ;
+        return hash ;
+    }
+
+    std::string snapshot_filename( unsigned long long key )
+    {
+        std::ostringstream filename ;
+        filename << "system_" << std::hex << std::setw( 16 ) << std::setfill( '0' )
+            << key << ".snap" ;
+        return filename.str() ;
+    }
+
+    template < typename T >
+    static void write_array( std::ofstream& out, const std::vector< T >& values )
+    {
+        if( !values.empty() ) {
+            out.write( reinterpret_cast< const char* >( &values[0] ), values.size() * sizeof( T ) ) ;
+        }
+    }
+
+    /* copies size values out of the mapping and moves after them */
+    template < typename T >
+    static void read_array( const char*& position, size_t size, std::vector< T >& values )
+    {
+        values.resize( size ) ;
+        if( size > 0 ) memcpy( &values[0], position, size * sizeof( T ) ) ;
+        position += size * sizeof( T ) ;
+    }
+
+    /****************************************************************/
+    /* Implementation of AssembledSystem */
+    /****************************************************************/
+
+    AssembledSystem::AssembledSystem()
+    {
+
+    }
+
+    AssembledSystem::AssembledSystem( const SparseMatrix& K, const std::vector< double >& F )
+        : K_( K ), F_( F )
+    {
+        assert( F.size() == K.nb_rows() ) ;
+    }
+
+    int AssembledSystem::nb_rows() const
+    {
+        return F_.size() ;
+    }
+
+    void AssembledSystem::set_boundary( const Mesh& mesh,
+        const std::vector< bool >& attribute_is_dirichlet, const std::vector< double >& values )
+    {
+        attribute_is_dirichlet_ = attribute_is_dirichlet ;
+        dirichlet_vertices( mesh, attribute_is_dirichlet, dirichlet_vertices_ ) ;
+        dirichlet_values_.resize( dirichlet_vertices_.size() ) ;
+        for( int d = 0; d < dirichlet_vertices_.size(); ++d ) {
+            dirichlet_values_[d] = values[dirichlet_vertices_[d]] ;
+        }
+    }
+
+    void AssembledSystem::to_sparse_matrix( SparseMatrix& K ) const
+    {
+        const int n = nb_rows() ;
+        K = SparseMatrix( n ) ;
+        for( int i = 0; i < n; ++i ) {
+            for( int k = K_.row_ptr_[i]; k < K_.row_ptr_[i + 1]; ++k ) {
+                K.add( i, K_.col_[k], K_.val_[k] ) ;
+            }
+        }
+    }
+
+    bool AssembledSystem::save( const std::string& filename, unsigned long long key ) const
+    {
+        std::ofstream out( filename.c_str(), std::ios::out | std::ios::trunc | std::ios::binary ) ;
+        if( !out ) {
+            std::cout << "Unable to write " << filename << std::endl ;
+            return false ;
+        }
+        SnapshotHeader header ;
+        memset( &header, 0, sizeof( header ) ) ;
+        memcpy( header.magic, snapshot_magic, sizeof( snapshot_magic ) ) ;
+        header.version = snapshot_version ;
+        header.nb_attributes = attribute_is_dirichlet_.size() ;
+        header.key = key ;
+        header.nb_rows = nb_rows() ;
+        header.nnz = K_.col_.size() ;
+        header.nb_dirichlet = dirichlet_vertices_.size() ;
+        out.write( reinterpret_cast< const char* >( &header ), sizeof( header ) ) ;
+
+        /* the doubles, then the ints */
+        write_array( out, K_.val_ ) ;
+        write_array( out, F_ ) ;
+        write_array( out, dirichlet_values_ ) ;
+        write_array( out, K_.row_ptr_ ) ;
+        write_array( out, K_.col_ ) ;
+        write_array( out, dirichlet_vertices_ ) ;
+        std::vector< int > flags( attribute_is_dirichlet_.begin(), attribute_is_dirichlet_.end() ) ;
+        write_array( out, flags ) ;
+        out.flush() ;
+        if( !out ) {
+            std::cout << "Error while writing " << filename << std::endl ;
+            return false ;
+        }
+        return true ;
+    }
+
+    bool AssembledSystem::load( const std::string& filename, unsigned long long key )
+    {
+        const int fd = open( filename.c_str(), O_RDONLY ) ;
+        if( fd < 0 ) return false ;
+        struct stat status ;
+        if( fstat( fd, &status ) != 0 || status.st_size < sizeof( SnapshotHeader ) ) {
+            close( fd ) ;
+            return false ;
+        }
+        const size_t size = status.st_size ;
+        void* mapping = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 ) ;
+        close( fd ) ;
+        if( mapping == MAP_FAILED ) return false ;
+
+        const char* data = static_cast< const char* >( mapping ) ;
+        SnapshotHeader header ;
+        memcpy( &header, data, sizeof( header ) ) ;
+        const uint64_t expected_size = sizeof( SnapshotHeader )
+            + sizeof( double ) * ( header.nnz + header.nb_rows + header.nb_dirichlet )
+            + sizeof( int ) * ( header.nb_rows + 1 + header.nnz + header.nb_dirichlet
+                + header.nb_attributes ) ;
+        const bool valid = memcmp( header.magic, snapshot_magic, sizeof( snapshot_magic ) ) == 0
+            && header.version == snapshot_version && header.key == key
+            && expected_size == size ;
+        if( valid ) {
+            madvise( mapping, size, MADV_SEQUENTIAL ) ;
+            const char* position = data + sizeof( SnapshotHeader ) ;
+            read_array( position, header.nnz, K_.val_ ) ;
+            read_array( position, header.nb_rows, F_ ) ;
+            read_array( position, header.nb_dirichlet, dirichlet_values_ ) ;
+            read_array( position, header.nb_rows + 1, K_.row_ptr_ ) ;
+            read_array( position, header.nnz, K_.col_ ) ;
+            read_array( position, header.nb_dirichlet, dirichlet_vertices_ ) ;
+            std::vector< int > flags ;
+            read_array( position, header.nb_attributes, flags ) ;
+            attribute_is_dirichlet_.assign( flags.begin(), flags.end() ) ;
+            K_.diag_.resize( header.nb_rows ) ;
+            K_.update_diagonal() ;
+        }
+        munmap( mapping, size ) ;
+        return valid ;
+    }
+
+    bool AssembledSystem::export_matrix_market( const std::string& prefix ) const
+    {
+        const int n = nb_rows() ;
+        const CSRMatrix Kt = transpose( K_ ) ;
+        const bool symmetric = Kt.col_ == K_.col_ && Kt.val_ == K_.val_ ;
+
+        std::ofstream matrix_file( ( prefix + "_K.mtx" ).c_str(), std::ios::out | std::ios::trunc ) ;
+        std::ofstream vector_file( ( prefix + "_F.mtx" ).c_str(), std::ios::out | std::ios::trunc ) ;
+        if( !matrix_file || !vector_file ) {
+            std::cout << "Unable to write " << prefix << "_K.mtx and " << prefix << "_F.mtx" << std::endl ;
+            return false ;
+        }
+        matrix_file << std::setprecision( 17 ) ;
+        vector_file << std::setprecision( 17 ) ;
+
+        /* the lower triangle only if symmetric */
+        int nb_entries = 0 ;
+        for( int i = 0; i < n; ++i ) {
+            for( int k = K_.row_ptr_[i]; k < K_.row_ptr_[i + 1]; ++k ) {
+                if( !symmetric || K_.col_[k] <= i ) ++nb_entries ;
+            }
+        }
+        matrix_file << "%%MatrixMarket matrix coordinate real "
+            << ( symmetric ? "symmetric" : "general" ) << "\n" ;
+        matrix_file << n << " " << n << " " << nb_entries << "\n" ;
+        for( int i = 0; i < n; ++i ) {
+            for( int k = K_.row_ptr_[i]; k < K_.row_ptr_[i + 1]; ++k ) {
+                if( symmetric && K_.col_[k] > i ) continue ;
+                matrix_file << i + 1 << " " << K_.col_[k] + 1 << " " << K_.val_[k] << "\n" ;
+            }
+        }
+
+        vector_file << "%%MatrixMarket matrix array real general\n" ;
+        vector_file << n << " 1\n" ;
+        for( int i = 0; i < n; ++i ) vector_file << F_[i] << "\n" ;
+
+        matrix_file.flush() ;
+        vector_file.flush() ;
+        return !matrix_file.fail() && !vector_file.fail() ;
+    }
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "mesh.h"
+#include "solver.h"
+
+#include <vector>
+#include <string>
+
+namespace FEM2A {
+
+    /**
+     * \return a 64-bit FNV-1a hash of the content of the mesh file and of
+     *         the description of the problem (coefficients, sources,
+     *         boundary conditions, elements...): two runs with the same
+     *         key assemble the same system.
+     */
+    unsigned long long snapshot_key( const std::string& mesh_filename,
+        const std::string& problem ) ;
+
+    /**
+     * \return the name of the snapshot of a key, "system_<key in hex>.snap"
+     */
+    std::string snapshot_filename( unsigned long long key ) ;
+
+    /**
+     * \brief AssembledSystem holds a linear system ready to be solved,
+     *        boundary conditions included, with the metadata of its
+     *        Dirichlet boundary, so that a rerun on the same mesh and
+     *        problem can skip the assembly:
+     *          - save() writes it in a binary snapshot keyed by
+     *            snapshot_key(),
+     *          - load() maps the snapshot in memory and copies the arrays
+     *            out of it, after checking its key,
+     *          - export_matrix_market() writes K and F in the Matrix
+     *            Market format to study the linear system alone.
+     *
+     * The snapshot is a 64 bytes header (magic, version, key, sizes)
+     * followed by the arrays, the doubles first so that they are aligned
+     * in the mapping. It is read on the machine that wrote it (native
+     * byte order).
+     */
+    struct AssembledSystem {
+
+        /* Methods */
+        AssembledSystem() ;
+        AssembledSystem( const SparseMatrix& K, const std::vector< double >& F ) ;
+
+        int nb_rows() const ;
+
+        /**
+         * \brief Records the attributes and the vertices of the Dirichlet
+         *        edges (as apply_dirichlet_boundary_conditions()) and the
+         *        values imposed at these vertices.
+         */
+        void set_boundary( const Mesh& mesh, const std::vector< bool >& attribute_is_dirichlet,
+            const std::vector< double >& values ) ;
+
+        /**
+         * \brief Rebuilds the SparseMatrix used by solve().
+         */
+        void to_sparse_matrix( SparseMatrix& K ) const ;
+
+        bool save( const std::string& filename, unsigned long long key ) const ;
+
+        /**
+         * \return false if the file does not exist, is not a snapshot or
+         *         was written for another key (the system is unchanged)
+         */
+        bool load( const std::string& filename, unsigned long long key ) ;
+
+        /**
+         * \brief Writes <prefix>_K.mtx (coordinate real symmetric if K is,
+         *        else general, 1-based) and <prefix>_F.mtx (array real).
+         */
+        bool export_matrix_market( const std::string& prefix ) const ;
+
+        /* Data */
+        CSRMatrix K_ ;
+        std::vector< double > F_ ;
+        std::vector< bool > attribute_is_dirichlet_ ;
+        std::vector< int > dirichlet_vertices_ ;
+        std::vector< double > dirichlet_values_ ;
+    } ;
+
+}
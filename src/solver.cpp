@@ -1,11 +1,20 @@
 #include "solver.h"
+#include "amg.h"
+#include "cholesky.h"
+#include "recycling.h"
+#include "trace.h"
 #include <assert.h>
 #include <iostream>
 #include <iomanip>
 #include <cmath>
 #include <algorithm>
 #include <stdlib.h>
+#include <chrono>
+#include <utility>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "../third_party/OpenNL_psm.h"
 
@@ -24,40 +33,259 @@
 
 namespace FEM2A {
 
+    SolverOptions::SolverOptions()
+        : solver( SOLVER_DEFAULT ), preconditioner( PRECOND_NONE ),
+        threshold( 1e-12 ), max_iterations( 1000000 ), omega( 1.5 ),
+        mic_relaxation( 0.95 ), amg_strength( 0.08 ), amg_chebyshev( true ),
+        amg_smoothing_steps( 2 ),
+        symmetric( false ), nb_threads( 0 ), use_initial_guess( false ),
+        inner_threshold( 1e-3 ), recycle_dim( 8 ), multicolor( false ),
+        verbose( true )
+    {
+
+    }
+
+    SolveReport::SolveReport()
+        : converged( false ), nb_iterations( 0 ), error( 0. ),
+        elapsed_time( 0. ), gflops( 0. )
+    {
+
+    }
+
+    void SolveReport::print() const
+    {
+        std::cout << ( converged ? "converged" : "NOT converged" )
+            << " in " << nb_iterations << " iterations"
+            << ", ||Ax-b||/||b|| = " << error
+            << ", time = " << elapsed_time << " s"
+            << ", " << gflops << " GFlop/s" << std::endl ;
+    }
+
+    bool solver_type_from_string( const std::string& name, SolverType& solver )
+    {
+        if( name == "default" ) solver = SOLVER_DEFAULT ;
+        else if( name == "cg" ) solver = SOLVER_CG ;
+        else if( name == "bicgstab" ) solver = SOLVER_BICGSTAB ;
+        else if( name == "gmres" ) solver = SOLVER_GMRES ;
+        else if( name == "native-cg" ) solver = SOLVER_NATIVE_CG ;
+        else if( name == "cholesky" ) solver = SOLVER_CHOLESKY ;
+        else if( name == "mixed-cg" ) solver = SOLVER_MIXED_CG ;
+        else if( name == "recycling-cg" ) solver = SOLVER_RECYCLING_CG ;
+        else return false ;
+        return true ;
+    }
+
+    bool preconditioner_type_from_string(
+        const std::string& name, PreconditionerType& precond )
+    {
+        if( name == "none" ) precond = PRECOND_NONE ;
+        else if( name == "jacobi" ) precond = PRECOND_JACOBI ;
+        else if( name == "ssor" ) precond = PRECOND_SSOR ;
+        else if( name == "ic0" ) precond = PRECOND_IC0 ;
+        else if( name == "mic0" ) precond = PRECOND_MIC0 ;
+        else if( name == "amg" ) precond = PRECOND_AMG ;
+        else return false ;
+        return true ;
+    }
+
+    /**
+     * \brief Sets the number of OpenMP threads for the lifetime of the
+     *        object (if nb_threads > 0), then restores the previous one:
+     *        options.nb_threads only applies to the solve.
+     */
+    class ScopedThreadCount {
+        public:
+            explicit ScopedThreadCount( int nb_threads ) : previous_( 0 )
+            {
+#ifdef _OPENMP
+                if( nb_threads > 0 ) {
+                    previous_ = omp_get_max_threads() ;
+                    omp_set_num_threads( nb_threads ) ;
+                }
+#endif
+            }
+
+            ~ScopedThreadCount()
+            {
+#ifdef _OPENMP
+                if( previous_ > 0 ) omp_set_num_threads( previous_ ) ;
+#endif
+            }
+
+        private:
+            int previous_ ;     /* 0 if unchanged */
+    } ;
+
+    /**
+     * \brief Creates an OpenNL context for n variables and nb_systems
+     *        right hand sides, with the parameters of options. The
+     *        preconditioner is only set if one was requested, so that
+     *        OpenNL keeps its own choice otherwise (Jacobi with CG).
+     */
+    static NLContext new_nl_context( int n, int nb_systems, const SolverOptions& options )
+    {
+        NLenum nl_solver = NL_SOLVER_DEFAULT ;
+        switch( options.solver ) {
+            case SOLVER_CG : nl_solver = NL_CG ; break ;
+            case SOLVER_BICGSTAB : nl_solver = NL_BICGSTAB ; break ;
+            case SOLVER_GMRES : nl_solver = NL_GMRES ; break ;
+            default : break ;
+        }
+        NLenum nl_precond = NL_PRECOND_NONE ;
+        switch( options.preconditioner ) {
+            case PRECOND_JACOBI : nl_precond = NL_PRECOND_JACOBI ; break ;
+            case PRECOND_SSOR : nl_precond = NL_PRECOND_SSOR ; break ;
+            case PRECOND_IC0 :
+            case PRECOND_MIC0 :
+            case PRECOND_AMG :
+                std::cout << "Warning: this preconditioner is only available "
+                    << "with the native CG, no preconditioner used" << std::endl ;
+                break ;
+            default : break ;
+        }
+
+        NLContext nl_context = nlNewContext() ;
+        nlSolverParameteri( NL_NB_SYSTEMS, NLint( nb_systems ) ) ;
+        nlSolverParameteri( NL_NB_VARIABLES, NLint( n    ) ) ;
+        nlSolverParameteri( NL_SOLVER, NLint( nl_solver ) ) ;
+        if( nl_precond != NL_PRECOND_NONE ) {
+            nlSolverParameteri( NL_PRECONDITIONER, NLint( nl_precond ) ) ;
+        }
+        nlSolverParameteri( NL_SYMMETRIC, NLint( options.symmetric ) ) ;
+        nlSolverParameteri( NL_MAX_ITERATIONS, NLint( options.max_iterations ) ) ;
+        nlSolverParameterd( NL_THRESHOLD, NLdouble( options.threshold ) ) ;
+        nlSolverParameterd( NL_OMEGA, NLdouble( options.omega ) ) ;
+        if( options.verbose ) nlEnable( NL_VERBOSE ) ;
+        return nl_context ;
+    }
+
     bool solve(
         const SparseMatrix& A,
         const std::vector< double >& b,
         std::vector< double >& x )
     {
+        /* the previous hardcoded parameters, with the OpenNL log */
+        SolverOptions options ;
+        options.verbose = true ;
+        return solve( A, b, x, options ) ;
+    }
+
+    bool solve(
+        const SparseMatrix& A,
+        const std::vector< double >& b,
+        std::vector< double >& x,
+        const SolverOptions& options,
+        SolveReport* report )
+    {
+        ScopedTimer timer( "solve" ) ;
+        ScopedThreadCount threads( options.nb_threads ) ;
         assert(A.nb_rows() == b.size()) ;
         int n = b.size() ;
         x.resize( n ) ;
 
-        NLContext nl_context = nlNewContext() ;
-        nlSolverParameteri( NL_NB_VARIABLES, NLint( n    ) ) ;
-        nlSolverParameteri( NL_MAX_ITERATIONS, NLint( 1e6 ) ) ;
-        nlSolverParameterd( NL_THRESHOLD, NLdouble( 1e-12 ) ) ;
-        nlEnable( NL_VERBOSE ) ;
-        nlBegin( NL_SYSTEM ) ;
-        nlBegin( NL_MATRIX ) ;
-        for( int i = 0; i < n; i++ ) {
-            const std::vector< int >& J = A.get_cols_at_line( i ) ;
-            const std::vector< double >& V = A.get_vals_at_line( i ) ;
-            assert( J.size() == V.size() ) ;
-            nlBegin( NL_ROW ) ;
-            for( unsigned int k = 0; k < J.size(); k++ ) {
-                nlCoefficient( J[k], NLdouble( V[k] ) ) ;
+        if( options.solver == SOLVER_NATIVE_CG ) {
+            CSRMatrix A_csr( A ) ;
+            Preconditioner* P = new_preconditioner( A_csr, options ) ;
+            std::cout << "solving system with " << n << " unknowns (native CG) .. "
+                << std::endl ;
+            const bool converged = pcg_solve( A_csr, b, x, P, options, report ) ;
+            delete P ;
+            std::cout << ( converged ? ".. system solved" :
+                ".. maximum number of iterations reached" ) << std::endl ;
+            return converged ;
+        }
+
+        if( options.solver == SOLVER_RECYCLING_CG ) {
+            CSRMatrix A_csr( A ) ;
+            Preconditioner* P = new_preconditioner( A_csr, options ) ;
+            RecyclingCG recycler( options.recycle_dim ) ;
+            std::cout << "solving system with " << n << " unknowns (recycling CG) .. "
+                << std::endl ;
+            const bool converged = recycler.solve( A_csr, b, x, P, options, report ) ;
+            delete P ;
+            std::cout << ( converged ? ".. system solved" :
+                ".. maximum number of iterations reached" ) << std::endl ;
+            return converged ;
+        }
+
+        if( options.solver == SOLVER_MIXED_CG ) {
+            CSRMatrix A_csr( A ) ;
+            MixedPrecisionSolver mixed( A_csr, options ) ;
+            std::cout << "solving system with " << n << " unknowns (mixed precision CG) .. "
+                << std::endl ;
+            const bool converged = mixed.solve( b, x, report ) ;
+            std::cout << ( converged ? ".. system solved" :
+                ".. refinement did not converge" ) << std::endl ;
+            return converged ;
+        }
+
+        if( options.solver == SOLVER_CHOLESKY ) {
+            const std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now() ;
+            CSRMatrix A_csr( A ) ;
+            SparseCholesky cholesky ;
+            std::cout << "solving system with " << n << " unknowns (sparse Cholesky) .. "
+                << std::endl ;
+            if( !cholesky.factor( A_csr ) ) {
+                std::cout << "Failure: the matrix is not positive definite" << std::endl ;
+                return false ;
             }
-            nlRightHandSide( b[i] ) ;
-            nlEnd( NL_ROW ) ;
+            if( options.verbose ) cholesky.print() ;
+            cholesky.solve( b, x ) ;
+            std::vector< double > r ;
+            A_csr.mult( x, r ) ;
+            for( int i = 0; i < n; ++i ) r[i] = b[i] - r[i] ;
+            const double b_norm = std::sqrt( dot( b, b ) ) ;
+            const double error = b_norm > 0. ? std::sqrt( dot( r, r ) ) / b_norm : 0. ;
+            const double elapsed = std::chrono::duration< double >(
+                std::chrono::steady_clock::now() - start ).count() ;
+            if( report != NULL ) {
+                report->converged = true ;
+                report->nb_iterations = 0 ;
+                report->error = error ;
+                report->elapsed_time = elapsed ;
+                report->gflops = 0. ;
+                report->residual_history.assign( 1, error ) ;
+            }
+            std::cout << ".. system solved" << std::endl ;
+            return true ;
+        }
+
+        NLContext nl_context = new_nl_context( n, 1, options ) ;
+        {
+            ScopedTimer build_timer( "OpenNL build" ) ;
+            nlBegin( NL_SYSTEM ) ;
+            if( options.use_initial_guess ) {
+                for( int i = 0; i < n; i++ ) {
+                    nlSetVariable( i, x[i] ) ;
+                }
+            }
+            nlBegin( NL_MATRIX ) ;
+            for( int i = 0; i < n; i++ ) {
+                const std::vector< int >& J = A.get_cols_at_line( i ) ;
+                const std::vector< double >& V = A.get_vals_at_line( i ) ;
+                assert( J.size() == V.size() ) ;
+                nlBegin( NL_ROW ) ;
+                for( unsigned int k = 0; k < J.size(); k++ ) {
+                    nlCoefficient( J[k], NLdouble( V[k] ) ) ;
+                }
+                nlRightHandSide( b[i] ) ;
+                nlEnd( NL_ROW ) ;
+            }
+            nlEnd( NL_MATRIX ) ;
+            nlEnd( NL_SYSTEM ) ;
         }
-        nlEnd( NL_MATRIX ) ;
-        nlEnd( NL_SYSTEM ) ;
         std::cout << "solving system with " << n << " unknowns .. " << std::endl ;
 
-        if( !nlSolve() ) {
+        bool solved ;
+        {
+            ScopedTimer solve_timer( "OpenNL solve" ) ;
+            solved = nlSolve() ;
+        }
+        if( !solved ) {
             std::cout << "Failure: OpenNL didn't manage to solve the system"
                 << std::endl ;
+            nlDeleteContext( nl_context ) ;
             return false ;
         }
 
@@ -65,12 +293,171 @@ namespace FEM2A {
             x[i] = nlGetVariable( i ) ;
         }
 
+        NLint used_iterations = 0 ;
+        NLdouble error = 0. ;
+        nlGetIntegerv( NL_USED_ITERATIONS, &used_iterations ) ;
+        nlGetDoublev( NL_ERROR, &error ) ;
+        trace_counter( "solver iterations", used_iterations ) ;
+        const bool converged = error <= options.threshold ;
+        if( report != NULL ) {
+            report->converged = converged ;
+            report->nb_iterations = used_iterations ;
+            report->error = error ;
+            nlGetDoublev( NL_ELAPSED_TIME, &report->elapsed_time ) ;
+            nlGetDoublev( NL_GFLOPS, &report->gflops ) ;
+        }
+
         nlDeleteContext( nl_context ) ;
 
-        std::cout << ".. system solved" << std::endl ;
+        /* as before the options, OpenNL succeeds even if the threshold
+         * is not reached: report->converged tells it */
+        std::cout << ( converged ? ".. system solved" :
+            ".. maximum number of iterations reached" ) << std::endl ;
         return true ;
     }
 
+    bool solve(
+        const SparseMatrix& A,
+        const std::vector< std::vector< double > >& B,
+        std::vector< std::vector< double > >& X,
+        const SolverOptions& options,
+        SolveReport* report )
+    {
+        ScopedThreadCount threads( options.nb_threads ) ;
+        const int n = A.nb_rows() ;
+        const int nb_systems = B.size() ;
+        if( !options.use_initial_guess || X.size() != nb_systems ) {
+            X.assign( nb_systems, std::vector< double >( n, 0. ) ) ;
+        }
+        for( int s = 0; s < nb_systems; ++s ) X[s].resize( n, 0. ) ;
+        if( nb_systems == 0 ) return true ;
+        CSRMatrix A_csr( A ) ;
+
+        if( options.solver == SOLVER_NATIVE_CG ) {
+            Preconditioner* P = new_preconditioner( A_csr, options ) ;
+            std::cout << "solving " << nb_systems << " systems with " << n
+                << " unknowns (native block CG) .. " << std::endl ;
+            const bool converged = pcg_solve_block( A_csr, B, X, P, options, report ) ;
+            delete P ;
+            std::cout << ( converged ? ".. systems solved" :
+                ".. maximum number of iterations reached" ) << std::endl ;
+            return converged ;
+        }
+
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        NLint used_iterations = 0 ;
+        double gflops = 0. ;
+        bool converged = true ;     /* all the systems */
+        bool opennl = false ;
+        if( options.solver == SOLVER_MIXED_CG ) {
+            MixedPrecisionSolver mixed( A_csr, options ) ;
+            std::cout << "solving " << nb_systems << " systems with " << n
+                << " unknowns (mixed precision CG) .. " << std::endl ;
+            for( int s = 0; s < nb_systems; ++s ) {
+                SolveReport system_report ;
+                converged = mixed.solve( B[s], X[s], &system_report ) && converged ;
+                used_iterations = std::max( used_iterations, system_report.nb_iterations ) ;
+            }
+            if( !converged ) {
+                std::cout << ".. refinement did not converge" << std::endl ;
+            }
+        } else if( options.solver == SOLVER_RECYCLING_CG ) {
+            Preconditioner* P = new_preconditioner( A_csr, options ) ;
+            RecyclingCG recycler( options.recycle_dim ) ;
+            std::cout << "solving " << nb_systems << " systems with " << n
+                << " unknowns (recycling CG) .. " << std::endl ;
+            for( int s = 0; s < nb_systems; ++s ) {
+                SolveReport system_report ;
+                converged = recycler.solve( A_csr, B[s], X[s], P, options, &system_report )
+                    && converged ;
+                used_iterations = std::max( used_iterations, system_report.nb_iterations ) ;
+            }
+            delete P ;
+        } else if( options.solver == SOLVER_CHOLESKY ) {
+            SparseCholesky cholesky ;
+            std::cout << "solving " << nb_systems << " systems with " << n
+                << " unknowns (sparse Cholesky) .. " << std::endl ;
+            if( !cholesky.factor( A_csr ) ) {
+                std::cout << "Failure: the matrix is not positive definite" << std::endl ;
+                return false ;
+            }
+            if( options.verbose ) cholesky.print() ;
+            for( int s = 0; s < nb_systems; ++s ) {
+                cholesky.solve( B[s], X[s] ) ;
+            }
+        } else {
+            opennl = true ;
+            NLContext nl_context = new_nl_context( n, nb_systems, options ) ;
+            nlBegin( NL_SYSTEM ) ;
+            for( int s = 0; s < nb_systems && options.use_initial_guess; ++s ) {
+                for( int i = 0; i < n; i++ ) {
+                    nlMultiSetVariable( i, s, X[s][i] ) ;
+                }
+            }
+            nlBegin( NL_MATRIX ) ;
+            for( int i = 0; i < n; i++ ) {
+                const std::vector< int >& J = A.get_cols_at_line( i ) ;
+                const std::vector< double >& V = A.get_vals_at_line( i ) ;
+                nlBegin( NL_ROW ) ;
+                for( unsigned int k = 0; k < J.size(); k++ ) {
+                    nlCoefficient( J[k], NLdouble( V[k] ) ) ;
+                }
+                for( int s = 0; s < nb_systems; ++s ) {
+                    nlMultiRightHandSide( s, B[s][i] ) ;
+                }
+                nlEnd( NL_ROW ) ;
+            }
+            nlEnd( NL_MATRIX ) ;
+            nlEnd( NL_SYSTEM ) ;
+            std::cout << "solving " << nb_systems << " systems with " << n
+                << " unknowns .. " << std::endl ;
+            if( !nlSolve() ) {
+                std::cout << "Failure: OpenNL didn't manage to solve the systems"
+                    << std::endl ;
+                nlDeleteContext( nl_context ) ;
+                return false ;
+            }
+            for( int s = 0; s < nb_systems; ++s ) {
+                for( int i = 0; i < n; i++ ) {
+                    X[s][i] = nlMultiGetVariable( i, s ) ;
+                }
+            }
+            nlGetIntegerv( NL_USED_ITERATIONS, &used_iterations ) ;
+            nlGetDoublev( NL_GFLOPS, &gflops ) ;
+            nlDeleteContext( nl_context ) ;
+        }
+
+        /* OpenNL only reports the statistics of the last system, the
+         * true residuals of all the systems are computed here and decide
+         * its convergence. The iterations stop on the residual updated
+         * by the solver, so a system barely at the threshold may be
+         * reported as not converged, never the other way round. */
+        double max_error = 0. ;
+        std::vector< double > r ;
+        for( int s = 0; s < nb_systems; ++s ) {
+            A_csr.mult( X[s], r ) ;
+            for( int i = 0; i < n; ++i ) r[i] = B[s][i] - r[i] ;
+            const double b_norm = std::sqrt( dot( B[s], B[s] ) ) ;
+            if( b_norm > 0. ) {
+                max_error = std::max( max_error, std::sqrt( dot( r, r ) ) / b_norm ) ;
+            }
+        }
+        if( opennl ) converged = max_error <= options.threshold ;
+        if( report != NULL ) {
+            report->converged = converged ;
+            report->nb_iterations = used_iterations ;
+            report->error = max_error ;
+            report->elapsed_time = std::chrono::duration< double >(
+                std::chrono::steady_clock::now() - start ).count() ;
+            report->gflops = gflops ;
+            report->residual_history.assign( 1, max_error ) ;
+        }
+        std::cout << ( converged ? ".. systems solved" :
+            ".. maximum number of iterations reached" ) << std::endl ;
+        return converged ;
+    }
+
     bool test_opennl()
     {
         std::cout << "------------------------ \n" ;
@@ -272,4 +659,1117 @@ namespace FEM2A {
         }
     }
 
+    /****************************************************************/
+    /* Implementation of CSRMatrix */
+    /****************************************************************/
+
+    CSRMatrix::CSRMatrix()
+        : row_ptr_( 1, 0 )
+    {
+
+    }
+
+    CSRMatrix::CSRMatrix( const SparseMatrix& A )
+        : row_ptr_( A.nb_rows() + 1, 0 ), diag_( A.nb_rows(), -1 )
+    {
+        const int n = A.nb_rows() ;
+        for( int i = 0; i < n; ++i ) {
+            row_ptr_[i + 1] = row_ptr_[i] + A.get_cols_at_line( i ).size() ;
+        }
+        col_.resize( row_ptr_[n] ) ;
+        val_.resize( row_ptr_[n] ) ;
+
+        std::vector< std::pair< int, double > > row ;
+        for( int i = 0; i < n; ++i ) {
+            const std::vector< int >& J = A.get_cols_at_line( i ) ;
+            const std::vector< double >& V = A.get_vals_at_line( i ) ;
+            row.resize( J.size() ) ;
+            for( int k = 0; k < J.size(); ++k ) {
+                row[k] = std::make_pair( J[k], V[k] ) ;
+            }
+            std::sort( row.begin(), row.end() ) ;
+            for( int k = 0; k < row.size(); ++k ) {
+                col_[row_ptr_[i] + k] = row[k].first ;
+                val_[row_ptr_[i] + k] = row[k].second ;
+                if( row[k].first == i ) diag_[i] = row_ptr_[i] + k ;
+            }
+        }
+    }
+
+    int CSRMatrix::nb_rows() const
+    {
+        return row_ptr_.size() - 1 ;
+    }
+
+    int CSRMatrix::nnz() const
+    {
+        return col_.size() ;
+    }
+
+    void CSRMatrix::mult( const std::vector< double >& x, std::vector< double >& y ) const
+    {
+        const int n = nb_rows() ;
+        y.resize( n ) ;
+        for( int i = 0; i < n; ++i ) {
+            double sum = 0. ;
+            for( int k = row_ptr_[i]; k < row_ptr_[i + 1]; ++k ) {
+                sum += val_[k] * x[col_[k]] ;
+            }
+            y[i] = sum ;
+        }
+    }
+
+    void CSRMatrix::mult_block( const std::vector< double >& X, std::vector< double >& Y,
+        int nb_columns ) const
+    {
+        const int n = nb_rows() ;
+        const int m = nb_columns ;
+        Y.resize( n * m ) ;
+        for( int i = 0; i < n; ++i ) {
+            double* y = &Y[i * m] ;
+            /* four columns at a time, accumulated in registers */
+            int c = 0 ;
+            for( ; c + 4 <= m; c += 4 ) {
+                double s0 = 0., s1 = 0., s2 = 0., s3 = 0. ;
+                for( int k = row_ptr_[i]; k < row_ptr_[i + 1]; ++k ) {
+                    const double a = val_[k] ;
+                    const double* x = &X[col_[k] * m + c] ;
+                    s0 += a * x[0] ;
+                    s1 += a * x[1] ;
+                    s2 += a * x[2] ;
+                    s3 += a * x[3] ;
+                }
+                y[c] = s0 ;
+                y[c + 1] = s1 ;
+                y[c + 2] = s2 ;
+                y[c + 3] = s3 ;
+            }
+            for( ; c < m; ++c ) {
+                double sum = 0. ;
+                for( int k = row_ptr_[i]; k < row_ptr_[i + 1]; ++k ) {
+                    sum += val_[k] * X[col_[k] * m + c] ;
+                }
+                y[c] = sum ;
+            }
+        }
+    }
+
+    void CSRMatrix::update_diagonal()
+    {
+        const int n = nb_rows() ;
+        diag_.assign( n, -1 ) ;
+        for( int i = 0; i < n; ++i ) {
+            for( int k = row_ptr_[i]; k < row_ptr_[i + 1]; ++k ) {
+                if( col_[k] == i ) diag_[i] = k ;
+            }
+        }
+    }
+
+    CSRMatrix transpose( const CSRMatrix& A )
+    {
+        int nb_cols = 0 ;
+        for( int k = 0; k < A.nnz(); ++k ) {
+            nb_cols = std::max( nb_cols, A.col_[k] + 1 ) ;
+        }
+        CSRMatrix T ;
+        T.row_ptr_.assign( nb_cols + 1, 0 ) ;
+        for( int k = 0; k < A.nnz(); ++k ) {
+            T.row_ptr_[A.col_[k] + 1]++ ;
+        }
+        for( int j = 0; j < nb_cols; ++j ) {
+            T.row_ptr_[j + 1] += T.row_ptr_[j] ;
+        }
+        T.col_.resize( A.nnz() ) ;
+        T.val_.resize( A.nnz() ) ;
+        std::vector< int > next( T.row_ptr_.begin(), T.row_ptr_.end() - 1 ) ;
+        /* rows of A are visited in increasing order, so the columns of
+         * T are sorted */
+        for( int i = 0; i < A.nb_rows(); ++i ) {
+            for( int k = A.row_ptr_[i]; k < A.row_ptr_[i + 1]; ++k ) {
+                const int pos = next[A.col_[k]]++ ;
+                T.col_[pos] = i ;
+                T.val_[pos] = A.val_[k] ;
+            }
+        }
+        T.update_diagonal() ;
+        return T ;
+    }
+
+    CSRMatrix multiply( const CSRMatrix& A, const CSRMatrix& B, int nb_cols )
+    {
+        const int n = A.nb_rows() ;
+        CSRMatrix C ;
+        C.row_ptr_.assign( n + 1, 0 ) ;
+        std::vector< int > position( nb_cols, -1 ) ;
+        std::vector< int > row_cols ;
+        std::vector< double > row_vals ;
+        std::vector< std::pair< int, double > > row ;
+        for( int i = 0; i < n; ++i ) {
+            row_cols.clear() ;
+            row_vals.clear() ;
+            for( int ka = A.row_ptr_[i]; ka < A.row_ptr_[i + 1]; ++ka ) {
+                const int k = A.col_[ka] ;
+                const double a_ik = A.val_[ka] ;
+                for( int kb = B.row_ptr_[k]; kb < B.row_ptr_[k + 1]; ++kb ) {
+                    const int j = B.col_[kb] ;
+                    if( position[j] < 0 ) {
+                        position[j] = row_cols.size() ;
+                        row_cols.push_back( j ) ;
+                        row_vals.push_back( a_ik * B.val_[kb] ) ;
+                    } else {
+                        row_vals[position[j]] += a_ik * B.val_[kb] ;
+                    }
+                }
+            }
+            row.resize( row_cols.size() ) ;
+            for( int k = 0; k < row_cols.size(); ++k ) {
+                position[row_cols[k]] = -1 ;
+                row[k] = std::make_pair( row_cols[k], row_vals[k] ) ;
+            }
+            std::sort( row.begin(), row.end() ) ;
+            for( int k = 0; k < row.size(); ++k ) {
+                C.col_.push_back( row[k].first ) ;
+                C.val_.push_back( row[k].second ) ;
+            }
+            C.row_ptr_[i + 1] = C.col_.size() ;
+        }
+        C.update_diagonal() ;
+        return C ;
+    }
+
+    CSRMatrix permute( const CSRMatrix& A, const std::vector< int >& perm )
+    {
+        const int n = A.nb_rows() ;
+        assert( perm.size() == n ) ;
+        std::vector< int > inverse( n ) ;
+        for( int i = 0; i < n; ++i ) inverse[perm[i]] = i ;
+        CSRMatrix B ;
+        B.row_ptr_.assign( n + 1, 0 ) ;
+        B.col_.reserve( A.nnz() ) ;
+        B.val_.reserve( A.nnz() ) ;
+        std::vector< std::pair< int, double > > row ;
+        for( int i = 0; i < n; ++i ) {
+            const int old_i = perm[i] ;
+            row.clear() ;
+            for( int k = A.row_ptr_[old_i]; k < A.row_ptr_[old_i + 1]; ++k ) {
+                row.push_back( std::make_pair( inverse[A.col_[k]], A.val_[k] ) ) ;
+            }
+            std::sort( row.begin(), row.end() ) ;
+            for( int k = 0; k < row.size(); ++k ) {
+                B.col_.push_back( row[k].first ) ;
+                B.val_.push_back( row[k].second ) ;
+            }
+            B.row_ptr_[i + 1] = B.col_.size() ;
+        }
+        B.update_diagonal() ;
+        return B ;
+    }
+
+    int multicolor_ordering( const CSRMatrix& A, std::vector< int >& perm )
+    {
+        const int n = A.nb_rows() ;
+        std::vector< int > color( n, -1 ) ;
+        std::vector< int > used_by( n + 1, -1 ) ; /* colour -> last row using it */
+        int nb_colors = 0 ;
+        for( int i = 0; i < n; ++i ) {
+            for( int k = A.row_ptr_[i]; k < A.row_ptr_[i + 1]; ++k ) {
+                const int j = A.col_[k] ;
+                if( j != i && color[j] >= 0 ) used_by[color[j]] = i ;
+            }
+            int c = 0 ;
+            while( used_by[c] == i ) ++c ;
+            color[i] = c ;
+            nb_colors = std::max( nb_colors, c + 1 ) ;
+        }
+        /* counting sort by colour, the natural order is kept in a colour */
+        std::vector< int > start( nb_colors + 1, 0 ) ;
+        for( int i = 0; i < n; ++i ) start[color[i] + 1]++ ;
+        for( int c = 0; c < nb_colors; ++c ) start[c + 1] += start[c] ;
+        perm.resize( n ) ;
+        for( int i = 0; i < n; ++i ) perm[start[color[i]]++] = i ;
+        return nb_colors ;
+    }
+
+    double dot( const std::vector< double >& x, const std::vector< double >& y )
+    {
+        assert( x.size() == y.size() ) ;
+        double sum = 0. ;
+        for( int i = 0; i < x.size(); ++i ) {
+            sum += x[i] * y[i] ;
+        }
+        return sum ;
+    }
+
+    /****************************************************************/
+    /* Implementation of LevelSchedule */
+    /****************************************************************/
+
+    /**
+     * \brief Groups the rows by level, in increasing row order in each
+     *        level.
+     */
+    static void group_by_level( const std::vector< int >& level, int nb_levels,
+        std::vector< int >& ptr, std::vector< int >& rows )
+    {
+        ptr.assign( nb_levels + 1, 0 ) ;
+        for( int i = 0; i < level.size(); ++i ) ptr[level[i] + 1]++ ;
+        for( int l = 0; l < nb_levels; ++l ) ptr[l + 1] += ptr[l] ;
+        rows.resize( level.size() ) ;
+        std::vector< int > fill( ptr.begin(), ptr.end() - 1 ) ;
+        for( int i = 0; i < level.size(); ++i ) rows[fill[level[i]]++] = i ;
+    }
+
+    LevelSchedule::LevelSchedule()
+        : nb_analyses_( 0 ), nb_threads_( 0 )
+    {
+
+    }
+
+    void LevelSchedule::analyze( const CSRMatrix& A )
+    {
+        if( nb_analyses_ > 0 && A.row_ptr_ == pattern_row_ptr_ && A.col_ == pattern_col_ ) {
+            return ;
+        }
+        const int n = A.nb_rows() ;
+        std::vector< int > level( n ) ;
+        int nb_levels = 0 ;
+        for( int i = 0; i < n; ++i ) {
+            ASSERT( A.diag_[i] >= 0, "the sweeps need a non-zero diagonal" ) ;
+            int l = 0 ;
+            for( int k = A.row_ptr_[i]; k < A.diag_[i]; ++k ) {
+                l = std::max( l, level[A.col_[k]] + 1 ) ;
+            }
+            level[i] = l ;
+            nb_levels = std::max( nb_levels, l + 1 ) ;
+        }
+        group_by_level( level, nb_levels, lower_ptr_, lower_rows_ ) ;
+        nb_levels = 0 ;
+        for( int i = n - 1; i >= 0; --i ) {
+            int l = 0 ;
+            for( int k = A.diag_[i] + 1; k < A.row_ptr_[i + 1]; ++k ) {
+                l = std::max( l, level[A.col_[k]] + 1 ) ;
+            }
+            level[i] = l ;
+            nb_levels = std::max( nb_levels, l + 1 ) ;
+        }
+        group_by_level( level, nb_levels, upper_ptr_, upper_rows_ ) ;
+        pattern_row_ptr_ = A.row_ptr_ ;
+        pattern_col_ = A.col_ ;
+        ++nb_analyses_ ;
+    }
+
+    int LevelSchedule::nb_sweep_threads( int nb_levels ) const
+    {
+#ifdef _OPENMP
+        const int nb_threads = nb_threads_ > 0 ? nb_threads_ : omp_get_max_threads() ;
+        /* below a few hundred rows per level, the barriers cost more
+         * than the rows */
+        if( nb_levels > 0 && lower_rows_.size() / nb_levels >= 64 * nb_threads ) {
+            return nb_threads ;
+        }
+#endif
+        return 1 ;
+    }
+
+    void LevelSchedule::set_nb_threads( int nb_threads )
+    {
+        nb_threads_ = nb_threads ;
+    }
+
+    void LevelSchedule::lower_solve( const CSRMatrix& T, const std::vector< double >& r,
+        std::vector< double >& z, const std::vector< double >* inv_diag ) const
+    {
+        const int n = T.nb_rows() ;
+        assert( n + 1 == pattern_row_ptr_.size() ) ;
+        z.resize( n ) ;
+        const int nb_levels = nb_lower_levels() ;
+        const int nb_threads = nb_sweep_threads( nb_levels ) ;
+        if( nb_threads == 1 ) {
+            for( int i = 0; i < n; ++i ) {
+                double sum = r[i] ;
+                for( int k = T.row_ptr_[i]; k < T.diag_[i]; ++k ) {
+                    sum -= T.val_[k] * z[T.col_[k]] ;
+                }
+                z[i] = inv_diag != NULL ? sum * ( *inv_diag )[i] : sum ;
+            }
+            return ;
+        }
+#pragma omp parallel num_threads( nb_threads )
+        for( int l = 0; l < nb_levels; ++l ) {
+#pragma omp for schedule( static )
+            for( int p = lower_ptr_[l]; p < lower_ptr_[l + 1]; ++p ) {
+                const int i = lower_rows_[p] ;
+                double sum = r[i] ;
+                for( int k = T.row_ptr_[i]; k < T.diag_[i]; ++k ) {
+                    sum -= T.val_[k] * z[T.col_[k]] ;
+                }
+                z[i] = inv_diag != NULL ? sum * ( *inv_diag )[i] : sum ;
+            }
+        }
+    }
+
+    void LevelSchedule::upper_solve( const CSRMatrix& T, const std::vector< double >& r,
+        std::vector< double >& z, const std::vector< double >* inv_diag ) const
+    {
+        const int n = T.nb_rows() ;
+        assert( n + 1 == pattern_row_ptr_.size() ) ;
+        z.resize( n ) ;
+        const int nb_levels = nb_upper_levels() ;
+        const int nb_threads = nb_sweep_threads( nb_levels ) ;
+        if( nb_threads == 1 ) {
+            for( int i = n - 1; i >= 0; --i ) {
+                double sum = r[i] ;
+                for( int k = T.diag_[i] + 1; k < T.row_ptr_[i + 1]; ++k ) {
+                    sum -= T.val_[k] * z[T.col_[k]] ;
+                }
+                z[i] = inv_diag != NULL ? sum * ( *inv_diag )[i] : sum ;
+            }
+            return ;
+        }
+#pragma omp parallel num_threads( nb_threads )
+        for( int l = 0; l < nb_levels; ++l ) {
+#pragma omp for schedule( static )
+            for( int p = upper_ptr_[l]; p < upper_ptr_[l + 1]; ++p ) {
+                const int i = upper_rows_[p] ;
+                double sum = r[i] ;
+                for( int k = T.diag_[i] + 1; k < T.row_ptr_[i + 1]; ++k ) {
+                    sum -= T.val_[k] * z[T.col_[k]] ;
+                }
+                z[i] = inv_diag != NULL ? sum * ( *inv_diag )[i] : sum ;
+            }
+        }
+    }
+
+    int LevelSchedule::nb_lower_levels() const
+    {
+        return lower_ptr_.empty() ? 0 : lower_ptr_.size() - 1 ;
+    }
+
+    int LevelSchedule::nb_upper_levels() const
+    {
+        return upper_ptr_.empty() ? 0 : upper_ptr_.size() - 1 ;
+    }
+
+    int LevelSchedule::nb_analyses() const
+    {
+        return nb_analyses_ ;
+    }
+
+    void LevelSchedule::print() const
+    {
+        const int n = lower_rows_.size() ;
+        std::cout << "Level schedule: " << n << " rows, "
+            << nb_lower_levels() << " lower levels, "
+            << nb_upper_levels() << " upper levels ("
+            << ( nb_lower_levels() > 0 ? n / nb_lower_levels() : 0 )
+            << " rows per level), "
+            << nb_sweep_threads( nb_lower_levels() ) << " thread(s)" << std::endl ;
+    }
+
+    /****************************************************************/
+    /* Implementation of Preconditioners */
+    /****************************************************************/
+
+    Preconditioner::~Preconditioner()
+    {
+
+    }
+
+    JacobiPreconditioner::JacobiPreconditioner( const CSRMatrix& A )
+        : inv_diag_( A.nb_rows(), 1. )
+    {
+        for( int i = 0; i < A.nb_rows(); ++i ) {
+            ASSERT( A.diag_[i] >= 0, "Jacobi needs a non-zero diagonal" ) ;
+            inv_diag_[i] = 1. / A.val_[A.diag_[i]] ;
+        }
+    }
+
+    void JacobiPreconditioner::apply(
+        const std::vector< double >& r, std::vector< double >& z ) const
+    {
+        z.resize( r.size() ) ;
+        for( int i = 0; i < r.size(); ++i ) {
+            z[i] = inv_diag_[i] * r[i] ;
+        }
+    }
+
+    double JacobiPreconditioner::flops() const
+    {
+        return inv_diag_.size() ;
+    }
+
+    SSORPreconditioner::SSORPreconditioner( const CSRMatrix& A, double omega,
+        const LevelSchedule* schedule )
+        : A_( A ), omega_( omega ), omega_inv_diag_( A.nb_rows() ), schedule_( schedule )
+    {
+        for( int i = 0; i < A.nb_rows(); ++i ) {
+            ASSERT( A.diag_[i] >= 0, "SSOR needs a non-zero diagonal" ) ;
+            omega_inv_diag_[i] = omega / A.val_[A.diag_[i]] ;
+        }
+        if( schedule_ == NULL ) {
+            own_schedule_.analyze( A ) ;
+            schedule_ = &own_schedule_ ;
+        }
+    }
+
+    void SSORPreconditioner::apply(
+        const std::vector< double >& r, std::vector< double >& z ) const
+    {
+        const int n = A_.nb_rows() ;
+        /* forward sweep: (D/w + L) z = r */
+        schedule_->lower_solve( A_, r, z, &omega_inv_diag_ ) ;
+        /* z = (D/w) z */
+        for( int i = 0; i < n; ++i ) {
+            z[i] /= omega_inv_diag_[i] ;
+        }
+        /* backward sweep: (D/w + U) z = z, then scaling by (2-w)/w */
+        schedule_->upper_solve( A_, z, z, &omega_inv_diag_ ) ;
+        for( int i = 0; i < n; ++i ) {
+            z[i] *= ( 2. - omega_ ) / omega_ ;
+        }
+    }
+
+    double SSORPreconditioner::flops() const
+    {
+        return 2. * A_.nnz() + 4. * A_.nb_rows() ;
+    }
+
+    ICPreconditioner::ICPreconditioner( const CSRMatrix& A, double relaxation,
+        const LevelSchedule* schedule )
+        : LU_( A ), schedule_( schedule )
+    {
+        /* Row-oriented incomplete LU without fill (IKJ variant). For a
+         * symmetric matrix, the upper part is D L^T so this is IC(0) in
+         * its square root free form. */
+        const int n = LU_.nb_rows() ;
+        std::vector< int > position( n, -1 ) ; /* column -> index in row i */
+        for( int i = 0; i < n; ++i ) {
+            ASSERT( LU_.diag_[i] >= 0, "IC(0) needs a non-zero diagonal" ) ;
+            for( int k = LU_.row_ptr_[i]; k < LU_.row_ptr_[i + 1]; ++k ) {
+                position[LU_.col_[k]] = k ;
+            }
+            double& pivot = LU_.val_[LU_.diag_[i]] ;
+            for( int ik = LU_.row_ptr_[i]; ik < LU_.diag_[i]; ++ik ) {
+                const int k = LU_.col_[ik] ;
+                LU_.val_[ik] /= LU_.val_[LU_.diag_[k]] ;
+                const double l_ik = LU_.val_[ik] ;
+                for( int kj = LU_.diag_[k] + 1; kj < LU_.row_ptr_[k + 1]; ++kj ) {
+                    const int j = LU_.col_[kj] ;
+                    if( position[j] >= 0 ) {
+                        LU_.val_[position[j]] -= l_ik * LU_.val_[kj] ;
+                    } else {
+                        pivot -= relaxation * l_ik * LU_.val_[kj] ;
+                    }
+                }
+            }
+            if( pivot <= 0. ) {
+                /* breakdown: fall back to the diagonal of A */
+                pivot = A.val_[A.diag_[i]] ;
+            }
+            for( int k = LU_.row_ptr_[i]; k < LU_.row_ptr_[i + 1]; ++k ) {
+                position[LU_.col_[k]] = -1 ;
+            }
+        }
+        inv_diag_.resize( n ) ;
+        for( int i = 0; i < n; ++i ) {
+            inv_diag_[i] = 1. / LU_.val_[LU_.diag_[i]] ;
+        }
+        if( schedule_ == NULL ) {
+            own_schedule_.analyze( LU_ ) ;
+            schedule_ = &own_schedule_ ;
+        }
+    }
+
+    void ICPreconditioner::apply(
+        const std::vector< double >& r, std::vector< double >& z ) const
+    {
+        /* L y = r */
+        schedule_->lower_solve( LU_, r, z ) ;
+        /* D L^T z = y */
+        schedule_->upper_solve( LU_, z, z, &inv_diag_ ) ;
+    }
+
+    double ICPreconditioner::flops() const
+    {
+        return 2. * LU_.nnz() ;
+    }
+
+    const CSRMatrix& ICPreconditioner::factors() const
+    {
+        return LU_ ;
+    }
+
+    MulticolorPreconditioner::MulticolorPreconditioner(
+        const CSRMatrix& A, const SolverOptions& options )
+        : inner_( NULL )
+    {
+        nb_colors_ = multicolor_ordering( A, perm_ ) ;
+        PAPt_ = permute( A, perm_ ) ;
+        SolverOptions inner_options = options ;
+        inner_options.multicolor = false ;
+        inner_ = new_preconditioner( PAPt_, inner_options, &schedule_ ) ;
+        assert( inner_ != NULL ) ;
+    }
+
+    MulticolorPreconditioner::~MulticolorPreconditioner()
+    {
+        delete inner_ ;
+    }
+
+    void MulticolorPreconditioner::apply(
+        const std::vector< double >& r, std::vector< double >& z ) const
+    {
+        const int n = perm_.size() ;
+        r_.resize( n ) ;
+        for( int i = 0; i < n; ++i ) r_[i] = r[perm_[i]] ;
+        inner_->apply( r_, z_ ) ;
+        z.resize( n ) ;
+        for( int i = 0; i < n; ++i ) z[perm_[i]] = z_[i] ;
+    }
+
+    double MulticolorPreconditioner::flops() const
+    {
+        return inner_->flops() ;
+    }
+
+    int MulticolorPreconditioner::nb_colors() const
+    {
+        return nb_colors_ ;
+    }
+
+    Preconditioner* new_preconditioner(
+        const CSRMatrix& A, const SolverOptions& options, LevelSchedule* schedule )
+    {
+        if( options.multicolor && ( options.preconditioner == PRECOND_SSOR
+            || options.preconditioner == PRECOND_IC0
+            || options.preconditioner == PRECOND_MIC0 ) ) {
+            MulticolorPreconditioner* P = new MulticolorPreconditioner( A, options ) ;
+            if( options.verbose ) {
+                std::cout << "Multicolour ordering: " << P->nb_colors()
+                    << " colours" << std::endl ;
+            }
+            return P ;
+        }
+        if( schedule != NULL && ( options.preconditioner == PRECOND_SSOR
+            || options.preconditioner == PRECOND_IC0
+            || options.preconditioner == PRECOND_MIC0 ) ) {
+            schedule->set_nb_threads( options.nb_threads ) ;
+            schedule->analyze( A ) ;
+        }
+        switch( options.preconditioner ) {
+            case PRECOND_JACOBI : return new JacobiPreconditioner( A ) ;
+            case PRECOND_SSOR :
+                return new SSORPreconditioner( A, options.omega, schedule ) ;
+            case PRECOND_IC0 : return new ICPreconditioner( A, 0., schedule ) ;
+            case PRECOND_MIC0 :
+                return new ICPreconditioner( A, options.mic_relaxation, schedule ) ;
+            case PRECOND_AMG : {
+                AMGPreconditioner* amg = new AMGPreconditioner( A,
+                    options.amg_strength, options.amg_chebyshev,
+                    options.amg_smoothing_steps ) ;
+                if( options.verbose ) amg->print() ;
+                return amg ;
+            }
+            default : return NULL ;
+        }
+    }
+
+    /****************************************************************/
+    /* Implementation of native solvers */
+    /****************************************************************/
+
+    bool pcg_solve(
+        const CSRMatrix& A,
+        const std::vector< double >& b,
+        std::vector< double >& x,
+        const Preconditioner* P,
+        const SolverOptions& options,
+        SolveReport* report )
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        const int n = A.nb_rows() ;
+        assert( b.size() == n ) ;
+
+        std::vector< double > r( b ) ;
+        std::vector< double > z( n ) ;
+        std::vector< double > p( n ) ;
+        std::vector< double > Ap( n ) ;
+        std::vector< double > history ;
+
+        /* if b = 0, the solution is 0 whatever the initial guess */
+        const double b_norm = std::sqrt( dot( b, b ) ) ;
+        if( options.use_initial_guess && x.size() == n && b_norm > 0. ) {
+            A.mult( x, Ap ) ;
+            for( int i = 0; i < n; ++i ) r[i] -= Ap[i] ;
+        } else {
+            x.assign( n, 0. ) ;
+        }
+        double error = b_norm > 0. ? std::sqrt( dot( r, r ) ) / b_norm : 0. ;
+        history.push_back( error ) ;
+
+        if( P != NULL ) P->apply( r, z ) ; else z = r ;
+        p = z ;
+        double rz = dot( r, z ) ;
+        int it = 0 ;
+        while( error > options.threshold && it < options.max_iterations ) {
+            A.mult( p, Ap ) ;
+            const double alpha = rz / dot( p, Ap ) ;
+            for( int i = 0; i < n; ++i ) {
+                x[i] += alpha * p[i] ;
+                r[i] -= alpha * Ap[i] ;
+            }
+            ++it ;
+            error = std::sqrt( dot( r, r ) ) / b_norm ;
+            history.push_back( error ) ;
+            if( options.verbose && it % 100 == 0 ) {
+                std::cout << "  iter " << it << " ||r||/||b|| = " << error << std::endl ;
+            }
+            if( error <= options.threshold ) break ;
+
+            if( P != NULL ) P->apply( r, z ) ; else z = r ;
+            const double rz_new = dot( r, z ) ;
+            const double beta = rz_new / rz ;
+            rz = rz_new ;
+            for( int i = 0; i < n; ++i ) {
+                p[i] = z[i] + beta * p[i] ;
+            }
+        }
+
+        const double elapsed = std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+        const bool converged = error <= options.threshold ;
+        if( options.verbose ) {
+            std::cout << "in native CG : ||Ax-b||/||b|| = " << error << std::endl ;
+        }
+        if( report != NULL ) {
+            const double flops_per_iteration = 2. * A.nnz() + 12. * n
+                + ( P != NULL ? P->flops() : 0. ) ;
+            report->converged = converged ;
+            report->nb_iterations = it ;
+            report->error = error ;
+            report->elapsed_time = elapsed ;
+            report->gflops = elapsed > 0. ?
+                flops_per_iteration * it / ( elapsed * 1e9 ) : 0. ;
+            report->residual_history.swap( history ) ;
+        }
+        return converged ;
+    }
+
+    /* Number of systems iterated together by pcg_solve_block(): beyond
+     * that, the block of search directions no longer fits in cache */
+    const int block_width = 4 ;
+
+    bool pcg_solve_block(
+        const CSRMatrix& A,
+        const std::vector< std::vector< double > >& B,
+        std::vector< std::vector< double > >& X,
+        const Preconditioner* P,
+        const SolverOptions& options,
+        SolveReport* report )
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        const int n = A.nb_rows() ;
+        const int nb_systems = B.size() ;
+
+        /* residuals and preconditioned residuals of each system */
+        std::vector< std::vector< double > > R( B ) ;
+        if( options.use_initial_guess && X.size() == nb_systems ) {
+            std::vector< double > Ax ;
+            for( int s = 0; s < nb_systems; ++s ) {
+                /* if b = 0, the solution is 0 whatever the initial guess */
+                if( dot( B[s], B[s] ) == 0. ) X[s].assign( n, 0. ) ;
+                X[s].resize( n, 0. ) ;
+                A.mult( X[s], Ax ) ;
+                for( int i = 0; i < n; ++i ) R[s][i] -= Ax[i] ;
+            }
+        } else {
+            X.assign( nb_systems, std::vector< double >( n, 0. ) ) ;
+        }
+        std::vector< std::vector< double > > Z( nb_systems, std::vector< double >( n ) ) ;
+        std::vector< double > b_norm( nb_systems ), error( nb_systems ), rz( nb_systems ) ;
+        std::vector< double > history ;
+
+        /* systems to solve, they enter the block when there is room */
+        std::vector< int > pending ;
+        for( int s = nb_systems - 1; s >= 0; --s ) {
+            assert( B[s].size() == n ) ;
+            b_norm[s] = std::sqrt( dot( B[s], B[s] ) ) ;
+            error[s] = b_norm[s] > 0. ? std::sqrt( dot( R[s], R[s] ) ) / b_norm[s] : 0. ;
+            if( error[s] > options.threshold ) pending.push_back( s ) ;
+        }
+
+        /* search directions of the active systems, stored row by row */
+        std::vector< int > active ;
+        std::vector< double > Pb, APb ;
+        int m = 0 ;
+        history.push_back( *std::max_element( error.begin(), error.end() ) ) ;
+        double max_error = history[0] ;
+        int it = 0 ;
+        long nb_system_iterations = 0 ;
+        std::vector< int > still_active ;
+        while( true ) {
+            /* replace the converged systems by pending ones */
+            if( still_active.size() < m || ( m < block_width && !pending.empty() ) ) {
+                std::vector< int > new_active ;
+                for( int k = 0; k < still_active.size(); ++k ) {
+                    new_active.push_back( active[still_active[k]] ) ;
+                }
+                const int nb_kept = new_active.size() ;
+                while( new_active.size() < block_width && !pending.empty() ) {
+                    const int s = pending.back() ;
+                    pending.pop_back() ;
+                    if( P != NULL ) P->apply( R[s], Z[s] ) ; else Z[s] = R[s] ;
+                    rz[s] = dot( R[s], Z[s] ) ;
+                    new_active.push_back( s ) ;
+                }
+                const int new_m = new_active.size() ;
+                std::vector< double > new_Pb( n * new_m ) ;
+                for( int i = 0; i < n; ++i ) {
+                    for( int c = 0; c < nb_kept; ++c ) {
+                        new_Pb[i * new_m + c] = Pb[i * m + still_active[c]] ;
+                    }
+                    for( int c = nb_kept; c < new_m; ++c ) {
+                        new_Pb[i * new_m + c] = Z[new_active[c]][i] ;
+                    }
+                }
+                Pb.swap( new_Pb ) ;
+                active.swap( new_active ) ;
+                m = new_m ;
+            }
+            if( m == 0 || it >= options.max_iterations ) break ;
+
+            A.mult_block( Pb, APb, m ) ;
+            ++it ;
+            nb_system_iterations += m ;
+            /* the vectors are traversed once for all the columns */
+            std::vector< double > pAp( m, 0. ), alpha( m ), beta( m ) ;
+            for( int i = 0; i < n; ++i ) {
+                for( int c = 0; c < m; ++c ) {
+                    pAp[c] += Pb[i * m + c] * APb[i * m + c] ;
+                }
+            }
+            std::vector< double* > x( m ), r( m ) ;
+            for( int c = 0; c < m; ++c ) {
+                alpha[c] = rz[active[c]] / pAp[c] ;
+                x[c] = &X[active[c]][0] ;
+                r[c] = &R[active[c]][0] ;
+            }
+            for( int i = 0; i < n; ++i ) {
+                const double* p_i = &Pb[i * m] ;
+                const double* Ap_i = &APb[i * m] ;
+                for( int c = 0; c < m; ++c ) {
+                    x[c][i] += alpha[c] * p_i[c] ;
+                    r[c][i] -= alpha[c] * Ap_i[c] ;
+                }
+            }
+
+            still_active.clear() ;
+            for( int c = 0; c < m; ++c ) {
+                const int s = active[c] ;
+                error[s] = std::sqrt( dot( R[s], R[s] ) ) / b_norm[s] ;
+                if( error[s] <= options.threshold ) continue ;
+                if( P != NULL ) P->apply( R[s], Z[s] ) ; else Z[s] = R[s] ;
+                const double rz_new = dot( R[s], Z[s] ) ;
+                beta[c] = rz_new / rz[s] ;
+                rz[s] = rz_new ;
+                still_active.push_back( c ) ;
+            }
+            const int nb_still_active = still_active.size() ;
+            std::vector< const double* > z( nb_still_active ) ;
+            for( int k = 0; k < nb_still_active; ++k ) {
+                z[k] = &Z[active[still_active[k]]][0] ;
+            }
+            for( int i = 0; i < n; ++i ) {
+                double* p_i = &Pb[i * m] ;
+                for( int k = 0; k < nb_still_active; ++k ) {
+                    const int c = still_active[k] ;
+                    p_i[c] = z[k][i] + beta[c] * p_i[c] ;
+                }
+            }
+            max_error = *std::max_element( error.begin(), error.end() ) ;
+            history.push_back( max_error ) ;
+            if( options.verbose && it % 100 == 0 ) {
+                std::cout << "  iter " << it << " max ||r||/||b|| = " << max_error
+                    << ", " << still_active.size() << " active systems" << std::endl ;
+            }
+        }
+
+        const double elapsed = std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+        const bool converged = max_error <= options.threshold ;
+        if( options.verbose ) {
+            std::cout << "in native block CG : " << nb_systems << " systems, max ||Ax-b||/||b|| = "
+                << max_error << std::endl ;
+        }
+        if( report != NULL ) {
+            const double flops_per_iteration = 2. * A.nnz() + 12. * n
+                + ( P != NULL ? P->flops() : 0. ) ;
+            report->converged = converged ;
+            report->nb_iterations = it ;
+            report->error = max_error ;
+            report->elapsed_time = elapsed ;
+            report->gflops = elapsed > 0. ?
+                flops_per_iteration * nb_system_iterations / ( elapsed * 1e9 ) : 0. ;
+            report->residual_history.swap( history ) ;
+        }
+        return converged ;
+    }
+
+    /****************************************************************/
+    /* Implementation of MixedPrecisionSolver */
+    /****************************************************************/
+
+    MixedPrecisionSolver::MixedPrecisionSolver( const CSRMatrix& A,
+        const SolverOptions& options )
+        : A_( A ), options_( options )
+    {
+        const int n = A.nb_rows() ;
+        val_.assign( A.val_.begin(), A.val_.end() ) ;
+        switch( options.preconditioner ) {
+            case PRECOND_NONE :
+                break ;
+            case PRECOND_IC0 :
+            case PRECOND_MIC0 : {
+                const ICPreconditioner ic( A,
+                    options.preconditioner == PRECOND_MIC0 ? options.mic_relaxation : 0. ) ;
+                factors_.assign( ic.factors().val_.begin(), ic.factors().val_.end() ) ;
+                break ;
+            }
+            default :
+                if( options.preconditioner != PRECOND_JACOBI ) {
+                    std::cout << "Warning: this preconditioner is not available in "
+                        << "single precision, Jacobi used" << std::endl ;
+                }
+                inv_diag_.resize( n ) ;
+                for( int i = 0; i < n; ++i ) {
+                    ASSERT( A.diag_[i] >= 0, "Jacobi needs a non-zero diagonal" ) ;
+                    inv_diag_[i] = float( 1. / A.val_[A.diag_[i]] ) ;
+                }
+                break ;
+        }
+    }
+
+    void MixedPrecisionSolver::precondition( const std::vector< float >& r,
+        std::vector< float >& z ) const
+    {
+        const int n = r.size() ;
+        if( !factors_.empty() ) {
+            /* L y = r then D L^T z = y, see ICPreconditioner::apply() */
+            for( int i = 0; i < n; ++i ) {
+                float sum = r[i] ;
+                for( int k = A_.row_ptr_[i]; k < A_.diag_[i]; ++k ) {
+                    sum -= factors_[k] * z[A_.col_[k]] ;
+                }
+                z[i] = sum ;
+            }
+            for( int i = n - 1; i >= 0; --i ) {
+                float sum = z[i] ;
+                for( int k = A_.diag_[i] + 1; k < A_.row_ptr_[i + 1]; ++k ) {
+                    sum -= factors_[k] * z[A_.col_[k]] ;
+                }
+                z[i] = sum / factors_[A_.diag_[i]] ;
+            }
+        } else if( !inv_diag_.empty() ) {
+            for( int i = 0; i < n; ++i ) z[i] = inv_diag_[i] * r[i] ;
+        } else {
+            z = r ;
+        }
+    }
+
+    /* scalar product of single precision vectors, accumulated in double */
+    static double dot( const std::vector< float >& x, const std::vector< float >& y )
+    {
+        double sum = 0. ;
+        for( int i = 0; i < x.size(); ++i ) {
+            sum += x[i] * y[i] ;
+        }
+        return sum ;
+    }
+
+    int MixedPrecisionSolver::inner_solve( const std::vector< float >& b,
+        std::vector< float >& d ) const
+    {
+        const int n = b.size() ;
+        d.assign( n, 0.f ) ;
+        r_ = b ;
+        z_.resize( n ) ;
+        q_.resize( n ) ;
+        precondition( r_, z_ ) ;
+        p_ = z_ ;
+        double rz = dot( r_, z_ ) ;
+        const double b_norm = std::sqrt( dot( b, b ) ) ;
+        int it = 0 ;
+        while( it < options_.max_iterations ) {
+            for( int i = 0; i < n; ++i ) {
+                float sum = 0.f ;
+                for( int k = A_.row_ptr_[i]; k < A_.row_ptr_[i + 1]; ++k ) {
+                    sum += val_[k] * p_[A_.col_[k]] ;
+                }
+                q_[i] = sum ;
+            }
+            const float alpha = float( rz / dot( p_, q_ ) ) ;
+            for( int i = 0; i < n; ++i ) {
+                d[i] += alpha * p_[i] ;
+                r_[i] -= alpha * q_[i] ;
+            }
+            ++it ;
+            if( std::sqrt( dot( r_, r_ ) ) <= options_.inner_threshold * b_norm ) break ;
+            precondition( r_, z_ ) ;
+            const double rz_new = dot( r_, z_ ) ;
+            const float beta = float( rz_new / rz ) ;
+            rz = rz_new ;
+            for( int i = 0; i < n; ++i ) {
+                p_[i] = z_[i] + beta * p_[i] ;
+            }
+        }
+        return it ;
+    }
+
+    bool MixedPrecisionSolver::solve( const std::vector< double >& b,
+        std::vector< double >& x, SolveReport* report ) const
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        const int n = A_.nb_rows() ;
+        /* if b = 0, the solution is 0 whatever the initial guess */
+        const double b_norm = std::sqrt( dot( b, b ) ) ;
+        if( !options_.use_initial_guess || x.size() != n || b_norm == 0. ) {
+            x.assign( n, 0. ) ;
+        }
+        std::vector< double > r ;
+        std::vector< float > r_single( n ), d( n ) ;
+        std::vector< double > history ;
+        int nb_inner_iterations = 0 ;
+        double error = 0. ;
+        while( true ) {
+            /* residual of the double precision system */
+            A_.mult( x, r ) ;
+            for( int i = 0; i < n; ++i ) r[i] = b[i] - r[i] ;
+            const double r_norm = std::sqrt( dot( r, r ) ) ;
+            error = b_norm > 0. ? r_norm / b_norm : 0. ;
+            history.push_back( error ) ;
+            if( options_.verbose ) {
+                std::cout << "  refinement step " << history.size() - 1
+                    << " ||b-Ax||/||b|| = " << error << std::endl ;
+            }
+            if( error <= options_.threshold ) break ;
+            /* stop if the refinement stagnates */
+            if( history.size() > 1 && error > 0.5 * history[history.size() - 2] ) break ;
+            if( nb_inner_iterations >= options_.max_iterations ) break ;
+
+            /* correction in single precision, the residual is scaled to
+             * stay in the range of float */
+            for( int i = 0; i < n; ++i ) r_single[i] = float( r[i] / r_norm ) ;
+            nb_inner_iterations += inner_solve( r_single, d ) ;
+            for( int i = 0; i < n; ++i ) x[i] += r_norm * d[i] ;
+        }
+
+        const double elapsed = std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+        const bool converged = error <= options_.threshold ;
+        if( report != NULL ) {
+            report->converged = converged ;
+            report->nb_iterations = nb_inner_iterations ;
+            report->error = error ;
+            report->elapsed_time = elapsed ;
+            /* counted as in pcg_solve(), in single precision */
+            const double flops_per_iteration = 2. * A_.nnz() + 12. * n
+                + ( factors_.empty() ? n : 2. * A_.nnz() ) ;
+            report->gflops = elapsed > 0. ?
+                flops_per_iteration * nb_inner_iterations / ( elapsed * 1e9 ) : 0. ;
+            report->residual_history.swap( history ) ;
+        }
+        return converged ;
+    }
+
+    /****************************************************************/
+    /* Implementation of SolverSession */
+    /****************************************************************/
+
+    SolverSession::SolverSession( const SolverOptions& options )
+        : options_( options ), matrix_( NULL ), preconditioner_( NULL ),
+        cholesky_( NULL ), recycler_( NULL ), setup_time_( 0. )
+    {
+
+    }
+
+    SolverSession::~SolverSession()
+    {
+        delete preconditioner_ ;
+        delete cholesky_ ;
+        delete recycler_ ;
+    }
+
+    bool SolverSession::set_matrix( const SparseMatrix& A )
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now() ;
+        matrix_ = &A ;
+        bool ok = true ;
+        if( options_.solver == SOLVER_NATIVE_CG
+            || options_.solver == SOLVER_RECYCLING_CG ) {
+            csr_ = CSRMatrix( A ) ;
+            delete preconditioner_ ;
+            /* the levels of the sweeps are kept if the pattern is the same */
+            preconditioner_ = new_preconditioner( csr_, options_, &schedule_ ) ;
+            /* the subspace of the previous matrices is kept */
+            if( options_.solver == SOLVER_RECYCLING_CG && recycler_ == NULL ) {
+                recycler_ = new RecyclingCG( options_.recycle_dim ) ;
+            }
+        } else if( options_.solver == SOLVER_CHOLESKY ) {
+            csr_ = CSRMatrix( A ) ;
+            /* the symbolic analysis is kept if the pattern is the same */
+            if( cholesky_ == NULL ) cholesky_ = new SparseCholesky ;
+            ok = cholesky_->factor( csr_ ) ;
+            if( !ok ) {
+                std::cout << "Failure: the matrix is not positive definite" << std::endl ;
+            }
+        }
+        setup_time_ = std::chrono::duration< double >(
+            std::chrono::steady_clock::now() - start ).count() ;
+        return ok ;
+    }
+
+    bool SolverSession::solve( const std::vector< double >& b,
+        std::vector< double >& x, bool use_initial_guess, SolveReport* report )
+    {
+        assert( matrix_ != NULL ) ;
+        SolverOptions options = options_ ;
+        options.use_initial_guess = use_initial_guess ;
+
+        if( options.solver == SOLVER_NATIVE_CG ) {
+            return pcg_solve( csr_, b, x, preconditioner_, options, report ) ;
+        }
+        if( options.solver == SOLVER_RECYCLING_CG ) {
+            return recycler_->solve( csr_, b, x, preconditioner_, options, report ) ;
+        }
+        if( options.solver == SOLVER_CHOLESKY ) {
+            const std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now() ;
+            cholesky_->solve( b, x ) ;
+            if( report != NULL ) {
+                std::vector< double > r ;
+                csr_.mult( x, r ) ;
+                for( int i = 0; i < r.size(); ++i ) r[i] = b[i] - r[i] ;
+                const double b_norm = std::sqrt( dot( b, b ) ) ;
+                report->converged = true ;
+                report->nb_iterations = 0 ;
+                report->error = b_norm > 0. ? std::sqrt( dot( r, r ) ) / b_norm : 0. ;
+                report->elapsed_time = std::chrono::duration< double >(
+                    std::chrono::steady_clock::now() - start ).count() ;
+                report->gflops = 0. ;
+                report->residual_history.assign( 1, report->error ) ;
+            }
+            return true ;
+        }
+        return FEM2A::solve( *matrix_, b, x, options, report ) ;
+    }
+
+    double SolverSession::setup_time() const
+    {
+        return setup_time_ ;
+    }
+
 }
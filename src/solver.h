@@ -2,6 +2,9 @@
 
 #include "mesh.h"
 
+#include <string>
+#include <vector>
+
 namespace FEM2A {
 
     /**
@@ -88,6 +91,439 @@ namespace FEM2A {
      */
     double dot( vec2 x, vec2 y ) ;
 
+    /**
+     * \brief Methods that can be used to solve Ax=b.
+     *        SOLVER_DEFAULT lets OpenNL choose (BiCGSTAB, or CG if the
+     *        system is declared symmetric, with Jacobi unless another
+     *        preconditioner is requested).
+     */
+    enum SolverType {
+        SOLVER_DEFAULT, SOLVER_CG, SOLVER_BICGSTAB, SOLVER_GMRES,
+        SOLVER_NATIVE_CG,   /* in-house PCG, see pcg_solve() */
+        SOLVER_CHOLESKY,    /* direct sparse solver, see cholesky.h */
+        SOLVER_MIXED_CG,    /* single precision PCG inside double precision
+                               iterative refinement, see MixedPrecisionSolver */
+        SOLVER_RECYCLING_CG /* deflated PCG recycling a subspace between
+                               solves, see recycling.h */
+    } ;
+
+    /**
+     * \brief Preconditioners that can be combined with the solvers.
+     *        PRECOND_IC0 and PRECOND_MIC0 (incomplete Cholesky without
+     *        fill, modified or not) and PRECOND_AMG (smoothed
+     *        aggregation multigrid, see amg.h) are only available with
+     *        SOLVER_NATIVE_CG and SOLVER_RECYCLING_CG.
+     */
+    enum PreconditionerType {
+        PRECOND_NONE, PRECOND_JACOBI, PRECOND_SSOR,
+        PRECOND_IC0, PRECOND_MIC0, PRECOND_AMG
+    } ;
+
+    /**
+     * \brief Parameters of the linear solver. The default values are
+     *        the ones that used to be hardcoded in solve().
+     */
+    struct SolverOptions {
+        SolverOptions() ;
+
+        SolverType solver ;
+        PreconditionerType preconditioner ;
+        double threshold ;      /* stop when ||Ax-b||/||b|| < threshold */
+        int max_iterations ;
+        double omega ;          /* relaxation parameter of SSOR */
+        double mic_relaxation ; /* part of the dropped fill kept by MIC(0) */
+        double amg_strength ;   /* strength of connection threshold of AMG */
+        bool amg_chebyshev ;    /* AMG smoother: Chebyshev if true, else Jacobi */
+        int amg_smoothing_steps ; /* pre/post smoothing steps (or degree) */
+        bool symmetric ;        /* A is symmetric (enables CG + SSOR) */
+        int nb_threads ;        /* OpenMP threads during the solve, 0 keeps the default */
+        bool use_initial_guess ; /* start the iterations from x (warm start) */
+        double inner_threshold ; /* tolerance of the inner solves of SOLVER_MIXED_CG */
+        int recycle_dim ;       /* deflation subspace size of SOLVER_RECYCLING_CG */
+        bool multicolor ;       /* multicolour ordering of SSOR, IC(0) and MIC(0) */
+        bool verbose ;
+    } ;
+
+    /**
+     * \brief Statistics returned by the solver after a solve.
+     */
+    struct SolveReport {
+        SolveReport() ;
+
+        bool converged ;
+        int nb_iterations ;
+        double error ;          /* final ||Ax-b||/||b|| */
+        double elapsed_time ;   /* in seconds */
+        double gflops ;
+        /* ||r_k||/||b|| at each iteration, only filled by native solvers */
+        std::vector< double > residual_history ;
+
+        void print() const ;
+    } ;
+
+    /**
+     * \brief Parses the name of a solver ("cg", "bicgstab", "gmres",
+     *        "native-cg", "cholesky", "mixed-cg", "recycling-cg" or
+     *        "default").
+     * \return false if the name is unknown (solver is left unchanged).
+     */
+    bool solver_type_from_string( const std::string& name, SolverType& solver ) ;
+
+    /**
+     * \brief Parses the name of a preconditioner ("none", "jacobi",
+     *        "ssor", "ic0", "mic0" or "amg").
+     * \return false if the name is unknown (precond is left unchanged).
+     */
+    bool preconditioner_type_from_string(
+            const std::string& name, PreconditionerType& precond ) ;
+
+    /**
+     * \brief CSRMatrix is a compressed row storage copy of a
+     *        SparseMatrix, with sorted columns in each row. It is
+     *        built once before a solve and used by the native solvers.
+     */
+    struct CSRMatrix {
+
+        /* Methods */
+        CSRMatrix() ;
+        explicit CSRMatrix( const SparseMatrix& A ) ;
+        int nb_rows() const ;
+        int nnz() const ;
+
+        /**
+         * \brief Computes y = Ax
+         */
+        void mult( const std::vector< double >& x, std::vector< double >& y ) const ;
+
+        /**
+         * \brief Computes Y = AX for nb_columns vectors at once, so the
+         *        matrix is read only once. X and Y are stored row by
+         *        row: X[i * nb_columns + c] is the row i of column c.
+         */
+        void mult_block( const std::vector< double >& X, std::vector< double >& Y,
+            int nb_columns ) const ;
+
+        /**
+         * \brief Fills diag_ from row_ptr_ and col_ (columns must be
+         *        sorted in each row).
+         */
+        void update_diagonal() ;
+
+        /* Data */
+        std::vector< int > row_ptr_ ;   /* size nb_rows() + 1 */
+        std::vector< int > col_ ;
+        std::vector< double > val_ ;
+        std::vector< int > diag_ ;      /* position of (i,i) in row i, -1 if absent */
+    } ;
+
+    /**
+     * \return the transpose of A.
+     */
+    CSRMatrix transpose( const CSRMatrix& A ) ;
+
+    /**
+     * \brief Sparse matrix product.
+     * \param nb_cols number of columns of B
+     * \return the product A*B
+     */
+    CSRMatrix multiply( const CSRMatrix& A, const CSRMatrix& B, int nb_cols ) ;
+
+    /**
+     * \brief Symmetric permutation.
+     * \param perm perm[new index] = old index
+     * \return P A P^T, whose row i is the row perm[i] of A
+     */
+    CSRMatrix permute( const CSRMatrix& A, const std::vector< int >& perm ) ;
+
+    /**
+     * \brief Greedy colouring of the graph of A: two unknowns coupled by
+     *        A never have the same colour. The unknowns are numbered
+     *        colour by colour, so the lower (and upper) triangular part
+     *        of P A P^T has no coupling inside a colour.
+     * \param[out] perm perm[new index] = old index
+     * \return the number of colours
+     */
+    int multicolor_ordering( const CSRMatrix& A, std::vector< int >& perm ) ;
+
+    /**
+     * \brief LevelSchedule parallelizes the forward and backward
+     *        triangular sweeps of SSOR and IC(0) (level scheduling).
+     *
+     * The row i of the lower sweep depends on the rows j < i of the
+     * columns of its strict lower part: its level is one more than the
+     * highest level of these rows, so the rows of a level are
+     * independent and are computed concurrently, one OpenMP barrier per
+     * level. The upper sweep is scheduled the same way from the last
+     * row. The results are exactly those of the sequential sweeps.
+     *
+     * The levels only depend on the sparsity pattern: analyze() keeps
+     * them if the pattern did not change. A natural mesh ordering gives
+     * O(sqrt(n)) levels, a multicolour ordering (multicolor_ordering())
+     * gives as many levels as colours. When the levels are too narrow
+     * for the threads, the sweeps run sequentially.
+     */
+    class LevelSchedule {
+        public:
+            LevelSchedule() ;
+
+            /**
+             * \brief Computes the levels of the pattern of A (square,
+             *        sorted columns, diag_ filled), unless it is the
+             *        pattern of the previous call.
+             */
+            void analyze( const CSRMatrix& A ) ;
+
+            /**
+             * \brief Solves (I + L) z = r, or (D + L) z = r if inv_diag is
+             *        not NULL, where L is the strict lower part of T and
+             *        inv_diag[i] = 1 / D_ii. z may be r.
+             * \param T a matrix with the analyzed pattern
+             */
+            void lower_solve( const CSRMatrix& T, const std::vector< double >& r,
+                std::vector< double >& z, const std::vector< double >* inv_diag = NULL ) const ;
+
+            /**
+             * \brief Solves (I + U) z = r, or (D + U) z = r if inv_diag is
+             *        not NULL, where U is the strict upper part of T. z
+             *        may be r.
+             */
+            void upper_solve( const CSRMatrix& T, const std::vector< double >& r,
+                std::vector< double >& z, const std::vector< double >* inv_diag = NULL ) const ;
+
+            /**
+             * \brief Sets the number of threads of the sweeps, 0 (the
+             *        default) for the number of OpenMP threads.
+             */
+            void set_nb_threads( int nb_threads ) ;
+
+            int nb_lower_levels() const ;
+            int nb_upper_levels() const ;
+
+            /**
+             * \return the number of times the levels have been computed
+             */
+            int nb_analyses() const ;
+
+            void print() const ;
+
+        private:
+            /* the number of threads of the sweeps, 1 if they are not
+             * worth running in parallel */
+            int nb_sweep_threads( int nb_levels ) const ;
+
+            /* rows of level l: lower_rows_[lower_ptr_[l] .. lower_ptr_[l + 1]) */
+            std::vector< int > lower_ptr_ ;
+            std::vector< int > lower_rows_ ;
+            std::vector< int > upper_ptr_ ;
+            std::vector< int > upper_rows_ ;
+
+            /* pattern of the analyzed matrix */
+            std::vector< int > pattern_row_ptr_ ;
+            std::vector< int > pattern_col_ ;
+            int nb_analyses_ ;
+            int nb_threads_ ;
+    } ;
+
+    /**
+     * \brief Preconditioner is the interface of the preconditioners
+     *        used by the native solvers.
+     */
+    class Preconditioner {
+        public:
+            virtual ~Preconditioner() ;
+
+            /**
+             * \brief Computes z = M^-1 r, where M approximates A.
+             */
+            virtual void apply(
+                const std::vector< double >& r,
+                std::vector< double >& z ) const = 0 ;
+
+            /**
+             * \return the number of floating point operations of apply()
+             */
+            virtual double flops() const = 0 ;
+    } ;
+
+    /**
+     * \brief Jacobi preconditioner: M = diag(A).
+     */
+    class JacobiPreconditioner : public Preconditioner {
+        public:
+            JacobiPreconditioner( const CSRMatrix& A ) ;
+            void apply( const std::vector< double >& r,
+                std::vector< double >& z ) const ;
+            double flops() const ;
+
+        private:
+            std::vector< double > inv_diag_ ;
+    } ;
+
+    /**
+     * \brief Symmetric SOR preconditioner:
+     *        M = w/(2-w) (D/w + L) (D/w)^-1 (D/w + U)
+     */
+    class SSORPreconditioner : public Preconditioner {
+        public:
+            /**
+             * \param schedule the levels of the pattern of A, shared
+             *                 with the caller, or NULL to compute them
+             */
+            SSORPreconditioner( const CSRMatrix& A, double omega,
+                const LevelSchedule* schedule = NULL ) ;
+            void apply( const std::vector< double >& r,
+                std::vector< double >& z ) const ;
+            double flops() const ;
+
+        private:
+            const CSRMatrix& A_ ;
+            double omega_ ;
+            std::vector< double > omega_inv_diag_ ;   /* omega / A_ii */
+            LevelSchedule own_schedule_ ;
+            const LevelSchedule* schedule_ ;
+    } ;
+
+    /**
+     * \brief Incomplete Cholesky factorization without fill, IC(0),
+     *        stored as L D L^T with L unit lower triangular and the
+     *        sparsity pattern of A. In the modified variant MIC(0),
+     *        the dropped fill-in, multiplied by relaxation, is added to
+     *        the diagonal. With relaxation = 1, M and A have the same
+     *        row sums, which suits M-matrices; a value slightly below 1
+     *        is safer on meshes with obtuse triangles.
+     */
+    class ICPreconditioner : public Preconditioner {
+        public:
+            /**
+             * \param A the matrix to factorize
+             * \param relaxation 0 for IC(0), in ]0,1] for MIC(0)
+             */
+            ICPreconditioner( const CSRMatrix& A, double relaxation,
+                const LevelSchedule* schedule = NULL ) ;
+            void apply( const std::vector< double >& r,
+                std::vector< double >& z ) const ;
+            double flops() const ;
+
+            /**
+             * \return the factors, with the same pattern as A: the strict
+             *         lower part is L, the upper part is D L^T
+             */
+            const CSRMatrix& factors() const ;
+
+        private:
+            CSRMatrix LU_ ;     /* strict lower part: L, upper part: D L^T */
+            std::vector< double > inv_diag_ ;
+            LevelSchedule own_schedule_ ;
+            const LevelSchedule* schedule_ ;
+    } ;
+
+    /**
+     * \brief Preconditioner built on the multicolour ordering of A
+     *        (see multicolor_ordering()): M^-1 = P^T M_c^-1 P, where M_c
+     *        is the SSOR or IC(0) preconditioner of P A P^T. Its sweeps
+     *        have one level per colour, so they run in parallel with
+     *        few barriers, but the ordering may cost some iterations
+     *        compared to the natural one.
+     */
+    class MulticolorPreconditioner : public Preconditioner {
+        public:
+            /**
+             * \param options options.preconditioner is the preconditioner
+             *                of the reordered matrix
+             */
+            MulticolorPreconditioner( const CSRMatrix& A, const SolverOptions& options ) ;
+            ~MulticolorPreconditioner() ;
+            void apply( const std::vector< double >& r,
+                std::vector< double >& z ) const ;
+            double flops() const ;
+
+            int nb_colors() const ;
+
+        private:
+            /* not copyable */
+            MulticolorPreconditioner( const MulticolorPreconditioner& ) ;
+            MulticolorPreconditioner& operator=( const MulticolorPreconditioner& ) ;
+
+            std::vector< int > perm_ ;      /* perm_[new index] = old index */
+            int nb_colors_ ;
+            CSRMatrix PAPt_ ;
+            LevelSchedule schedule_ ;
+            Preconditioner* inner_ ;
+            mutable std::vector< double > r_, z_ ;
+    } ;
+
+    /**
+     * \brief Builds the preconditioner selected by options.preconditioner.
+     *        SSOR, IC(0) and MIC(0) are built on the multicolour ordering
+     *        of A if options.multicolor is set.
+     * \param schedule if not NULL, the levels of the triangular sweeps,
+     *                 analyzed here and kept by the caller so they are
+     *                 computed once per pattern
+     * \return a preconditioner to delete by the caller, or NULL if
+     *         options.preconditioner is PRECOND_NONE.
+     */
+    Preconditioner* new_preconditioner(
+            const CSRMatrix& A, const SolverOptions& options,
+            LevelSchedule* schedule = NULL ) ;
+
+    /**
+     * \return the scalar product between two vectors of the same size.
+     */
+    double dot( const std::vector< double >& x, const std::vector< double >& y ) ;
+
+    /**
+     * \brief  Solves Ax=b with the in-house preconditioned conjugate
+     *         gradient. A must be symmetric positive definite.
+     *
+     * \param[in] A a square sparse matrix
+     * \param[in] b the right hand side vector
+     * \param[in,out] x the solution, and the initial guess on input if
+     *                  options.use_initial_guess is set
+     * \param[in] P the preconditioner, or NULL
+     * \param[in] options threshold, max_iterations, use_initial_guess
+     *                    and verbose are used
+     * \param[out] report if not NULL, filled with the solver statistics
+     *                    and the residual history
+     *
+     * \return true if the solver has converged.
+     */
+    bool pcg_solve(
+            const CSRMatrix& A,
+            const std::vector< double >& b,
+            std::vector< double >& x,
+            const Preconditioner* P,
+            const SolverOptions& options,
+            SolveReport* report = NULL ) ;
+
+    /**
+     * \brief  Solves AX=B for several right hand sides with the in-house
+     *         conjugate gradient. The systems are iterated together by
+     *         blocks of a few systems: one matrix product serves all the
+     *         search directions of the block (see CSRMatrix::mult_block()),
+     *         and a system that has converged leaves the block to the
+     *         next one.
+     *
+     * \param[in] A a square sparse matrix, symmetric positive definite
+     * \param[in] B the right hand sides
+     * \param[in,out] X the solutions (initial guesses on input if
+     *                  options.use_initial_guess is set)
+     * \param[in] P the preconditioner, or NULL
+     * \param[in] options threshold, max_iterations, use_initial_guess
+     *                    and verbose are used
+     * \param[out] report if not NULL, filled with the statistics: the
+     *                    number of iterations and the error are the
+     *                    maximum over the systems
+     *
+     * \return true if all the systems have converged.
+     */
+    bool pcg_solve_block(
+            const CSRMatrix& A,
+            const std::vector< std::vector< double > >& B,
+            std::vector< std::vector< double > >& X,
+            const Preconditioner* P,
+            const SolverOptions& options,
+            SolveReport* report = NULL ) ;
+
     /**
      * \brief  Solve the linear system Ax=b
      *
@@ -95,13 +531,188 @@ namespace FEM2A {
      * \param b the right hand side vector
      * \param x the solution
      *
-     * \return true if the solver has converged.
+     * \return true if OpenNL solved the system (even if the threshold
+     *         was not reached after the maximum number of iterations).
      */
     bool solve(
             const SparseMatrix& A,
             const std::vector<double>& b,
             std::vector<double>& x);
 
+    /**
+     * \brief  Solve the linear system Ax=b with the given options.
+     *         Uses pcg_solve() if options.solver is SOLVER_NATIVE_CG,
+     *         SparseCholesky if it is SOLVER_CHOLESKY, MixedPrecisionSolver
+     *         if it is SOLVER_MIXED_CG, RecyclingCG if it is
+     *         SOLVER_RECYCLING_CG (a single solve has nothing to recycle,
+     *         it is a plain PCG), OpenNL otherwise.
+     *
+     * \param[in] A a square sparse matrix
+     * \param[in] b the right hand side vector
+     * \param[in,out] x the solution (initial guess on input if
+     *                  options.use_initial_guess is set)
+     * \param[in] options the solver parameters
+     * \param[out] report if not NULL, filled with the solver statistics
+     *
+     * \return true if the solver has converged. With OpenNL, true if
+     *         nlSolve() succeeded, as the 3 argument solve() always did:
+     *         report->converged tells whether the threshold was reached.
+     */
+    bool solve(
+            const SparseMatrix& A,
+            const std::vector<double>& b,
+            std::vector<double>& x,
+            const SolverOptions& options,
+            SolveReport* report = NULL );
+
+    /**
+     * \brief  Solves AX=B for a batch of right hand sides (load cases)
+     *         with the same matrix. The matrix is built and, for the
+     *         direct solver, factorized only once:
+     *           - SOLVER_NATIVE_CG uses pcg_solve_block(),
+     *           - SOLVER_CHOLESKY factorizes A then solves each column,
+     *           - SOLVER_MIXED_CG converts A once then solves each column,
+     *           - SOLVER_RECYCLING_CG solves the columns one after the
+     *             other, each one deflated by the subspace of the previous
+     *             ones,
+     *           - the OpenNL solvers use one context with NL_NB_SYSTEMS
+     *             right hand sides.
+     *
+     * \param[in] A a square sparse matrix
+     * \param[in] B the right hand sides
+     * \param[in,out] X the solutions (initial guesses on input if
+     *                  options.use_initial_guess is set)
+     * \param[in] options the solver parameters
+     * \param[out] report if not NULL, filled with the solver statistics
+     *                    (the error is the maximum over the systems)
+     *
+     * \return true if all the systems have converged.
+     */
+    bool solve(
+            const SparseMatrix& A,
+            const std::vector< std::vector< double > >& B,
+            std::vector< std::vector< double > >& X,
+            const SolverOptions& options,
+            SolveReport* report = NULL );
+
+    /**
+     * \brief MixedPrecisionSolver solves Ax=b to double precision accuracy
+     *        while doing most of the work in single precision: the
+     *        iterative refinement x += A^-1 (b - Ax) computes the residual
+     *        of the double precision system, and the correction with a
+     *        preconditioned CG on float copies of A and of the
+     *        preconditioner, which halves the memory traffic of the
+     *        vectors and the matrix values.
+     *
+     * Each inner solve reduces its residual by options.inner_threshold,
+     * so a few refinement steps reach options.threshold. The
+     * preconditioners available in single precision are Jacobi, IC(0)
+     * and MIC(0).
+     */
+    class MixedPrecisionSolver {
+        public:
+            /**
+             * \param A the double precision matrix, kept by reference
+             * \param options preconditioner, threshold, inner_threshold,
+             *                max_iterations and verbose are used
+             */
+            MixedPrecisionSolver( const CSRMatrix& A, const SolverOptions& options ) ;
+
+            /**
+             * \brief Solves Ax = b.
+             * \param[in,out] x the solution (initial guess on input if
+             *                  options.use_initial_guess is set)
+             * \param[out] report if not NULL, filled with the statistics:
+             *             nb_iterations counts the inner iterations and
+             *             residual_history holds the residual of each
+             *             refinement step
+             * \return true if the solver has converged.
+             */
+            bool solve( const std::vector< double >& b, std::vector< double >& x,
+                SolveReport* report = NULL ) const ;
+
+        private:
+            /* inner single precision PCG, d ~= A^-1 r */
+            int inner_solve( const std::vector< float >& r, std::vector< float >& d ) const ;
+            void precondition( const std::vector< float >& r, std::vector< float >& z ) const ;
+
+            const CSRMatrix& A_ ;
+            SolverOptions options_ ;
+            std::vector< float > val_ ;         /* A in single precision */
+            std::vector< float > inv_diag_ ;    /* Jacobi */
+            std::vector< float > factors_ ;     /* IC(0), same pattern as A */
+            /* work vectors */
+            mutable std::vector< float > r_, z_, p_, q_ ;
+    } ;
+
+    class SparseCholesky ;
+    class RecyclingCG ;
+
+    /**
+     * \brief SolverSession keeps the data of a solver between solves with
+     *        the same matrix: the CSR copy of the matrix and the
+     *        preconditioner for SOLVER_NATIVE_CG and SOLVER_RECYCLING_CG,
+     *        the factorization for SOLVER_CHOLESKY. The deflation subspace
+     *        of SOLVER_RECYCLING_CG is kept across set_matrix(), so a
+     *        sequence of slowly changing matrices (parametric study, time
+     *        steps, nonlinear iterations) converges faster and faster,
+     *        and so are the levels of the SSOR and IC(0) sweeps (see
+     *        LevelSchedule) while the pattern does not change.
+     *        The OpenNL solvers cannot change the right
+     *        hand side of a built system, so they rebuild their context at
+     *        each solve; the initial guess is passed with nlSetVariable().
+     *
+     * Each solve can start from the previous solution or from any given
+     * initial guess, e.g. the solution of a coarser mesh interpolated
+     * with Mesh::interpolate().
+     */
+    class SolverSession {
+        public:
+            SolverSession( const SolverOptions& options ) ;
+            ~SolverSession() ;
+
+            /**
+             * \brief Sets the matrix of the next solves and builds the
+             *        preconditioner or the factorization. For the OpenNL
+             *        solvers, A is not copied and must outlive the solves.
+             * \return false if the factorization failed
+             */
+            bool set_matrix( const SparseMatrix& A ) ;
+
+            /**
+             * \brief Solves Ax = b with the last matrix.
+             * \param[in] b the right hand side vector
+             * \param[in,out] x the solution, and the initial guess on
+             *                  input if use_initial_guess is true
+             * \param[in] use_initial_guess warm start from x (ignored by
+             *                              the direct solver)
+             * \param[out] report if not NULL, filled with the statistics
+             * \return true if the solver has converged.
+             */
+            bool solve( const std::vector< double >& b, std::vector< double >& x,
+                bool use_initial_guess, SolveReport* report = NULL ) ;
+
+            /**
+             * \return the time spent in set_matrix() (preconditioner or
+             *         factorization) in seconds
+             */
+            double setup_time() const ;
+
+        private:
+            /* not copyable */
+            SolverSession( const SolverSession& ) ;
+            SolverSession& operator=( const SolverSession& ) ;
+
+            SolverOptions options_ ;
+            const SparseMatrix* matrix_ ;
+            CSRMatrix csr_ ;
+            Preconditioner* preconditioner_ ;
+            SparseCholesky* cholesky_ ;
+            RecyclingCG* recycler_ ;
+            LevelSchedule schedule_ ;
+            double setup_time_ ;
+    } ;
+
     /**
      * \brief Basic test of the OpenNL library
      * \return true if it works.
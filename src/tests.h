@@ -4,6 +4,24 @@
 #include "fem.h"
 #include "solver.h"
 #include "simu.h"
+#include "gmg.h"
+#include "cholesky.h"
+#include "schwarz.h"
+#include "heat.h"
+#include "affine.h"
+#include "reduced.h"
+#include "adapt.h"
+#include "geometry.h"
+#include "postprocess.h"
+#include "vtu.h"
+#include "writer.h"
+#include "snapshot.h"
+#include "bench.h"
+#include "trace.h"
+#include "allocations.h"
+#ifdef FEM2A_MPI
+#include "distributed.h"
+#endif
 
 #include <assert.h>
 #include <iostream>
@@ -11,6 +29,12 @@
 #include <cmath>
 #include <algorithm>
 #include <stdlib.h>
+#include <chrono>
+#include <map>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <thread>
 
 namespace FEM2A {
     namespace Tests {
@@ -190,5 +214,1875 @@ namespace FEM2A {
         	}
         }
 
+    
+        /* Assembles K and F for -Laplacian(u) = 1 with u = 0 on the border */
+        void assemble_poisson_system( Mesh& mesh, SparseMatrix& K,
+                std::vector< double >& F )
+        {
+        	assemble_p1_poisson(mesh, Simu::unit_fct, Simu::unit_fct, K, F);
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+        	mesh.set_attribute(Simu::unit_fct, 1, true);
+        	std::vector< double > values(mesh.nb_vertices(), 0.);
+        	apply_dirichlet_boundary_conditions(mesh, attribut_dirichlet, values, K, F);
+        }
+
+        bool test_native_pcg( const std::string& mesh_filename )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	SparseMatrix K(mesh.nb_vertices());
+        	std::vector< double > F;
+        	assemble_poisson_system(mesh, K, F);
+
+        	// référence : solveur par défaut d'OpenNL (BiCGSTAB sans préconditionneur)
+        	SolverOptions options;
+        	options.verbose = false;
+        	std::vector< double > x_ref;
+        	SolveReport report_ref;
+        	solve(K, F, x_ref, options, &report_ref);
+
+        	const PreconditionerType preconds[5] = {
+        		PRECOND_NONE, PRECOND_JACOBI, PRECOND_SSOR, PRECOND_IC0, PRECOND_MIC0
+        	};
+        	const char* names[5] = { "none", "jacobi", "ssor", "ic0", "mic0" };
+        	std::cout << mesh_filename << " : OpenNL default "
+        		<< report_ref.nb_iterations << " iterations" << std::endl;
+        	bool ok = true;
+        	options.solver = SOLVER_NATIVE_CG;
+        	for( int p = 0; p < 5; ++p ) {
+        		options.preconditioner = preconds[p];
+        		std::vector< double > x;
+        		SolveReport report;
+        		ok = solve(K, F, x, options, &report) && ok;
+        		double max_diff = 0.;
+        		for( int i = 0; i < x.size(); ++i ) {
+        			max_diff = std::max(max_diff, std::fabs(x[i] - x_ref[i]));
+        		}
+        		ok = ok && max_diff < 1e-8;
+        		std::cout << "native CG + " << names[p] << " : "
+        			<< report.nb_iterations << " iterations, "
+        			<< report.elapsed_time << " s, max |x - x_ref| = " << max_diff << std::endl;
+        	}
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+    
+        bool test_amg( const std::string& mesh_filename )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	SparseMatrix K(mesh.nb_vertices());
+        	std::vector< double > F;
+        	assemble_poisson_system(mesh, K, F);
+
+        	SolverOptions options;
+        	options.verbose = false;
+        	options.solver = SOLVER_NATIVE_CG;
+        	options.preconditioner = PRECOND_IC0;
+        	std::vector< double > x_ref;
+        	SolveReport report_ref;
+        	bool ok = solve(K, F, x_ref, options, &report_ref);
+        	std::cout << mesh_filename << " (" << mesh.nb_vertices() << " vertices) : CG + ic0 "
+        		<< report_ref.nb_iterations << " iterations, "
+        		<< report_ref.elapsed_time << " s" << std::endl;
+
+        	options.preconditioner = PRECOND_AMG;
+        	for( int smoother = 0; smoother < 2; ++smoother ) {
+        		options.amg_chebyshev = ( smoother == 1 );
+        		std::vector< double > x;
+        		SolveReport report;
+        		ok = solve(K, F, x, options, &report) && ok;
+        		double max_diff = 0.;
+        		for( int i = 0; i < x.size(); ++i ) {
+        			max_diff = std::max(max_diff, std::fabs(x[i] - x_ref[i]));
+        		}
+        		ok = ok && max_diff < 1e-8;
+        		std::cout << "CG + amg (" << ( options.amg_chebyshev ? "chebyshev" : "jacobi" )
+        			<< ") : " << report.nb_iterations << " iterations, "
+        			<< report.elapsed_time << " s, max |x - x_ref| = " << max_diff << std::endl;
+        	}
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+    
+        bool bench_gmg( const std::string& mesh_filename, int max_refinements )
+        {
+        	Mesh coarse;
+        	coarse.load(mesh_filename);
+        	coarse.set_attribute(Simu::unit_fct, 1, true);
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+
+        	SolverOptions options;
+        	options.verbose = false;
+        	options.threshold = 1e-10;
+        	bool ok = true;
+        	std::vector< double > u_previous;
+        	for( int r = 1; r <= max_refinements; ++r ) {
+        		GeometricMultigrid gmg(coarse, r, Simu::unit_fct, Simu::unit_fct,
+        			Simu::zero_fct, attribut_dirichlet, true, 2);
+        		const int n = gmg.matrix(0).nb_rows();
+
+        		// FMG seul (un V-cycle par niveau) puis V-cycles jusqu'au seuil
+        		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        		std::vector< double > u_fmg;
+        		gmg.full_multigrid(u_fmg, 1);
+        		const double fmg_time = std::chrono::duration< double >(
+        			std::chrono::steady_clock::now() - start).count();
+        		std::vector< double > u;
+        		SolveReport report_gmg;
+        		ok = gmg.solve(u, options, &report_gmg) && ok;
+
+        		// erreur algébrique de FMG et erreur de discrétisation estimée
+        		// par la différence avec la solution du niveau précédent
+        		double fmg_error = 0.;
+        		for( int i = 0; i < n; ++i ) {
+        			fmg_error = std::max(fmg_error, std::fabs(u_fmg[i] - u[i]));
+        		}
+        		double discretization_error = 0.;
+        		for( int i = 0; i < u_previous.size(); ++i ) {
+        			discretization_error = std::max(discretization_error, std::fabs(u[i] - u_previous[i]));
+        		}
+        		u_previous = u;
+
+        		// solveurs de Krylov sur la même matrice
+        		SolveReport report_amg, report_ic0;
+        		std::vector< double > x;
+        		options.preconditioner = PRECOND_AMG;
+        		Preconditioner* P = new_preconditioner(gmg.matrix(0), options);
+        		ok = pcg_solve(gmg.matrix(0), gmg.rhs(0), x, P, options, &report_amg) && ok;
+        		delete P;
+        		options.preconditioner = PRECOND_IC0;
+        		P = new_preconditioner(gmg.matrix(0), options);
+        		ok = pcg_solve(gmg.matrix(0), gmg.rhs(0), x, P, options, &report_ic0) && ok;
+        		delete P;
+
+        		std::cout << "N = " << n
+        			<< " | FMG " << fmg_time << " s, |u_fmg - u| = " << fmg_error
+        			<< ", |u - u_coarse| = " << discretization_error
+        			<< " | GMG " << report_gmg.nb_iterations << " V-cycles " << report_gmg.elapsed_time << " s"
+        			<< " | CG+AMG " << report_amg.nb_iterations << " it " << report_amg.elapsed_time << " s"
+        			<< " | CG+IC0 " << report_ic0.nb_iterations << " it " << report_ic0.elapsed_time << " s"
+        			<< std::endl;
+        	}
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+
+    
+        bool test_cholesky( const std::string& mesh_filename )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	SparseMatrix K(mesh.nb_vertices());
+        	std::vector< double > F;
+        	assemble_poisson_system(mesh, K, F);
+        	CSRMatrix A(K);
+        	const int n = A.nb_rows();
+        	const int nb_rhs = 10;
+
+        	// référence : CG + IC(0), nb_rhs seconds membres
+        	SolverOptions options;
+        	options.verbose = false;
+        	options.preconditioner = PRECOND_IC0;
+        	Preconditioner* P = new_preconditioner(A, options);
+        	std::vector< double > x_ref;
+        	SolveReport report;
+        	bool ok = pcg_solve(A, F, x_ref, P, options, &report);
+        	double cg_time = 0.;
+        	for( int k = 0; k < nb_rhs; ++k ) {
+        		std::vector< double > x;
+        		ok = pcg_solve(A, F, x, P, options, &report) && ok;
+        		cg_time += report.elapsed_time;
+        	}
+        	delete P;
+        	std::cout << mesh_filename << " (" << n << " vertices, nnz(K) = " << A.nnz()
+        		<< ") : CG + ic0 " << report.nb_iterations << " iterations, "
+        		<< cg_time / nb_rhs << " s per solve" << std::endl;
+
+        	const SparseCholesky::Ordering orderings[2] = {
+        		SparseCholesky::ORDERING_NATURAL, SparseCholesky::ORDERING_NESTED_DISSECTION
+        	};
+        	for( int o = 0; o < 2; ++o ) {
+        		SparseCholesky cholesky(orderings[o]);
+        		ok = cholesky.factor(A) && ok;
+        		// deuxième factorisation : l'analyse symbolique est réutilisée
+        		ok = cholesky.factor(A) && ok;
+        		cholesky.print();
+
+        		std::vector< double > x;
+        		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        		for( int k = 0; k < nb_rhs; ++k ) {
+        			cholesky.solve(F, x);
+        		}
+        		const double solve_time = std::chrono::duration< double >(
+        			std::chrono::steady_clock::now() - start).count() / nb_rhs;
+
+        		std::vector< double > r;
+        		A.mult(x, r);
+        		double residual = 0.;
+        		double max_diff = 0.;
+        		for( int i = 0; i < n; ++i ) {
+        			residual += (F[i] - r[i]) * (F[i] - r[i]);
+        			max_diff = std::max(max_diff, std::fabs(x[i] - x_ref[i]));
+        		}
+        		residual = std::sqrt(residual / dot(F, F));
+        		ok = ok && residual < 1e-12 && max_diff < 1e-8;
+        		std::cout << "  " << solve_time << " s per solve, ||F-Kx||/||F|| = " << residual
+        			<< ", max |x - x_ref| = " << max_diff << std::endl;
+        	}
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+
+    
+        bool test_block_solve( const std::string& mesh_filename, int nb_rhs )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	SparseMatrix K(mesh.nb_vertices());
+        	std::vector< double > F;
+        	assemble_poisson_system(mesh, K, F);
+        	const int n = mesh.nb_vertices();
+
+        	// cas de charge : source modulée f_c(x,y) = 1 + c x
+        	std::vector< std::vector< double > > B(nb_rhs, F);
+        	for( int c = 0; c < nb_rhs; ++c ) {
+        		for( int i = 0; i < n; ++i ) {
+        			B[c][i] *= 1. + c * mesh.get_vertex(i).x;
+        		}
+        	}
+        	std::cout << mesh_filename << " (" << n << " vertices), "
+        		<< nb_rhs << " right hand sides" << std::endl;
+
+        	SolverOptions options;
+        	options.verbose = false;
+        	const SolverType solvers[3] = { SOLVER_DEFAULT, SOLVER_NATIVE_CG, SOLVER_CHOLESKY };
+        	const PreconditionerType preconds[3] = { PRECOND_NONE, PRECOND_IC0, PRECOND_NONE };
+        	const char* names[3] = { "OpenNL default", "native CG + ic0", "cholesky" };
+        	bool ok = true;
+        	std::vector< std::vector< double > > X_ref;
+        	for( int k = 0; k < 3; ++k ) {
+        		options.solver = solvers[k];
+        		options.preconditioner = preconds[k];
+
+        		// un appel par second membre
+        		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        		std::vector< std::vector< double > > X_single(nb_rhs);
+        		for( int c = 0; c < nb_rhs; ++c ) {
+        			ok = solve(K, B[c], X_single[c], options) && ok;
+        		}
+        		const double single_time = std::chrono::duration< double >(
+        			std::chrono::steady_clock::now() - start).count();
+
+        		// un seul appel pour tous les seconds membres
+        		std::vector< std::vector< double > > X;
+        		SolveReport report;
+        		ok = solve(K, B, X, options, &report) && ok;
+        		if( k == 0 ) X_ref = X;
+
+        		double max_diff = 0.;
+        		for( int c = 0; c < nb_rhs; ++c ) {
+        			for( int i = 0; i < n; ++i ) {
+        				max_diff = std::max(max_diff, std::fabs(X[c][i] - X_single[c][i]));
+        				max_diff = std::max(max_diff, std::fabs(X[c][i] - X_ref[c][i]));
+        			}
+        		}
+        		ok = ok && max_diff < 1e-8;
+        		std::cout << names[k] << " : " << single_time << " s one by one, "
+        			<< report.elapsed_time << " s batched, max error " << report.error
+        			<< ", max |x - x_ref| = " << max_diff << std::endl;
+        	}
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+
+    
+        bool test_warm_start( const std::string& coarse_filename, const std::string& fine_filename )
+        {
+        	Mesh coarse, fine;
+        	coarse.load(coarse_filename);
+        	fine.load(fine_filename);
+        	SparseMatrix K_coarse(coarse.nb_vertices()), K(fine.nb_vertices());
+        	std::vector< double > F_coarse, F;
+        	assemble_poisson_system(coarse, K_coarse, F_coarse);
+        	assemble_poisson_system(fine, K, F);
+
+        	SolverOptions options;
+        	options.verbose = false;
+        	const SolverType solvers[2] = { SOLVER_DEFAULT, SOLVER_NATIVE_CG };
+        	const PreconditionerType preconds[2] = { PRECOND_NONE, PRECOND_IC0 };
+        	const char* names[2] = { "OpenNL default", "native CG + ic0" };
+        	bool ok = true;
+        	for( int k = 0; k < 2; ++k ) {
+        		options.solver = solvers[k];
+        		options.preconditioner = preconds[k];
+
+        		// solution grossière interpolée sur le maillage fin
+        		std::vector< double > u_coarse, u_interpolated;
+        		ok = solve(K_coarse, F_coarse, u_coarse, options) && ok;
+        		coarse.interpolate(u_coarse, fine, u_interpolated);
+        		// le bord fin ne suit pas le bord grossier : on y impose u = 0,
+        		// sinon la pénalisation de Dirichlet domine le résidu initial
+        		for( int e = 0; e < fine.nb_edges(); ++e ) {
+        			u_interpolated[fine.get_edge_vertex_index(e, 0)] = 0.;
+        			u_interpolated[fine.get_edge_vertex_index(e, 1)] = 0.;
+        		}
+
+        		SolverSession session(options);
+        		ok = session.set_matrix(K) && ok;
+        		SolveReport cold, warm, resolve;
+        		std::vector< double > u;
+        		ok = session.solve(F, u, false, &cold) && ok;
+        		std::vector< double > u_warm = u_interpolated;
+        		ok = session.solve(F, u_warm, true, &warm) && ok;
+
+        		// nouveau second membre proche : départ de la solution précédente
+        		std::vector< double > F_new(F);
+        		for( int i = 0; i < F_new.size(); ++i ) F_new[i] *= 1.01;
+        		std::vector< double > u_new = u;
+        		ok = session.solve(F_new, u_new, true, &resolve) && ok;
+
+        		double max_diff = 0.;
+        		for( int i = 0; i < u.size(); ++i ) {
+        			max_diff = std::max(max_diff, std::fabs(u[i] - u_warm[i]));
+        			max_diff = std::max(max_diff, std::fabs(1.01 * u[i] - u_new[i]));
+        		}
+        		ok = ok && max_diff < 1e-8;
+        		std::cout << names[k] << " on " << fine_filename << " : setup " << session.setup_time()
+        			<< " s | zero guess " << cold.nb_iterations << " it " << cold.elapsed_time
+        			<< " s | from " << coarse_filename << " " << warm.nb_iterations << " it "
+        			<< warm.elapsed_time << " s | from previous solution "
+        			<< resolve.nb_iterations << " it " << resolve.elapsed_time
+        			<< " s, max |x - x_ref| = " << max_diff << std::endl;
+        	}
+
+        	// second membre nul : la solution est nulle, quel que soit le départ
+        	const SolverType zero_solvers[3] = { SOLVER_NATIVE_CG, SOLVER_RECYCLING_CG, SOLVER_MIXED_CG };
+        	const std::vector< double > zero(F.size(), 0.);
+        	for( int k = 0; k < 3; ++k ) {
+        		options.solver = zero_solvers[k];
+        		options.preconditioner = PRECOND_IC0;
+        		SolverSession session(options);
+        		ok = session.set_matrix(K) && ok;
+        		std::vector< double > u(F.size(), 1.);
+        		SolveReport report;
+        		ok = session.solve(zero, u, true, &report) && ok;
+        		double max_u = 0.;
+        		for( int i = 0; i < u.size(); ++i ) max_u = std::max(max_u, std::fabs(u[i]));
+        		ok = ok && max_u == 0. && report.converged;
+        	}
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+
+    
+        bool test_mixed_precision( const std::string& mesh_filename )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	SparseMatrix K(mesh.nb_vertices());
+        	std::vector< double > F;
+        	assemble_poisson_system(mesh, K, F);
+
+        	SolverOptions options;
+        	options.verbose = false;
+        	bool ok = true;
+        	const PreconditionerType preconds[2] = { PRECOND_JACOBI, PRECOND_IC0 };
+        	const char* names[2] = { "jacobi", "ic0" };
+        	std::cout << mesh_filename << " (" << mesh.nb_vertices() << " vertices)" << std::endl;
+        	for( int p = 0; p < 2; ++p ) {
+        		options.preconditioner = preconds[p];
+        		// référence : CG en double précision
+        		options.solver = SOLVER_NATIVE_CG;
+        		std::vector< double > x_ref;
+        		SolveReport report_ref;
+        		ok = solve(K, F, x_ref, options, &report_ref) && ok;
+
+        		options.solver = SOLVER_MIXED_CG;
+        		std::vector< double > x;
+        		SolveReport report;
+        		ok = solve(K, F, x, options, &report) && ok;
+        		double max_diff = 0.;
+        		for( int i = 0; i < x.size(); ++i ) {
+        			max_diff = std::max(max_diff, std::fabs(x[i] - x_ref[i]));
+        		}
+        		ok = ok && max_diff < 1e-8 && report.error <= options.threshold;
+        		std::cout << names[p] << " : double " << report_ref.nb_iterations << " it "
+        			<< report_ref.elapsed_time << " s, ||F-Kx||/||F|| = " << report_ref.error
+        			<< " | mixed " << report.residual_history.size() - 1 << " refinements "
+        			<< report.nb_iterations << " it " << report.elapsed_time
+        			<< " s, ||F-Kx||/||F|| = " << report.error
+        			<< ", max |x - x_ref| = " << max_diff << std::endl;
+        	}
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        bool test_recycling( const std::string& mesh_filename, int nb_steps )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	const int n = mesh.nb_vertices();
+        	// matrices élémentaires avec un coefficient unité, mises à
+        	// l'échelle par le coefficient de la région à chaque pas
+        	ShapeFunctions shape_f_triangle(2,1);
+        	Quadrature quad = Quadrature::get_quadrature(2);
+        	std::vector< DenseMatrix > Ke(mesh.nb_triangles());
+        	std::vector< double > F0(n, 0.);
+        	for ( int triangle = 0; triangle < mesh.nb_triangles(); ++triangle) {
+        		ElementMapping mapping(mesh, false, triangle);
+        		assemble_elementary_matrix(mapping, shape_f_triangle, quad, Simu::unit_fct, Ke[triangle]);
+        		std::vector< double > Fe(shape_f_triangle.nb_functions(), 0.);
+        		assemble_elementary_vector(mapping, shape_f_triangle, quad, Simu::unit_fct, Fe);
+        		local_to_global_vector(mesh, false, triangle, Fe, F0);
+        	}
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+        	mesh.set_attribute(Simu::unit_fct, 1, true);
+        	std::vector< double > values(n, 0.);
+
+        	SolverOptions options;
+        	options.verbose = false;
+        	bool ok = true;
+        	const PreconditionerType preconds[2] = { PRECOND_JACOBI, PRECOND_IC0 };
+        	const char* names[2] = { "jacobi", "ic0" };
+        	std::cout << mesh_filename << " (" << n << " vertices), "
+        		<< nb_steps << " matrices" << std::endl;
+        	for( int p = 0; p < 2; ++p ) {
+        		options.preconditioner = preconds[p];
+        		options.solver = SOLVER_NATIVE_CG;
+        		SolverSession plain(options);
+        		options.solver = SOLVER_RECYCLING_CG;
+        		SolverSession recycling(options);
+        		int plain_iterations = 0;
+        		int recycling_iterations = 0;
+        		double plain_time = 0.;
+        		double recycling_time = 0.;
+        		double max_diff = 0.;
+        		for( int step = 0; step < nb_steps; ++step ) {
+        			// étude paramétrique : les conductivités des régions varient lentement
+        			SparseMatrix K(n);
+        			for ( int triangle = 0; triangle < mesh.nb_triangles(); ++triangle) {
+        				const int region = mesh.get_triangle_attribute(triangle);
+        				const double k = std::pow(10., 2. * std::sin(0.2 * step + region));
+        				DenseMatrix Ke_step = Ke[triangle];
+        				for( int i = 0; i < 3; ++i ) {
+        					for( int j = 0; j < 3; ++j ) {
+        						Ke_step.set(i, j, k * Ke[triangle].get(i, j));
+        					}
+        				}
+        				local_to_global_matrix(mesh, triangle, Ke_step, K);
+        			}
+        			std::vector< double > F = F0;
+        			apply_dirichlet_boundary_conditions(mesh, attribut_dirichlet, values, K, F);
+
+        			std::vector< double > x_plain, x;
+        			SolveReport report_plain, report;
+        			plain.set_matrix(K);
+        			ok = plain.solve(F, x_plain, false, &report_plain) && ok;
+        			recycling.set_matrix(K);
+        			ok = recycling.solve(F, x, false, &report) && ok;
+        			plain_iterations += report_plain.nb_iterations;
+        			recycling_iterations += report.nb_iterations;
+        			plain_time += report_plain.elapsed_time;
+        			recycling_time += report.elapsed_time;
+        			for( int i = 0; i < n; ++i ) {
+        				max_diff = std::max(max_diff, std::fabs(x[i] - x_plain[i]));
+        			}
+        		}
+        		ok = ok && max_diff < 1e-8 && recycling_iterations < plain_iterations;
+        		std::cout << names[p] << " : PCG " << plain_iterations << " it "
+        			<< plain_time << " s | recycling CG (" << options.recycle_dim
+        			<< " vectors) " << recycling_iterations << " it "
+        			<< recycling_time << " s, max |x - x_pcg| = " << max_diff << std::endl;
+        	}
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        bool test_schwarz( const std::string& mesh_filename )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	SparseMatrix K(mesh.nb_vertices());
+        	std::vector< double > F;
+        	assemble_poisson_system(mesh, K, F);
+        	CSRMatrix A(K);
+        	// le bord de Dirichlet de assemble_poisson_system
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+
+        	// référence : CG natif + IC(0)
+        	SolverOptions options;
+        	options.verbose = false;
+        	ICPreconditioner ic(A, 0.);
+        	std::vector< double > x_ref;
+        	SolveReport report_ref;
+        	bool ok = pcg_solve(A, F, x_ref, &ic, options, &report_ref);
+        	std::cout << mesh_filename << " (" << mesh.nb_vertices() << " vertices) : ic0 "
+        		<< report_ref.nb_iterations << " it " << report_ref.elapsed_time << " s" << std::endl;
+
+        	const int nb_subdomains[2] = { 4, 64 };
+        	for( int s = 0; s < 2; ++s ) {
+        		int iterations[2] = { 0, 0 };
+        		for( int coarse = 0; coarse < 2; ++coarse ) {
+        			SchwarzPreconditioner schwarz(mesh, A, attribut_dirichlet, nb_subdomains[s], 1, coarse == 1);
+        			schwarz.print();
+        			ok = ok && schwarz.ok();
+        			std::vector< double > x;
+        			SolveReport report;
+        			ok = pcg_solve(A, F, x, &schwarz, options, &report) && ok;
+        			double max_diff = 0.;
+        			for( int i = 0; i < x.size(); ++i ) {
+        				max_diff = std::max(max_diff, std::fabs(x[i] - x_ref[i]));
+        			}
+        			ok = ok && max_diff < 1e-8;
+        			iterations[coarse] = report.nb_iterations;
+        			std::cout << "schwarz " << nb_subdomains[s]
+        				<< ( coarse ? " + coarse : " : " : " )
+        				<< report.nb_iterations << " it " << report.elapsed_time
+        				<< " s, max |x - x_ref| = " << max_diff << std::endl;
+        		}
+        		// avec beaucoup de sous-domaines, la correction grossière
+        		// doit réduire le nombre d'itérations
+        		if( s == 1 ) ok = ok && iterations[1] < iterations[0];
+        	}
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        bool test_level_schedule( const std::string& mesh_filename )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	SparseMatrix K(mesh.nb_vertices());
+        	std::vector< double > F;
+        	assemble_poisson_system(mesh, K, F);
+        	CSRMatrix A(K);
+
+        	// niveaux de l'ordre naturel, calculés une seule fois par motif
+        	LevelSchedule natural;
+        	natural.analyze(A);
+        	natural.analyze(A);
+        	natural.print();
+        	bool ok = natural.nb_analyses() == 1;
+
+        	// ordre multicolore : un niveau par couleur
+        	std::vector< int > perm;
+        	const int nb_colors = multicolor_ordering(A, perm);
+        	CSRMatrix B = permute(A, perm);
+        	for( int i = 0; i < B.nb_rows(); ++i ) {
+        		ok = ok && B.val_[B.diag_[i]] == A.val_[A.diag_[perm[i]]];
+        	}
+        	LevelSchedule colored;
+        	colored.set_nb_threads(2);
+        	colored.analyze(B);
+        	colored.print();
+        	ok = ok && colored.nb_lower_levels() <= nb_colors
+        		&& colored.nb_upper_levels() <= nb_colors;
+        	std::cout << nb_colors << " colours" << std::endl;
+
+        	// les balayages parallèles donnent exactement les balayages séquentiels
+        	ICPreconditioner ic(B, 0., &colored);
+        	const CSRMatrix& LU = ic.factors();
+        	std::vector< double > r(B.nb_rows()), z, z_ref(B.nb_rows());
+        	for( int i = 0; i < r.size(); ++i ) r[i] = std::sin(0.1 * i);
+        	ic.apply(r, z);
+        	for( int i = 0; i < r.size(); ++i ) {
+        		double sum = r[i];
+        		for( int k = LU.row_ptr_[i]; k < LU.diag_[i]; ++k ) {
+        			sum -= LU.val_[k] * z_ref[LU.col_[k]];
+        		}
+        		z_ref[i] = sum;
+        	}
+        	for( int i = r.size() - 1; i >= 0; --i ) {
+        		double sum = z_ref[i];
+        		for( int k = LU.diag_[i] + 1; k < LU.row_ptr_[i + 1]; ++k ) {
+        			sum -= LU.val_[k] * z_ref[LU.col_[k]];
+        		}
+        		z_ref[i] = sum / LU.val_[LU.diag_[i]];
+        	}
+        	double max_diff = 0.;
+        	for( int i = 0; i < r.size(); ++i ) {
+        		max_diff = std::max(max_diff, std::fabs(z[i] - z_ref[i]));
+        	}
+        	ok = ok && max_diff < 1e-12;
+        	std::cout << "parallel sweeps : max |z - z_ref| = " << max_diff << std::endl;
+
+        	// CG natif : ordre naturel et multicolore
+        	SolverOptions options;
+        	options.verbose = false;
+        	const PreconditionerType preconds[2] = { PRECOND_SSOR, PRECOND_IC0 };
+        	const char* names[2] = { "ssor", "ic0" };
+        	std::vector< double > x_ref;
+        	for( int p = 0; p < 2; ++p ) {
+        		for( int multicolor = 0; multicolor < 2; ++multicolor ) {
+        			options.preconditioner = preconds[p];
+        			options.multicolor = multicolor == 1;
+        			Preconditioner* P = new_preconditioner(A, options);
+        			std::vector< double > x;
+        			SolveReport report;
+        			ok = pcg_solve(A, F, x, P, options, &report) && ok;
+        			delete P;
+        			if( x_ref.empty() ) x_ref = x;
+        			double max_diff_x = 0.;
+        			for( int i = 0; i < x.size(); ++i ) {
+        				max_diff_x = std::max(max_diff_x, std::fabs(x[i] - x_ref[i]));
+        			}
+        			ok = ok && max_diff_x < 1e-8;
+        			std::cout << names[p] << ( multicolor ? " multicolour : " : " natural : " )
+        				<< report.nb_iterations << " it " << report.elapsed_time
+        				<< " s, max |x - x_ref| = " << max_diff_x << std::endl;
+        		}
+        	}
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        bool test_heat_transient( const std::string& mesh_filename )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	SparseMatrix K(mesh.nb_vertices());
+        	std::vector< double > F;
+        	assemble_poisson_system(mesh, K, F);
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+
+        	// état stationnaire de référence
+        	CSRMatrix A(K);
+        	SparseCholesky cholesky;
+        	bool ok = cholesky.factor(A);
+        	std::vector< double > u_steady;
+        	cholesky.solve(F, u_steady);
+
+        	// Euler implicite : convergence vers l'état stationnaire
+        	HeatSolver euler(mesh, Simu::unit_fct, Simu::unit_fct, Simu::zero_fct,
+        		attribut_dirichlet, 0.01, 1.);
+        	euler.set_initial_condition(Simu::zero_fct);
+        	ok = euler.run(1000) && ok;
+        	euler.print();
+        	double steady_diff = 0.;
+        	for( int i = 0; i < u_steady.size(); ++i ) {
+        		steady_diff = std::max(steady_diff, std::fabs(euler.solution()[i] - u_steady[i]));
+        	}
+        	ok = ok && steady_diff < 1e-10;
+        	std::cout << "t = " << euler.time() << " : max |u - u_steady| = " << steady_diff << std::endl;
+
+        	// ordre en temps à T = 0.1, référence : Crank-Nicolson avec un petit pas
+        	const double T = 0.1;
+        	HeatSolver reference(mesh, Simu::unit_fct, Simu::unit_fct, Simu::zero_fct,
+        		attribut_dirichlet, T / 512, 0.5);
+        	reference.set_initial_condition(Simu::zero_fct);
+        	ok = reference.run(512) && ok;
+        	const double thetas[2] = { 1., 0.5 };
+        	const char* names[2] = { "backward Euler", "Crank-Nicolson" };
+        	for( int s = 0; s < 2; ++s ) {
+        		double errors[2];
+        		for( int r = 0; r < 2; ++r ) {
+        			const int nb_steps = 8 << r;
+        			HeatSolver heat(mesh, Simu::unit_fct, Simu::unit_fct, Simu::zero_fct,
+        				attribut_dirichlet, T / nb_steps, thetas[s]);
+        			heat.set_initial_condition(Simu::zero_fct);
+        			ok = heat.run(nb_steps) && ok;
+        			errors[r] = 0.;
+        			for( int i = 0; i < u_steady.size(); ++i ) {
+        				errors[r] = std::max(errors[r],
+        					std::fabs(heat.solution()[i] - reference.solution()[i]));
+        			}
+        		}
+        		// l'erreur est divisée par 2 (Euler) ou 4 (Crank-Nicolson)
+        		// quand le pas est divisé par 2
+        		const double ratio = errors[0] / errors[1];
+        		ok = ok && ratio > ( s == 0 ? 1.7 : 3.4 );
+        		std::cout << names[s] << " : error " << errors[0] << " (dt = T/8), "
+        			<< errors[1] << " (dt = T/16), ratio " << ratio << std::endl;
+        	}
+
+        	// CG natif : préconditionneur construit une fois, départ du pas précédent
+        	SolverOptions options;
+        	options.solver = SOLVER_NATIVE_CG;
+        	options.preconditioner = PRECOND_IC0;
+        	HeatSolver heat_cg(mesh, Simu::unit_fct, Simu::unit_fct, Simu::zero_fct,
+        		attribut_dirichlet, T / 16, 0.5, options);
+        	heat_cg.set_initial_condition(Simu::zero_fct);
+        	HeatSolver heat_chol(mesh, Simu::unit_fct, Simu::unit_fct, Simu::zero_fct,
+        		attribut_dirichlet, T / 16, 0.5);
+        	heat_chol.set_initial_condition(Simu::zero_fct);
+        	ok = heat_cg.run(16) && heat_chol.run(16) && ok;
+        	heat_cg.print();
+        	heat_chol.print();
+        	double max_diff = 0.;
+        	for( int i = 0; i < u_steady.size(); ++i ) {
+        		max_diff = std::max(max_diff, std::fabs(heat_cg.solution()[i] - heat_chol.solution()[i]));
+        	}
+        	ok = ok && max_diff < 1e-8;
+        	std::cout << "native CG + IC0 : max |u_cg - u_cholesky| = " << max_diff << std::endl;
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        bool test_affine_stiffness( const std::string& mesh_filename, int nb_sets )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	mesh.set_attribute(Simu::unit_fct, 1, true);
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+        	AffineStiffness affine(mesh);
+        	affine.add_dirichlet_penalty(mesh, attribut_dirichlet);
+        	affine.print();
+
+        	bool ok = true;
+        	double assembly_time = 0.;
+        	double combine_time = 0.;
+        	double max_diff = 0.;
+        	CSRMatrix K_affine;
+        	for( int set = 0; set < nb_sets; ++set ) {
+        		// conductivités constantes par couche
+        		std::vector< double > k(mesh.get_attr_max() + 1, 0.);
+        		for( int a = 0; a < k.size(); ++a ) {
+        			k[a] = std::pow(10., std::sin(0.7 * set + a));
+        		}
+
+        		// référence : assemblage complet avec la boucle sur les éléments
+        		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        		SparseMatrix K(mesh.nb_vertices());
+        		ShapeFunctions shape_f_triangle(2,1);
+        		Quadrature quad = Quadrature::get_quadrature(2);
+        		for ( int triangle = 0; triangle < mesh.nb_triangles(); ++triangle) {
+        			ElementMapping mapping(mesh, false, triangle);
+        			DenseMatrix Ke;
+        			assemble_elementary_matrix(mapping, shape_f_triangle, quad, Simu::unit_fct, Ke);
+        			const double k_t = k[mesh.get_triangle_attribute(triangle)];
+        			for( int i = 0; i < 3; ++i ) {
+        				for( int j = 0; j < 3; ++j ) {
+        					Ke.set(i, j, k_t * Ke.get(i, j));
+        				}
+        			}
+        			local_to_global_matrix(mesh, triangle, Ke, K);
+        		}
+        		std::vector< double > F(mesh.nb_vertices(), 0.);
+        		std::vector< double > values(mesh.nb_vertices(), 0.);
+        		apply_dirichlet_boundary_conditions(mesh, attribut_dirichlet, values, K, F);
+        		CSRMatrix K_ref(K);
+        		assembly_time += std::chrono::duration< double >(
+        			std::chrono::steady_clock::now() - start).count();
+
+        		// combinaison affine des matrices par région
+        		start = std::chrono::steady_clock::now();
+        		affine.combine(k, K_affine);
+        		combine_time += std::chrono::duration< double >(
+        			std::chrono::steady_clock::now() - start).count();
+
+        		ok = ok && K_affine.row_ptr_ == K_ref.row_ptr_ && K_affine.col_ == K_ref.col_;
+        		for( int p = 0; ok && p < K_ref.nnz(); ++p ) {
+        			max_diff = std::max(max_diff, std::fabs(K_affine.val_[p] - K_ref.val_[p])
+        				/ std::fabs(K_ref.val_[K_ref.diag_[0]]));
+        		}
+        	}
+        	ok = ok && max_diff < 1e-12;
+
+        	// même taille mais une autre structure : celle de K est recopiée
+        	const std::vector< double > k_unit(mesh.get_attr_max() + 1, 1.);
+        	CSRMatrix K_expected, K_other = K_affine;
+        	std::reverse(K_other.col_.begin(), K_other.col_.end());
+        	affine.combine(k_unit, K_expected);
+        	affine.combine(k_unit, K_other);
+        	ok = ok && K_other.col_ == K_expected.col_ && K_other.diag_ == K_expected.diag_
+        		&& K_other.val_ == K_expected.val_;
+        	std::cout << nb_sets << " coefficient sets : element assembly "
+        		<< assembly_time / nb_sets << " s/set | affine combination "
+        		<< combine_time / nb_sets << " s/set | max relative diff " << max_diff << std::endl;
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        bool test_reduced_basis( const std::string& mesh_filename )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	mesh.set_attribute(Simu::unit_fct, 1, true);
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+
+        	// paramètres : conductivité et source par couche
+        	const int nb_training = 40;
+        	const int nb_test = 10;
+        	std::vector< ReducedParameter > parameters(nb_training + nb_test);
+        	for( int p = 0; p < parameters.size(); ++p ) {
+        		parameters[p].conductivity.assign(mesh.get_attr_max() + 1, 1.);
+        		parameters[p].source.assign(mesh.get_attr_max() + 1, 0.);
+        		for( int a = 0; a <= mesh.get_attr_max(); ++a ) {
+        			parameters[p].conductivity[a] = std::pow(10., std::sin(1.3 * p + 0.7 * a));
+        			parameters[p].source[a] = 0.5 + 0.5 * std::sin(2.1 * p + a);
+        		}
+        	}
+        	const std::vector< ReducedParameter > training(parameters.begin(),
+        		parameters.begin() + nb_training);
+
+        	bool ok = true;
+        	for( int method = 0; method < 2; ++method ) {
+        		ReducedBasis rb(mesh, attribut_dirichlet);
+        		const int size = method == 0 ? rb.build_greedy(training, 1e-5, 40)
+        			: rb.build_pod(training, 1e-5, 40);
+        		ok = ok && rb.ok() && size > 0;
+        		std::cout << ( method == 0 ? "greedy | " : "POD | " );
+        		rb.print();
+
+        		// erreur vraie et estimation sur des paramètres hors entraînement
+        		double truth_time = 0.;
+        		double max_error = 0.;
+        		double min_effectivity = 1e30;
+        		std::vector< double > u, u_N, c;
+        		for( int p = nb_training; p < parameters.size(); ++p ) {
+        			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        			ok = rb.truth_solve(parameters[p], u) && ok;
+        			truth_time += std::chrono::duration< double >(
+        				std::chrono::steady_clock::now() - start).count();
+        			double estimate = 0.;
+        			ok = rb.solve(parameters[p], c, &estimate) && ok;
+        			rb.reconstruct(c, u_N);
+        			for( int i = 0; i < u.size(); ++i ) u_N[i] -= u[i];
+        			const double error = rb.energy_norm(u_N);
+        			max_error = std::max(max_error, error / rb.energy_norm(u));
+        			if( error > 0. ) min_effectivity = std::min(min_effectivity, estimate / error);
+        		}
+
+        		// coût de la résolution en ligne
+        		const int nb_online = 10000;
+        		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        		for( int s = 0; s < nb_online; ++s ) {
+        			double estimate;
+        			rb.solve(parameters[nb_training + s % nb_test], c, &estimate);
+        		}
+        		const double online_time = std::chrono::duration< double >(
+        			std::chrono::steady_clock::now() - start).count() / nb_online;
+        		truth_time /= nb_test;
+
+        		std::cout << "max relative error " << max_error << " | min effectivity "
+        			<< min_effectivity << " | truth solve " << truth_time
+        			<< " s | online solve + estimate " << online_time * 1e6 << " us (x"
+        			<< truth_time / online_time << ")" << std::endl;
+        		ok = ok && max_error < 1e-3 && min_effectivity >= 1.;
+        	}
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        // source concentrée autour de (0.3, 0.6)
+        double peak_source( vertex v )
+        {
+        	const double r2 = (v.x - 0.3) * (v.x - 0.3) + (v.y - 0.6) * (v.y - 0.6);
+        	return 100. * std::exp(-r2 / 0.002);
+        }
+
+        bool test_adaptive_refinement( const std::string& mesh_filename, double tolerance )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	mesh.set_attribute(Simu::unit_fct, 1, true);
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+        	int nb_border_edges = 0;
+        	for( int e = 0; e < mesh.nb_edges(); ++e ) {
+        		if( mesh.get_edge_attribute(e) == 1 ) ++nb_border_edges;
+        	}
+
+        	// boucle solve - estimate - mark - refine
+        	AdaptiveOptions options;
+        	options.tolerance = tolerance;
+        	options.verbose = true;
+        	Mesh adapted = mesh;
+        	std::vector< double > u;
+        	AdaptiveReport adaptive;
+        	bool ok = adaptive_solve(adapted, Simu::unit_fct, peak_source, Simu::zero_fct,
+        		attribut_dirichlet, options, u, &adaptive);
+
+        	// maillage conforme : chaque arête est partagée par deux triangles,
+        	// sauf les arêtes du bord qui gardent leur attribut
+        	std::map< std::pair< int, int >, int > edge_count;
+        	double area = 0.;
+        	for( int t = 0; t < adapted.nb_triangles(); ++t ) {
+        		for( int k = 0; k < 3; ++k ) {
+        			const int a = adapted.get_triangle_vertex_index(t, k);
+        			const int b = adapted.get_triangle_vertex_index(t, (k + 1) % 3);
+        			++edge_count[std::make_pair(std::min(a, b), std::max(a, b))];
+        		}
+        		const vertex p0 = adapted.get_triangle_vertex(t, 0);
+        		const vertex p1 = adapted.get_triangle_vertex(t, 1);
+        		const vertex p2 = adapted.get_triangle_vertex(t, 2);
+        		area += 0.5 * ((p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y));
+        	}
+        	int nb_border = 0;
+        	for( std::map< std::pair< int, int >, int >::const_iterator it = edge_count.begin();
+        		it != edge_count.end(); ++it ) {
+        		ok = ok && it->second <= 2;
+        		if( it->second == 1 ) ++nb_border;
+        	}
+        	int nb_adapted_border_edges = 0;
+        	for( int e = 0; e < adapted.nb_edges(); ++e ) {
+        		if( adapted.get_edge_attribute(e) == 1 ) ++nb_adapted_border_edges;
+        	}
+        	ok = ok && nb_border == nb_adapted_border_edges
+        		&& nb_adapted_border_edges >= nb_border_edges
+        		&& std::fabs(area - 1.) < 1e-10;
+
+        	// raffinement uniforme jusqu'à la même précision
+        	options.bulk_fraction = 1.;
+        	Mesh uniform = mesh;
+        	AdaptiveReport uniform_report;
+        	adaptive_solve(uniform, Simu::unit_fct, peak_source, Simu::zero_fct,
+        		attribut_dirichlet, options, u, &uniform_report);
+
+        	std::cout << "adaptive: ";
+        	adaptive.print();
+        	std::cout << "uniform:  ";
+        	uniform_report.print();
+        	std::cout << "conforming: " << nb_border << " border edges, area " << area
+        		<< " | DOFs ratio " << double(adaptive.nb_vertices.back())
+        		/ uniform_report.nb_vertices.back() << std::endl;
+        	ok = ok && adaptive.nb_vertices.back() < uniform_report.nb_vertices.back();
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        // solution exacte u = sin(pi x) sin(pi y) sur le carré unité
+        double sine_solution( vertex v )
+        {
+        	return std::sin(M_PI * v.x) * std::sin(M_PI * v.y);
+        }
+
+        double sine_source( vertex v )
+        {
+        	return 2. * M_PI * M_PI * sine_solution(v);
+        }
+
+        // résout -lap u = f avec u = 0 au bord en P1 ou P2, renvoie l'erreur L2
+        double solve_sine_problem( const Mesh& mesh, int order, double& time, int& nb_dofs )
+        {
+        	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        	DofNumbering dofs(mesh, order);
+        	SparseMatrix K(dofs.nb_dofs());
+        	std::vector< double > F(dofs.nb_dofs(), 0.);
+        	ShapeFunctions shape_f_triangle(2, order);
+        	Quadrature quad = Quadrature::get_quadrature(2 * order);
+        	for ( int triangle = 0; triangle < mesh.nb_triangles(); ++triangle) {
+        		ElementMapping mapping(mesh, false, triangle);
+        		DenseMatrix Ke;
+        		assemble_elementary_matrix(mapping, shape_f_triangle, quad, Simu::unit_fct, Ke);
+        		local_to_global_matrix(dofs, triangle, Ke, K);
+        		std::vector< double > Fe(shape_f_triangle.nb_functions(), 0.);
+        		assemble_elementary_vector(mapping, shape_f_triangle, quad, sine_source, Fe);
+        		local_to_global_vector(dofs, false, triangle, Fe, F);
+        	}
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+        	std::vector< double > values(dofs.nb_dofs());
+        	for( int d = 0; d < dofs.nb_dofs(); ++d ) values[d] = sine_solution(dofs.get_dof_position(d));
+        	apply_dirichlet_boundary_conditions(mesh, dofs, attribut_dirichlet, values, K, F);
+        	std::vector< double > u(dofs.nb_dofs(), 0.);
+        	SolverOptions options;
+        	options.solver = SOLVER_CHOLESKY;
+        	solve(K, F, u, options);
+        	time = std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+        	nb_dofs = dofs.nb_dofs();
+
+        	// erreur L2 avec une quadrature d'ordre 6
+        	Quadrature quad_error = Quadrature::get_quadrature(6);
+        	double error = 0.;
+        	for ( int triangle = 0; triangle < mesh.nb_triangles(); ++triangle) {
+        		ElementMapping mapping(mesh, false, triangle);
+        		for( int q = 0; q < quad_error.nb_points(); ++q ) {
+        			const vertex x_r = quad_error.point(q);
+        			double u_h = 0.;
+        			for( int i = 0; i < shape_f_triangle.nb_functions(); ++i ) {
+        				u_h += u[dofs.get_triangle_dof_index(triangle, i)] * shape_f_triangle.evaluate(i, x_r);
+        			}
+        			const double diff = u_h - sine_solution(mapping.transform(x_r));
+        			error += quad_error.weight(q) * mapping.jacobian(x_r) * diff * diff;
+        		}
+        	}
+        	return std::sqrt(error);
+        }
+
+        bool test_p2_elements( const std::string& mesh_filename, int nb_levels )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	mesh.set_attribute(Simu::unit_fct, 1, true);
+        	bool ok = true;
+
+        	// P2 = P1 du maillage raffini uniformément pour la sortie Medit
+        	DofNumbering p2_dofs(mesh, 2);
+        	Mesh sub_mesh;
+        	std::vector< int > parents;
+        	mesh.refine_uniformly(sub_mesh, parents);
+        	ok = ok && sub_mesh.nb_vertices() == p2_dofs.nb_dofs();
+        	for( int d = 0; ok && d < p2_dofs.nb_dofs(); ++d ) {
+        		const vertex p = p2_dofs.get_dof_position(d);
+        		const vertex q = sub_mesh.get_vertex(d);
+        		ok = std::fabs(p.x - q.x) + std::fabs(p.y - q.y) < 1e-14;
+        	}
+
+        	// convergence et temps pour atteindre une précision
+        	std::vector< std::vector< double > > errors(3), times(3);
+        	std::vector< std::vector< int > > sizes(3);
+        	for( int level = 0; level < nb_levels; ++level ) {
+        		for( int order = 1; order <= 2; ++order ) {
+        			double time = 0.;
+        			int nb_dofs = 0;
+        			const double error = solve_sine_problem(mesh, order, time, nb_dofs);
+        			errors[order].push_back(error);
+        			times[order].push_back(time);
+        			sizes[order].push_back(nb_dofs);
+        		}
+        		Mesh fine;
+        		mesh.refine_uniformly(fine, parents);
+        		mesh = fine;
+        	}
+        	for( int level = 0; level < nb_levels; ++level ) {
+        		std::cout << "level " << level;
+        		for( int order = 1; order <= 2; ++order ) {
+        			std::cout << " | P" << order << ": " << sizes[order][level] << " DOFs, L2 error "
+        				<< errors[order][level] << ", " << times[order][level] << " s";
+        		}
+        		std::cout << std::endl;
+        	}
+        	const int last = nb_levels - 1;
+        	// taux moyens : sur les maillages fins, l'erreur P2 atteint celle
+        	// de la pénalisation de Dirichlet (1e4)
+        	const double rate_p1 = std::log2(errors[1][0] / errors[1][last]) / last;
+        	const double rate_p2 = std::log2(errors[2][0] / errors[2][last]) / last;
+        	// le premier niveau P2 aussi précis que le P1 le plus fin
+        	int level_p2 = 0;
+        	while( level_p2 < last && errors[2][level_p2] > errors[1][last] ) ++level_p2;
+        	std::cout << "L2 convergence rates: P1 " << rate_p1 << ", P2 " << rate_p2
+        		<< " | accuracy of the finest P1 (" << errors[1][last] << "): P1 "
+        		<< sizes[1][last] << " DOFs " << times[1][last] << " s, P2 "
+        		<< sizes[2][level_p2] << " DOFs " << times[2][level_p2] << " s" << std::endl;
+        	ok = ok && rate_p1 > 1.8 && rate_p2 > 2.5
+        		&& errors[2][level_p2] <= errors[1][last]
+        		&& sizes[2][level_p2] < sizes[1][last];
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        bool test_geometry_cache( const std::string& mesh_filename )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	bool ok = true;
+
+        	// un seul passage parallèle sur les triangles
+        	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        	GeometryCache geometry(mesh);
+        	const double cache_time = std::chrono::duration< double >(
+        		std::chrono::steady_clock::now() - start).count();
+
+        	// référence : ElementMapping et les fonctions élémentaires
+        	double mapping_time = 0.;
+        	double max_diff = 0.;
+        	ShapeFunctions shape_f_triangle(2,1);
+        	Quadrature quad = Quadrature::get_quadrature(2);
+        	vertex center;
+        	center.x = 1. / 3.;
+        	center.y = 1. / 3.;
+        	for ( int triangle = 0; triangle < mesh.nb_triangles(); ++triangle) {
+        		start = std::chrono::steady_clock::now();
+        		ElementMapping mapping(mesh, false, triangle);
+        		const double det = mapping.jacobian(center);
+        		const DenseMatrix inv_J = mapping.jacobian_matrix(center).invert_2x2().transpose();
+        		const vertex centroid = mapping.transform(center);
+        		mapping_time += std::chrono::duration< double >(
+        			std::chrono::steady_clock::now() - start).count();
+        		const double scale = std::sqrt(std::fabs(det));
+        		max_diff = std::max(max_diff, std::fabs(geometry.det_[triangle] - det) / std::fabs(det));
+        		max_diff = std::max(max_diff, scale * std::fabs(geometry.inv_jt_xx_[triangle] - inv_J.get(0, 0)));
+        		max_diff = std::max(max_diff, scale * std::fabs(geometry.inv_jt_xy_[triangle] - inv_J.get(0, 1)));
+        		max_diff = std::max(max_diff, scale * std::fabs(geometry.inv_jt_yx_[triangle] - inv_J.get(1, 0)));
+        		max_diff = std::max(max_diff, scale * std::fabs(geometry.inv_jt_yy_[triangle] - inv_J.get(1, 1)));
+        		max_diff = std::max(max_diff, std::fabs(geometry.centroid_x_[triangle] - centroid.x) / scale);
+        		max_diff = std::max(max_diff, std::fabs(geometry.centroid_y_[triangle] - centroid.y) / scale);
+
+        		// noyaux P1 exacts
+        		DenseMatrix Ke, Me;
+        		assemble_elementary_matrices(mapping, shape_f_triangle, quad, Simu::unit_fct, Ke, Me);
+        		std::vector< double > Fe(3, 0.);
+        		assemble_elementary_vector(mapping, shape_f_triangle, quad, Simu::unit_fct, Fe);
+        		double Ke_cache[9], Me_cache[9], Fe_cache[3];
+        		geometry.p1_stiffness(triangle, 1., Ke_cache);
+        		geometry.p1_mass(triangle, Me_cache);
+        		geometry.p1_load(triangle, 1., Fe_cache);
+        		const double area = geometry.area(triangle);
+        		for( int i = 0; i < 3; ++i ) {
+        			max_diff = std::max(max_diff, std::fabs(Fe_cache[i] - Fe[i]) / area);
+        			for( int j = 0; j < 3; ++j ) {
+        				max_diff = std::max(max_diff, std::fabs(Ke_cache[3 * i + j] - Ke.get(i, j)));
+        				max_diff = std::max(max_diff, std::fabs(Me_cache[3 * i + j] - Me.get(i, j)) / area);
+        			}
+        		}
+        	}
+        	ok = ok && geometry.nb_triangles() == mesh.nb_triangles() && max_diff < 1e-12;
+        	std::cout << mesh.nb_triangles() << " triangles : cache " << cache_time
+        		<< " s | ElementMapping " << mapping_time << " s (x" << mapping_time / cache_time
+        		<< ") | max relative diff " << max_diff << std::endl;
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        // bord gauche du carré unité
+        double left_side_fct( vertex v )
+        {
+        	return v.x < 1e-9 ? 1. : -1.;
+        }
+
+        bool test_postprocessing( const std::string& mesh_filename )
+        {
+        	bool ok = true;
+
+        	// u = x : gradients exacts, flux entrant 1 à gauche, nul au total
+        	Mesh square;
+        	square.load("data/square.mesh");
+        	square.set_attribute(Simu::unit_fct, 1, true);
+        	square.set_attribute(left_side_fct, 2, true);
+        	std::vector< double > x_values(square.nb_vertices());
+        	for( int v = 0; v < square.nb_vertices(); ++v ) x_values[v] = square.get_vertex(v).x;
+        	GeometryCache square_geometry(square);
+        	std::vector< vec2 > gradients, nodal_gradients;
+        	std::vector< double > fluxes;
+        	triangle_gradients(square, square_geometry, x_values, gradients);
+        	recover_nodal_gradients(square, square_geometry, gradients, nodal_gradients);
+        	boundary_fluxes(square, square_geometry, gradients, Simu::unit_fct, fluxes);
+        	for( int v = 0; v < square.nb_vertices(); ++v ) {
+        		ok = ok && std::fabs(nodal_gradients[v].x - 1.) < 1e-12 && std::fabs(nodal_gradients[v].y) < 1e-12;
+        	}
+        	ok = ok && fluxes.size() > 2 && std::fabs(fluxes[2] - 1.) < 1e-12
+        		&& std::fabs(fluxes[1] + fluxes[2]) < 1e-12;
+
+        	// -lap u = 1, u = 0 sur les arêtes : le flux absorbé vaut l'aire du domaine
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	mesh.set_attribute(Simu::unit_fct, 1, true);
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+        	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        	AffineStiffness affine(mesh);
+        	affine.add_dirichlet_penalty(mesh, attribut_dirichlet);
+        	CSRMatrix K;
+        	affine.combine(std::vector< double >(mesh.get_attr_max() + 1, 1.), K);
+        	GeometryCache geometry(mesh);
+        	std::vector< double > F(mesh.nb_vertices(), 0.);
+        	double area = 0.;
+        	for( int t = 0; t < mesh.nb_triangles(); ++t ) {
+        		double Fe[3];
+        		geometry.p1_load(t, 1., Fe);
+        		for( int i = 0; i < 3; ++i ) F[mesh.get_triangle_vertex_index(t, i)] += Fe[i];
+        		area += geometry.area(t);
+        	}
+        	SparseCholesky cholesky;
+        	std::vector< double > u;
+        	const bool factored = cholesky.factor(K);
+        	ok = ok && factored;
+        	cholesky.solve(F, u);
+        	const double solve_time = std::chrono::duration< double >(
+        		std::chrono::steady_clock::now() - start).count();
+
+        	start = std::chrono::steady_clock::now();
+        	GeometryCache post_geometry(mesh);
+        	triangle_gradients(mesh, post_geometry, u, gradients);
+        	recover_nodal_gradients(mesh, post_geometry, gradients, nodal_gradients);
+        	boundary_fluxes(mesh, post_geometry, gradients, Simu::unit_fct, fluxes);
+        	const double post_time = std::chrono::duration< double >(
+        		std::chrono::steady_clock::now() - start).count();
+
+        	const double balance = std::fabs(fluxes[1] - area) / area;
+        	std::cout << mesh.nb_vertices() << " vertices : flux through the edges " << fluxes[1]
+        		<< " for a source " << area << " (balance error " << balance
+        		<< ") | assembly + solve " << solve_time << " s | post-processing "
+        		<< post_time << " s (" << 100. * post_time / solve_time << " %)" << std::endl;
+        	ok = ok && balance < 0.05 && post_time < 0.2 * solve_time;
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        // lit le bloc d'un tableau ajouté : sa taille puis ses valeurs
+        bool read_vtu_block( const std::string& file, const std::string& array_name,
+        	size_t expected_bytes, const void* expected )
+        {
+        	const size_t name_pos = file.find("Name=\"" + array_name + "\"");
+        	const size_t offset_pos = file.find("offset=\"", name_pos);
+        	const size_t data_pos = file.find("<AppendedData encoding=\"raw\">");
+        	if( name_pos == std::string::npos || data_pos == std::string::npos ) return false;
+        	const size_t start = file.find('_', data_pos) + 1
+        		+ atol(file.c_str() + offset_pos + 8);
+        	unsigned long long nb_bytes = 0;
+        	file.copy(reinterpret_cast< char* >(&nb_bytes), sizeof(nb_bytes), start);
+        	return nb_bytes == expected_bytes
+        		&& file.compare(start + sizeof(nb_bytes), expected_bytes,
+        		static_cast< const char* >(expected), expected_bytes) == 0;
+        }
+
+        bool test_vtu_output( const std::string& mesh_filename, int nb_refinements )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	for( int level = 0; level < nb_refinements; ++level ) {
+        		Mesh fine;
+        		std::vector< int > parents;
+        		mesh.refine_uniformly(fine, parents);
+        		mesh = fine;
+        	}
+        	bool ok = true;
+
+        	// un champ nodal, son gradient par triangle et nodal
+        	std::vector< double > u(mesh.nb_vertices());
+        	for( int v = 0; v < mesh.nb_vertices(); ++v ) {
+        		u[v] = std::sin(mesh.get_vertex(v).x) * mesh.get_vertex(v).y;
+        	}
+        	GeometryCache geometry(mesh);
+        	std::vector< vec2 > gradients, nodal_gradients;
+        	triangle_gradients(mesh, geometry, u, gradients);
+        	recover_nodal_gradients(mesh, geometry, gradients, nodal_gradients);
+
+        	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        	VtuWriter writer(mesh);
+        	writer.add_point_field("u", u);
+        	writer.add_point_field("nodal_gradient", nodal_gradients);
+        	writer.add_cell_field("gradient", gradients);
+        	ok = ok && writer.write("vtu_test.vtu");
+        	const double vtu_time = std::chrono::duration< double >(
+        		std::chrono::steady_clock::now() - start).count();
+
+        	// référence : Medit texte, maillage et solution seulement
+        	start = std::chrono::steady_clock::now();
+        	mesh.save("vtu_test.mesh");
+        	save_solution(u, "vtu_test.bb");
+        	const double medit_time = std::chrono::duration< double >(
+        		std::chrono::steady_clock::now() - start).count();
+
+        	// relecture des blocs
+        	std::ifstream in("vtu_test.vtu", std::ios::in | std::ios::binary);
+        	const std::string file((std::istreambuf_iterator< char >(in)),
+        		std::istreambuf_iterator< char >());
+        	std::vector< double > points(3 * mesh.nb_vertices(), 0.);
+        	for( int v = 0; v < mesh.nb_vertices(); ++v ) {
+        		points[3 * v] = mesh.get_vertex(v).x;
+        		points[3 * v + 1] = mesh.get_vertex(v).y;
+        	}
+        	std::vector< int > connectivity(3 * mesh.nb_triangles());
+        	for( int t = 0; t < mesh.nb_triangles(); ++t ) {
+        		for( int i = 0; i < 3; ++i ) connectivity[3 * t + i] = mesh.get_triangle_vertex_index(t, i);
+        	}
+        	ok = ok && file.size() == writer.file_size()
+        		&& file.compare(file.size() - 11, 11, "</VTKFile>\n") == 0;
+        	ok = ok && read_vtu_block(file, "u", u.size() * sizeof(double), &u[0]);
+        	ok = ok && read_vtu_block(file, "gradient", gradients.size() * sizeof(vec2), &gradients[0]);
+        	ok = ok && read_vtu_block(file, "connectivity", connectivity.size() * sizeof(int), &connectivity[0]);
+        	// les points sont le seul tableau sans nom
+        	const std::string points_tag = "NumberOfComponents=\"3\" format=\"appended\" offset=\"";
+        	const size_t points_offset = atol(file.c_str() + file.find(points_tag) + points_tag.size());
+        	ok = ok && file.compare(file.find('_', file.find("<AppendedData")) + 1 + points_offset + 8,
+        		points.size() * sizeof(double), reinterpret_cast< const char* >(&points[0]),
+        		points.size() * sizeof(double)) == 0;
+        	std::remove("vtu_test.vtu");
+        	std::remove("vtu_test.mesh");
+        	std::remove("vtu_test.bb");
+
+        	const double megabytes = writer.file_size() / 1e6;
+        	std::cout << mesh.nb_vertices() << " vertices : .vtu " << megabytes << " MB in " << vtu_time
+        		<< " s (" << megabytes / vtu_time << " MB/s) | .mesh + .bb " << medit_time
+        		<< " s (x" << medit_time / vtu_time << ")" << std::endl;
+        	ok = ok && vtu_time < medit_time;
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        // une écriture lente, pour remplir la file
+        bool slow_write()
+        {
+        	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        	return true;
+        }
+
+        bool test_async_writer( const std::string& mesh_filename )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	bool ok = true;
+        	const int n = mesh.nb_vertices();
+
+        	// les solutions sont transférées puis écrites dans l'ordre
+        	{
+        		AsyncWriter writer(2, 2);
+        		for( int k = 0; k < 4; ++k ) {
+        			std::vector< double > x(n, k);
+        			writer.save_solution(std::move(x), "async_" + std::to_string(k) + ".bb");
+        			ok = ok && x.empty();
+        		}
+        		writer.flush();
+        		ok = ok && writer.nb_written() == 4 && writer.nb_failed() == 0;
+        		for( int k = 0; k < 4; ++k ) {
+        			std::ifstream in("async_" + std::to_string(k) + ".bb");
+        			int dim, nb_fields, size, location;
+        			in >> dim >> nb_fields >> size >> location;
+        			double value = -1., last = -1.;
+        			int nb_values = 0;
+        			while( in >> value ) { last = value; ++nb_values; }
+        			ok = ok && size == n && nb_values == n && last == k;
+        			std::remove(("async_" + std::to_string(k) + ".bb").c_str());
+        		}
+        	}
+
+        	// contre-pression : 1 écriture en cours + 2 en attente au plus
+        	double submit_time = 0.;
+        	double blocked_time = 0.;
+        	{
+        		AsyncWriter writer(1, 2);
+        		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        		for( int k = 0; k < 6; ++k ) writer.submit(slow_write);
+        		submit_time = std::chrono::duration< double >(
+        			std::chrono::steady_clock::now() - start).count();
+        		blocked_time = writer.blocked_time();
+        		writer.flush();
+        		ok = ok && writer.nb_written() == 6;
+        	}
+        	ok = ok && submit_time > 0.04 && blocked_time > 0.04;
+
+        	// vidage à la destruction
+        	{
+        		AsyncWriter writer;
+        		writer.save_mesh(Mesh(mesh), "async_exit.mesh");
+        	}
+        	Mesh saved;
+        	ok = ok && saved.load("async_exit.mesh") && saved.nb_vertices() == n
+        		&& saved.nb_triangles() == mesh.nb_triangles();
+        	std::remove("async_exit.mesh");
+
+        	// le calcul n'attend plus le disque
+        	std::vector< double > u(n);
+        	for( int v = 0; v < n; ++v ) u[v] = mesh.get_vertex(v).x;
+        	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        	mesh.save("sync.mesh");
+        	save_solution(u, "sync.bb");
+        	const double sync_time = std::chrono::duration< double >(
+        		std::chrono::steady_clock::now() - start).count();
+        	double async_time = 0.;
+        	{
+        		AsyncWriter writer;
+        		start = std::chrono::steady_clock::now();
+        		writer.save_mesh(Mesh(mesh), "async.mesh");
+        		writer.save_solution(std::move(u), "async.bb");
+        		async_time = std::chrono::duration< double >(
+        			std::chrono::steady_clock::now() - start).count();
+        	}
+        	std::remove("sync.mesh");
+        	std::remove("sync.bb");
+        	std::remove("async.mesh");
+        	std::remove("async.bb");
+
+        	std::cout << "submit with backpressure " << submit_time << " s (blocked " << blocked_time
+        		<< " s) | output of " << n << " vertices : synchronous " << sync_time
+        		<< " s, caller blocked " << async_time << " s" << std::endl;
+        	ok = ok && async_time < 0.1 * sync_time;
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        bool test_system_snapshot( const std::string& mesh_filename )
+        {
+        	bool ok = true;
+        	const std::string problem = "test_system_snapshot P1 k=1 f=1 g=0";
+        	const unsigned long long key = snapshot_key(mesh_filename, problem);
+        	ok = ok && key == snapshot_key(mesh_filename, problem)
+        		&& key != snapshot_key(mesh_filename, problem + " ")
+        		&& key != snapshot_key("data/square.mesh", problem);
+
+        	// assemblage de référence
+        	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	mesh.set_attribute(Simu::unit_fct, 1, true);
+        	SparseMatrix K(mesh.nb_vertices());
+        	std::vector< double > F;
+        	assemble_p1_poisson(mesh, Simu::unit_fct, Simu::unit_fct, K, F);
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+        	std::vector< double > values(mesh.nb_vertices(), 0.);
+        	apply_dirichlet_boundary_conditions(mesh, attribut_dirichlet, values, K, F);
+        	const double assembly_time = std::chrono::duration< double >(
+        		std::chrono::steady_clock::now() - start).count();
+
+        	AssembledSystem system(K, F);
+        	system.set_boundary(mesh, attribut_dirichlet, values);
+        	const std::string filename = snapshot_filename(key);
+        	ok = ok && system.save(filename, key);
+
+        	// relecture : le même système, sans assemblage
+        	start = std::chrono::steady_clock::now();
+        	Mesh reloaded_mesh;
+        	reloaded_mesh.load(mesh_filename);
+        	AssembledSystem loaded;
+        	ok = ok && loaded.load(filename, key);
+        	SparseMatrix K_loaded(0);
+        	loaded.to_sparse_matrix(K_loaded);
+        	const double load_time = std::chrono::duration< double >(
+        		std::chrono::steady_clock::now() - start).count();
+        	ok = ok && loaded.K_.row_ptr_ == system.K_.row_ptr_ && loaded.K_.col_ == system.K_.col_
+        		&& loaded.K_.val_ == system.K_.val_ && loaded.K_.diag_ == system.K_.diag_
+        		&& loaded.F_ == F && loaded.attribute_is_dirichlet_ == attribut_dirichlet
+        		&& loaded.dirichlet_vertices_ == system.dirichlet_vertices_
+        		&& loaded.dirichlet_values_ == system.dirichlet_values_
+        		&& !loaded.dirichlet_vertices_.empty();
+        	AssembledSystem other;
+        	ok = ok && !other.load(filename, key + 1) && !other.load("missing.snap", key);
+
+        	// les deux systèmes donnent la même solution
+        	SolverOptions options;
+        	options.solver = SOLVER_CHOLESKY;
+        	std::vector< double > u(mesh.nb_vertices()), u_loaded(mesh.nb_vertices());
+        	ok = ok && solve(K, F, u, options) && solve(K_loaded, loaded.F_, u_loaded, options)
+        		&& u == u_loaded;
+
+        	// export Matrix Market : symétrique, triangle inférieur
+        	ok = ok && system.export_matrix_market("test_system");
+        	std::ifstream mtx("test_system_K.mtx");
+        	std::string banner;
+        	std::getline(mtx, banner);
+        	int rows = 0, cols = 0, entries = 0;
+        	mtx >> rows >> cols >> entries;
+        	ok = ok && banner == "%%MatrixMarket matrix coordinate real symmetric"
+        		&& rows == mesh.nb_vertices() && cols == rows
+        		&& entries == ( system.K_.nnz() + rows ) / 2;
+        	std::remove(filename.c_str());
+        	std::remove("test_system_K.mtx");
+        	std::remove("test_system_F.mtx");
+
+        	std::cout << mesh.nb_vertices() << " vertices, " << system.K_.nnz() << " nnz : assembly "
+        		<< assembly_time << " s | snapshot load " << load_time << " s (x"
+        		<< assembly_time / load_time << ")" << std::endl;
+        	ok = ok && load_time < 0.2 * assembly_time;
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        bool test_bench( const std::string& mesh_filename )
+        {
+        	bool ok = true;
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+
+        	// tous les maillages de data/, du plus petit au plus grand
+        	const std::vector< std::string > meshes = list_meshes("data");
+        	ok = ok && meshes.size() >= 2 && meshes.back() == "data/geothermie_0_1.mesh";
+
+        	BenchOptions options;
+        	options.meshes.push_back(mesh_filename);
+        	options.repetitions = 3;
+        	options.warmup = 1;
+        	std::vector< BenchResult > results;
+        	run_benchmarks(options, results);
+        	print_bench_results(results);
+        	ok = ok && results.size() == 2;
+        	for( int i = 0; i < results.size(); ++i ) {
+        		const BenchResult& result = results[i];
+        		ok = ok && result.mesh == mesh_filename && result.nb_vertices == mesh.nb_vertices()
+        			&& result.nnz > result.nb_vertices && result.converged && result.peak_rss_kb > 0;
+        		for( int p = 0; p < BENCH_NB_PHASES; ++p ) {
+        			ok = ok && result.min[p] >= 0. && result.min[p] <= result.median[p];
+        		}
+        		ok = ok && result.median[BENCH_TOTAL] >= result.median[BENCH_SOLVE];
+        	}
+
+        	// relecture du JSON
+        	std::vector< BenchResult > loaded;
+        	ok = ok && save_bench_json(options, results, "bench_test.json")
+        		&& load_bench_json("bench_test.json", loaded) && loaded.size() == results.size();
+        	std::remove("bench_test.json");
+        	for( int i = 0; ok && i < loaded.size(); ++i ) {
+        		ok = ok && loaded[i].problem == results[i].problem && loaded[i].mesh == results[i].mesh
+        			&& loaded[i].nnz == results[i].nnz && loaded[i].nb_iterations == results[i].nb_iterations
+        			&& loaded[i].converged == results[i].converged
+        			&& loaded[i].solver == results[i].solver && loaded[i].preconditioner == results[i].preconditioner;
+        		for( int p = 0; p < BENCH_NB_PHASES; ++p ) {
+        			ok = ok && std::fabs(loaded[i].median[p] - results[i].median[p]) <= 1e-8 * results[i].median[p];
+        		}
+        	}
+
+        	// pas de régression contre soi-même, une par problème si tout ralentit de 10 ms
+        	std::vector< BenchResult > slower = results;
+        	for( int i = 0; i < slower.size(); ++i ) slower[i].median[BENCH_TOTAL] += 0.01;
+        	ok = ok && compare_bench_results(results, loaded, 0.1) == 0
+        		&& compare_bench_results(slower, loaded, 0.1) == 2;
+        	// une référence d'un autre solveur n'est pas comparée
+        	std::vector< BenchResult > other_solver = loaded;
+        	for( int i = 0; i < other_solver.size(); ++i ) other_solver[i].solver = "cholesky";
+        	ok = ok && compare_bench_results(slower, other_solver, 0.1) == 0;
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        // flux de sortie qui jette tout (le formatage des traces est compté)
+        struct NullBuffer : public std::streambuf {
+        	int overflow( int c ) { return c; }
+        	std::streamsize xsputn( const char*, std::streamsize n ) { return n; }
+        };
+
+        struct KernelTiming {
+        	std::string name;
+        	double median_ns;
+        	double min_ns;
+        	double spread;          // écart interquartile / médiane
+        	double allocations;     // par opération
+        };
+
+        // nb_samples mesures de nb_ops appels de kernel(i), après un passage à blanc
+        template < typename Kernel >
+        KernelTiming time_kernel( const std::string& name, int nb_ops, int nb_samples, Kernel kernel )
+        {
+        	for( int i = 0; i < nb_ops; ++i ) kernel(i);
+        	std::vector< double > ns;
+        	long allocations = 0;
+        	for( int s = 0; s < nb_samples; ++s ) {
+        		const long before = nb_allocations();
+        		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        		for( int i = 0; i < nb_ops; ++i ) kernel(i);
+        		ns.push_back(std::chrono::duration< double, std::nano >(
+        			std::chrono::steady_clock::now() - start).count() / nb_ops);
+        		allocations += nb_allocations() - before;
+        	}
+        	std::sort(ns.begin(), ns.end());
+        	KernelTiming timing;
+        	timing.name = name;
+        	timing.median_ns = ns[ns.size() / 2];
+        	timing.min_ns = ns[0];
+        	timing.spread = (ns[(3 * ns.size()) / 4] - ns[ns.size() / 4]) / timing.median_ns;
+        	timing.allocations = double(allocations) / (double(nb_ops) * nb_samples);
+        	return timing;
+        }
+
+        bool bench_kernels( const std::string& mesh_filename, int nb_samples )
+        {
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	mesh.set_attribute(Simu::unit_fct, 1, true);
+        	const int nt = mesh.nb_triangles();
+        	const int n = mesh.nb_vertices();
+
+        	// données partagées, construites avant les mesures
+        	ShapeFunctions shape_f_triangle(2,1);
+        	Quadrature quad = Quadrature::get_quadrature(2);
+        	std::vector< ElementMapping > mappings;
+        	std::vector< DenseMatrix > Kes(nt);
+        	SparseMatrix K(n);
+        	std::vector< double > F(n, 1.), values(n, 0.), u(n, 0.);
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+        	NullBuffer null_buffer;
+        	std::streambuf* output = std::cout.rdbuf(&null_buffer);
+        	for( int t = 0; t < nt; ++t ) {
+        		mappings.push_back(ElementMapping(mesh, false, t));
+        		assemble_elementary_matrix(mappings[t], shape_f_triangle, quad, Simu::unit_fct, Kes[t]);
+        		local_to_global_matrix(mesh, t, Kes[t], K);
+        	}
+        	vertex center;
+        	center.x = 1. / 3.;
+        	center.y = 1. / 3.;
+        	volatile double sink = 0.;
+
+        	std::vector< KernelTiming > timings;
+        	timings.push_back(time_kernel("Quadrature::get_quadrature", 1000, nb_samples,
+        		[&]( int i ) { sink = sink + Quadrature::get_quadrature(2).weight(0); }));
+        	timings.push_back(time_kernel("ElementMapping (constructor)", nt, nb_samples,
+        		[&]( int i ) { ElementMapping mapping(mesh, false, i); sink = sink + mapping.transform(center).x; }));
+        	timings.push_back(time_kernel("ElementMapping::jacobian", nt, nb_samples,
+        		[&]( int i ) { sink = sink + mappings[i].jacobian(center); }));
+        	timings.push_back(time_kernel("ShapeFunctions::evaluate_grad", 3000, nb_samples,
+        		[&]( int i ) { sink = sink + shape_f_triangle.evaluate_grad(i % 3, center).x; }));
+        	timings.push_back(time_kernel("assemble_elementary_matrix", nt, nb_samples,
+        		[&]( int i ) {
+        			DenseMatrix Ke;
+        			assemble_elementary_matrix(mappings[i], shape_f_triangle, quad, Simu::unit_fct, Ke);
+        			sink = sink + Ke.get(0, 0);
+        		}));
+        	timings.push_back(time_kernel("SparseMatrix::add (existing entry)", 9 * nt, nb_samples,
+        		[&]( int i ) {
+        			const int t = i / 9;
+        			K.add(mesh.get_triangle_vertex_index(t, (i % 9) / 3),
+        				mesh.get_triangle_vertex_index(t, i % 3), 0.);
+        		}));
+        	timings.push_back(time_kernel("local_to_global_matrix", nt, nb_samples,
+        		[&]( int i ) { local_to_global_matrix(mesh, i, Kes[i], K); }));
+        	timings.push_back(time_kernel("apply_dirichlet_boundary_conditions", 10, nb_samples,
+        		[&]( int i ) { apply_dirichlet_boundary_conditions(mesh, attribut_dirichlet, values, K, F); }));
+        	// le transfert vers OpenNL et une seule itération
+        	SolverOptions options;
+        	options.max_iterations = 1;
+        	timings.push_back(time_kernel("solve (OpenNL hand-off, 1 iteration)", 3, nb_samples,
+        		[&]( int i ) { solve(K, F, u, options); }));
+        	std::cout.rdbuf(output);
+
+        	bool ok = true;
+        	std::cout << mesh_filename << " : " << n << " vertices, " << nt << " triangles, "
+        		<< nb_samples << " samples (std::cout discarded)" << std::endl;
+        	std::cout << std::left << std::setw(40) << "kernel" << std::right << std::setw(14) << "ns/op"
+        		<< std::setw(14) << "min ns/op" << std::setw(10) << "IQR %" << std::setw(14)
+        		<< "allocs/op" << std::endl;
+        	for( int k = 0; k < timings.size(); ++k ) {
+        		const KernelTiming& timing = timings[k];
+        		std::cout << std::left << std::setw(40) << timing.name << std::right << std::fixed
+        			<< std::setprecision(1) << std::setw(14) << timing.median_ns << std::setw(14)
+        			<< timing.min_ns << std::setw(10) << 100. * timing.spread << std::setprecision(2)
+        			<< std::setw(14);
+        		if( allocations_counted() ) std::cout << timing.allocations;
+        		else std::cout << "-";
+        		std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+        		ok = ok && timing.median_ns > 0. && std::isfinite(timing.median_ns);
+        	}
+        	// le compteur voit les allocations : un ElementMapping alloue ses sommets
+        	if( allocations_counted() ) ok = ok && timings[1].allocations >= 1.;
+        	else std::cout << "allocations not counted (make COUNT_ALLOCATIONS=1)" << std::endl;
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+        // nombre d'appels d'une portée ou d'un compteur du résumé, -1 si absent
+        long long trace_calls( const std::vector< TraceSummary >& summary, const std::string& name )
+        {
+        	for( int k = 0; k < summary.size(); ++k ) {
+        		if( summary[k].name == name ) return summary[k].nb_calls;
+        	}
+        	return -1;
+        }
+
+        bool test_trace( const std::string& mesh_filename )
+        {
+        	bool ok = true;
+        	const bool was_enabled = trace_enabled();
+        	NullBuffer null_buffer;
+        	std::streambuf* output = std::cout.rdbuf(&null_buffer);
+
+        	// un problème instrumenté : chargement, boucle, scatter, Dirichlet, OpenNL
+        	trace_stop();
+        	trace_reset();
+        	trace_start();
+        	Mesh mesh;
+        	mesh.load(mesh_filename);
+        	mesh.set_attribute(Simu::unit_fct, 1, true);
+        	const int n = mesh.nb_vertices();
+        	SparseMatrix K(n);
+        	std::vector< double > F(n, 0.), values(n, 0.), u(n, 0.);
+        	{
+        		ScopedTimer timer("element loop");
+        		assemble_p1_poisson(mesh, Simu::unit_fct, Simu::unit_fct, K, F);
+        	}
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+        	apply_dirichlet_boundary_conditions(mesh, attribut_dirichlet, values, K, F);
+        	ok = ok && solve(K, F, u);
+
+        	// des portées imbriquées sur plusieurs threads, sans verrou
+        	const int nb_threads = 4;
+        	const int nb_scopes = 1000;
+        	std::vector< std::thread > threads;
+        	for( int i = 0; i < nb_threads; ++i ) {
+        		threads.push_back(std::thread([]() {
+        			ScopedTimer outer("thread work");
+        			for( int k = 0; k < nb_scopes; ++k ) {
+        				ScopedTimer inner("thread scope");
+        			}
+        		}));
+        	}
+        	for( int i = 0; i < nb_threads; ++i ) threads[i].join();
+        	trace_stop();
+        	std::cout.rdbuf(output);
+        	print_trace_summary();
+
+        	std::vector< TraceSummary > summary;
+        	trace_summary(summary);
+        	ok = ok && trace_calls(summary, "mesh load") == 1
+        		&& trace_calls(summary, "element loop") == 1
+        		&& trace_calls(summary, "scatter") == 2 * mesh.nb_triangles()
+        		&& trace_calls(summary, "boundary conditions") == 1
+        		&& trace_calls(summary, "solve") == 1
+        		&& trace_calls(summary, "OpenNL build") == 1
+        		&& trace_calls(summary, "OpenNL solve") == 1
+        		&& trace_calls(summary, "solver iterations") == 1
+        		&& trace_calls(summary, "thread work") == nb_threads
+        		&& trace_calls(summary, "thread scope") == nb_threads * nb_scopes;
+        	// les temps sont inclusifs
+        	long long nb_events = 0;
+        	double solve_time = 0., opennl_time = 0.;
+        	for( int k = 0; k < summary.size(); ++k ) {
+        		if( !summary[k].counter ) nb_events += summary[k].nb_calls;
+        		if( summary[k].name == "solve" ) solve_time = summary[k].total_time;
+        		if( summary[k].name.compare(0, 6, "OpenNL") == 0 ) opennl_time += summary[k].total_time;
+        		ok = ok && summary[k].max_time <= summary[k].total_time;
+        	}
+        	ok = ok && opennl_time > 0. && opennl_time <= solve_time;
+
+        	// une trace Chrome : un événement "X" par portée, un "C" par valeur
+        	ok = ok && save_trace("trace_test.json");
+        	std::ifstream json("trace_test.json");
+        	const std::string text((std::istreambuf_iterator< char >(json)), std::istreambuf_iterator< char >());
+        	json.close();
+        	std::remove("trace_test.json");
+        	long long nb_x = 0, nb_c = 0;
+        	for( size_t pos = text.find("\"ph\":\"X\""); pos != std::string::npos;
+        		pos = text.find("\"ph\":\"X\"", pos + 1) ) ++nb_x;
+        	for( size_t pos = text.find("\"ph\":\"C\""); pos != std::string::npos;
+        		pos = text.find("\"ph\":\"C\"", pos + 1) ) ++nb_c;
+        	ok = ok && text.compare(0, 37, "{\"displayTimeUnit\":\"ms\",\"traceEvents\"") == 0
+        		&& nb_x == nb_events && nb_c == 1;
+
+        	// coût d'une portée, désactivée puis activée
+        	const int nb_timers = 100000;
+        	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        	for( int k = 0; k < nb_timers; ++k ) ScopedTimer timer("disabled scope");
+        	const double disabled_ns = std::chrono::duration< double, std::nano >(
+        		std::chrono::steady_clock::now() - start).count() / nb_timers;
+        	trace_start();
+        	start = std::chrono::steady_clock::now();
+        	for( int k = 0; k < nb_timers; ++k ) ScopedTimer timer("enabled scope");
+        	const double enabled_ns = std::chrono::duration< double, std::nano >(
+        		std::chrono::steady_clock::now() - start).count() / nb_timers;
+        	trace_stop();
+        	trace_summary(summary);
+        	ok = ok && trace_calls(summary, "disabled scope") == -1
+        		&& trace_calls(summary, "enabled scope") == nb_timers;
+        	std::cout << "cost of a scope: " << disabled_ns << " ns disabled, "
+        		<< enabled_ns << " ns enabled" << std::endl;
+        	ok = ok && enabled_ns < 1000.;
+
+        	// la trace éventuellement demandée (--trace) reprend, sans ces événements
+        	trace_reset();
+        	if( was_enabled ) trace_start();
+        	std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	return ok;
+        }
+
+#ifdef FEM2A_MPI
+        bool test_distributed_solve( const std::string& mesh_filename )
+        {
+        	DistributedSystem system(MPI_COMM_WORLD);
+        	Mesh mesh;
+        	if( system.rank() == 0 ) {
+        		mesh.load(mesh_filename);
+        		mesh.set_attribute(Simu::unit_fct, 1, true);
+        	}
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+        	system.distribute(mesh);
+        	system.assemble(Simu::unit_fct, Simu::unit_fct, Simu::zero_fct, attribut_dirichlet);
+        	system.print();
+
+        	SolverOptions options;
+        	options.verbose = false;
+        	options.threshold = 1e-10;
+        	std::vector< double > x, global_x;
+        	SolveReport report;
+        	bool ok = system.solve(x, options, &report);
+        	system.gather(x, global_x);
+
+        	// référence : assemblage séquentiel et CG natif + Jacobi sur le rang 0
+        	if( system.rank() == 0 ) {
+        		SparseMatrix K(mesh.nb_vertices());
+        		std::vector< double > F;
+        		assemble_poisson_system(mesh, K, F);
+        		CSRMatrix A(K);
+        		options.preconditioner = PRECOND_JACOBI;
+        		Preconditioner* P = new_preconditioner(A, options);
+        		std::vector< double > x_ref;
+        		SolveReport report_ref;
+        		ok = pcg_solve(A, F, x_ref, P, options, &report_ref) && ok;
+        		delete P;
+        		double max_diff = 0.;
+        		for( int i = 0; i < x_ref.size(); ++i ) {
+        			max_diff = std::max(max_diff, std::fabs(global_x[i] - x_ref[i]));
+        		}
+        		ok = ok && max_diff < 1e-8;
+        		std::cout << mesh_filename << " on " << system.nb_ranks() << " ranks : "
+        			<< report.nb_iterations << " it " << report.elapsed_time
+        			<< " s (sequential " << report_ref.nb_iterations << " it "
+        			<< report_ref.elapsed_time << " s), max |x - x_ref| = "
+        			<< max_diff << std::endl;
+        	}
+        	int all_ok = ok ? 1 : 0;
+        	MPI_Bcast(&all_ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        	ok = all_ok == 1;
+        	if( system.rank() == 0 ) {
+        		std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	}
+        	return ok;
+        }
+
+        bool bench_weak_scaling( const std::string& mesh_filename, int base_refinements )
+        {
+        	DistributedSystem system(MPI_COMM_WORLD);
+        	// un raffinement de plus multiplie les triangles par 4 : la taille
+        	// par rang reste à peu près constante quand np est multiplié par 4
+        	const int refinements = base_refinements
+        		+ int(std::floor(std::log(double(system.nb_ranks())) / std::log(4.) + 0.5));
+        	Mesh mesh;
+        	if( system.rank() == 0 ) {
+        		mesh.load(mesh_filename);
+        		for( int r = 0; r < refinements; ++r ) {
+        			Mesh fine;
+        			std::vector< int > parents;
+        			mesh.refine_uniformly(fine, parents);
+        			mesh = fine;
+        		}
+        		mesh.set_attribute(Simu::unit_fct, 1, true);
+        	}
+        	std::vector< bool > attribut_dirichlet(2, false);
+        	attribut_dirichlet[1] = true;
+
+        	MPI_Barrier(MPI_COMM_WORLD);
+        	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        	system.distribute(mesh);
+        	MPI_Barrier(MPI_COMM_WORLD);
+        	const double distribute_time = std::chrono::duration< double >(
+        		std::chrono::steady_clock::now() - start).count();
+        	start = std::chrono::steady_clock::now();
+        	system.assemble(Simu::unit_fct, Simu::unit_fct, Simu::zero_fct, attribut_dirichlet);
+        	MPI_Barrier(MPI_COMM_WORLD);
+        	const double assemble_time = std::chrono::duration< double >(
+        		std::chrono::steady_clock::now() - start).count();
+        	system.print();
+
+        	SolverOptions options;
+        	options.verbose = false;
+        	options.threshold = 1e-10;
+        	std::vector< double > x;
+        	SolveReport report;
+        	const bool ok = system.solve(x, options, &report);
+        	double halo_time = system.halo_time();
+        	double max_halo_time = 0.;
+        	MPI_Reduce(&halo_time, &max_halo_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        	if( system.rank() == 0 ) {
+        		std::cout << "np = " << system.nb_ranks()
+        			<< " | N = " << system.nb_global()
+        			<< " (" << system.nb_global() / system.nb_ranks() << " per rank)"
+        			<< " | distribute " << distribute_time << " s"
+        			<< " | assemble " << assemble_time << " s"
+        			<< " | CG+Jacobi " << report.nb_iterations << " it "
+        			<< report.elapsed_time << " s, "
+        			<< report.elapsed_time / std::max(report.nb_iterations, 1) << " s/it"
+        			<< ", halo wait " << 100. * max_halo_time / report.elapsed_time << " %"
+        			<< std::endl;
+        		std::cout << ( ok ? ".. SUCCESS" : ".. FAILED" ) << std::endl;
+        	}
+        	return ok;
+        }
+#endif
+
     }
 }
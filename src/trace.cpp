@@ -0,0 +1,293 @@
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+namespace FEM2A {
+
+    /* events kept by thread for the trace, the statistics are complete */
+    static const size_t trace_max_events = 1 << 20 ;
+
+    struct TraceEvent {
+        const char* name ;
+        long long start_ns ;
+        long long duration_ns ;
+        double value ;          /* of a counter */
+        bool counter ;
+    } ;
+
+    struct TraceStat {
+        const char* name ;
+        long long nb_calls ;
+        long long total_ns ;
+        long long max_ns ;
+        double total_value ;
+        bool counter ;
+    } ;
+
+    /* the buffer of a thread, only written by it */
+    struct ThreadTrace {
+        int id ;
+        std::vector< TraceEvent > events ;
+        std::vector< TraceStat > stats ;
+        long long nb_dropped ;
+    } ;
+
+    static std::atomic< bool > enabled( false ) ;
+    /* the origin of the times, set before main() and never changed */
+    static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now() ;
+    static std::atomic< long long > start_ns( 0 ) ;    /* of the last trace_start() */
+    static std::atomic< int > main_trace_id( -1 ) ;    /* of the thread of trace_start() */
+    static std::string exit_filename ;
+
+    /* the buffers of all the threads, never freed: a thread may end
+     * before the trace is written */
+    static std::mutex registry_mutex ;
+    static std::vector< ThreadTrace* > registry ;
+    static thread_local ThreadTrace* local_trace = NULL ;
+
+    static long long now_ns()
+    {
+        return std::chrono::duration_cast< std::chrono::nanoseconds >(
+            std::chrono::steady_clock::now() - origin ).count() ;
+    }
+
+    static ThreadTrace& thread_trace()
+    {
+        if( local_trace == NULL ) {
+            ThreadTrace* trace = new ThreadTrace ;
+            trace->nb_dropped = 0 ;
+            std::lock_guard< std::mutex > lock( registry_mutex ) ;
+            trace->id = registry.size() ;
+            registry.push_back( trace ) ;
+            local_trace = trace ;
+        }
+        return *local_trace ;
+    }
+
+    static TraceStat& find_stat( ThreadTrace& trace, const char* name, bool counter )
+    {
+        for( int i = 0; i < trace.stats.size(); ++i ) {
+            if( trace.stats[i].name == name ) return trace.stats[i] ;
+        }
+        TraceStat stat ;
+        stat.name = name ;
+        stat.nb_calls = 0 ;
+        stat.total_ns = 0 ;
+        stat.max_ns = 0 ;
+        stat.total_value = 0. ;
+        stat.counter = counter ;
+        trace.stats.push_back( stat ) ;
+        return trace.stats.back() ;
+    }
+
+    static void record( const TraceEvent& event )
+    {
+        ThreadTrace& trace = thread_trace() ;
+        TraceStat& stat = find_stat( trace, event.name, event.counter ) ;
+        ++stat.nb_calls ;
+        stat.total_ns += event.duration_ns ;
+        stat.max_ns = std::max( stat.max_ns, event.duration_ns ) ;
+        stat.total_value += event.value ;
+        if( trace.events.size() < trace_max_events ) trace.events.push_back( event ) ;
+        else ++trace.nb_dropped ;
+    }
+
+    static void trace_at_exit()
+    {
+        trace_stop() ;
+        if( save_trace( exit_filename ) ) {
+            std::cout << "trace written in " << exit_filename << std::endl ;
+        }
+        print_trace_summary() ;
+    }
+
+    /****************************************************************/
+    /* Implementation of ScopedTimer */
+    /****************************************************************/
+
+    ScopedTimer::ScopedTimer( const char* name )
+        : name_( name ), start_ns_( -1 )
+    {
+        if( enabled.load( std::memory_order_relaxed ) ) start_ns_ = now_ns() ;
+    }
+
+    ScopedTimer::~ScopedTimer()
+    {
+        if( start_ns_ < 0 ) return ;
+        TraceEvent event ;
+        event.name = name_ ;
+        event.start_ns = start_ns_ ;
+        event.duration_ns = now_ns() - start_ns_ ;
+        event.value = 0. ;
+        event.counter = false ;
+        record( event ) ;
+    }
+
+    void trace_counter( const char* name, double value )
+    {
+        if( !enabled.load( std::memory_order_relaxed ) ) return ;
+        TraceEvent event ;
+        event.name = name ;
+        event.start_ns = now_ns() ;
+        event.duration_ns = 0 ;
+        event.value = value ;
+        event.counter = true ;
+        record( event ) ;
+    }
+
+    /****************************************************************/
+    /* Implementation of the trace functions */
+    /****************************************************************/
+
+    void trace_start()
+    {
+        main_trace_id.store( thread_trace().id ) ;
+        start_ns.store( now_ns() ) ;
+        enabled.store( true ) ;
+    }
+
+    void trace_stop()
+    {
+        enabled.store( false ) ;
+    }
+
+    bool trace_enabled()
+    {
+        return enabled.load() ;
+    }
+
+    void trace_reset()
+    {
+        std::lock_guard< std::mutex > lock( registry_mutex ) ;
+        for( int t = 0; t < registry.size(); ++t ) {
+            registry[t]->events.clear() ;
+            registry[t]->stats.clear() ;
+            registry[t]->nb_dropped = 0 ;
+        }
+    }
+
+    static bool longest_first( const TraceSummary& a, const TraceSummary& b )
+    {
+        if( a.counter != b.counter ) return !a.counter ;
+        return a.total_time > b.total_time ;
+    }
+
+    /* registry_mutex must be held */
+    static void summarize( std::vector< TraceSummary >& summary )
+    {
+        summary.clear() ;
+        for( int t = 0; t < registry.size(); ++t ) {
+            for( int s = 0; s < registry[t]->stats.size(); ++s ) {
+                const TraceStat& stat = registry[t]->stats[s] ;
+                /* the same name may have several addresses */
+                int k = 0 ;
+                while( k < summary.size() && summary[k].name != stat.name ) ++k ;
+                if( k == summary.size() ) {
+                    TraceSummary entry ;
+                    entry.name = stat.name ;
+                    entry.nb_calls = 0 ;
+                    entry.total_time = 0. ;
+                    entry.max_time = 0. ;
+                    entry.counter = stat.counter ;
+                    summary.push_back( entry ) ;
+                }
+                summary[k].nb_calls += stat.nb_calls ;
+                if( stat.counter ) {
+                    summary[k].total_time += stat.total_value ;
+                } else {
+                    summary[k].total_time += 1e-9 * stat.total_ns ;
+                    summary[k].max_time = std::max( summary[k].max_time, 1e-9 * stat.max_ns ) ;
+                }
+            }
+        }
+        std::sort( summary.begin(), summary.end(), longest_first ) ;
+    }
+
+    void trace_summary( std::vector< TraceSummary >& summary )
+    {
+        std::lock_guard< std::mutex > lock( registry_mutex ) ;
+        summarize( summary ) ;
+    }
+
+    void print_trace_summary()
+    {
+        std::lock_guard< std::mutex > lock( registry_mutex ) ;
+        std::vector< TraceSummary > summary ;
+        summarize( summary ) ;
+        const double elapsed = 1e-9 * ( now_ns() - start_ns.load() ) ;
+        std::cout << "trace summary (" << elapsed << " s, inclusive times):" << std::endl ;
+        std::cout << std::left << std::setw( 28 ) << "scope" << std::right << std::setw( 10 ) << "calls"
+            << std::setw( 12 ) << "total ms" << std::setw( 12 ) << "mean us" << std::setw( 12 )
+            << "max us" << std::setw( 8 ) << "%" << std::endl ;
+        for( int k = 0; k < summary.size(); ++k ) {
+            const TraceSummary& entry = summary[k] ;
+            std::cout << std::left << std::setw( 28 ) << entry.name << std::right
+                << std::setw( 10 ) << entry.nb_calls << std::fixed << std::setprecision( 3 ) ;
+            if( entry.counter ) {
+                std::cout << std::setw( 12 ) << "" << std::setw( 12 )
+                    << entry.total_time / entry.nb_calls << "  (counter mean)" ;
+            } else {
+                std::cout << std::setw( 12 ) << 1e3 * entry.total_time
+                    << std::setw( 12 ) << 1e6 * entry.total_time / entry.nb_calls
+                    << std::setw( 12 ) << 1e6 * entry.max_time
+                    << std::setprecision( 1 ) << std::setw( 8 )
+                    << ( elapsed > 0. ? 100. * entry.total_time / elapsed : 0. ) ;
+            }
+            std::cout << std::defaultfloat << std::setprecision( 6 ) << std::endl ;
+        }
+        long long nb_dropped = 0 ;
+        for( int t = 0; t < registry.size(); ++t ) nb_dropped += registry[t]->nb_dropped ;
+        if( nb_dropped > 0 ) {
+            std::cout << nb_dropped << " events not kept in the trace (only in the summary)" << std::endl ;
+        }
+    }
+
+    bool save_trace( const std::string& filename )
+    {
+        std::ofstream json( filename.c_str(), std::ios::out | std::ios::trunc ) ;
+        if( !json ) {
+            std::cout << "Unable to write " << filename << std::endl ;
+            return false ;
+        }
+        std::lock_guard< std::mutex > lock( registry_mutex ) ;
+        const int main_id = main_trace_id.load() ;
+        json << std::fixed << std::setprecision( 3 ) ;
+        json << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" ;
+        json << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"fem2a\"}}" ;
+        for( int t = 0; t < registry.size(); ++t ) {
+            const ThreadTrace& trace = *registry[t] ;
+            json << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << trace.id
+                << ",\"args\":{\"name\":\"" << ( trace.id == main_id ? "main" : "thread " )
+                << ( trace.id == main_id ? "" : std::to_string( trace.id ) ) << "\"}}" ;
+            for( int e = 0; e < trace.events.size(); ++e ) {
+                const TraceEvent& event = trace.events[e] ;
+                /* the times are in microseconds */
+                json << ",\n{\"name\":\"" << event.name << "\",\"pid\":1,\"tid\":" << trace.id
+                    << ",\"ts\":" << 1e-3 * event.start_ns ;
+                if( event.counter ) {
+                    json << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}" ;
+                } else {
+                    json << ",\"ph\":\"X\",\"dur\":" << 1e-3 * event.duration_ns << "}" ;
+                }
+            }
+        }
+        json << "\n]}\n" ;
+        return !json.fail() ;
+    }
+
+    void trace_until_exit( const std::string& filename )
+    {
+        exit_filename = filename ;
+        trace_start() ;
+        atexit( trace_at_exit ) ;
+    }
+
+}
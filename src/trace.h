@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+namespace FEM2A {
+
+    /**
+     * \brief ScopedTimer measures the time spent in a scope (from its
+     *        construction to its destruction) when tracing is enabled:
+     *          {
+     *              ScopedTimer timer( "element loop" ) ;
+     *              ...
+     *          }
+     *        The name must be a string literal (only its address is
+     *        kept). When tracing is disabled, a timer costs a test.
+     *
+     * Each thread records its events in its own buffer, registered once
+     * (under a lock) at its first event: the timers take no lock. The
+     * buffers keep the statistics of every name and, up to
+     * trace_max_events per thread, the events themselves for the trace.
+     * The scopes are inclusive: a nested scope is also counted in the
+     * enclosing one.
+     */
+    class ScopedTimer {
+        public:
+            explicit ScopedTimer( const char* name ) ;
+            ~ScopedTimer() ;
+
+        private:
+            /* not copyable */
+            ScopedTimer( const ScopedTimer& ) ;
+            ScopedTimer& operator=( const ScopedTimer& ) ;
+
+            const char* name_ ;
+            long long start_ns_ ;       /* -1 if tracing was disabled */
+    } ;
+
+    /**
+     * \brief Records the value of a counter (e.g. solver iterations),
+     *        shown as a graph in the trace.
+     */
+    void trace_counter( const char* name, double value ) ;
+
+    /**
+     * \brief The statistics of a name over all the threads.
+     */
+    struct TraceSummary {
+        std::string name ;
+        long long nb_calls ;
+        double total_time ;     /* in seconds */
+        double max_time ;
+        bool counter ;          /* then total_time is the sum of the values */
+    } ;
+
+    /**
+     * \brief Enables or disables the timers. The times of the trace
+     *        start at the launch of the program; the thread calling
+     *        trace_start() is named "main" in the trace, and the summary
+     *        gives the shares of the time since its last call.
+     */
+    void trace_start() ;
+    void trace_stop() ;
+    bool trace_enabled() ;
+
+    /**
+     * \brief Clears the events and the statistics of all the threads.
+     *        The other threads must not record events meanwhile.
+     */
+    void trace_reset() ;
+
+    /**
+     * \brief The statistics by name, the longest first.
+     */
+    void trace_summary( std::vector< TraceSummary >& summary ) ;
+
+    /**
+     * \brief Prints the summary as a table, with the share of the time
+     *        since trace_start().
+     */
+    void print_trace_summary() ;
+
+    /**
+     * \brief Writes the events in the Chrome trace format (JSON), read by
+     *        chrome://tracing and ui.perfetto.dev: one "X" event per
+     *        scope, one "C" event per counter value, a track per thread.
+     */
+    bool save_trace( const std::string& filename ) ;
+
+    /**
+     * \brief Starts tracing and, at the exit of the program, writes the
+     *        trace in filename and prints the summary. Call it before
+     *        creating the threads to trace (e.g. output_writer()), so
+     *        that they are stopped when the trace is written.
+     */
+    void trace_until_exit( const std::string& filename ) ;
+
+}
@@ -0,0 +1,240 @@
+#include "vtu.h"
+#include "trace.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+namespace FEM2A {
+
+    /* number of entries converted at once for the arrays of the mesh */
+    static const int chunk_size = 1 << 14 ;
+
+    /* VTK cell type of the triangles */
+    static const uint8_t vtk_triangle = 5 ;
+
+    static const char* byte_order()
+    {
+        const uint16_t one = 1 ;
+        return *reinterpret_cast< const uint8_t* >( &one ) == 1 ? "LittleEndian" : "BigEndian" ;
+    }
+
+    /**
+     * \brief Writes the size of a block (the UInt64 header of the
+     *        appended data) followed by nb_bytes bytes of data.
+     */
+    static void write_block( std::ofstream& out, const void* data, uint64_t nb_bytes )
+    {
+        out.write( reinterpret_cast< const char* >( &nb_bytes ), sizeof( uint64_t ) ) ;
+        if( nb_bytes > 0 ) out.write( static_cast< const char* >( data ), nb_bytes ) ;
+    }
+
+    static void write_block_header( std::ofstream& out, uint64_t nb_bytes )
+    {
+        out.write( reinterpret_cast< const char* >( &nb_bytes ), sizeof( uint64_t ) ) ;
+    }
+
+    template < typename T >
+    static void write_chunk( std::ofstream& out, const std::vector< T >& buffer, int size )
+    {
+        out.write( reinterpret_cast< const char* >( &buffer[0] ), size * sizeof( T ) ) ;
+    }
+
+    /****************************************************************/
+    /* Implementation of VtuWriter */
+    /****************************************************************/
+
+    VtuWriter::VtuWriter( const Mesh& mesh )
+        : mesh_( mesh ), file_size_( 0 )
+    {
+
+    }
+
+    void VtuWriter::add_point_field( const std::string& name, const double* values,
+        int nb_components )
+    {
+        Field field ;
+        field.name_ = name ;
+        field.values_ = values ;
+        field.nb_components_ = nb_components ;
+        point_fields_.push_back( field ) ;
+    }
+
+    void VtuWriter::add_cell_field( const std::string& name, const double* values,
+        int nb_components )
+    {
+        Field field ;
+        field.name_ = name ;
+        field.values_ = values ;
+        field.nb_components_ = nb_components ;
+        cell_fields_.push_back( field ) ;
+    }
+
+    void VtuWriter::add_point_field( const std::string& name, const std::vector< double >& values )
+    {
+        assert( values.size() == mesh_.nb_vertices() ) ;
+        add_point_field( name, values.empty() ? NULL : &values[0], 1 ) ;
+    }
+
+    void VtuWriter::add_point_field( const std::string& name, const std::vector< vec2 >& values )
+    {
+        assert( values.size() == mesh_.nb_vertices() ) ;
+        assert( sizeof( vec2 ) == 2 * sizeof( double ) ) ;
+        add_point_field( name, values.empty() ? NULL : &values[0].x, 2 ) ;
+    }
+
+    void VtuWriter::add_cell_field( const std::string& name, const std::vector< double >& values )
+    {
+        assert( values.size() == mesh_.nb_triangles() ) ;
+        add_cell_field( name, values.empty() ? NULL : &values[0], 1 ) ;
+    }
+
+    void VtuWriter::add_cell_field( const std::string& name, const std::vector< vec2 >& values )
+    {
+        assert( values.size() == mesh_.nb_triangles() ) ;
+        assert( sizeof( vec2 ) == 2 * sizeof( double ) ) ;
+        add_cell_field( name, values.empty() ? NULL : &values[0].x, 2 ) ;
+    }
+
+    bool VtuWriter::write( const std::string& filename ) const
+    {
+        ScopedTimer timer( "vtu write" ) ;
+        const int nv = mesh_.nb_vertices() ;
+        const int nt = mesh_.nb_triangles() ;
+
+        /* the header: each array gives the offset of its block in the
+         * appended data, a block being its size (8 bytes) then the values */
+        std::ostringstream header ;
+        uint64_t offset = 0 ;
+        header << "<?xml version=\"1.0\"?>\n"
+            << "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\""
+            << byte_order() << "\" header_type=\"UInt64\">\n"
+            << "  <UnstructuredGrid>\n"
+            << "    <Piece NumberOfPoints=\"" << nv << "\" NumberOfCells=\"" << nt << "\">\n" ;
+
+        header << "      <PointData>\n" ;
+        for( int f = 0; f < point_fields_.size(); ++f ) {
+            const Field& field = point_fields_[f] ;
+            header << "        <DataArray type=\"Float64\" Name=\"" << field.name_
+                << "\" NumberOfComponents=\"" << field.nb_components_
+                << "\" format=\"appended\" offset=\"" << offset << "\"/>\n" ;
+            offset += sizeof( uint64_t ) + sizeof( double ) * uint64_t( nv ) * field.nb_components_ ;
+        }
+        header << "      </PointData>\n" ;
+
+        header << "      <CellData>\n"
+            << "        <DataArray type=\"Int32\" Name=\"attribute\" format=\"appended\" offset=\""
+            << offset << "\"/>\n" ;
+        offset += sizeof( uint64_t ) + sizeof( int32_t ) * uint64_t( nt ) ;
+        for( int f = 0; f < cell_fields_.size(); ++f ) {
+            const Field& field = cell_fields_[f] ;
+            header << "        <DataArray type=\"Float64\" Name=\"" << field.name_
+                << "\" NumberOfComponents=\"" << field.nb_components_
+                << "\" format=\"appended\" offset=\"" << offset << "\"/>\n" ;
+            offset += sizeof( uint64_t ) + sizeof( double ) * uint64_t( nt ) * field.nb_components_ ;
+        }
+        header << "      </CellData>\n" ;
+
+        header << "      <Points>\n"
+            << "        <DataArray type=\"Float64\" NumberOfComponents=\"3\" format=\"appended\" offset=\""
+            << offset << "\"/>\n"
+            << "      </Points>\n" ;
+        offset += sizeof( uint64_t ) + sizeof( double ) * 3 * uint64_t( nv ) ;
+
+        header << "      <Cells>\n"
+            << "        <DataArray type=\"Int32\" Name=\"connectivity\" format=\"appended\" offset=\""
+            << offset << "\"/>\n" ;
+        offset += sizeof( uint64_t ) + sizeof( int32_t ) * 3 * uint64_t( nt ) ;
+        header << "        <DataArray type=\"Int32\" Name=\"offsets\" format=\"appended\" offset=\""
+            << offset << "\"/>\n" ;
+        offset += sizeof( uint64_t ) + sizeof( int32_t ) * uint64_t( nt ) ;
+        header << "        <DataArray type=\"UInt8\" Name=\"types\" format=\"appended\" offset=\""
+            << offset << "\"/>\n"
+            << "      </Cells>\n"
+            << "    </Piece>\n"
+            << "  </UnstructuredGrid>\n"
+            << "  <AppendedData encoding=\"raw\">\n   _" ;
+
+        /* a large buffer, the blocks are written by big pieces */
+        std::vector< char > stream_buffer( 1 << 20 ) ;
+        std::ofstream out ;
+        out.rdbuf()->pubsetbuf( &stream_buffer[0], stream_buffer.size() ) ;
+        out.open( filename.c_str(), std::ios::out | std::ios::trunc | std::ios::binary ) ;
+        if( !out ) {
+            std::cout << "Unable to write " << filename << std::endl ;
+            return false ;
+        }
+        const std::string xml = header.str() ;
+        out.write( xml.c_str(), xml.size() ) ;
+
+        /* the fields, from the memory of the user */
+        for( int f = 0; f < point_fields_.size(); ++f ) {
+            write_block( out, point_fields_[f].values_,
+                sizeof( double ) * uint64_t( nv ) * point_fields_[f].nb_components_ ) ;
+        }
+        std::vector< int32_t > ints( 3 * chunk_size ) ;
+        write_block_header( out, sizeof( int32_t ) * uint64_t( nt ) ) ;
+        for( int start = 0; start < nt; start += chunk_size ) {
+            const int size = std::min( chunk_size, nt - start ) ;
+            for( int i = 0; i < size; ++i ) ints[i] = mesh_.get_triangle_attribute( start + i ) ;
+            write_chunk( out, ints, size ) ;
+        }
+        for( int f = 0; f < cell_fields_.size(); ++f ) {
+            write_block( out, cell_fields_[f].values_,
+                sizeof( double ) * uint64_t( nt ) * cell_fields_[f].nb_components_ ) ;
+        }
+
+        /* the mesh, through the buffers */
+        std::vector< double > points( 3 * chunk_size ) ;
+        write_block_header( out, sizeof( double ) * 3 * uint64_t( nv ) ) ;
+        for( int start = 0; start < nv; start += chunk_size ) {
+            const int size = std::min( chunk_size, nv - start ) ;
+            for( int i = 0; i < size; ++i ) {
+                const vertex v = mesh_.get_vertex( start + i ) ;
+                points[3 * i] = v.x ;
+                points[3 * i + 1] = v.y ;
+                points[3 * i + 2] = 0. ;
+            }
+            write_chunk( out, points, 3 * size ) ;
+        }
+        write_block_header( out, sizeof( int32_t ) * 3 * uint64_t( nt ) ) ;
+        for( int start = 0; start < nt; start += chunk_size ) {
+            const int size = std::min( chunk_size, nt - start ) ;
+            for( int i = 0; i < size; ++i ) {
+                for( int j = 0; j < 3; ++j ) {
+                    ints[3 * i + j] = mesh_.get_triangle_vertex_index( start + i, j ) ;
+                }
+            }
+            write_chunk( out, ints, 3 * size ) ;
+        }
+        write_block_header( out, sizeof( int32_t ) * uint64_t( nt ) ) ;
+        for( int start = 0; start < nt; start += chunk_size ) {
+            const int size = std::min( chunk_size, nt - start ) ;
+            for( int i = 0; i < size; ++i ) ints[i] = 3 * ( start + i + 1 ) ;
+            write_chunk( out, ints, size ) ;
+        }
+        const std::vector< uint8_t > types( chunk_size, vtk_triangle ) ;
+        write_block_header( out, sizeof( uint8_t ) * uint64_t( nt ) ) ;
+        for( int start = 0; start < nt; start += chunk_size ) {
+            write_chunk( out, types, std::min( chunk_size, nt - start ) ) ;
+        }
+
+        out << "\n  </AppendedData>\n</VTKFile>\n" ;
+        out.flush() ;
+        if( !out ) {
+            std::cout << "Error while writing " << filename << std::endl ;
+            return false ;
+        }
+        file_size_ = out.tellp() ;
+        return true ;
+    }
+
+    long long VtuWriter::file_size() const
+    {
+        return file_size_ ;
+    }
+
+}
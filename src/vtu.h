@@ -0,0 +1,68 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <vector>
+#include <string>
+
+namespace FEM2A {
+
+    /**
+     * \brief VtuWriter saves a mesh and fields in the VTK XML format for
+     *        unstructured grids (.vtu, read by ParaView and VisIt), with
+     *        all the arrays appended as raw binary data after the XML
+     *        header:
+     *          Points          Float64, 3 components (z = 0)
+     *          connectivity    Int32, the triangles
+     *          attribute       Int32 cell data, the triangle attributes
+     *        then the point fields and the cell fields added by the user.
+     *
+     * The fields are not copied: only their address is kept, they must
+     * stay alive until write(). They are streamed to the file directly
+     * from the vectors, the arrays of the mesh through a small buffer.
+     */
+    class VtuWriter {
+        public:
+            explicit VtuWriter( const Mesh& mesh ) ;
+
+            /**
+             * \brief Adds a field with nb_components values per vertex
+             *        (point data) or per triangle (cell data), stored
+             *        component by component: values[nb_components * i + c].
+             */
+            void add_point_field( const std::string& name, const double* values,
+                int nb_components ) ;
+            void add_cell_field( const std::string& name, const double* values,
+                int nb_components ) ;
+
+            /* scalar and vector (e.g. gradient) fields */
+            void add_point_field( const std::string& name, const std::vector< double >& values ) ;
+            void add_point_field( const std::string& name, const std::vector< vec2 >& values ) ;
+            void add_cell_field( const std::string& name, const std::vector< double >& values ) ;
+            void add_cell_field( const std::string& name, const std::vector< vec2 >& values ) ;
+
+            /**
+             * \brief Writes the file.
+             * \return false if it cannot be opened or written
+             */
+            bool write( const std::string& filename ) const ;
+
+            /**
+             * \return the size of the file written by write(), in bytes
+             */
+            long long file_size() const ;
+
+        private:
+            struct Field {
+                std::string name_ ;
+                const double* values_ ;
+                int nb_components_ ;
+            } ;
+
+            const Mesh& mesh_ ;
+            std::vector< Field > point_fields_ ;
+            std::vector< Field > cell_fields_ ;
+            mutable long long file_size_ ;
+    } ;
+
+}
@@ -0,0 +1,136 @@
+#include "writer.h"
+#include "postprocess.h"
+#include "vtu.h"
+
+#include <assert.h>
+#include <iostream>
+#include <chrono>
+#include <utility>
+
+namespace FEM2A {
+
+    /****************************************************************/
+    /* Implementation of AsyncWriter */
+    /****************************************************************/
+
+    AsyncWriter::AsyncWriter( int nb_threads, int max_pending )
+        : max_pending_( max_pending ), nb_running_( 0 ), stopping_( false ),
+        nb_written_( 0 ), nb_failed_( 0 ), blocked_time_( 0. )
+    {
+        assert( nb_threads > 0 && max_pending > 0 ) ;
+        for( int i = 0; i < nb_threads; ++i ) {
+            threads_.push_back( std::thread( &AsyncWriter::serve, this ) ) ;
+        }
+    }
+
+    AsyncWriter::~AsyncWriter()
+    {
+        {
+            std::unique_lock< std::mutex > lock( mutex_ ) ;
+            stopping_ = true ;
+        }
+        /* the threads empty the queue before leaving */
+        not_empty_.notify_all() ;
+        for( int i = 0; i < threads_.size(); ++i ) threads_[i].join() ;
+        if( nb_failed_ > 0 ) {
+            std::cout << "AsyncWriter: " << nb_failed_ << " write(s) failed" << std::endl ;
+        }
+    }
+
+    void AsyncWriter::save_mesh( Mesh&& mesh, const std::string& filename )
+    {
+        submit( [ mesh = std::move( mesh ), filename ]() {
+            return mesh.save( filename ) ;
+        } ) ;
+    }
+
+    void AsyncWriter::save_solution( std::vector< double >&& x, const std::string& filename )
+    {
+        submit( [ x = std::move( x ), filename ]() {
+            FEM2A::save_solution( x, filename ) ;
+            return true ;
+        } ) ;
+    }
+
+    void AsyncWriter::save_results( Mesh&& mesh, std::vector< double >&& u,
+        double (*conductivity)(vertex), const std::string& name )
+    {
+        submit( [ mesh = std::move( mesh ), u = std::move( u ), conductivity, name ]() {
+            bool ok = mesh.save( name + ".mesh" ) ;
+            FEM2A::save_solution( u, name + ".bb" ) ;
+            ok = save_postprocessing( mesh, u, conductivity, name ) && ok ;
+            VtuWriter vtu( mesh ) ;
+            vtu.add_point_field( "u", u ) ;
+            return vtu.write( name + ".vtu" ) && ok ;
+        } ) ;
+    }
+
+    void AsyncWriter::submit( std::function< bool() > write )
+    {
+        std::unique_lock< std::mutex > lock( mutex_ ) ;
+        if( queue_.size() >= max_pending_ ) {
+            const std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now() ;
+            not_full_.wait( lock, [ this ]() { return queue_.size() < max_pending_ ; } ) ;
+            blocked_time_ += std::chrono::duration< double >(
+                std::chrono::steady_clock::now() - start ).count() ;
+        }
+        queue_.push_back( std::move( write ) ) ;
+        lock.unlock() ;
+        not_empty_.notify_one() ;
+    }
+
+    void AsyncWriter::flush()
+    {
+        std::unique_lock< std::mutex > lock( mutex_ ) ;
+        idle_.wait( lock, [ this ]() { return queue_.empty() && nb_running_ == 0 ; } ) ;
+    }
+
+    int AsyncWriter::nb_written() const
+    {
+        std::unique_lock< std::mutex > lock( mutex_ ) ;
+        return nb_written_ ;
+    }
+
+    int AsyncWriter::nb_failed() const
+    {
+        std::unique_lock< std::mutex > lock( mutex_ ) ;
+        return nb_failed_ ;
+    }
+
+    double AsyncWriter::blocked_time() const
+    {
+        std::unique_lock< std::mutex > lock( mutex_ ) ;
+        return blocked_time_ ;
+    }
+
+    void AsyncWriter::serve()
+    {
+        std::unique_lock< std::mutex > lock( mutex_ ) ;
+        while( true ) {
+            not_empty_.wait( lock, [ this ]() { return stopping_ || !queue_.empty() ; } ) ;
+            if( queue_.empty() ) return ; /* stopping, nothing left */
+            std::function< bool() > write = std::move( queue_.front() ) ;
+            queue_.pop_front() ;
+            ++nb_running_ ;
+            lock.unlock() ;
+            not_full_.notify_one() ;
+
+            const bool ok = write() ;
+            write = nullptr ; /* frees the buffers outside the lock */
+
+            lock.lock() ;
+            --nb_running_ ;
+            if( ok ) ++nb_written_ ;
+            else ++nb_failed_ ;
+            if( queue_.empty() && nb_running_ == 0 ) idle_.notify_all() ;
+        }
+    }
+
+    AsyncWriter& output_writer()
+    {
+        static AsyncWriter writer( 1, 4 ) ;
+        return writer ;
+    }
+
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <vector>
+#include <string>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace FEM2A {
+
+    /**
+     * \brief AsyncWriter writes the output files in background threads,
+     *        so the computation of the next problem (or time step) is not
+     *        blocked on the disk.
+     *
+     * The meshes and the solutions are moved into the writer: the caller
+     * gives up its buffers and nothing is copied. The writes wait in a
+     * bounded queue served by nb_threads threads; when max_pending writes
+     * are waiting, the next call blocks until one starts (backpressure),
+     * so a fast producer cannot pile up an unbounded amount of memory.
+     * The destructor waits for all the writes: every file submitted is
+     * written, including by output_writer() at the exit of the program.
+     *
+     * Writes to the same file must be submitted with a single thread to
+     * keep their order.
+     */
+    class AsyncWriter {
+        public:
+            explicit AsyncWriter( int nb_threads = 1, int max_pending = 4 ) ;
+
+            /**
+             * \brief Waits for the pending writes and stops the threads.
+             */
+            ~AsyncWriter() ;
+
+            /**
+             * \brief Writes the mesh (Mesh::save()) in the background.
+             */
+            void save_mesh( Mesh&& mesh, const std::string& filename ) ;
+
+            /**
+             * \brief Writes a solution (save_solution()) in the background.
+             */
+            void save_solution( std::vector< double >&& x, const std::string& filename ) ;
+
+            /**
+             * \brief Writes all the results of a P1 problem in the
+             *        background: <name>.mesh, <name>.bb, the gradient and
+             *        the fluxes (save_postprocessing()) and <name>.vtu.
+             */
+            void save_results( Mesh&& mesh, std::vector< double >&& u,
+                double (*conductivity)(vertex), const std::string& name ) ;
+
+            /**
+             * \brief Runs any write in the background, it returns false if
+             *        it failed.
+             */
+            void submit( std::function< bool() > write ) ;
+
+            /**
+             * \brief Waits until all the writes submitted are done.
+             */
+            void flush() ;
+
+            int nb_written() const ;
+            int nb_failed() const ;
+
+            /**
+             * \return the time spent by the callers blocked on a full
+             *         queue, in seconds
+             */
+            double blocked_time() const ;
+
+        private:
+            void serve() ;
+
+            std::vector< std::thread > threads_ ;
+            std::deque< std::function< bool() > > queue_ ;
+            int max_pending_ ;
+            int nb_running_ ;
+            bool stopping_ ;
+
+            mutable std::mutex mutex_ ;
+            std::condition_variable not_empty_ ;
+            std::condition_variable not_full_ ;
+            std::condition_variable idle_ ;
+
+            int nb_written_ ;
+            int nb_failed_ ;
+            double blocked_time_ ;
+    } ;
+
+    /**
+     * \brief The writer shared by the simulations. It is destroyed, and
+     *        so flushed, at the exit of the program.
+     */
+    AsyncWriter& output_writer() ;
+
+}